@@ -0,0 +1,25 @@
+# Writes the commit the tree is at to OUTPUT as METABALLS_COMMIT, run with
+#   cmake -DSOURCE_DIR=<repo> -DOUTPUT=<header> -P WriteCommit.cmake
+# The header is only rewritten when the commit changes, so the sources that
+# include it aren't rebuilt for nothing.
+
+SET(COMMIT "unknown")
+FIND_PACKAGE(Git QUIET)
+IF(GIT_FOUND)
+  EXECUTE_PROCESS(COMMAND ${GIT_EXECUTABLE} rev-parse --short HEAD
+                  WORKING_DIRECTORY ${SOURCE_DIR}
+                  OUTPUT_VARIABLE HEAD_COMMIT
+                  OUTPUT_STRIP_TRAILING_WHITESPACE
+                  ERROR_QUIET)
+  IF(HEAD_COMMIT)
+    SET(COMMIT ${HEAD_COMMIT})
+  ENDIF(HEAD_COMMIT)
+ENDIF(GIT_FOUND)
+
+SET(CONTENTS "#define METABALLS_COMMIT \"${COMMIT}\"\n")
+IF(EXISTS ${OUTPUT})
+  FILE(READ ${OUTPUT} OLD_CONTENTS)
+ENDIF(EXISTS ${OUTPUT})
+IF(NOT "${CONTENTS}" STREQUAL "${OLD_CONTENTS}")
+  FILE(WRITE ${OUTPUT} "${CONTENTS}")
+ENDIF(NOT "${CONTENTS}" STREQUAL "${OLD_CONTENTS}")
@@ -1,4 +1,9 @@
+#include "FrameLimiter.h"
+#include "FrameStats.h"
 #include "Graphics.h"
+#include "ImageWriter.h"
+#include "PosterFile.h"
+#include "VideoStream.h"
 
 typedef std::chrono::duration<float, std::micro> microseconds;
 typedef std::chrono::duration<float, std::ratio<1, 1>> seconds;
@@ -7,7 +12,34 @@ typedef std::chrono::duration<float, std::ratio<1, 1>> seconds;
 typedef struct {
     int height;
     int width;
-    double fps_cap;
+    double fps_cap;     // 0 leaves the pace to the swap interval
+    int swap_interval;  // 0, 1 for vsync or -1 for adaptive vsync
+    int uncapped;       // neither cap nor vsync, for benchmarking
+    int latency;        // wait for the GPU before polling the next input
+    int idle;           // sleep while paused, throttle in the background
+    int seed;
+    int threads;
+    double tick_rate;
+    int substeps;
+    int sim_thread;
+    int headless;
+    int render_frames;  // frames to render offline, 0 opens the GUI
+    int render_every;
+    std::string render_dir;
+    ImageWriter::Format render_format;
+    int stream;  // write frames to stdout instead of opening the GUI
+    VideoStream::Format stream_format;
+    int stream_drop;
+    int poster_height;  // one huge image rendered in tiles, 0 for none
+    int poster_width;
+    std::string scene;   // balls to start with instead of random ones
+    int generate;        // start with balls from generator instead
+    SceneGenerator::Settings generator;
+    std::string stats;   // write frame times here on exit
+    std::string profile;  // write a Chrome trace here on exit
+    int counters;        // read hardware counters around the hot paths
+    std::string record;  // log the run to this file
+    std::string replay;  // replay this log instead of taking input
 } cmdParams;
 
 class Application {
@@ -16,11 +48,18 @@ public:
     ~Application();
 
     void run();
+    void renderFrames();
+    void streamFrames();
+    void renderPoster();
+    void replayFrames();
 
 private:
     // command line handling
     cmdParams m_params;
     bool parseCMD(int argc, char* argv[]);
+    void finishRecording();
+    void writeProfile();
+    static bool parseSize(const std::string& size, int& height, int& width);
 
     // Terminal formats for coloring output
     static TermFormatter::Formatter s_green;
@@ -28,10 +67,16 @@ private:
     static TermFormatter::Formatter s_reset;
 
     // variables for framerate
-    float m_FPS;
+    float m_FPS;  // frame rate shown in green, the cap or 60
+    FrameLimiter m_limiter;
+    FrameLimiter m_backgroundLimiter;  // while minimized or unfocused
     size_t m_frameCount;
+    FrameStats m_frameStats;
+    std::vector<FrameStats::Frame> m_statsLog;  // every frame, for -stats
+    void writeFrameStats();
 
     // graphics variables
     Graphics* m_graphics;
+    Replayer* m_replayer;
     EventHandler m_handler;
 };
\ No newline at end of file
@@ -1,6 +1,7 @@
 #ifndef BALL_H
 #define BALL_H
 
+#include <cstdint>
 #include <cstdlib>
 #include <vector>
 #include <cmath>
@@ -22,10 +23,23 @@ typedef struct {
     } color;
 } Ball;
 
+/// Time stepping schemes for the ball movement, see Integrator.h
+typedef enum {
+    ExplicitEuler,
+    SemiImplicitEuler,
+    VelocityVerlet,
+    RungeKutta4
+} IntegratorMethod;
+
 void updateMetaballs_StraightPath(std::vector<Ball>& balls, size_t width, size_t height);
-void updateMetaballs_RandomPath(std::vector<Ball>& balls, float theta, size_t width, size_t height);
+void updateMetaballs_RandomPath(std::vector<Ball>& balls, float theta, size_t width, size_t height, uint64_t seed, uint64_t frame);
 
 void updateMetaballs_StraightPath(size_t numBalls, Ball* balls, size_t width, size_t height);
-void updateMetaballs_RandomPath(size_t numBalls, Ball* balls, float theta, size_t width, size_t height);
+void updateMetaballs_RandomPath(size_t numBalls, Ball* balls, float theta, size_t width, size_t height, uint64_t seed, uint64_t frame);
+
+void updateMetaballs_Integrate(std::vector<Ball>& balls, IntegratorMethod method, float drag, float dt, int substeps, size_t width, size_t height);
+void updateMetaballs_Integrate(size_t numBalls, Ball* balls, IntegratorMethod method, float drag, float dt, int substeps, size_t width, size_t height);
+
+void headingRotation(float angle, float& sin, float& cos);
 
 #endif /* BALL_H */
\ No newline at end of file
@@ -0,0 +1,130 @@
+#ifndef BALL_SYSTEM_H
+#define BALL_SYSTEM_H
+
+#include <cstdlib>
+#include <new>
+#include <vector>
+
+#include "Ball.h"
+#include "SIMD.h"
+
+/** Allocator for SIMD friendly storage
+ *  @struct AlignedAllocator
+ *
+ *  @note Alignment defaults to a cache line, which also covers AVX loads
+ */
+template <typename T, size_t Alignment = 64>
+struct AlignedAllocator {
+    typedef T value_type;
+    template <typename U>
+    struct rebind {
+        typedef AlignedAllocator<U, Alignment> other;
+    };
+
+    AlignedAllocator() = default;
+    template <typename U>
+    AlignedAllocator(const AlignedAllocator<U, Alignment>&) {}
+
+    T* allocate(size_t n) {
+        size_t bytes = (n * sizeof(T) + Alignment - 1) & ~(Alignment - 1);
+        void* ptr = std::aligned_alloc(Alignment, bytes ? bytes : Alignment);
+        if (!ptr) {
+            throw std::bad_alloc();
+        }
+        return (T*)ptr;
+    }
+    void deallocate(T* ptr, size_t) { std::free(ptr); }
+
+    template <typename U>
+    bool operator==(const AlignedAllocator<U, Alignment>&) const {
+        return true;
+    }
+    template <typename U>
+    bool operator!=(const AlignedAllocator<U, Alignment>&) const {
+        return false;
+    }
+};
+
+template <typename T>
+using AlignedVector = std::vector<T, AlignedAllocator<T>>;
+
+/** Structure-of-arrays container for metaballs
+ *  @class BallSystem
+ *
+ *  Every Ball member lives in its own aligned array so the update loops can
+ *  run over SIMD registers. load() and store() convert to and from the
+ *  array-of-structs Ball layout used by the shader storage buffer.
+ *  Positions from before the last tick are kept for render interpolation.
+ */
+class BallSystem {
+public:
+    BallSystem();
+
+    size_t count() const;
+    void resize(size_t numBalls);
+    void reserve(size_t numBalls);
+    void clear();
+
+    void push(const Ball& ball);
+    void pop();
+    Ball get(size_t index) const;
+    void set(size_t index, const Ball& ball);
+
+    // conversion to and from the Ball/SSBO layout
+    void load(size_t numBalls, const Ball* balls);
+    void store(Ball* balls) const;
+    void store(Ball* balls, size_t first, size_t last) const;
+    void store(Ball* balls, size_t first, size_t last, float alpha) const;
+    void savePositions(size_t first, size_t last);
+    void interpolate(float alpha, BallSystem& out) const;
+
+    // movement, scale is the fraction of a velocity step to advance by
+    void updateStraightPath(float width, float height, float scale = 1.0f);
+    void updateStraightPath(size_t first, size_t last, float width,
+                            float height, float scale = 1.0f);
+    void updateRandomPath(float theta, float width, float height,
+                          uint64_t seed, uint64_t frame, float scale = 1.0f);
+    void updateRandomPath(size_t first, size_t last, float theta, float width,
+                          float height, uint64_t seed, uint64_t frame,
+                          float scale = 1.0f);
+    void integrate(size_t first, size_t last, IntegratorMethod method,
+                   float drag, const float* accX, const float* accY,
+                   float dt, int substeps, float width, float height);
+
+    // direct access to the arrays
+    float* size();
+    float* posX();
+    float* posY();
+    float* velX();
+    float* velY();
+    float* red();
+    float* green();
+    float* blue();
+    float* prevX();
+    float* prevY();
+    const float* size() const;
+    const float* posX() const;
+    const float* posY() const;
+    const float* velX() const;
+    const float* velY() const;
+    const float* red() const;
+    const float* green() const;
+    const float* blue() const;
+    const float* prevX() const;
+    const float* prevY() const;
+
+private:
+    size_t m_count;
+    AlignedVector<float> m_size;
+    AlignedVector<float> m_posX;
+    AlignedVector<float> m_posY;
+    AlignedVector<float> m_velX;
+    AlignedVector<float> m_velY;
+    AlignedVector<float> m_red;
+    AlignedVector<float> m_green;
+    AlignedVector<float> m_blue;
+    AlignedVector<float> m_prevX;  ///< positions before the last tick
+    AlignedVector<float> m_prevY;
+};
+
+#endif /* BALL_SYSTEM_H */
@@ -0,0 +1,53 @@
+#ifndef BARNES_HUT_H
+#define BARNES_HUT_H
+
+#include <cstdint>
+#include <vector>
+
+#include "BallSystem.h"
+#include "Quadtree.h"
+
+/** Barnes-Hut attraction between balls
+ *  @class BarnesHut
+ *
+ *  Every node of a Morton ordered Quadtree gets the total size and center
+ *  of mass of its balls. Each leaf walks the tree once for all of its
+ *  balls, collecting the nodes far enough away to act as a single ball and
+ *  the balls of nearby leaves, then the list is applied to each of them.
+ *
+ *  @note Rebuilt from scratch every step, the build is mostly serial and
+ * the force walk runs across the job system
+ */
+class BarnesHut {
+public:
+    BarnesHut();
+
+    void build(const BallSystem& balls);
+    void accelerations(const BallSystem& balls, float theta, float strength,
+                       float* accX, float* accY) const;
+
+    size_t nodeCount() const;
+
+private:
+    /// Center of mass of a node
+    typedef struct {
+        float x;
+        float y;
+        float mass;  ///< sum of the ball sizes inside
+    } Moment;
+
+    static const uint32_t s_leafSize;   // most balls in a leaf
+    static const float s_softening;     // keeps close pairs from blowing up
+
+    Quadtree m_tree;
+    std::vector<Moment> m_moments;   ///< one per node of m_tree
+    AlignedVector<float> m_x;        ///< sorted copies of the balls
+    AlignedVector<float> m_y;
+    AlignedVector<float> m_mass;
+
+    static void pull(const float* listX, const float* listY,
+                     const float* listMass, size_t count, float x, float y,
+                     float& ax, float& ay);
+};
+
+#endif /* BARNES_HUT_H */
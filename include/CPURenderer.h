@@ -0,0 +1,51 @@
+#ifndef CPU_RENDERER_H
+#define CPU_RENDERER_H
+
+#include <string>
+#include <vector>
+
+#include "BallSystem.h"
+#include "FieldTree.h"
+#include "ShaderManifest.h"
+
+/** Renders the metaball shaders on the CPU
+ *  @class CPURenderer
+ *
+ *  The image is split into square tiles which are handed to the job system,
+ *  each kernel mirrors the compute shader with the same manifest id. Pixels
+ *  are stored as rows of RGBA floats, ready for glTexSubImage2D.
+ *
+ *  setView() places the image anywhere on a larger canvas, pixel (x, y) is
+ *  shaded at origin + (x, y) * scale in ball coordinates.
+ */
+class CPURenderer {
+public:
+    CPURenderer(int tileSize = 32);
+
+    void resize(int width, int height);
+    int width() const;
+    int height() const;
+    const float* pixels() const;
+    void setView(float originX, float originY, float scaleX, float scaleY);
+
+    static bool supports(const std::string& id);
+    void render(const Shader::ProgramEntry& entry, const BallSystem& balls);
+
+private:
+    int m_width;
+    int m_height;
+    int m_tileSize;
+    float m_originX;
+    float m_originY;
+    float m_scaleX;
+    float m_scaleY;
+    AlignedVector<float> m_pixels;
+    FieldTree m_fieldTree;
+
+    template <typename Kernel>
+    void renderTiles(const Kernel& kernel);
+    template <typename Kernel>
+    void renderFieldTiles(const Kernel& kernel, float tolerance);
+};
+
+#endif /* CPU_RENDERER_H */
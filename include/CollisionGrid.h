@@ -0,0 +1,46 @@
+#ifndef COLLISION_GRID_H
+#define COLLISION_GRID_H
+
+#include <cstdint>
+#include <vector>
+
+#include "BallSystem.h"
+
+/** Elastic ball-ball collisions with a uniform grid broad phase
+ *  @class CollisionGrid
+ *
+ *  Cells are as wide as the largest ball, so overlapping balls are always in
+ *  the same or neighbouring cells. Balls are counting sorted by cell and
+ *  copied into cell order, then every ball checks the 3x3 cells around it.
+ *  Each ball only writes its own result from the state before the step, so
+ *  the narrow phase runs on the job system without locks.
+ *
+ *  @note The buffers are kept between calls to avoid reallocating per frame
+ */
+class CollisionGrid {
+public:
+    CollisionGrid();
+
+    void resolve(BallSystem& balls, float width, float height);
+
+private:
+    float m_cellSize;
+    size_t m_cellsX;
+    size_t m_cellsY;
+
+    std::vector<uint32_t> m_cellOf;     ///< cell of each ball
+    std::vector<uint32_t> m_cellStart;  ///< first sorted ball of each cell
+    std::vector<uint32_t> m_order;      ///< ball index of each sorted slot
+
+    // copies of the balls in cell order
+    AlignedVector<float> m_size;
+    AlignedVector<float> m_posX;
+    AlignedVector<float> m_posY;
+    AlignedVector<float> m_velX;
+    AlignedVector<float> m_velY;
+
+    void buildGrid(const BallSystem& balls, float width, float height);
+    void resolveRange(BallSystem& balls, size_t first, size_t last) const;
+};
+
+#endif /* COLLISION_GRID_H */
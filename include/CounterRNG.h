@@ -0,0 +1,71 @@
+#ifndef COUNTER_RNG_H
+#define COUNTER_RNG_H
+
+#include <cstddef>
+#include <cstdint>
+
+/** Stateless counter-based random numbers
+ *  @namespace CounterRNG
+ *
+ *  Every value is a pure function of (seed, stream, counter), so any ball
+ *  can draw its numbers for any frame on any thread and get the same result.
+ *  A SplitMix64 finalizer derives a 32 bit key per (seed, stream), and the
+ *  counter is mixed with two rounds of a 32 bit avalanche hash, which keeps
+ *  the per-element work to integer ops that vectorize.
+ */
+namespace CounterRNG {
+
+    /// SplitMix64 finalizer
+    inline uint64_t splitmix64(uint64_t x) {
+        x += 0x9e3779b97f4a7c15ull;
+        x = (x ^ (x >> 30)) * 0xbf58476d1ce4e5b9ull;
+        x = (x ^ (x >> 27)) * 0x94d049bb133111ebull;
+        return x ^ (x >> 31);
+    }
+
+    /// 32 bit avalanche hash (lowbias32)
+    inline uint32_t hash32(uint32_t x) {
+        x ^= x >> 16;
+        x *= 0x7feb352du;
+        x ^= x >> 15;
+        x *= 0x846ca68bu;
+        x ^= x >> 16;
+        return x;
+    }
+
+    /** Derives the key shared by every counter of one stream
+     *  @param seed The run's seed
+     *  @param stream Which stream to draw from, ex. the frame number
+     */
+    inline uint32_t key(uint64_t seed, uint64_t stream) {
+        return (uint32_t)(splitmix64(seed ^ splitmix64(stream)) >> 32);
+    }
+
+    /// Returns the random bits for a counter in the stream owning key
+    inline uint32_t bits(uint32_t key, uint32_t counter) {
+        return hash32(hash32(counter ^ key) + key);
+    }
+
+    /// Converts random bits to a float in [0, 1)
+    inline float toUnit(uint32_t bits) {
+        return (bits >> 8) * (1.0f / 16777216.0f);
+    }
+
+    /// Returns a float in [0, 1) for a counter in the stream owning key
+    inline float uniform(uint32_t key, uint32_t counter) {
+        return toUnit(bits(key, counter));
+    }
+
+    /** Fills out[i] with uniform(key, first + i) for i in [0, count)
+     *  @note Written without branches so the compiler vectorizes it
+     */
+    inline void uniform(uint32_t key, uint32_t first, size_t count,
+                        float* out) {
+        for (size_t i = 0; i < count; i++) {
+            out[i] = toUnit(bits(key, first + (uint32_t)i));
+        }
+    }
+
+}  // namespace CounterRNG
+
+#endif /* COUNTER_RNG_H */
@@ -0,0 +1,90 @@
+#ifndef FIELD_TREE_H
+#define FIELD_TREE_H
+
+#include <cstdint>
+#include <vector>
+
+#include "BallSystem.h"
+#include "Quadtree.h"
+
+/** Hierarchical evaluation of the metaball field sum(size / distance)
+ *  @class FieldTree
+ *
+ *  Every node of a Morton ordered Quadtree stores the multipole expansion
+ *  of its balls about their size weighted center: the total size, which
+ *  makes the dipole term vanish, and the second moments for the quadrupole
+ *  term. A region of pixels sums the balls of nearby leaves exactly and
+ *  every node that is far enough away through its expansion, so a pixel
+ *  costs O(log balls) instead of O(balls).
+ *
+ *  A node is far enough when its radius is below openingRatio(tolerance)
+ *  times its distance, which keeps the relative error of each node's
+ *  contribution around the tolerance. A tolerance of 0 is exact.
+ *
+ *  @note nodes() and points() are laid out for std430 storage buffers, see
+ * shaders/meta_fmm.comp
+ */
+class FieldTree {
+public:
+    /// A node's expansion, 48 bytes to match the shader's struct
+    typedef struct {
+        float x;          ///< center, weighted by ball size
+        float y;
+        float mass;       ///< sum of the ball sizes
+        float radius;     ///< distance from the center to the farthest ball
+        float xx;         ///< second moments about the center
+        float xy;
+        float yy;
+        float pad;
+        uint32_t first;   ///< first ball in points()
+        uint32_t count;   ///< number of balls inside
+        uint32_t next;    ///< node after this subtree, node + 1 for leaves
+        uint32_t pad2;
+    } Node;
+
+    /// A ball sorted into tree order, 16 bytes to match the shader
+    typedef struct {
+        float x;
+        float y;
+        float size;
+        float pad;
+    } Point;
+
+    /** Everything acting on a region of pixels
+     *  @struct Terms
+     *
+     *  @note Both lists are padded with zero size entries to a multiple of
+     * SIMD::width
+     */
+    typedef struct {
+        AlignedVector<float> nearX;   ///< balls summed exactly
+        AlignedVector<float> nearY;
+        AlignedVector<float> nearSize;
+        AlignedVector<float> farX;    ///< nodes summed by expansion
+        AlignedVector<float> farY;
+        AlignedVector<float> farMass;
+        AlignedVector<float> farXX;
+        AlignedVector<float> farXY;
+        AlignedVector<float> farYY;
+    } Terms;
+
+    FieldTree();
+
+    void build(const BallSystem& balls);
+    void gather(float minX, float minY, float maxX, float maxY,
+                float tolerance, Terms& terms) const;
+    static float evaluate(const Terms& terms, float x, float y);
+    static float openingRatio(float tolerance);
+
+    const std::vector<Node>& nodes() const;
+    const std::vector<Point>& points() const;
+
+private:
+    static const uint32_t s_leafSize;  // most balls in a leaf
+
+    Quadtree m_tree;
+    std::vector<Node> m_nodes;
+    std::vector<Point> m_points;
+};
+
+#endif /* FIELD_TREE_H */
@@ -0,0 +1,85 @@
+#ifndef FRAME_STATS_H
+#define FRAME_STATS_H
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <string>
+#include <vector>
+
+/** Per frame timings, split into the phases of a frame
+ *  @class FrameStats
+ *
+ *  The frame loop calls begin(), then mark() as each phase ends, then
+ *  end(), which writes the frame into a fixed ring of the most recent
+ *  frames. Writing never blocks or allocates: the frame is stored and then
+ *  published with an atomic count, so count() can be read from any thread.
+ *  The frames themselves aren't guarded, so recent() must be called from
+ *  the thread calling end(), as the frame loop and the GUI it draws do.
+ *
+ *  Summaries give percentiles rather than averages, since a frame rate
+ *  that looks fine on average can still stutter. Histograms use bins that
+ *  grow by sqrt(2), from half a millisecond up to 2 seconds, so a single
+ *  100ms hitch stands out as much as the thousands of 16ms frames.
+ *
+ *  @note Wait is the time spent idle to hold a frame rate, see FrameLimiter
+ *  @note GPU work is asynchronous, so drawing usually only shows the time
+ * taken to submit it and the GPU's share turns up in the swap
+ */
+class FrameStats {
+public:
+    typedef enum { Wait, Events, Update, Draw, GUI, Swap, Phases } Phase;
+
+    /// Milliseconds spent in each phase, and in the whole frame
+    typedef struct {
+        float phases[Phases];
+        float total;
+    } Frame;
+
+    typedef struct {
+        size_t frames;
+        float mean;
+        float p50;
+        float p95;
+        float p99;
+        float max;
+    } Summary;
+
+    static const size_t s_bins = 24;
+    typedef std::array<size_t, s_bins> Histogram;
+
+    FrameStats(size_t capacity = 1024);
+
+    FrameStats(const FrameStats& other) = delete;
+    FrameStats& operator=(const FrameStats& other) = delete;
+
+    void begin();
+    void mark(Phase phase);
+    const Frame& end();
+
+    size_t count() const;
+    size_t capacity() const;
+    void recent(std::vector<Frame>& frames) const;
+
+    static const char* phaseName(Phase phase);
+    static Summary summarize(const std::vector<Frame>& frames, int phase);
+    static Histogram histogram(const std::vector<Frame>& frames, int phase);
+    static float binEdge(size_t bin);
+
+    static void writeCSV(const std::string& path,
+                         const std::vector<Frame>& frames);
+    static void writeJSON(const std::string& path,
+                          const std::vector<Frame>& frames);
+
+private:
+    typedef std::chrono::steady_clock clock;
+
+    std::vector<Frame> m_ring;
+    std::atomic<size_t> m_count;  ///< frames ever written
+    Frame m_frame;                ///< the frame being timed
+    clock::time_point m_start;
+    clock::time_point m_last;     ///< end of the last phase
+};
+
+#endif /* FRAME_STATS_H */
@@ -0,0 +1,44 @@
+#ifndef GOLDEN_IMAGE_H
+#define GOLDEN_IMAGE_H
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+/** Compares rendered frames against stored reference images
+ *  @namespace GoldenImage
+ *
+ *  References are binary PPMs, so they diff and view anywhere. Frames are
+ *  compared on their color channels only: the largest difference of any
+ *  channel, the number of pixels that differ at all or by more than a
+ *  threshold, and the PSNR over every channel, which is infinite for
+ *  identical frames.
+ *
+ *  Hard edged shaders can flip a pixel from one color to the other on a
+ *  rounding difference, so a shader may let a small fraction of its pixels
+ *  go past its largest error, see the tolerance key in
+ *  shaders/shaders.manifest.
+ */
+namespace GoldenImage {
+
+    typedef struct {
+        int maxError;      ///< largest difference of any channel, 0 to 255
+        double psnr;       ///< in dB, infinite when the frames match
+        size_t differing;  ///< pixels with any channel differing
+        size_t outliers;   ///< pixels with a channel past the threshold
+    } Comparison;
+
+    Comparison compare(const uint8_t* rgba, const uint8_t* reference,
+                       int width, int height, int threshold);
+    void diff(const uint8_t* rgba, const uint8_t* reference, int width,
+              int height, std::vector<uint8_t>& out);
+
+    bool readPPM(const std::string& path, std::vector<uint8_t>& rgba,
+                 int& width, int& height);
+    void writePPM(const std::string& path, const uint8_t* rgba, int width,
+                  int height);
+
+};  // namespace GoldenImage
+
+#endif /* GOLDEN_IMAGE_H */
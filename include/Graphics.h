@@ -1,9 +1,27 @@
 #include "Ball.h"
+#include "BallSystem.h"
+#include "CPURenderer.h"
+#include "CounterRNG.h"
+#include "FieldTree.h"
+#include "FrameStats.h"
+#include "PixelReadback.h"
+#include "Recorder.h"
+#include "SceneFile.h"
+#include "SceneGenerator.h"
+#include "Simulation.h"
 #include "Shader.h"
+#include "ShaderManifest.h"
 
 #define INVALID_UNIFORM_LOCATION 0x7fffffff
 #define GRAPHICS_USE_SPIRV 0
 
+// name of the backend used to filter the shader manifest
+#if GRAPHICS_USE_SPIRV
+#define GRAPHICS_BACKEND "spirv"
+#else
+#define GRAPHICS_BACKEND "glsl"
+#endif
+
 class Graphics;
 
 // required by the rendering functions
@@ -13,7 +31,7 @@ typedef struct {
 
 class Graphics {
 public:
-    Graphics(int height, int width);
+    Graphics(int height, int width, uint64_t seed = 0);
     ~Graphics();
 
     GUIWindow* Window();
@@ -21,11 +39,55 @@ public:
     int width();
     void updateDimensions();
 
-    void update();// Update positions of metaballs
+    void setTickRate(double hz, int substeps);
+    void setSimulationThread(bool threaded);
+    void setPaused(bool paused);
+    bool paused();
+    void update(double elapsed);// Pick up the latest metaball positions
+    void step(uint64_t ticks);// Run whole ticks, for offline rendering
+
+    // offline rendering, without the GUI
+    void setMenuVisible(bool visible);
+    void setView(float originX, float originY, float scaleX, float scaleY);
+    int imageWidth();
+    int imageHeight();
+    void renderImage(uint8_t* pixels);
+    void renderImage(PixelReadback& readback);
+
+    void setFrameStats(const FrameStats* stats);
+
+    // benchmarks, see metaballs_bench
+    size_t shaderCount();
+    const Shader::ProgramEntry& shaderEntry(size_t index);
+    bool useShader(size_t index, bool cpu);
+    bool setPersistentSSBO(bool persistent);
+    void uploadBalls();
+    void render();
+
+    // saved and generated scenes, see SceneFile and SceneGenerator
+    size_t loadScene(const std::string& path);
+    size_t generateScene(SceneGenerator::Settings settings);
+    size_t openScene(const std::string& scene);
+    void saveScene(const std::string& path, bool quantize);
+
+    // record and replay, see Recorder
+    void record(const std::string& path);
+    void stopRecording();
+    size_t recordedFrames();
+    size_t recordedBytes();
+    void startReplay(const Replayer& replay);
+    bool replayFrame();
+    uint64_t checksum();
 
 private:
     // members utilized by rendering functions
     bool m_sizeChanged;
+    // what the output texture was last rendered from, see fieldChanged
+    bool m_fieldDirty;  // set by changes the snapshot doesn't show
+    uint64_t m_fieldTick;
+    uint64_t m_fieldCommands;
+    float m_fieldAlpha;
+    bool fieldChanged();
     int m_height;
     int m_width;
     static GLfloat s_quadVertexBufferData[8];
@@ -39,55 +101,79 @@ private:
     drawParams m_params;
     static void m_drawGUIFunc(void*);// This will also update general settings
     static void m_drawFunc(void*);
+    void renderField();
 
     // shader variables
-    typedef enum {
-        Default,
-        Circles = Default,
-        Cells,
-        Meta_BlueGreen,
-        Meta_RedOrange,
-        Meta_RGB,
-        Meta_Params,
-        NumShaderTypes
-    } ShaderType;
-    ShaderType m_currentShader;
-    std::string m_shaderName;
-    std::vector<Shader::ComputeProgram*> m_computeShaders;
+    Shader::Manifest m_shaders;
+    size_t m_currentShader;
     GLuint m_metaballsSSBO;
     GLuint m_ssboBindingIndex;
-    GLuint m_cellsUniform_thresh;
-    float m_cellsThresh;
-    GLuint m_metaBGUniform_radiusMult;
-    float m_metaBGRadiusMult;
-    GLuint m_metaROUniform_radiusMult;
-    float m_metaRORadiusMult;
-    GLuint m_metaRGBUniform_radiusMult;
-    float m_metaRGBRadiusMult;
-    GLuint m_metaParamUniform_radiusMult;
-    GLuint m_metaParamUniform_red;
-    GLuint m_metaParamUniform_green;
-    GLuint m_metaParamUniform_blue;
-    GLuint m_metaParamUniform_high;
-    float m_metaParamRadiusMult;
-    bool m_metaParamRed;
-    bool m_metaParamGreen;
-    bool m_metaParamBlue;
-    bool m_metaParamHigh;
+    Shader::ComputeProgram* program(size_t index);
+    void selectShader(size_t index);
+    void drawShaderParameters();
+    void uploadShaderParameters();
     void bindSSBO();
-    Ball* m_ssboData;
+    void bindFieldTree();
+    GLuint* m_ssboData;  // the mapped SSBO, if it stays mapped
+    size_t m_ssboCapacity;
+    bool m_ssboPersistent;
+    // persistent SSBOs are split into regions written in turn, so an
+    // upload doesn't wait for the dispatch reading the last one
+    static const int s_ssboRegions = 3;
+    GLsync m_ssboFences[s_ssboRegions];  // signalled once a dispatch is done
+    size_t m_ssboRegion;       // region of the latest upload
+    size_t m_ssboRegionBytes;  // stride between regions
+    bool m_ssboStale;  // the SSBO is behind the snapshot, see uploadSnapshot
+    void releaseSSBO();
+    FieldTree m_fieldTree;
+    GLuint m_fieldTreeSSBOs[2];  // nodes and sorted balls
+    float m_tileOrigin[2];  // canvas position of the image, see setView
+    float m_tileScale[2];
+    bool m_cpuRender;
+    CPURenderer m_cpuRenderer;
+    void renderCPU(int width, int height);
 #if GRAPHICS_USE_SPIRV
     GLuint m_ubo;//uniform buffer object for spirv shaders
 #endif
 
     //metaball data
-    bool m_genSSBO;
+    size_t m_ssboCount;
+    bool m_paused;
     bool m_wigglyMovement;
-    size_t m_numBalls;//needed for shaders
-    std::vector<Ball> m_metaballs;
-    std::vector<ImVec4> m_colors;
+    bool m_collisions;
+    bool m_gravity;
+    float m_gravityStrength;
+    float m_theta;
+    int m_integrator;
+    float m_drag;
+    float m_wiggleAngle;
+    float m_alpha;  // how far the renderer is between the last two ticks
+    Simulation m_simulation;
+    const BallSnapshot* m_snapshot;  // latest snapshot, valid for the frame
+    uint64_t m_seed;
+    uint64_t m_spawned;  // balls added, each draws its own random numbers
+    static const uint64_t s_spawnStream;  // CounterRNG streams for spawns
+    Recorder* m_recorder;
+    const Replayer* m_replay;
+    size_t m_replayCommand;  // next command to send
+    size_t m_replayEvent;    // next event to run
+    uint64_t m_replayTick;   // ticks the simulation has run
+    std::string m_scene;     // scene file or generator used, if any
+    char m_sceneFile[256];   // where Save Scene writes to
+    bool m_quantizeScene;
+    BallSystem m_frameBalls;  // interpolated copy for the CPU renderer
+    static const size_t s_updateGrain;  // balls per SSBO copy job
+    void uploadSnapshot(float alpha);
+    size_t replaceBalls(BallSystem& balls, const std::string& source);
     void pushBall(Ball ball);
     void pushBall(int& height, int& width);
     void popBall();
     void drawBallInterface();
+
+    // frame time panel, see FrameStats
+    const FrameStats* m_frameStats;
+    std::vector<FrameStats::Frame> m_recentFrames;
+    std::vector<float> m_plotValues;
+    void drawFrameStats();
+    void drawPerfCounters();
 };
\ No newline at end of file
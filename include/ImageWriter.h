@@ -0,0 +1,62 @@
+#ifndef IMAGE_WRITER_H
+#define IMAGE_WRITER_H
+
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+/** Writes 8 bit RGBA frames to image files on the job system
+ *  @class ImageWriter
+ *
+ *  Frames are rendered straight into one of a ring of buffers from
+ *  acquire(), and submit() hands the buffer to a job that encodes and
+ *  writes it while the caller renders the next frame. acquire() only blocks
+ *  when every buffer is still being encoded, so rendering sets the pace.
+ *
+ *  @note Without worker threads frames are encoded inside submit()
+ *  @note Errors from the jobs are thrown by the next acquire() or finish()
+ */
+class ImageWriter {
+public:
+    typedef enum { PNG, PPM, QOI } Format;
+
+    ImageWriter(Format format, size_t depth = 0);
+    ~ImageWriter();
+
+    ImageWriter(const ImageWriter& other) = delete;
+    ImageWriter& operator=(const ImageWriter& other) = delete;
+
+    uint8_t* acquire(int width, int height);
+    void submit(const std::string& path);
+    void finish();
+    size_t written() const;
+
+    static bool parseFormat(const std::string& name, Format& format);
+    static const char* extension(Format format);
+    static void encode(Format format, const uint8_t* rgba, int width,
+                       int height, std::vector<uint8_t>& out);
+
+private:
+    /// A frame buffer and the job encoding it
+    typedef struct {
+        std::vector<uint8_t> pixels;   ///< rows top to bottom, RGBA
+        std::vector<uint8_t> encoded;  ///< reused between frames
+        int width;
+        int height;
+        std::string path;
+        std::string error;             ///< set by the job if writing failed
+        std::atomic<bool> busy;
+    } Slot;
+
+    Format m_format;
+    std::vector<std::unique_ptr<Slot>> m_slots;
+    size_t m_next;
+    size_t m_written;
+
+    static void write(Format format, Slot* slot);
+    void wait(Slot& slot);
+};
+
+#endif /* IMAGE_WRITER_H */
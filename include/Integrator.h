@@ -0,0 +1,331 @@
+#ifndef INTEGRATOR_H
+#define INTEGRATOR_H
+
+#include <algorithm>
+#include <cstddef>
+
+#include "Ball.h"
+#include "SIMD.h"
+
+/** Fixed step integrators for the ball movement
+ *  @namespace Integrator
+ *
+ *  integrate() is templated on the method, the layout the balls are stored
+ *  in and the force acting on them, so every combination compiles down to a
+ *  single SIMD loop with the force inlined. A register of balls stays
+ *  loaded for all of its substeps and bounces off the walls after each one.
+ *  Time is measured in ticks of 1/60th of a second, so velocities are in
+ *  pixels per tick and accelerations in pixels per tick squared.
+ */
+namespace Integrator {
+
+    /// One SIMD register worth of balls
+    typedef struct {
+        SIMD::floatv size;
+        SIMD::floatv x;
+        SIMD::floatv y;
+        SIMD::floatv vx;
+        SIMD::floatv vy;
+    } Lanes;
+
+    /// Loads the first n values of p, the rest of the lanes repeat p[0]
+    inline SIMD::floatv loadLanes(const float* p, size_t n) {
+        if (n == SIMD::width) {
+            return SIMD::loadu(p);
+        }
+        alignas(32) float lanes[SIMD::width];
+        for (size_t j = 0; j < SIMD::width; j++) {
+            lanes[j] = p[j < n ? j : 0];
+        }
+        return SIMD::load(lanes);
+    }
+
+    /// Stores the first n lanes of v to p
+    inline void storeLanes(float* p, SIMD::floatv v, size_t n) {
+        if (n == SIMD::width) {
+            SIMD::storeu(p, v);
+            return;
+        }
+        alignas(32) float lanes[SIMD::width];
+        SIMD::store(lanes, v);
+        std::copy(lanes, lanes + n, p);
+    }
+
+    /** Balls kept in separate arrays, as in BallSystem
+     *  @struct SoAState
+     */
+    typedef struct {
+        const float* size;
+        float* posX;
+        float* posY;
+        float* velX;
+        float* velY;
+
+        void load(size_t i, size_t n, Lanes& lanes) const {
+            lanes.size = loadLanes(size + i, n);
+            lanes.x = loadLanes(posX + i, n);
+            lanes.y = loadLanes(posY + i, n);
+            lanes.vx = loadLanes(velX + i, n);
+            lanes.vy = loadLanes(velY + i, n);
+        }
+        void store(size_t i, size_t n, const Lanes& lanes) const {
+            storeLanes(posX + i, lanes.x, n);
+            storeLanes(posY + i, lanes.y, n);
+            storeLanes(velX + i, lanes.vx, n);
+            storeLanes(velY + i, lanes.vy, n);
+        }
+    } SoAState;
+
+    /** Balls interleaved in the shader storage buffer layout
+     *  @struct AoSState
+     *
+     *  @note Every register is gathered and scattered through the stack
+     */
+    typedef struct {
+        Ball* balls;
+
+        void load(size_t i, size_t n, Lanes& lanes) const {
+            alignas(32) float values[5][SIMD::width];
+            for (size_t j = 0; j < SIMD::width; j++) {
+                const Ball& ball = balls[i + (j < n ? j : 0)];
+                values[0][j] = ball.size;
+                values[1][j] = ball.position.x;
+                values[2][j] = ball.position.y;
+                values[3][j] = ball.velocity.x;
+                values[4][j] = ball.velocity.y;
+            }
+            lanes.size = SIMD::load(values[0]);
+            lanes.x = SIMD::load(values[1]);
+            lanes.y = SIMD::load(values[2]);
+            lanes.vx = SIMD::load(values[3]);
+            lanes.vy = SIMD::load(values[4]);
+        }
+        void store(size_t i, size_t n, const Lanes& lanes) const {
+            alignas(32) float values[4][SIMD::width];
+            SIMD::store(values[0], lanes.x);
+            SIMD::store(values[1], lanes.y);
+            SIMD::store(values[2], lanes.vx);
+            SIMD::store(values[3], lanes.vy);
+            for (size_t j = 0; j < n; j++) {
+                balls[i + j].position.x = values[0][j];
+                balls[i + j].position.y = values[1][j];
+                balls[i + j].velocity.x = values[2][j];
+                balls[i + j].velocity.y = values[3][j];
+            }
+        }
+    } AoSState;
+
+    /** No force, the balls coast in straight lines
+     *  @struct NoForce
+     */
+    typedef struct {
+        void operator()(size_t, size_t, SIMD::floatv, SIMD::floatv,
+                        SIMD::floatv, SIMD::floatv, SIMD::floatv& ax,
+                        SIMD::floatv& ay) const {
+            ax = SIMD::set1(0.0f);
+            ay = ax;
+        }
+    } NoForce;
+
+    /** Linear drag plus an optional acceleration per ball
+     *  @struct DragForce
+     *
+     *  @note The per ball accelerations are held for the whole step, so
+     * forces like gravity between balls are only sampled once per call
+     */
+    typedef struct {
+        float drag;          ///< fraction of velocity lost per tick
+        const float* accX;   ///< nullptr for no extra acceleration
+        const float* accY;
+
+        void operator()(size_t i, size_t n, SIMD::floatv, SIMD::floatv,
+                        SIMD::floatv vx, SIMD::floatv vy, SIMD::floatv& ax,
+                        SIMD::floatv& ay) const {
+            using namespace SIMD;
+            const floatv k = set1(-drag);
+            ax = mul(k, vx);
+            ay = mul(k, vy);
+            if (accX) {
+                ax = add(ax, loadLanes(accX + i, n));
+                ay = add(ay, loadLanes(accY + i, n));
+            }
+        }
+    } DragForce;
+
+    /// A single step of the method, specialized below
+    template <IntegratorMethod Method>
+    struct Stepper;
+
+    /// x and v both advance with the values from the start of the step
+    template <>
+    struct Stepper<ExplicitEuler> {
+        template <typename Force>
+        static void step(size_t i, size_t n, Lanes& b, SIMD::floatv dt,
+                         const Force& force) {
+            using namespace SIMD;
+            floatv ax, ay;
+            force(i, n, b.x, b.y, b.vx, b.vy, ax, ay);
+            b.x = add(b.x, mul(b.vx, dt));
+            b.y = add(b.y, mul(b.vy, dt));
+            b.vx = add(b.vx, mul(ax, dt));
+            b.vy = add(b.vy, mul(ay, dt));
+        }
+    };
+
+    /// v advances first and x moves with the new v, symplectic
+    template <>
+    struct Stepper<SemiImplicitEuler> {
+        template <typename Force>
+        static void step(size_t i, size_t n, Lanes& b, SIMD::floatv dt,
+                         const Force& force) {
+            using namespace SIMD;
+            floatv ax, ay;
+            force(i, n, b.x, b.y, b.vx, b.vy, ax, ay);
+            b.vx = add(b.vx, mul(ax, dt));
+            b.vy = add(b.vy, mul(ay, dt));
+            b.x = add(b.x, mul(b.vx, dt));
+            b.y = add(b.y, mul(b.vy, dt));
+        }
+    };
+
+    /** Half kick, drift, half kick with the force at the new position
+     *  @note Velocity dependent forces see the half step velocity
+     */
+    template <>
+    struct Stepper<VelocityVerlet> {
+        template <typename Force>
+        static void step(size_t i, size_t n, Lanes& b, SIMD::floatv dt,
+                         const Force& force) {
+            using namespace SIMD;
+            const floatv half = mul(dt, set1(0.5f));
+            floatv ax, ay;
+            force(i, n, b.x, b.y, b.vx, b.vy, ax, ay);
+            b.vx = add(b.vx, mul(ax, half));
+            b.vy = add(b.vy, mul(ay, half));
+            b.x = add(b.x, mul(b.vx, dt));
+            b.y = add(b.y, mul(b.vy, dt));
+            force(i, n, b.x, b.y, b.vx, b.vy, ax, ay);
+            b.vx = add(b.vx, mul(ax, half));
+            b.vy = add(b.vy, mul(ay, half));
+        }
+    };
+
+    /// Classic fourth order Runge-Kutta, four force evaluations per step
+    template <>
+    struct Stepper<RungeKutta4> {
+        template <typename Force>
+        static void step(size_t i, size_t n, Lanes& b, SIMD::floatv dt,
+                         const Force& force) {
+            using namespace SIMD;
+            const floatv half = mul(dt, set1(0.5f));
+            const floatv sixth = mul(dt, set1(1.0f / 6.0f));
+            const floatv two = set1(2.0f);
+
+            // k1 = f(y)
+            floatv ax1, ay1;
+            force(i, n, b.x, b.y, b.vx, b.vy, ax1, ay1);
+            // k2 = f(y + k1 dt / 2)
+            floatv vx2 = add(b.vx, mul(ax1, half));
+            floatv vy2 = add(b.vy, mul(ay1, half));
+            floatv ax2, ay2;
+            force(i, n, add(b.x, mul(b.vx, half)), add(b.y, mul(b.vy, half)),
+                  vx2, vy2, ax2, ay2);
+            // k3 = f(y + k2 dt / 2)
+            floatv vx3 = add(b.vx, mul(ax2, half));
+            floatv vy3 = add(b.vy, mul(ay2, half));
+            floatv ax3, ay3;
+            force(i, n, add(b.x, mul(vx2, half)), add(b.y, mul(vy2, half)),
+                  vx3, vy3, ax3, ay3);
+            // k4 = f(y + k3 dt)
+            floatv vx4 = add(b.vx, mul(ax3, dt));
+            floatv vy4 = add(b.vy, mul(ay3, dt));
+            floatv ax4, ay4;
+            force(i, n, add(b.x, mul(vx3, dt)), add(b.y, mul(vy3, dt)), vx4,
+                  vy4, ax4, ay4);
+
+            b.x = add(b.x, mul(sixth, add(add(b.vx, vx4),
+                                          mul(two, add(vx2, vx3)))));
+            b.y = add(b.y, mul(sixth, add(add(b.vy, vy4),
+                                          mul(two, add(vy2, vy3)))));
+            b.vx = add(b.vx, mul(sixth, add(add(ax1, ax4),
+                                            mul(two, add(ax2, ax3)))));
+            b.vy = add(b.vy, mul(sixth, add(add(ay1, ay4),
+                                            mul(two, add(ay2, ay3)))));
+        }
+    };
+
+    /// Branchless wall reflection for one SIMD register of balls
+    inline void bounce(SIMD::floatv& pos, SIMD::floatv& vel, SIMD::floatv size,
+                       SIMD::floatv limit) {
+        using namespace SIMD;
+        const floatv zero = set1(0.0f);
+        const floatv one = set1(1.0f);
+        floatv high = cmpge(add(pos, size), limit);
+        floatv low = andNot(high, cmple(sub(pos, size), zero));
+        pos = blend(pos, sub(limit, add(size, one)), high);
+        pos = blend(pos, add(size, one), low);
+        vel = blend(vel, negAbs(vel), high);
+        vel = blend(vel, abs(vel), low);
+    }
+
+    /** Advances the balls in [first, last) and bounces them off the walls
+     *  @param state Where the balls are stored
+     *  @param first Index of the first ball to update
+     *  @param last One past the last ball to update
+     *  @param force The acceleration acting on the balls
+     *  @param dt Length of a substep in ticks
+     *  @param substeps Number of steps to take
+     *  @param width The width of the area the balls are contained in
+     *  @param height The height of the area the balls are contained in
+     *
+     *  @note Disjoint ranges may be updated concurrently. The last register
+     * is padded, so a ball's result doesn't depend on where ranges split
+     */
+    template <IntegratorMethod Method, typename State, typename Force>
+    inline void integrate(const State& state, size_t first, size_t last,
+                          const Force& force, float dt, int substeps,
+                          float width, float height) {
+        const SIMD::floatv step = SIMD::set1(dt);
+        const SIMD::floatv w = SIMD::set1(width);
+        const SIMD::floatv h = SIMD::set1(height);
+        for (size_t i = first; i < last; i += SIMD::width) {
+            size_t n = std::min(SIMD::width, last - i);
+            Lanes b;
+            state.load(i, n, b);
+            for (int substep = 0; substep < substeps; substep++) {
+                Stepper<Method>::step(i, n, b, step, force);
+                bounce(b.x, b.vx, b.size, w);
+                bounce(b.y, b.vy, b.size, h);
+            }
+            state.store(i, n, b);
+        }
+    }
+
+    /// integrate() with the method picked at run time
+    template <typename State, typename Force>
+    inline void integrate(IntegratorMethod method, const State& state,
+                          size_t first, size_t last, const Force& force,
+                          float dt, int substeps, float width, float height) {
+        switch (method) {
+            case ExplicitEuler:
+                integrate<ExplicitEuler>(state, first, last, force, dt,
+                                         substeps, width, height);
+                break;
+            case SemiImplicitEuler:
+                integrate<SemiImplicitEuler>(state, first, last, force, dt,
+                                             substeps, width, height);
+                break;
+            case VelocityVerlet:
+                integrate<VelocityVerlet>(state, first, last, force, dt,
+                                          substeps, width, height);
+                break;
+            case RungeKutta4:
+                integrate<RungeKutta4>(state, first, last, force, dt,
+                                       substeps, width, height);
+                break;
+        }
+    }
+
+}  // namespace Integrator
+
+#endif /* INTEGRATOR_H */
@@ -0,0 +1,55 @@
+#ifndef PIXEL_READBACK_H
+#define PIXEL_READBACK_H
+
+#define GL_DO_NOT_WARN_IF_MULTI_GL_VERSION_HEADERS_INCLUDED
+#include <GL/glew.h>
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+/** Asynchronous texture readback through a ring of pixel buffer objects
+ *  @class PixelReadback
+ *
+ *  start() queues a copy of a texture into the next pixel buffer and fences
+ *  it, so the copy runs on the GPU while the following frames are being
+ *  issued. ready() polls the oldest fence without blocking, map() returns
+ *  the oldest copy's pixels and release() hands its buffer back.
+ *
+ *  @note Needs the same OpenGL context to be current for its whole life
+ */
+class PixelReadback {
+public:
+    PixelReadback(size_t depth = 3);
+    ~PixelReadback();
+
+    PixelReadback(const PixelReadback& other) = delete;
+    PixelReadback& operator=(const PixelReadback& other) = delete;
+
+    void start(GLuint texture, int width, int height);
+    bool ready();
+    const uint8_t* map();
+    void release();
+
+    bool empty() const;
+    bool full() const;
+    int width() const;
+    int height() const;
+
+private:
+    /// A pixel buffer and the fence for the copy into it
+    typedef struct {
+        GLuint buffer;
+        GLsync fence;
+        size_t size;  ///< bytes allocated for the buffer
+        int width;
+        int height;
+    } Slot;
+
+    std::vector<Slot> m_slots;
+    size_t m_first;  ///< oldest copy in flight
+    size_t m_count;  ///< copies in flight
+    bool m_mapped;
+};
+
+#endif /* PIXEL_READBACK_H */
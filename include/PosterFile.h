@@ -0,0 +1,52 @@
+#ifndef POSTER_FILE_H
+#define POSTER_FILE_H
+
+#include <cstddef>
+#include <cstdint>
+#include <fstream>
+#include <string>
+#include <vector>
+
+/** A binary PPM too large to hold in memory, written a band of rows at a
+ *  time
+ *  @class PosterFile
+ *
+ *  The file is created at its full size up front. mapRows() memory maps a
+ *  band of rows to fill in, and unmapRows() lets the kernel write it out,
+ *  so memory use stays around one band however large the image is.
+ *
+ *  @note Without mmap (non UNIX builds) the band is a buffer written out by
+ * unmapRows()
+ */
+class PosterFile {
+public:
+    PosterFile(const std::string& path, int width, int height);
+    ~PosterFile();
+
+    PosterFile(const PosterFile& other) = delete;
+    PosterFile& operator=(const PosterFile& other) = delete;
+
+    uint8_t* mapRows(int first, int count);
+    void unmapRows();
+
+    int width() const;
+    int height() const;
+
+private:
+    std::string m_path;
+    int m_width;
+    int m_height;
+    size_t m_headerSize;
+    uint8_t* m_rows;  ///< the mapped band, null if none
+#ifdef UNIX
+    int m_file;
+    void* m_map;      ///< start of the mapping, rounded down to a page
+    size_t m_mapSize;
+#else
+    std::fstream m_file;
+    std::vector<uint8_t> m_band;
+    size_t m_bandOffset;
+#endif
+};
+
+#endif /* POSTER_FILE_H */
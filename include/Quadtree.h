@@ -0,0 +1,56 @@
+#ifndef QUADTREE_H
+#define QUADTREE_H
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+/** Linear quadtree over points sorted by Morton code
+ *  @class Quadtree
+ *
+ *  Points are sorted by the Morton code of their position, so every node
+ *  covers a contiguous run of sorted points. The nodes are stored in depth
+ *  first (Morton) order with the index of the node after their subtree,
+ *  which lets a walk run without a stack: an accepted or leaf node skips to
+ *  next, an opened node steps to the node after it. The children of a node
+ *  are found by hopping along next from the node after it, and walking the
+ *  nodes backwards visits every child before its parent.
+ *
+ *  @note Only the structure is stored, users keep their own per node data
+ * in arrays indexed like nodes()
+ */
+class Quadtree {
+public:
+    /// A square cell of the quadtree
+    typedef struct {
+        float width;      ///< side length of the cell
+        uint32_t first;   ///< first sorted point inside
+        uint32_t count;   ///< number of points inside
+        uint32_t next;    ///< node after this subtree, node + 1 for leaves
+    } Node;
+
+    Quadtree(uint32_t leafSize = 32);
+
+    void build(const float* posX, const float* posY, size_t count);
+
+    const std::vector<Node>& nodes() const;
+    const std::vector<uint32_t>& leaves() const;
+    const std::vector<uint32_t>& order() const;
+    bool isLeaf(uint32_t node) const;
+
+private:
+    static const uint32_t s_maxDepth;  // bits per axis in the Morton codes
+
+    uint32_t m_leafSize;
+    float m_width;
+    std::vector<Node> m_nodes;
+    std::vector<uint32_t> m_leaves;   ///< index of every leaf node
+    std::vector<uint32_t> m_codes;    ///< Morton code of each sorted point
+    std::vector<uint32_t> m_order;    ///< point index of each sorted slot
+    std::vector<uint32_t> m_scratch;
+
+    void sortByCode(size_t count);
+    void buildNode(uint32_t first, uint32_t last, uint32_t depth);
+};
+
+#endif /* QUADTREE_H */
@@ -0,0 +1,142 @@
+#ifndef RECORDER_H
+#define RECORDER_H
+
+#include <cstdint>
+#include <fstream>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include "Simulation.h"
+
+/** Logs a run so it can be replayed exactly, see Replayer
+ *  @class Recorder
+ *
+ *  Every simulation command is logged with the tick it was applied at, and
+ *  every frame with the tick and command count of the snapshot it drew and
+ *  how far it was interpolated. The starting balls are commands like any
+ *  other, so together with the seed and the scene (a file or generator, if
+ *  one was used) in the header that's the whole run, whatever thread the
+ *  simulation was on. Changes to the renderer (shader, shader parameters,
+ *  CPU rendering and size) are logged between frames.
+ *
+ *  The log is a header followed by events, each a type byte and then its
+ *  fields. Ticks and counts are deltas from the previous event of their
+ *  kind and, like indices, are written as LEB128 varints. Floats are
+ *  written as their bits so replays match to the last bit.
+ *
+ *  @note command() is called from the simulation thread, everything else
+ * from the rendering thread
+ */
+class Recorder {
+public:
+    /// Events besides the simulation's commands, which use CommandType
+    typedef enum {
+        Frame = 16,
+        SelectShader,
+        ShaderParameter,
+        CPURender,
+        Resize,
+        End
+    } EventType;
+
+    Recorder(const std::string& path, uint64_t seed, int width, int height,
+             const std::string& scene);
+    ~Recorder();
+
+    Recorder(const Recorder& other) = delete;
+    Recorder& operator=(const Recorder& other) = delete;
+
+    void command(uint64_t tick, const Simulation::Command& command);
+    void frame(uint64_t tick, uint64_t commands, float alpha);
+    void selectShader(size_t index);
+    void shaderParameter(size_t index, float value);
+    void cpuRender(bool enabled);
+    void resize(int width, int height);
+    void finish(uint64_t checksum);
+
+    size_t frames() const;
+    size_t bytes() const;
+
+    static uint64_t checksum(const BallSystem& balls);
+
+    static const char s_magic[4];
+    static const uint64_t s_version;
+
+private:
+    std::string m_path;
+    std::ofstream m_file;
+    std::mutex m_mutex;
+    std::vector<uint8_t> m_buffer;  ///< events not yet written out
+    size_t m_bytes;
+    size_t m_frames;
+    uint64_t m_commandTick;  ///< tick of the last command
+    uint64_t m_frameTick;    ///< tick of the last frame
+    uint64_t m_frameCommands;
+    bool m_finished;
+
+    void putVarint(uint64_t value);
+    void putFloat(float value);
+    void putDouble(double value);
+    void putBall(const Ball& ball);
+    void flush(bool force);
+};
+
+/** Reads a log written by Recorder
+ *  @class Replayer
+ *
+ *  The log is decoded up front into the commands, to be sent to the
+ *  simulation as their ticks come up, and the rendering events, which are
+ *  run through in order.
+ */
+class Replayer {
+public:
+    typedef struct {
+        uint64_t tick;  ///< the tick the command is applied at
+        Simulation::Command command;
+    } TimedCommand;
+
+    typedef struct {
+        Recorder::EventType type;
+        uint64_t tick;      ///< Frame, the tick of its snapshot
+        uint64_t commands;  ///< Frame, the commands applied before it
+        size_t index;       ///< shader or parameter index, CPURender flag
+        float value;        ///< Frame alpha or parameter value
+        int width;          ///< Resize
+        int height;         ///< Resize
+    } Event;
+
+    Replayer(const std::string& path);
+
+    uint64_t seed() const;
+    const std::string& scene() const;
+    int width() const;
+    int height() const;
+    const std::vector<TimedCommand>& commands() const;
+    const std::vector<Event>& events() const;
+    size_t frames() const;
+    bool finished() const;
+    uint64_t checksum() const;
+
+private:
+    std::string m_path;
+    std::vector<uint8_t> m_data;
+    size_t m_offset;
+    uint64_t m_seed;
+    std::string m_scene;
+    int m_width;
+    int m_height;
+    std::vector<TimedCommand> m_commands;
+    std::vector<Event> m_events;
+    size_t m_frames;
+    bool m_finished;  ///< whether the log ended with a checksum
+    uint64_t m_checksum;
+
+    uint8_t getByte();
+    uint64_t getVarint();
+    float getFloat();
+    double getDouble();
+    Ball getBall();
+};
+
+#endif /* RECORDER_H */
@@ -0,0 +1,184 @@
+#ifndef SIMD_H
+#define SIMD_H
+
+#include <cstddef>
+#include <cstdint>
+
+#if defined(__AVX__) || defined(__SSE2__)
+#include <immintrin.h>
+#endif
+
+/** Thin wrappers over the widest float vector available at compile time
+ *  @namespace SIMD
+ *
+ *  @note AVX is used when compiled with -mavx (or -march=native), otherwise
+ *        SSE2 which every x86_64 target has, with a scalar fallback for
+ *        anything else. Masks are full-width vectors of all ones or zeros.
+ */
+namespace SIMD {
+
+#if defined(__AVX__)
+    typedef __m256 floatv;
+    constexpr size_t width = 8;
+
+    inline floatv load(const float* p) { return _mm256_load_ps(p); }
+    inline floatv loadu(const float* p) { return _mm256_loadu_ps(p); }
+    inline void store(float* p, floatv v) { _mm256_store_ps(p, v); }
+    inline void storeu(float* p, floatv v) { _mm256_storeu_ps(p, v); }
+    inline floatv set1(float v) { return _mm256_set1_ps(v); }
+    inline floatv add(floatv a, floatv b) { return _mm256_add_ps(a, b); }
+    inline floatv sub(floatv a, floatv b) { return _mm256_sub_ps(a, b); }
+    inline floatv mul(floatv a, floatv b) { return _mm256_mul_ps(a, b); }
+    inline floatv div(floatv a, floatv b) { return _mm256_div_ps(a, b); }
+    inline floatv min(floatv a, floatv b) { return _mm256_min_ps(a, b); }
+    inline floatv max(floatv a, floatv b) { return _mm256_max_ps(a, b); }
+    inline floatv sqrt(floatv a) { return _mm256_sqrt_ps(a); }
+    inline floatv cmpge(floatv a, floatv b) {
+        return _mm256_cmp_ps(a, b, _CMP_GE_OQ);
+    }
+    inline floatv cmple(floatv a, floatv b) {
+        return _mm256_cmp_ps(a, b, _CMP_LE_OQ);
+    }
+    inline floatv cmplt(floatv a, floatv b) {
+        return _mm256_cmp_ps(a, b, _CMP_LT_OQ);
+    }
+    inline floatv bitAnd(floatv a, floatv b) { return _mm256_and_ps(a, b); }
+    inline floatv bitOr(floatv a, floatv b) { return _mm256_or_ps(a, b); }
+    inline floatv andNot(floatv a, floatv b) { return _mm256_andnot_ps(a, b); }
+    /// Returns b where mask is set, a elsewhere
+    inline floatv blend(floatv a, floatv b, floatv mask) {
+        return _mm256_blendv_ps(a, b, mask);
+    }
+    /// Loads one channel (0 to 3) of width RGBA8 pixels as floats
+    inline floatv loadChannel(const uint8_t* rgba, int channel) {
+        const __m128i mask = _mm_set1_epi32(0xff);
+        const __m128i shift = _mm_cvtsi32_si128(channel * 8);
+        __m128i lo = _mm_loadu_si128((const __m128i*)rgba);
+        __m128i hi = _mm_loadu_si128((const __m128i*)(rgba + 16));
+        lo = _mm_and_si128(_mm_srl_epi32(lo, shift), mask);
+        hi = _mm_and_si128(_mm_srl_epi32(hi, shift), mask);
+        return _mm256_insertf128_ps(
+            _mm256_castps128_ps256(_mm_cvtepi32_ps(lo)), _mm_cvtepi32_ps(hi),
+            1);
+    }
+    /// Rounds and clamps every lane to 0-255 and stores them as bytes
+    inline void storeBytes(uint8_t* p, floatv v) {
+        __m256i i = _mm256_cvtps_epi32(v);
+        __m128i words = _mm_packs_epi32(_mm256_castsi256_si128(i),
+                                        _mm256_extractf128_si256(i, 1));
+        _mm_storel_epi64((__m128i*)p, _mm_packus_epi16(words, words));
+    }
+#elif defined(__SSE2__)
+    typedef __m128 floatv;
+    constexpr size_t width = 4;
+
+    inline floatv load(const float* p) { return _mm_load_ps(p); }
+    inline floatv loadu(const float* p) { return _mm_loadu_ps(p); }
+    inline void store(float* p, floatv v) { _mm_store_ps(p, v); }
+    inline void storeu(float* p, floatv v) { _mm_storeu_ps(p, v); }
+    inline floatv set1(float v) { return _mm_set1_ps(v); }
+    inline floatv add(floatv a, floatv b) { return _mm_add_ps(a, b); }
+    inline floatv sub(floatv a, floatv b) { return _mm_sub_ps(a, b); }
+    inline floatv mul(floatv a, floatv b) { return _mm_mul_ps(a, b); }
+    inline floatv div(floatv a, floatv b) { return _mm_div_ps(a, b); }
+    inline floatv min(floatv a, floatv b) { return _mm_min_ps(a, b); }
+    inline floatv max(floatv a, floatv b) { return _mm_max_ps(a, b); }
+    inline floatv sqrt(floatv a) { return _mm_sqrt_ps(a); }
+    inline floatv cmpge(floatv a, floatv b) { return _mm_cmpge_ps(a, b); }
+    inline floatv cmple(floatv a, floatv b) { return _mm_cmple_ps(a, b); }
+    inline floatv cmplt(floatv a, floatv b) { return _mm_cmplt_ps(a, b); }
+    inline floatv bitAnd(floatv a, floatv b) { return _mm_and_ps(a, b); }
+    inline floatv bitOr(floatv a, floatv b) { return _mm_or_ps(a, b); }
+    inline floatv andNot(floatv a, floatv b) { return _mm_andnot_ps(a, b); }
+    /// Returns b where mask is set, a elsewhere
+    inline floatv blend(floatv a, floatv b, floatv mask) {
+        return _mm_or_ps(_mm_and_ps(mask, b), _mm_andnot_ps(mask, a));
+    }
+    /// Loads one channel (0 to 3) of width RGBA8 pixels as floats
+    inline floatv loadChannel(const uint8_t* rgba, int channel) {
+        __m128i pixels = _mm_loadu_si128((const __m128i*)rgba);
+        pixels = _mm_srl_epi32(pixels, _mm_cvtsi32_si128(channel * 8));
+        return _mm_cvtepi32_ps(_mm_and_si128(pixels, _mm_set1_epi32(0xff)));
+    }
+    /// Rounds and clamps every lane to 0-255 and stores them as bytes
+    inline void storeBytes(uint8_t* p, floatv v) {
+        __m128i words =
+            _mm_packs_epi32(_mm_cvtps_epi32(v), _mm_setzero_si128());
+        int bytes = _mm_cvtsi128_si32(_mm_packus_epi16(words, words));
+        __builtin_memcpy(p, &bytes, 4);
+    }
+#else
+    typedef float floatv;
+    constexpr size_t width = 1;
+
+    inline floatv load(const float* p) { return *p; }
+    inline floatv loadu(const float* p) { return *p; }
+    inline void store(float* p, floatv v) { *p = v; }
+    inline void storeu(float* p, floatv v) { *p = v; }
+    inline floatv set1(float v) { return v; }
+    inline floatv add(floatv a, floatv b) { return a + b; }
+    inline floatv sub(floatv a, floatv b) { return a - b; }
+    inline floatv mul(floatv a, floatv b) { return a * b; }
+    inline floatv div(floatv a, floatv b) { return a / b; }
+    inline floatv min(floatv a, floatv b) { return a < b ? a : b; }
+    inline floatv max(floatv a, floatv b) { return a > b ? a : b; }
+    inline floatv sqrt(floatv a) { return __builtin_sqrtf(a); }
+    inline floatv fromBits(uint32_t bits) {
+        floatv v;
+        __builtin_memcpy(&v, &bits, sizeof(v));
+        return v;
+    }
+    inline uint32_t toBits(floatv v) {
+        uint32_t bits;
+        __builtin_memcpy(&bits, &v, sizeof(v));
+        return bits;
+    }
+    inline floatv cmpge(floatv a, floatv b) {
+        return fromBits(a >= b ? 0xffffffffu : 0u);
+    }
+    inline floatv cmple(floatv a, floatv b) {
+        return fromBits(a <= b ? 0xffffffffu : 0u);
+    }
+    inline floatv cmplt(floatv a, floatv b) {
+        return fromBits(a < b ? 0xffffffffu : 0u);
+    }
+    inline floatv bitAnd(floatv a, floatv b) {
+        return fromBits(toBits(a) & toBits(b));
+    }
+    inline floatv bitOr(floatv a, floatv b) {
+        return fromBits(toBits(a) | toBits(b));
+    }
+    inline floatv andNot(floatv a, floatv b) {
+        return fromBits(~toBits(a) & toBits(b));
+    }
+    inline floatv blend(floatv a, floatv b, floatv mask) {
+        return toBits(mask) ? b : a;
+    }
+    inline floatv loadChannel(const uint8_t* rgba, int channel) {
+        return rgba[channel];
+    }
+    inline void storeBytes(uint8_t* p, floatv v) {
+        v = v + 0.5f;
+        *p = v <= 0.0f ? 0 : v >= 255.0f ? 255 : (uint8_t)v;
+    }
+#endif
+
+    /// Returns the sum of every lane
+    inline float sum(floatv a) {
+        alignas(32) float lanes[width];
+        store(lanes, a);
+        float total = 0.0f;
+        for (size_t i = 0; i < width; i++) {
+            total += lanes[i];
+        }
+        return total;
+    }
+
+    /// Returns |a|
+    inline floatv abs(floatv a) { return andNot(set1(-0.0f), a); }
+    /// Returns -|a|
+    inline floatv negAbs(floatv a) { return bitOr(set1(-0.0f), a); }
+
+}  // namespace SIMD
+
+#endif /* SIMD_H */
@@ -0,0 +1,79 @@
+#ifndef SCENE_FILE_H
+#define SCENE_FILE_H
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "BallSystem.h"
+
+/** A saved set of balls, memory mapped for loading
+ *  @class SceneFile
+ *
+ *  A scene is a 64 byte header followed by one packed array per ball
+ *  member, in BallSystem's order, each starting on a 64 byte boundary. The
+ *  arrays are either floats, copied straight into a BallSystem, or
+ *  quantized to 13 bytes a ball: 16 bits for the size, position and
+ *  velocity, scaled to the ranges in the header, and 8 bits per color.
+ *
+ *  The constructor maps the file and checks the header, nothing is parsed,
+ *  and load() copies the arrays out on the job system.
+ *
+ *  @note Files are little endian, like every platform this runs on
+ */
+class SceneFile {
+public:
+    typedef struct {
+        char magic[4];     ///< MBSC
+        uint32_t version;
+        uint64_t count;    ///< number of balls
+        uint32_t flags;    ///< see Flags
+        float width;       ///< bounds the scene was saved with
+        float height;
+        float minX;        ///< quantized positions cover [min, min + range]
+        float minY;
+        float rangeX;
+        float rangeY;
+        float maxSize;     ///< quantized sizes cover [0, maxSize]
+        float maxSpeed;    ///< quantized velocities cover +-maxSpeed
+        uint8_t padding[12];
+    } Header;
+
+    typedef enum { Quantized = 1 } Flags;
+
+    SceneFile(const std::string& path);
+    ~SceneFile();
+
+    SceneFile(const SceneFile& other) = delete;
+    SceneFile& operator=(const SceneFile& other) = delete;
+
+    size_t count() const;
+    bool quantized() const;
+    float width() const;
+    float height() const;
+    void load(BallSystem& balls) const;
+
+    static void save(const std::string& path, const BallSystem& balls,
+                     float width, float height, bool quantize);
+    static size_t fileSize(size_t count, bool quantize);
+
+    static const char s_magic[4];
+    static const uint32_t s_version;
+
+private:
+    std::string m_path;
+    const uint8_t* m_data;
+    size_t m_size;
+    Header m_header;
+#ifdef UNIX
+    void* m_map;
+#else
+    std::vector<uint8_t> m_buffer;
+#endif
+
+    void checkHeader();
+    void unmap();
+};
+
+#endif /* SCENE_FILE_H */
@@ -0,0 +1,54 @@
+#ifndef SCENE_GENERATOR_H
+#define SCENE_GENERATOR_H
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+#include "BallSystem.h"
+
+/** Builds scenes with known statistics, for benchmarks
+ *  @namespace SceneGenerator
+ *
+ *  Every ball member is drawn from its own CounterRNG stream, indexed by
+ *  the ball, so a scene depends only on its settings and seed and is
+ *  generated on the job system in any order.
+ *
+ *  Ball radii are scaled so the balls together cover a set fraction of the
+ *  field, which is how much they overlap on average, and spread the
+ *  smallest to the largest by a set ratio:
+ *  - Uniform places balls anywhere, with log-uniform radii
+ *  - Clustered gathers them in gaussian clumps around random centers
+ *  - PowerLaw places them anywhere with pareto radii, many tiny balls and a
+ *    few huge ones
+ *  - Grid lines equal balls up in rows, so the overlap is exact
+ *  - Ring spaces them evenly around a circle in the middle of the field
+ */
+namespace SceneGenerator {
+
+    typedef enum { Uniform, Clustered, PowerLaw, Grid, Ring } Distribution;
+
+    typedef struct {
+        Distribution distribution;
+        size_t count;
+        uint64_t seed;
+        float width;     ///< size of the field the balls are placed in
+        float height;
+        float coverage;  ///< total ball area over the field's area
+        float spread;    ///< largest radius over the smallest
+        float speed;     ///< the fastest a ball starts moving
+    } Settings;
+
+    Settings defaults();
+    bool parseDistribution(const std::string& name,
+                           Distribution& distribution);
+    const char* name(Distribution distribution);
+
+    void generate(const Settings& settings, BallSystem& balls);
+
+    std::string describe(const Settings& settings);
+    bool parse(const std::string& description, Settings& settings);
+
+}  // namespace SceneGenerator
+
+#endif /* SCENE_GENERATOR_H */
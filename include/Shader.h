@@ -1,3 +1,6 @@
+#ifndef SHADER_H
+#define SHADER_H
+
 #include <cstdarg>
 #include <fstream>
 #include <initializer_list>
@@ -109,4 +112,6 @@ namespace Shader {
         void dispatchIndirect(GLintptr indirect);
     };
 
-};  // namespace Shader
\ No newline at end of file
+};  // namespace Shader
+
+#endif /* SHADER_H */
@@ -0,0 +1,93 @@
+#ifndef SHADER_MANIFEST_H
+#define SHADER_MANIFEST_H
+
+#include <fstream>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include "Shader.h"
+
+namespace Shader {
+
+    /// Type of a manifest parameter, determines the GUI widget and uniform
+    typedef enum {
+        FloatParam,  ///< slider, uploaded with glUniform1f
+        BoolParam    ///< checkbox, uploaded with glUniform1i
+    } ParameterType;
+
+    /** A single user adjustable shader parameter
+     *  @struct Parameter
+     */
+    typedef struct {
+        ParameterType type;
+        std::string uniform;  ///< uniform name inside of the shader
+        std::string label;    ///< label shown in the GUI
+        float min;
+        float max;
+        float value;        ///< current value, bools are stored as 0/1
+        bool reciprocal;    ///< upload 1/value instead of value
+        bool sameLine;      ///< draw on the same GUI line as the previous one
+        GLint location;     ///< uniform location, filled once built
+    } Parameter;
+
+    /// Returns the value a parameter's uniform is set to
+    inline float uniformValue(const Parameter& param) {
+        return param.reciprocal ? 1.0f / param.value : param.value;
+    }
+
+    /** Description of a selectable compute program
+     *  @struct ProgramEntry
+     *
+     *  @note The program itself is only built the first time it is requested
+     */
+    typedef struct {
+        std::string id;    ///< section name in the manifest
+        std::string name;  ///< display name
+        std::string file;  ///< GLSL source, SPIR-V binaries use file + ".spv"
+        std::vector<std::string> backends;
+        std::vector<Parameter> params;
+        bool fieldTree;    ///< reads the balls' FieldTree at bindings 3 and 4
+        int maxError;      ///< largest channel error against a golden image
+        float minPSNR;     ///< lowest PSNR against a golden image, in dB
+        float maxOutliers;  ///< fraction of pixels allowed past maxError
+        ComputeProgram* program;
+    } ProgramEntry;
+
+    /** Loads the list of selectable shaders from a manifest file
+     *  @class Manifest
+     *
+     *  The manifest is a plain text file made of [section] blocks,
+     *  see shaders/shaders.manifest for the format.
+     */
+    class Manifest {
+    public:
+        Manifest();
+        ~Manifest();
+
+        Manifest(const Manifest& other) = delete;
+        Manifest& operator=(const Manifest& other) = delete;
+
+        void load(const std::string& filename);
+
+        size_t size() const;
+        size_t defaultProgram() const;
+        ProgramEntry& operator[](size_t index);
+        std::vector<ProgramEntry>& programs();
+
+        bool supports(size_t index, const std::string& backend) const;
+        void release();
+
+    private:
+        std::vector<ProgramEntry> m_programs;
+        size_t m_default;
+
+        static Parameter parseParameter(ParameterType type,
+                                        const std::string& value,
+                                        size_t lineNumber);
+    };
+
+};  // namespace Shader
+
+#endif /* SHADER_MANIFEST_H */
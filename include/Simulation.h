@@ -0,0 +1,153 @@
+#ifndef SIMULATION_H
+#define SIMULATION_H
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+
+#include "BallSystem.h"
+#include "BarnesHut.h"
+#include "CollisionGrid.h"
+#include "SPSCQueue.h"
+#include "TripleBuffer.h"
+
+typedef std::chrono::steady_clock::time_point simTimePoint;
+
+class Recorder;
+
+/** Immutable copy of the simulation handed to the renderer
+ *  @struct BallSnapshot
+ */
+typedef struct {
+    BallSystem balls;        ///< current and previous tick positions
+    simTimePoint tickTime;   ///< when the newest tick was due
+    double tickLength = 0;   ///< seconds per tick, 0 before the first tick
+    uint64_t tick = 0;       ///< ticks run so far
+    uint64_t commands = 0;   ///< commands applied so far
+} BallSnapshot;
+
+/** Fixed timestep ball simulation
+ *  @class Simulation
+ *
+ *  Either runs on its own thread once start() is called, or is advanced
+ *  from the calling thread with advance(). After each batch of ticks the
+ *  balls are published as a BallSnapshot through a triple buffer, and every
+ *  change from the GUI is sent as a command over a queue, so the renderer
+ *  never touches the balls being simulated.
+ *
+ *  @note The setters and snapshot() must be called from one thread, the
+ * one that renders
+ */
+class Simulation {
+public:
+    /// Changes sent to the simulation, replays send recorded ones as is
+    typedef enum {
+        PushBall,
+        PopBall,
+        SetBall,
+        SetBounds,
+        SetWiggly,
+        SetCollisions,
+        SetGravity,
+        SetIntegrator,
+        SetTickRate,
+        SetPaused
+    } CommandType;
+
+    typedef struct {
+        CommandType type;
+        size_t index;   ///< SetBall
+        Ball ball;      ///< PushBall and SetBall
+        double value;   ///< width, angle, strength, method, tick rate
+        double value2;  ///< height, theta, drag, substeps
+        bool flag;      ///< switches a movement mode or pausing on or off
+    } Command;
+
+    Simulation(uint64_t seed = 0);
+    ~Simulation();
+
+    Simulation(const Simulation& other) = delete;
+    Simulation& operator=(const Simulation& other) = delete;
+
+    void start();
+    void stop();
+    bool threaded() const;
+    void advance(double elapsed);
+    void advanceTicks(uint64_t ticks);
+
+    const BallSnapshot& snapshot();
+    static float alpha(const BallSnapshot& snapshot);
+
+    // commands, applied before the next tick
+    void pushBall(const Ball& ball);
+    void popBall();
+    void setBall(size_t index, const Ball& ball);
+    void setBounds(float width, float height);
+    void setWiggly(bool wiggly, float angle);
+    void setCollisions(bool collisions);
+    void setGravity(bool gravity, float strength, float theta);
+    void setIntegrator(IntegratorMethod method, float drag);
+    void setTickRate(double hz, int substeps);
+    void setPaused(bool paused);
+    void loadBalls(BallSystem& balls);
+
+    // record and replay, see Recorder
+    void setRecorder(Recorder* recorder);
+    void replay(const Command& command);
+    void discardCommands();
+
+private:
+    static const double s_referenceHz;  // rate velocities are measured at
+    static const double s_maxBacklog;   // most seconds advance will catch up
+    static const size_t s_grain;        // balls per update job
+
+    // simulation state, owned by whichever thread advances
+    BallSystem m_balls;
+    CollisionGrid m_collisionGrid;
+    BarnesHut m_barnesHut;
+    float m_width;
+    float m_height;
+    bool m_wiggly;
+    float m_wiggleAngle;
+    bool m_collisions;
+    bool m_gravity;
+    float m_gravityStrength;
+    float m_theta;
+    IntegratorMethod m_integrator;
+    float m_drag;
+    AlignedVector<float> m_accX;  ///< pull between the balls, if enabled
+    AlignedVector<float> m_accY;
+    double m_tickRate;
+    int m_substeps;
+    bool m_paused;          ///< no ticks run, commands are still applied
+    double m_accumulator;
+    uint64_t m_seed;
+    uint64_t m_frame;
+    uint64_t m_tick;
+    uint64_t m_applied;     ///< commands applied so far
+    Recorder* m_recorder;   ///< logs every command as it's applied
+
+    // hand over between the threads
+    SPSCQueue<Command, 1024> m_commands;
+    TripleBuffer<BallSnapshot> m_snapshots;
+    std::thread m_thread;
+    std::atomic<bool> m_running;
+    std::mutex m_wakeMutex;  // a paused thread sleeps until a command
+    std::condition_variable m_wake;
+
+    // caller side copy of the last bounds sent
+    float m_sentWidth;
+    float m_sentHeight;
+
+    void send(const Command& command);
+    bool applyCommands();
+    void step();
+    void kick(size_t first, size_t last, const float* accX,
+              const float* accY, float dt);
+    void publish();
+    void run();
+};
+
+#endif /* SIMULATION_H */
@@ -0,0 +1,75 @@
+#ifndef VIDEO_STREAM_H
+#define VIDEO_STREAM_H
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <cstdio>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+/** Writes frames to a file or pipe as YUV4MPEG2 or raw RGBA video
+ *  @class VideoStream
+ *
+ *  push() converts a frame into a ring of output buffers on the calling
+ *  thread (split over the job system) and a writer thread sends them out,
+ *  so a slow consumer only holds up the writer. Once every buffer is
+ *  queued, push() either waits for the writer or drops the frame.
+ *
+ *  Y4M frames are 4:2:0 with full range BT.601 colors (C420jpeg), which
+ *  ffmpeg and x264 read straight from a pipe.
+ *
+ *  @note The stream stops for good if a write fails, e.g. when the reading
+ * end of a pipe is closed, see good()
+ */
+class VideoStream {
+public:
+    typedef enum { Y4M, RGBA } Format;
+
+    VideoStream(Format format, FILE* out, int width, int height, double fps,
+                bool drop, size_t depth = 4);
+    ~VideoStream();
+
+    VideoStream(const VideoStream& other) = delete;
+    VideoStream& operator=(const VideoStream& other) = delete;
+
+    bool push(const uint8_t* rgba);
+    void finish();
+
+    bool good() const;
+    size_t sent() const;
+    size_t dropped() const;
+
+    static bool parseFormat(const std::string& name, Format& format);
+    static size_t frameSize(Format format, int width, int height);
+    static void toYUV420(const uint8_t* rgba, int width, int height,
+                         uint8_t* yuv);
+
+private:
+    Format m_format;
+    FILE* m_out;
+    int m_width;
+    int m_height;
+    double m_fps;
+    bool m_drop;
+    size_t m_sent;
+    size_t m_dropped;
+
+    // ring of converted frames, filled by push() and emptied by the writer
+    std::vector<std::vector<uint8_t>> m_frames;
+    size_t m_head;    ///< next frame to fill
+    size_t m_tail;    ///< next frame to write
+    size_t m_queued;  ///< frames waiting for the writer
+    bool m_stop;
+    std::atomic<bool> m_good;
+    std::mutex m_mutex;
+    std::condition_variable m_filled;
+    std::condition_variable m_freed;
+    std::thread m_thread;
+
+    void run();
+};
+
+#endif /* VIDEO_STREAM_H */
@@ -8,6 +8,11 @@
 #include "CMDParser.h"
 #include "TermFormatter.hpp"
 
+//Threading
+#include "JobSystem.h"
+#include "SPSCQueue.h"
+#include "TripleBuffer.h"
+
 //Graphics
 #include "GUIWindow.h" //includes Window.h and ImGui headers. Links w/ SDL2, OpenGL, and GLEW
 #include "EventHandler.h" //Links w/ SDL2
@@ -0,0 +1,134 @@
+#ifndef BENCHMARK_H
+#define BENCHMARK_H
+
+#include <algorithm>
+#include <chrono>
+#include <cstddef>
+#include <ostream>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "PerfCounters.h"
+
+/** Times small pieces of code and reports robust statistics
+ *  @class Benchmark
+ *
+ *  Each case is run for a few warmup calls, which also decide how many calls
+ *  make up one sample so that even tiny cases are timed over at least the
+ *  minimum sample time, then for a number of timed samples. Cases report
+ *  the median and the median absolute deviation of their samples, which
+ *  ignore the odd sample lost to the scheduler, rather than the mean and
+ *  standard deviation.
+ *
+ *  While PerfCounters are on, the timed samples of each case are counted
+ *  too, and reported as instructions per cycle and cycles and misses per
+ *  item.
+ *
+ *  @note Code that runs asynchronously, like GPU work, must wait for itself
+ * inside the timed function
+ */
+class Benchmark {
+public:
+    /// Named numbers describing a case, ex. the ball count
+    typedef std::vector<std::pair<std::string, double>> Params;
+
+    typedef struct {
+        std::string name;
+        Params params;
+        double items;       ///< work done per call, for the throughput
+        size_t iterations;  ///< calls per sample
+        std::vector<double> samples;  ///< seconds per call
+        double median;
+        double mad;
+        double min;
+        Params counters;  ///< IPC and counts per item, if PerfCounters are on
+    } Result;
+
+    Benchmark(size_t warmup = 2, size_t repetitions = 10,
+              double minSampleTime = 0.005);
+
+    void setFilter(const std::string& filter);
+    bool selected(const std::string& name) const;
+
+    /** Times a case, if the filter selects it
+     *  @param name The name of the case, groups are separated by /
+     *  @param params Numbers describing the case
+     *  @param items Work done per call, ex. pixels or balls
+     *  @param fn The code to time, called with no arguments
+     *  @return The result, or nullptr if the case was filtered out
+     */
+    template <typename F>
+    const Result* run(const std::string& name, const Params& params,
+                      double items, const F& fn) {
+        if (!selected(name)) {
+            return nullptr;
+        }
+        // the slowest warmup call decides how many calls fill a sample
+        double slowest = 0;
+        for (size_t i = 0; i < std::max<size_t>(m_warmup, 1); i++) {
+            slowest = std::max(slowest, time(fn, 1));
+        }
+        size_t iterations = 1;
+        if (slowest < m_minSampleTime) {
+            iterations = (size_t)(m_minSampleTime / std::max(slowest, 1e-9));
+        }
+
+        Result result;
+        result.name = name;
+        result.params = params;
+        result.items = items;
+        result.iterations = iterations;
+        bool counting = PerfCounters::enabled();
+        PerfCounters::Reading start = {};
+        if (counting) {
+            start = PerfCounters::read();
+        }
+        for (size_t i = 0; i < m_repetitions; i++) {
+            result.samples.push_back(time(fn, iterations) / iterations);
+        }
+        if (counting) {
+            perItem(result, PerfCounters::difference(PerfCounters::read(),
+                                                     start));
+        }
+        summarize(result);
+        m_results.push_back(result);
+        report(m_results.back());
+        return &m_results.back();
+    }
+
+    void skip(const std::string& name, const Params& params,
+              const std::string& reason);
+
+    void setContext(const std::string& key, const std::string& value);
+    const std::vector<Result>& results() const;
+    void writeJSON(std::ostream& out) const;
+
+    static double median(std::vector<double> values);
+    static void summarize(Result& result);
+
+private:
+    size_t m_warmup;
+    size_t m_repetitions;
+    double m_minSampleTime;
+    std::string m_filter;
+    std::vector<Result> m_results;
+    /// describes the machine and build, written at the top of the JSON
+    std::vector<std::pair<std::string, std::string>> m_context;
+
+    template <typename F>
+    static double time(const F& fn, size_t iterations) {
+        auto start = std::chrono::steady_clock::now();
+        for (size_t i = 0; i < iterations; i++) {
+            fn();
+        }
+        std::chrono::duration<double> elapsed =
+            std::chrono::steady_clock::now() - start;
+        return elapsed.count();
+    }
+
+    static void perItem(Result& result, const PerfCounters::Reading& delta);
+    void report(const Result& result) const;
+};
+
+#endif /* BENCHMARK_H */
@@ -89,6 +89,9 @@ public:
 
     // poll the event queue and process accordingly
     void poll();
+
+    // sleep until an event arrives, without taking it off the queue
+    bool wait(int timeout);
 };
 
 #endif /* EVENT_HANDLER_H */
\ No newline at end of file
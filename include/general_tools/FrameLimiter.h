@@ -0,0 +1,37 @@
+#ifndef FRAME_LIMITER_H
+#define FRAME_LIMITER_H
+
+#include <chrono>
+
+/** Paces a loop to a fixed frame rate
+ *  @class FrameLimiter
+ *
+ *  wait() returns at the start of each frame's period. Frames start on a
+ *  fixed grid, a multiple of the period from the first one, so a frame that
+ *  runs a little long doesn't push every later frame back. A frame that
+ *  misses whole periods skips them rather than rushing to catch up.
+ *
+ *  Sleeping is only accurate to a scheduler tick, so wait() sleeps until
+ *  shortly before the deadline and spins for the rest, which costs up to
+ *  the spin time of a core each frame.
+ */
+class FrameLimiter {
+public:
+    typedef std::chrono::steady_clock clock;
+
+    FrameLimiter(double fps = 0,
+                 clock::duration spin = std::chrono::microseconds(300));
+
+    void setRate(double fps);
+    double rate() const;
+    void wait();
+
+private:
+    double m_fps;               ///< 0 when uncapped
+    clock::duration m_period;
+    clock::duration m_spin;     ///< spun rather than slept before a deadline
+    clock::time_point m_next;   ///< when the next frame starts
+    bool m_started;
+};
+
+#endif /* FRAME_LIMITER_H */
@@ -35,6 +35,9 @@ public:
     void setGUIParams(void* params);
     void drawGUI();
 
+    // also resizes ImGui's display, which has no SDL2 backend when headless
+    void resize(size_t height, size_t width);
+
     // helper functions for abstracting the draw function
     static void NewFrame(SDL_Window* window);
     static void RenderFrame();
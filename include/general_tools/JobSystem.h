@@ -0,0 +1,139 @@
+#ifndef JOB_SYSTEM_H
+#define JOB_SYSTEM_H
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+#include <new>
+#include <stdexcept>
+#include <thread>
+#include <type_traits>
+#include <vector>
+
+/** Work-stealing job system
+ *  @class JobSystem
+ *
+ *  Starts a fixed set of worker threads once, each with its own job pool and
+ *  lock-free deque. Threads push and pop work on their own deque and steal
+ *  from the others when they run dry. Jobs can have a parent, which is only
+ *  finished once all of its children are, and continuations, which are only
+ *  scheduled once every job they depend on has finished.
+ *
+ *  @note Jobs come from a per-thread ring, a thread may have at most
+ * PoolSize jobs in flight, create() skips slots that are still in use and
+ * throws once none are left
+ *  @note Threads other than the workers each claim one of ExtraThreads
+ * slots the first time they schedule a job, and give it back when they
+ * exit. Past that many at once, the rest run their jobs serially.
+ *  @note Without init() every call runs serially on the calling thread
+ */
+class JobSystem {
+public:
+    static constexpr size_t PoolSize = 4096;  ///< jobs per thread, power of 2
+    static constexpr size_t JobDataSize = 64;  ///< bytes of inline job data
+    static constexpr size_t MaxContinuations = 6;
+    static constexpr size_t ExtraThreads = 8;  ///< non-worker thread slots
+
+    struct Job;
+    typedef void (*JobFunction)(Job*, void*);
+
+    /// A unit of work, padded to two cache lines to avoid false sharing
+    struct alignas(128) Job {
+        JobFunction function;
+        Job* parent;
+        std::atomic<int32_t> unfinished;  ///< this job plus its children
+        std::atomic<int32_t> pending;     ///< run() plus unmet dependencies
+        int32_t numContinuations;
+        Job* continuations[MaxContinuations];
+        alignas(16) unsigned char data[JobDataSize];
+    };
+
+    static void init(size_t numThreads = 0);
+    static void shutdown();
+    static bool initialized();
+    static size_t threadCount();
+
+    static Job* create(JobFunction function, Job* parent = nullptr,
+                       const void* data = nullptr, size_t dataSize = 0);
+    static void addDependency(Job* job, Job* prerequisite);
+    static void run(Job* job);
+    static void wait(Job* job);
+    static bool isFinished(const Job* job);
+
+    /** Creates a job from a callable
+     *  @param fn Called with no arguments, it's copied into the job so it
+     * must fit in JobDataSize and be trivially destructible
+     *  @param parent Optional job that won't finish until this one does
+     */
+    template <typename F>
+    static Job* create(F fn, Job* parent = nullptr) {
+        static_assert(sizeof(F) <= JobDataSize,
+                      "Job lambda captures too much, capture pointers");
+        static_assert(std::is_trivially_destructible<F>::value,
+                      "Job lambdas must be trivially destructible");
+        Job* job = create(&callLambda<F>, parent);
+        new (job->data) F(fn);
+        return job;
+    }
+
+    /** Calls fn(begin, end) over [first, last) split into parallel chunks
+     *  @param first The first index of the range
+     *  @param last One past the last index
+     *  @param grain The smallest chunk handed to a single call of fn
+     *  @param fn Callable taking (size_t begin, size_t end)
+     *
+     *  @note Blocks until the whole range is done, the calling thread helps
+     */
+    template <typename F>
+    static void parallelFor(size_t first, size_t last, size_t grain,
+                            const F& fn) {
+        if (first >= last) {
+            return;
+        }
+        grain = std::max<size_t>(grain, 1);
+        // keep the number of chunks within the job pool
+        grain = std::max(grain, (last - first) / (PoolSize / 4) + 1);
+        if (last - first <= grain || !canSchedule()) {
+            fn(first, last);
+            return;
+        }
+        Range<F> range = {&fn, first, last, grain};
+        Job* root = create(&splitRange<F>, nullptr, &range, sizeof(range));
+        run(root);
+        wait(root);
+    }
+
+private:
+    template <typename F>
+    struct Range {
+        const F* fn;
+        size_t first;
+        size_t last;
+        size_t grain;
+    };
+
+    template <typename F>
+    static void callLambda(Job*, void* data) {
+        (*(F*)data)();
+    }
+
+    /// Splits off the upper half as a new job until the range fits the grain
+    template <typename F>
+    static void splitRange(Job* job, void* data) {
+        Range<F> range = *(Range<F>*)data;
+        while (range.last - range.first > range.grain) {
+            size_t mid = range.first + (range.last - range.first) / 2;
+            Range<F> upper = {range.fn, mid, range.last, range.grain};
+            run(create(&splitRange<F>, job, &upper, sizeof(upper)));
+            range.last = mid;
+        }
+        (*range.fn)(range.first, range.last);
+    }
+
+    static bool canSchedule();
+};
+
+#endif /* JOB_SYSTEM_H */
@@ -0,0 +1,103 @@
+#ifndef PERF_COUNTERS_H
+#define PERF_COUNTERS_H
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+/** Hardware performance counters around hot paths, through perf_event_open
+ *  @class PerfCounters
+ *
+ *  start() opens cycles, instructions, L1 data cache misses, last level
+ *  cache misses and branch misses for the whole process. The counters are
+ *  inherited by threads created afterwards, so start it before the job
+ *  system and the simulation thread and work spread over the workers is
+ *  counted too. Counters the CPU or kernel doesn't offer are left out and
+ *  read as zero, and if none open at all every Scope does nothing.
+ *
+ *  A Scope adds what was counted while it was open to a Section, along with
+ *  the number of items (balls, pixels) it processed, so sections report
+ *  instructions per cycle and misses per item rather than raw counts.
+ *
+ *  @note The counters are process wide, so a scope also counts whatever
+ * other threads ran at the same time. Run the simulation on the main thread
+ * for clean numbers, as metaballs_bench does.
+ *  @note Each counter is read with a system call, a Scope costs a few
+ * microseconds and should only wrap coarse work
+ */
+class PerfCounters {
+public:
+    typedef enum {
+        Cycles,
+        Instructions,
+        L1Misses,
+        LLCMisses,
+        BranchMisses,
+        Counters
+    } Counter;
+
+    typedef struct {
+        uint64_t counts[Counters];
+    } Reading;
+
+    /// Counts summed over every Scope of one part of the program
+    class Section {
+    public:
+        Section(const char* name, const char* item);
+
+        Section(const Section& other) = delete;
+        Section& operator=(const Section& other) = delete;
+
+        void add(const Reading& delta, uint64_t items);
+        void reset();
+
+        const char* name() const;
+        const char* item() const;  ///< what items are, "ball" or "pixel"
+        uint64_t calls() const;
+        uint64_t items() const;
+        Reading totals() const;
+
+    private:
+        const char* m_name;
+        const char* m_item;
+        std::atomic<uint64_t> m_calls;
+        std::atomic<uint64_t> m_items;
+        std::atomic<uint64_t> m_counts[Counters];
+    };
+
+    /// Counts the rest of the enclosing scope into a Section
+    class Scope {
+    public:
+        Scope(Section& section, uint64_t items = 0);
+        ~Scope();
+
+        Scope(const Scope& other) = delete;
+        Scope& operator=(const Scope& other) = delete;
+
+    private:
+        Section* m_section;  ///< nullptr when the counters are off
+        uint64_t m_items;
+        Reading m_start;
+    };
+
+    static bool start();
+    static bool enabled();
+    static bool available(Counter counter);
+    static const std::string& status();
+    static const char* name(Counter counter);
+    static Reading read();
+    static Reading difference(const Reading& end, const Reading& start);
+
+    static const std::vector<Section*>& sections();
+
+private:
+    static std::atomic<bool> s_enabled;
+    static int s_files[Counters];  ///< -1 for counters that didn't open
+    static std::string s_status;
+
+    static std::vector<Section*>& registry();
+};
+
+#endif /* PERF_COUNTERS_H */
@@ -0,0 +1,110 @@
+#ifndef PROFILER_H
+#define PROFILER_H
+
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+/** Hierarchical scope profiler, exported as a Chrome trace
+ *  @class Profiler
+ *
+ *  PROFILE_SCOPE("name") times the rest of the enclosing scope. Names must
+ *  be string literals: the event keeps the pointer, along with an ID hashed
+ *  from the name at compile time for grouping, so timing a scope is two
+ *  clock reads and a store. Scopes nest, each thread tracks its own depth.
+ *
+ *  Every thread writes into its own ring of events, the newest ones are
+ *  kept once it fills. Writers never lock: an event is stored and then
+ *  published by bumping the ring's atomic count. Only a thread's first
+ *  event takes a lock, to register its ring.
+ *
+ *  writeChromeTrace() saves the events in Chrome's trace_event JSON, which
+ *  loads in Perfetto (ui.perfetto.dev) or chrome://tracing.
+ *
+ *  @note The macros compile to nothing unless METABALLS_PROFILE is defined,
+ * and record nothing until start() is called
+ *  @note Write the trace once the threads are idle, a ring being written
+ * to while it's copied out may lose its oldest events
+ */
+class Profiler {
+public:
+    /// A finished scope
+    typedef struct {
+        const char* name;
+        uint32_t id;     ///< hash of the name
+        uint32_t depth;  ///< scopes open around it on its thread
+        int64_t start;   ///< nanoseconds since the profiler's epoch
+        int64_t end;
+    } Event;
+
+    /// Times one scope, see PROFILE_SCOPE
+    class Scope {
+    public:
+        Scope(const char* name, uint32_t id) {
+            if (s_enabled.load(std::memory_order_relaxed)) {
+                begin(name, id);
+            } else {
+                m_name = nullptr;
+            }
+        }
+        ~Scope() {
+            if (m_name) {
+                end();
+            }
+        }
+
+        Scope(const Scope& other) = delete;
+        Scope& operator=(const Scope& other) = delete;
+
+    private:
+        const char* m_name;
+        uint32_t m_id;
+        int64_t m_start;
+
+        void begin(const char* name, uint32_t id);
+        void end();
+    };
+
+    /// FNV-1a, evaluated by the compiler for literal names
+    static constexpr uint32_t hash(const char* name,
+                                   uint32_t value = 2166136261u) {
+        return *name ? hash(name + 1, (value ^ (uint8_t)*name) * 16777619u)
+                     : value;
+    }
+
+    static void start(size_t eventsPerThread = 1 << 16);
+    static void stop();
+    static bool enabled();
+    static void setThreadName(const char* name);
+    static int64_t now();
+
+    static size_t eventCount();
+    static void writeChromeTrace(const std::string& path);
+
+private:
+    static std::atomic<bool> s_enabled;
+    static size_t s_capacity;
+    static std::chrono::steady_clock::time_point s_epoch;
+};
+
+#define PROFILER_CONCAT_(a, b) a##b
+#define PROFILER_CONCAT(a, b) PROFILER_CONCAT_(a, b)
+
+#ifdef METABALLS_PROFILE
+/// Times the rest of the enclosing scope, name must be a string literal
+#define PROFILE_SCOPE(name)                                                \
+    constexpr uint32_t PROFILER_CONCAT(profileId_, __LINE__) =             \
+        Profiler::hash(name);                                              \
+    Profiler::Scope PROFILER_CONCAT(profileScope_, __LINE__)(              \
+        name, PROFILER_CONCAT(profileId_, __LINE__))
+/// Names the calling thread in the trace, name must be a string literal
+#define PROFILE_THREAD(name) Profiler::setThreadName(name)
+#else
+#define PROFILE_SCOPE(name) ((void)0)
+#define PROFILE_THREAD(name) ((void)0)
+#endif
+
+#endif /* PROFILER_H */
@@ -0,0 +1,57 @@
+#ifndef SPSC_QUEUE_H
+#define SPSC_QUEUE_H
+
+#include <atomic>
+#include <cstddef>
+
+/** Bounded lock-free single producer, single consumer queue
+ *  @class SPSCQueue
+ *
+ *  @note Capacity must be a power of 2
+ */
+template <typename T, size_t Capacity>
+class SPSCQueue {
+    static_assert((Capacity & (Capacity - 1)) == 0 && Capacity > 0,
+                  "SPSCQueue capacity must be a power of 2");
+
+public:
+    SPSCQueue() : m_head(0), m_tail(0) {}
+
+    SPSCQueue(const SPSCQueue& other) = delete;
+    SPSCQueue& operator=(const SPSCQueue& other) = delete;
+
+    /// Producer only, returns false if the queue is full
+    bool push(const T& item) {
+        size_t head = m_head.load(std::memory_order_relaxed);
+        if (head - m_tail.load(std::memory_order_acquire) == Capacity) {
+            return false;
+        }
+        m_items[head & (Capacity - 1)] = item;
+        m_head.store(head + 1, std::memory_order_release);
+        return true;
+    }
+
+    /// Consumer only, returns false if the queue is empty
+    bool pop(T& item) {
+        size_t tail = m_tail.load(std::memory_order_relaxed);
+        if (tail == m_head.load(std::memory_order_acquire)) {
+            return false;
+        }
+        item = m_items[tail & (Capacity - 1)];
+        m_tail.store(tail + 1, std::memory_order_release);
+        return true;
+    }
+
+    /// Consumer only, returns whether there's nothing to pop
+    bool empty() const {
+        return m_tail.load(std::memory_order_relaxed) ==
+               m_head.load(std::memory_order_acquire);
+    }
+
+private:
+    alignas(64) std::atomic<size_t> m_head;  ///< next slot to write
+    alignas(64) std::atomic<size_t> m_tail;  ///< next slot to read
+    alignas(64) T m_items[Capacity];
+};
+
+#endif /* SPSC_QUEUE_H */
@@ -6,6 +6,7 @@
 #include <fstream>
 #include <iomanip>
 #include <iostream>
+#include <mutex>
 #include <string>
 #include <thread>
 #include <vector>
@@ -25,15 +26,16 @@ namespace Timers {
 
     /// Timer scope struct
     typedef struct {
-        std::string m_scopeName;     ///< The name given to the time
-        long long* m_executionTime;  ///< How long the timer was active
+        std::string m_scopeName;    ///< The name given to the time
+        long long m_executionTime;  ///< How long the timer was active
     } timerScope;
 
-    static std::vector<timerScope>
-        named_timers;  ///< Vector of named scope timer execution times
-    static std::string out_file = "";  ///< File for storing a timer log
-    static bool toScreen =
-        false;  ///< Whether or not timers should be logged to the console
+    extern std::vector<timerScope>
+        named_timers;  ///< Named scope timer execution times, by end time
+    extern std::mutex named_timers_mutex;  ///< Guards named_timers
+    extern std::string out_file;  ///< File for storing a timer log
+    extern bool toScreen;  ///< Whether or not timers should be logged to the
+                           ///< console
 }  // namespace Timers
 
 /** Timer class
@@ -83,6 +85,7 @@ public:
 private:
     hresClockTimePoint m_initialTime;
     long long* m_out;  ///< Storage location for length timer was active
+    std::string m_scopeName;  ///< Logged to Timers::named_timers if set
 };
 
 #endif /* TIMER_H */
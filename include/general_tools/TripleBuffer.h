@@ -0,0 +1,60 @@
+#ifndef TRIPLE_BUFFER_H
+#define TRIPLE_BUFFER_H
+
+#include <atomic>
+#include <cstdint>
+
+/** Lock-free triple buffer for handing the latest value between two threads
+ *  @class TripleBuffer
+ *
+ *  The writer fills writeBuffer() and publishes it, the reader calls
+ *  update() and reads readBuffer(). Neither side ever waits, the reader
+ *  always gets the newest published value and older ones are dropped.
+ *
+ *  @note Exactly one writer thread and one reader thread
+ */
+template <typename T>
+class TripleBuffer {
+public:
+    TripleBuffer() : m_middle(1), m_write(0), m_read(2) {}
+
+    TripleBuffer(const TripleBuffer& other) = delete;
+    TripleBuffer& operator=(const TripleBuffer& other) = delete;
+
+    /// Writer only, the buffer to fill before publish()
+    T& writeBuffer() { return m_buffers[m_write]; }
+
+    /// Writer only, hands the filled buffer to the reader
+    void publish() {
+        uint8_t previous =
+            m_middle.exchange(m_write | DirtyBit, std::memory_order_acq_rel);
+        m_write = previous & IndexMask;
+    }
+
+    /** Reader only, swaps in the newest published buffer
+     *  @return Whether a new buffer was published since the last update
+     */
+    bool update() {
+        if (!(m_middle.load(std::memory_order_relaxed) & DirtyBit)) {
+            return false;
+        }
+        uint8_t previous =
+            m_middle.exchange(m_read, std::memory_order_acq_rel);
+        m_read = previous & IndexMask;
+        return true;
+    }
+
+    /// Reader only, the buffer picked up by the last update()
+    const T& readBuffer() const { return m_buffers[m_read]; }
+
+private:
+    static constexpr uint8_t IndexMask = 0x3;
+    static constexpr uint8_t DirtyBit = 0x4;
+
+    T m_buffers[3];
+    alignas(64) std::atomic<uint8_t> m_middle;  ///< spare index + dirty bit
+    alignas(64) uint8_t m_write;                ///< owned by the writer
+    alignas(64) uint8_t m_read;                 ///< owned by the reader
+};
+
+#endif /* TRIPLE_BUFFER_H */
@@ -15,6 +15,9 @@
  *
  *  @note Requires OpenGL 4.3+ and SDL2
  *  @note Cannot be copied, move semantics only
+ *  @note After setHeadless(true) windows are created without a display: the
+ * context comes from EGL and everything is drawn into a framebuffer object
+ * of the window's size, which stays bound as the draw target
  */
 class Window {
 public:
@@ -30,6 +33,8 @@ public:
     Window& operator=(const Window& other) = delete;
 
     void swap();
+    int setSwapInterval(int interval);
+    int getSwapInterval() const;
     void focus();
     void hide();
     void show();
@@ -39,6 +44,7 @@ public:
 
     SDL_Window* getWindow();
     SDL_GLContext& getContext();
+    GLuint getFramebuffer() const;
 
     void resize(size_t height, size_t width);
     size_t getHeight() const;
@@ -47,6 +53,7 @@ public:
     bool isShown() const;
     bool isHidden() const;
     bool isMinimized() const;
+    bool hasFocus() const;
 
     // functions to make drawing look a tad cleaner
     void setDrawFunc(const std::function<void(void*)>& drawFunctor);
@@ -59,6 +66,10 @@ public:
         return SDL_WINDOW_OPENGL | SDL_WINDOW_SHOWN | SDL_WINDOW_RESIZABLE;
     }
 
+    // offscreen rendering, must be picked before the first window is made
+    static void setHeadless(bool headless);
+    static bool isHeadless();
+
     // directly pass window to SDL functions
     operator SDL_Window*();
 
@@ -77,14 +88,26 @@ private:
     bool m_shown;
     bool m_minimized;
     bool m_hidden;
+    bool m_focused;
+
+    int m_swapInterval;  ///< vertical blanks each swap waits for, -1 adaptive
 
     // Stored function and params for drawing into the window
     std::function<void(void*)> m_drawFunc;
     void* m_drawParams;
 
+    // Headless context and its render target, EGL types are kept opaque
+    void* m_eglDisplay;
+    void* m_eglContext;
+    GLuint m_framebuffer;
+    GLuint m_colorbuffer;
+    void createHeadlessContext();
+    void createFramebuffer();
+
     // Static variables for tracking global window status
     static int s_windowCount;
     static bool s_glewInitialized;
+    static bool s_headless;
 };
 
 #endif /* WINDOW_H */
\ No newline at end of file
@@ -1,5 +1,21 @@
 import subprocess
 
-shader_files = ["cells.comp", "circles.comp", "meta_bg.comp", "meta_params.comp", "meta_rgb.comp", "meta_ro.comp"]
+# compile every program listed in the manifest that supports SPIR-V
+shader_files = []
+with open("shaders.manifest") as manifest:
+    entry = {}
+    for line in manifest:
+        line = line.strip()
+        if not line or line.startswith("#"):
+            continue
+        if line.startswith("["):
+            entry = {}
+            continue
+        key, value = [part.strip() for part in line.split("=", 1)]
+        entry[key] = value
+        if "file" in entry and "backends" in entry and "spirv" in entry["backends"].split():
+            if entry["file"] not in shader_files:
+                shader_files.append(entry["file"])
+
 for shader in shader_files:
     subprocess.call(["glslangValidator", "-G", shader, "-o", shader + ".spv"])
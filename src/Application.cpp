@@ -1,5 +1,15 @@
 #include "Application.h"
 
+#include <algorithm>
+#include <csignal>
+#include <cstdio>
+#include <deque>
+#include <filesystem>
+#include <thread>
+
+#include "PerfCounters.h"
+#include "Profiler.h"
+
 TermFormatter::Formatter Application::s_green =
     TermFormatter::Formatter({TermFormatter::FG_Green});
 TermFormatter::Formatter Application::s_red =
@@ -10,25 +20,190 @@ TermFormatter::Formatter Application::s_reset =
 Application::Application(int argc, char* argv[]) {
     m_params.height = 0;
     m_params.width = 0;
-    m_params.fps_cap = 60;
+    m_params.fps_cap = 0;
+    m_params.swap_interval = 1;
+    m_params.uncapped = 0;
+    m_params.latency = 0;
+    m_params.idle = 1;
+    m_params.seed = 0;
+    m_params.threads = 0;
+    m_params.tick_rate = 60;
+    m_params.substeps = 1;
+    m_params.sim_thread = 1;
+    m_params.headless = 0;
+    m_params.render_frames = 0;
+    m_params.render_every = 1;
+    m_params.render_dir = ".";
+    m_params.render_format = ImageWriter::PNG;
+    m_params.stream = 0;
+    m_params.stream_format = VideoStream::Y4M;
+    m_params.stream_drop = 0;
+    m_params.poster_height = 0;
+    m_params.poster_width = 0;
+    m_params.generate = 0;
+    m_params.generator = SceneGenerator::defaults();
+    m_params.counters = 0;
     if (!parseCMD(argc, argv)) {
         exit(-1);
     }
+    Window::setHeadless(m_params.headless != 0);
+    PROFILE_THREAD("main");
+    if (m_params.profile.size() != 0) {
+        Profiler::start();
+    }
+    // before any threads start, so the workers inherit the counters
+    if (m_params.counters) {
+        bool counting = PerfCounters::start();
+        // stderr, -stream writes the video to stdout
+        std::cerr << (counting ? s_green : s_red)
+                  << "CPU counters: " << PerfCounters::status() << s_reset
+                  << std::endl;
+    }
+
+    // a replay runs with the seed and size it was recorded with
+    m_replayer = nullptr;
+    if (m_params.replay.size() != 0) {
+        try {
+            m_replayer = new Replayer(m_params.replay);
+        } catch (std::exception& e) {
+            std::cout << s_red << e.what() << s_reset << std::endl;
+            exit(-1);
+        }
+        m_params.seed = (int)m_replayer->seed();
+        m_params.height = m_replayer->height();
+        m_params.width = m_replayer->width();
+    }
 
-    m_graphics = new Graphics(m_params.height, m_params.width);
+    JobSystem::init(m_params.threads > 0 ? m_params.threads : 0);
 
-    m_FPS = m_params.fps_cap;
+    m_graphics = new Graphics(m_params.height, m_params.width, m_params.seed);
+    // a replay starts from the scene it was recorded with
+    std::string scene = m_replayer ? m_replayer->scene() : m_params.scene;
+    if (scene.size() != 0 || m_params.generate) {
+        Timer timer;
+        try {
+            size_t count;
+            if (scene.size() != 0) {
+                count = m_graphics->openScene(scene);
+            } else {
+                m_params.generator.seed = (uint64_t)m_params.seed;
+                count = m_graphics->generateScene(m_params.generator);
+                scene = SceneGenerator::name(
+                    m_params.generator.distribution);
+            }
+            // stderr, -stream writes the video to stdout
+            std::cerr << "Loaded " << count << " balls from " << scene
+                      << " in " << timer.getMicrosecondsElapsed() / 1000.0f
+                      << "ms" << std::endl;
+        } catch (std::exception& e) {
+            std::cerr << s_red << e.what() << s_reset << std::endl;
+            exit(-1);
+        }
+    }
+    m_graphics->setTickRate(m_params.tick_rate, m_params.substeps);
+    // offline rendering ticks the simulation itself, once a frame
+    bool offline = m_params.render_frames > 0 || m_params.stream ||
+                   m_params.poster_width > 0 || m_replayer;
+    if (offline) {
+        m_graphics->setMenuVisible(false);
+    }
+    if (m_replayer) {
+        m_graphics->startReplay(*m_replayer);
+    }
+    if (m_params.record.size() != 0) {
+        try {
+            m_graphics->record(m_params.record);
+        } catch (std::exception& e) {
+            std::cout << s_red << e.what() << s_reset << std::endl;
+            exit(-1);
+        }
+    }
+    m_graphics->setSimulationThread(!offline && m_params.sim_thread != 0);
+    m_graphics->setFrameStats(&m_frameStats);
+
+    // -uncapped runs as fast as it can, for benchmarks
+    int swapInterval = m_params.uncapped ? 0 : m_params.swap_interval;
+    int swapping = m_graphics->Window()->setSwapInterval(swapInterval);
+    if (!Window::isHeadless() && swapping != swapInterval) {
+        std::cout << "Swap interval " << swapInterval
+                  << " isn't supported, using " << swapping << std::endl;
+    }
+    m_limiter.setRate(m_params.uncapped ? 0 : m_params.fps_cap);
+    m_backgroundLimiter.setRate(10);
+    m_FPS = m_params.fps_cap > 0 ? m_params.fps_cap : 60;
     m_frameCount = 0;
 }
 
-Application::~Application() { delete m_graphics; }
+Application::~Application() {
+    finishRecording();
+    delete m_graphics;
+    delete m_replayer;
+    JobSystem::shutdown();
+    writeProfile();
+}
+
+/// Writes the scopes timed over the run, if -profile was passed
+void Application::writeProfile() {
+    if (m_params.profile.size() == 0) {
+        return;
+    }
+    // every other thread has stopped, so the trace can't be torn
+    Profiler::stop();
+    // stderr, so nothing lands after a -stream video on stdout
+    try {
+        Profiler::writeChromeTrace(m_params.profile);
+    } catch (std::exception& e) {
+        std::cerr << s_red << e.what() << s_reset << std::endl;
+        return;
+    }
+    std::cerr << s_green << "Wrote " << Profiler::eventCount()
+              << " profiled scopes to " << m_params.profile << s_reset
+              << std::endl;
+}
 
 void Application::run() {
-    Timer frameTimer;
+    if (m_replayer) {
+        replayFrames();
+        return;
+    }
+    if (m_params.render_frames > 0) {
+        renderFrames();
+        return;
+    }
+    if (m_params.stream) {
+        streamFrames();
+        return;
+    }
+    if (m_params.poster_width > 0) {
+        renderPoster();
+        return;
+    }
+
+    // frames drawn without input since the last event, the GUI can take a
+    // frame or two to settle after one
+    const int settleFrames = 3;
+    int quietFrames = 0;
     bool running = true;
+    auto lastUpdate = std::chrono::steady_clock::now();
+    std::vector<FrameStats::Frame> recent;
     while (running) {
-        frameTimer.start();
+        bool minimized = m_graphics->Window()->isMinimized();
+        bool background =
+            m_params.idle && (minimized || !m_graphics->Window()->hasFocus());
+        // a paused scene only changes on input, so sleep until some arrives
+        // rather than drawing the same frame again, the timeout lets the
+        // window notice it's been hidden
+        if (m_params.idle && m_graphics->paused() &&
+            quietFrames >= settleFrames && !m_handler.wait(500)) {
+            continue;
+        }
+
+        PROFILE_SCOPE("Application::frame");
+        m_frameStats.begin();
+        (background ? m_backgroundLimiter : m_limiter).wait();
+        m_frameStats.mark(FrameStats::Wait);
         m_handler.poll();
+        quietFrames = m_handler.events.empty() ? quietFrames + 1 : 0;
 
         for (auto event : m_handler.events) {
             m_graphics->Window()->handleEvent(event);
@@ -41,83 +216,535 @@ void Application::run() {
             m_graphics->Window()->isHidden()) {
             running = false;
         }
+        m_frameStats.mark(FrameStats::Events);
 
         // update window
         if (running) {
-            int newWidth, newHeight;
-            SDL_GetWindowSize(*m_graphics->Window(), &newWidth, &newHeight);
-            if (newWidth != m_graphics->height() ||
-                newHeight != m_graphics->width()) {
+            int newWidth = m_graphics->Window()->getWidth();
+            int newHeight = m_graphics->Window()->getHeight();
+            if (newWidth != m_graphics->width() ||
+                newHeight != m_graphics->height()) {
                 m_graphics->updateDimensions();
             }
-            m_graphics->update();
-            m_graphics->Window()->draw();
-            m_graphics->Window()->drawGUI();
-            m_graphics->Window()->swap();
+            // the simulation runs on real time, slow frames just take more
+            // ticks before drawing (or tick on their own thread)
+            auto now = std::chrono::steady_clock::now();
+            m_graphics->update(
+                std::chrono::duration<double>(now - lastUpdate).count());
+            lastUpdate = now;
+            m_frameStats.mark(FrameStats::Update);
+            // nothing is seen while minimized, and some drivers block the
+            // swap until the window is shown again
+            if (!(m_params.idle && minimized)) {
+                m_graphics->Window()->draw();
+                m_frameStats.mark(FrameStats::Draw);
+                m_graphics->Window()->drawGUI();
+                m_frameStats.mark(FrameStats::GUI);
+                m_graphics->Window()->swap();
+                if (m_params.latency) {
+                    // nothing queues up behind the frame on screen, so the
+                    // next one is drawn from input polled just before it
+                    glFinish();
+                }
+                m_frameStats.mark(FrameStats::Swap);
+            }
         }
 
-        auto endTime = (microseconds)frameTimer.getMicrosecondsElapsed();
-        // print out current frame rate, green if it's fast, red if it's slow
+        const FrameStats::Frame& frame = m_frameStats.end();
+        if (m_params.stats.size() != 0) {
+            m_statsLog.push_back(frame);
+        }
+        // print out the median frame rate and the slowest frames, green if
+        // it's fast, red if it's slow
         if (m_frameCount % 15 == 0) {
-            float currFPS = 1.0f / (endTime.count() / 1000000);
-            std::cout << "\r                      \r" << std::flush;
-            if (currFPS >= m_FPS) {
-                std::cout << s_green << currFPS;
-            } else {
-                std::cout << s_red << currFPS;
-            }
-            std::cout << std::flush;
+            m_frameStats.recent(recent);
+            FrameStats::Summary total =
+                FrameStats::summarize(recent, FrameStats::Phases);
+            float currFPS = 1000.0f / total.p50;
+            std::cout << "\r                                        \r"
+                      << (currFPS >= m_FPS ? s_green : s_red) << currFPS
+                      << " fps, p99 " << total.p99 << "ms" << std::flush;
         }
         m_frameCount++;
     }
-    std::cout << s_reset << '\r';
+    std::cout << s_reset << '\n';
+    writeFrameStats();
+}
+
+/// Writes the times of every frame the GUI drew, if -stats was passed
+void Application::writeFrameStats() {
+    if (m_params.stats.size() == 0) {
+        return;
+    }
+    std::string path = m_params.stats;
+    bool json = path.size() >= 5 && path.compare(path.size() - 5, 5,
+                                                 ".json") == 0;
+    try {
+        if (json) {
+            FrameStats::writeJSON(path, m_statsLog);
+        } else {
+            FrameStats::writeCSV(path, m_statsLog);
+        }
+    } catch (std::exception& e) {
+        std::cout << s_red << e.what() << s_reset << std::endl;
+        return;
+    }
+    FrameStats::Summary total =
+        FrameStats::summarize(m_statsLog, FrameStats::Phases);
+    std::cout << s_green << "Wrote " << total.frames << " frame times to "
+              << path << ", p50 " << total.p50 << "ms, p99 " << total.p99
+              << "ms, max " << total.max << "ms" << s_reset << std::endl;
+}
+
+/** Renders frames offline and writes them to image files
+ *  Each frame is one simulation tick. Every k-th frame is read back into
+ *  the ImageWriter, which encodes it on the job system while the next
+ *  frames render.
+ */
+void Application::renderFrames() {
+    std::error_code error;
+    std::filesystem::create_directories(m_params.render_dir, error);
+    if (error) {
+        std::cout << s_red << "Unable to create " << m_params.render_dir
+                  << ": " << error.message() << s_reset << std::endl;
+        return;
+    }
+
+    ImageWriter writer(m_params.render_format);
+    const char* extension = ImageWriter::extension(m_params.render_format);
+    int width = m_graphics->imageWidth();
+    int height = m_graphics->imageHeight();
+    Timer timer;
+    try {
+        for (int frame = 0; frame < m_params.render_frames; frame++) {
+            PROFILE_SCOPE("Application::renderFrame");
+            m_handler.poll();
+            bool quit = m_handler.keyDown[EventHandler::keys::ESC];
+            for (auto event : m_handler.events) {
+                quit = quit || event.type == SDL_QUIT;
+            }
+            if (quit) {
+                break;
+            }
+
+            // the first frame only picks up the starting balls
+            m_graphics->step(frame > 0 ? 1 : 0);
+            if (frame % m_params.render_every != 0) {
+                continue;
+            }
+            uint8_t* pixels = writer.acquire(width, height);
+            m_graphics->renderImage(pixels);
+            char name[32];
+            snprintf(name, sizeof(name), "frame_%06d.%s", frame, extension);
+            writer.submit(m_params.render_dir + "/" + name);
+
+            if (writer.written() % 15 == 0) {
+                std::cout << "\r" << frame + 1 << " / "
+                          << m_params.render_frames << std::flush;
+            }
+        }
+        writer.finish();
+    } catch (std::exception& e) {
+        std::cout << '\n' << s_red << e.what() << s_reset << std::endl;
+        return;
+    }
+
+    float elapsed = timer.getMicrosecondsElapsed() / 1000000.0f;
+    std::cout << "\r" << s_green << "Wrote " << writer.written() << ' '
+              << width << 'x' << height << " frames to "
+              << m_params.render_dir << " in " << elapsed << "s ("
+              << writer.written() / elapsed << " fps)" << s_reset
+              << std::endl;
+}
+
+/** Streams frames to stdout as video until it's closed or ESC is pressed
+ *  Each frame is one simulation tick. Frames are read back asynchronously,
+ *  so the GPU runs a couple of frames ahead of the conversion and writing.
+ *  When dropping frames the loop is paced to the tick rate, like a live
+ *  source, otherwise it runs as fast as the consumer reads.
+ *
+ *  @note Everything else is printed to stderr, stdout carries the video
+ */
+void Application::streamFrames() {
+#ifdef UNIX
+    // a closed pipe should end the stream, not the process
+    signal(SIGPIPE, SIG_IGN);
+#endif
+    int width = m_graphics->imageWidth();
+    int height = m_graphics->imageHeight();
+    bool drop = m_params.stream_drop != 0;
+    VideoStream stream(m_params.stream_format, stdout, width, height,
+                       m_params.tick_rate, drop);
+    PixelReadback readback(3);
+    auto send = [&]() {
+        stream.push(readback.map());
+        readback.release();
+    };
+
+    auto start = std::chrono::steady_clock::now();
+    std::chrono::duration<double> tick(1.0 / m_params.tick_rate);
+    size_t frame = 0;
+    try {
+        while (stream.good()) {
+            m_handler.poll();
+            bool quit = m_handler.keyDown[EventHandler::keys::ESC];
+            for (auto event : m_handler.events) {
+                quit = quit || event.type == SDL_QUIT;
+            }
+            if (quit) {
+                break;
+            }
+
+            m_graphics->step(frame > 0 ? 1 : 0);
+            if (readback.full()) {
+                send();
+            }
+            m_graphics->renderImage(readback);
+            while (readback.ready()) {
+                send();
+            }
+            frame++;
+            if (drop) {
+                std::this_thread::sleep_until(
+                    start + std::chrono::duration_cast<
+                                std::chrono::steady_clock::duration>(
+                                tick * (double)frame));
+            }
+        }
+        while (!readback.empty() && stream.good()) {
+            send();
+        }
+    } catch (std::exception& e) {
+        std::cerr << s_red << e.what() << s_reset << std::endl;
+    }
+    stream.finish();
+
+    float elapsed = std::chrono::duration<float>(
+                        std::chrono::steady_clock::now() - start)
+                        .count();
+    std::cerr << s_green << "Streamed " << stream.sent() << ' ' << width
+              << 'x' << height << " frames in " << elapsed << "s ("
+              << stream.sent() / elapsed << " fps), dropped "
+              << stream.dropped() << s_reset << std::endl;
+}
+
+/** Renders the first frame as one image larger than the GPU could hold
+ *  The scene is scaled up to fit the poster and rendered in window sized
+ *  tiles, a band of tiles at a time. Each band of the output file is
+ *  memory mapped and filled in from asynchronous readbacks, so memory use
+ *  stays around one band of tiles however large the poster is.
+ */
+void Application::renderPoster() {
+    std::error_code error;
+    std::filesystem::create_directories(m_params.render_dir, error);
+    if (error) {
+        std::cout << s_red << "Unable to create " << m_params.render_dir
+                  << ": " << error.message() << s_reset << std::endl;
+        return;
+    }
+
+    std::string path = m_params.render_dir + "/poster.ppm";
+    int posterWidth = m_params.poster_width;
+    int posterHeight = m_params.poster_height;
+    int tileWidth = m_graphics->imageWidth();
+    int tileHeight = m_graphics->imageHeight();
+    int tilesX = (posterWidth + tileWidth - 1) / tileWidth;
+    int tilesY = (posterHeight + tileHeight - 1) / tileHeight;
+
+    // fit the whole scene in the poster, centered, keeping balls round
+    float scale = std::max((float)tileWidth / posterWidth,
+                           (float)tileHeight / posterHeight);
+    float originX = (tileWidth - posterWidth * scale) * 0.5f;
+    float originY = (tileHeight - posterHeight * scale) * 0.5f;
+
+    Timer timer;
+    try {
+        PosterFile poster(path, posterWidth, posterHeight);
+        PixelReadback readback(3);
+        std::deque<int> tileColumns;  // x of each tile being read back
+        uint8_t* band = nullptr;
+        int bandFirst = 0;
+        int bandRows = 0;
+        // copies the oldest tile into the band, dropping alpha
+        auto copyTile = [&]() {
+            const uint8_t* pixels = readback.map();
+            int x0 = tileColumns.front();
+            int columns = std::min(tileWidth, posterWidth - x0);
+            JobSystem::parallelFor(
+                0, bandRows, 16, [&](size_t first, size_t last) {
+                    for (size_t y = first; y < last; y++) {
+                        const uint8_t* in = pixels + y * tileWidth * 4;
+                        uint8_t* out = band + (y * posterWidth + x0) * 3;
+                        for (int x = 0; x < columns; x++) {
+                            out[x * 3] = in[x * 4];
+                            out[x * 3 + 1] = in[x * 4 + 1];
+                            out[x * 3 + 2] = in[x * 4 + 2];
+                        }
+                    }
+                });
+            readback.release();
+            tileColumns.pop_front();
+        };
+
+        m_graphics->step(0);
+        for (int ty = 0; ty < tilesY; ty++) {
+            bandFirst = ty * tileHeight;
+            bandRows = std::min(tileHeight, posterHeight - bandFirst);
+            band = poster.mapRows(bandFirst, bandRows);
+            for (int tx = 0; tx < tilesX; tx++) {
+                int x0 = tx * tileWidth;
+                m_graphics->setView(originX + x0 * scale,
+                                    originY + bandFirst * scale, scale,
+                                    scale);
+                if (readback.full()) {
+                    copyTile();
+                }
+                m_graphics->renderImage(readback);
+                tileColumns.push_back(x0);
+            }
+            // the band has to be complete before it's unmapped
+            while (!readback.empty()) {
+                copyTile();
+            }
+            poster.unmapRows();
+            std::cout << "\r" << ty + 1 << " / " << tilesY << " rows of tiles"
+                      << std::flush;
+        }
+    } catch (std::exception& e) {
+        std::cout << '\n' << s_red << e.what() << s_reset << std::endl;
+        m_graphics->setView(0, 0, 1, 1);
+        return;
+    }
+    m_graphics->setView(0, 0, 1, 1);
+
+    float elapsed = timer.getMicrosecondsElapsed() / 1000000.0f;
+    std::cout << "\r" << s_green << "Wrote a " << posterWidth << 'x'
+              << posterHeight << " poster to " << path << " from "
+              << tilesX * tilesY << ' ' << tileWidth << 'x' << tileHeight
+              << " tiles in " << elapsed << "s" << s_reset << std::endl;
+}
+
+/** Replays a recorded run as fast as it renders, see Recorder
+ *  Every recorded frame is drawn from the same simulation state it was
+ *  recorded with, headless or in the window. If the recording was finished
+ *  the last frame's balls are checked against it.
+ */
+void Application::replayFrames() {
+    // don't wait on vsync
+    m_graphics->Window()->setSwapInterval(0);
+    size_t frames = 0;
+    size_t total = m_replayer->frames();
+    Timer timer;
+    while (m_graphics->replayFrame()) {
+        m_handler.poll();
+        bool quit = m_handler.keyDown[EventHandler::keys::ESC];
+        for (auto event : m_handler.events) {
+            m_graphics->Window()->handleEvent(event);
+            quit = quit || event.type == SDL_QUIT;
+        }
+        if (quit) {
+            break;
+        }
+
+        m_graphics->Window()->draw();
+        m_graphics->Window()->drawGUI();
+        m_graphics->Window()->swap();
+        frames++;
+        if (frames % 15 == 0) {
+            std::cout << "\r" << frames << " / " << total << std::flush;
+        }
+    }
+
+    float elapsed = timer.getMicrosecondsElapsed() / 1000000.0f;
+    std::cout << "\r" << s_green << "Replayed " << frames << " frames in "
+              << elapsed << "s (" << frames / elapsed << " fps)" << s_reset
+              << std::endl;
+    if (frames != total || !m_replayer->finished()) {
+        return;
+    }
+    if (m_graphics->checksum() == m_replayer->checksum()) {
+        std::cout << s_green << "The last frame matches the recording"
+                  << s_reset << std::endl;
+    } else {
+        std::cout << s_red << "The last frame doesn't match the recording"
+                  << s_reset << std::endl;
+    }
+}
+
+/// Ends the recording, if there is one, and says where it went
+void Application::finishRecording() {
+    if (m_params.record.size() == 0 || m_replayer) {
+        return;
+    }
+    size_t frames = m_graphics->recordedFrames();
+    try {
+        m_graphics->stopRecording();
+    } catch (std::exception& e) {
+        std::cout << s_red << e.what() << s_reset << std::endl;
+        return;
+    }
+    std::cout << s_green << "Recorded " << frames << " frames to "
+              << m_params.record << s_reset << std::endl;
 }
 
 bool Application::parseCMD(int argc, char* argv[]) {
     std::string size;  // HxW
+    std::string format;
+    std::string streamFormat;
+    std::string poster;  // HxW
+    std::string generator;
+    int count = (int)m_params.generator.count;
+    double coverage = m_params.generator.coverage;
+    double spread = m_params.generator.spread;
     CMDParser parser;
     parser.bindVar<std::string>("-size", size, 1,
                                 "<Height>x<Width> of the window");
-    parser.bindVar<double>("-fps", m_params.fps_cap, 1, "FPS cap");
+    parser.bindVar<double>("-fps", m_params.fps_cap, 1,
+                           "FPS cap, 0 to leave it to the swap interval");
+    parser.bindVar<int>("-swap", m_params.swap_interval, 1,
+                        "Swap interval: 0 for none, 1 for vsync, -1 for "
+                        "adaptive vsync");
+    parser.bindVar<int>("-uncapped", m_params.uncapped, 1,
+                        "1 to ignore -fps and -swap and run flat out");
+    parser.bindVar<int>("-latency", m_params.latency, 1,
+                        "1 to finish each frame before polling input, for "
+                        "the least input lag");
+    parser.bindVar<int>("-idle", m_params.idle, 1,
+                        "0 to keep drawing every frame while paused or in "
+                        "the background");
+    parser.bindVar<int>("-seed", m_params.seed, 1,
+                        "Seed for the random ball movement");
+    parser.bindVar<int>("-threads", m_params.threads, 1,
+                        "Number of worker threads, 0 uses every core");
+    parser.bindVar<double>("-hz", m_params.tick_rate, 1,
+                           "Simulation ticks per second");
+    parser.bindVar<int>("-substeps", m_params.substeps, 1,
+                        "Simulation steps per tick");
+    parser.bindVar<int>("-simthread", m_params.sim_thread, 1,
+                        "1 to simulate on its own thread, 0 for the main one");
+    parser.bindVar<int>("-headless", m_params.headless, 1,
+                        "1 to render offscreen without a display (needs EGL)");
+    parser.bindVar<int>("-render", m_params.render_frames, 1,
+                        "Render this many frames to images, without the GUI");
+    parser.bindVar<std::string>("-out", m_params.render_dir, 1,
+                                "Directory -render writes frames to");
+    parser.bindVar<int>("-every", m_params.render_every, 1,
+                        "Write every k-th frame of -render");
+    parser.bindVar<std::string>("-format", format, 1,
+                                "Image format for -render: png, ppm or qoi");
+    parser.bindVar<std::string>("-stream", streamFormat, 1,
+                                "Write video to stdout: y4m or rgba");
+    parser.bindVar<int>("-streamdrop", m_params.stream_drop, 1,
+                        "1 to drop frames -stream can't write in time");
+    parser.bindVar<std::string>("-poster", poster, 1,
+                                "Render one <Height>x<Width> image in tiles");
+    parser.bindVar<std::string>("-scene", m_params.scene, 1,
+                                "Start with the balls saved in a scene file");
+    parser.bindVar<std::string>(
+        "-gen", generator, 1,
+        "Start with generated balls: uniform, clustered, powerlaw, grid or "
+        "ring");
+    parser.bindVar<int>("-count", count, 1, "Number of balls -gen makes");
+    parser.bindVar<double>("-coverage", coverage, 1,
+                           "Fraction of the window -gen's balls cover");
+    parser.bindVar<double>("-spread", spread, 1,
+                           "Largest over smallest radius of -gen's balls");
+    parser.bindVar<std::string>("-stats", m_params.stats, 1,
+                                "Write frame times to a .csv or .json file "
+                                "on exit");
+    parser.bindVar<std::string>("-profile", m_params.profile, 1,
+                                "Write a Chrome trace of the run on exit");
+    parser.bindVar<int>("-counters", m_params.counters, 1,
+                        "1 to show hardware counters of the hot paths in the "
+                        "side panel (Linux)");
+    parser.bindVar<std::string>("-record", m_params.record, 1,
+                                "Log the run to a file for -replay");
+    parser.bindVar<std::string>("-replay", m_params.replay, 1,
+                                "Replay a run logged with -record");
     if (!parser.parse(argc, argv)) {
         return false;
     }
-    if (size.size() != 0) {
-        std::string height;
-        std::string width;
-        size_t x_index = 0;
-
-        // split on x
-        while (x_index < size.size() && size[x_index] != 'x') {
-            x_index++;
-        }
-        if (x_index >= size.size()) {
-            std::cout
-                << "Incorrect format, -size requires format <Height>x<Width>"
-                << std::endl;
-            parser.printHelp();
-            return false;
-        }
-        height = size.substr(0, x_index);
-        width = size.substr(x_index + 1, size.size() - x_index - 1);
-
-        // attempt to convert substrings to integers
-        try {
-            m_params.height = std::stoi(height);
-        } catch (...) {
-            std::cout << "Could not convert " << height << " to integer height"
+    if (format.size() != 0 &&
+        !ImageWriter::parseFormat(format, m_params.render_format)) {
+        std::cout << "Unknown image format " << format << std::endl;
+        parser.printHelp();
+        return false;
+    }
+    m_params.render_every = std::max(m_params.render_every, 1);
+    if (streamFormat.size() != 0) {
+        if (!VideoStream::parseFormat(streamFormat,
+                                      m_params.stream_format)) {
+            std::cout << "Unknown stream format " << streamFormat
                       << std::endl;
             parser.printHelp();
             return false;
         }
-        try {
-            m_params.width = std::stoi(width);
-        } catch (...) {
-            std::cout << "Could not convert " << width << " to integer width"
+        m_params.stream = 1;
+    }
+    if (size.size() != 0 &&
+        !parseSize(size, m_params.height, m_params.width)) {
+        std::cout << "-size requires format <Height>x<Width>" << std::endl;
+        parser.printHelp();
+        return false;
+    }
+    if (poster.size() != 0 &&
+        (!parseSize(poster, m_params.poster_height, m_params.poster_width) ||
+         m_params.poster_height <= 0 || m_params.poster_width <= 0)) {
+        std::cout << "-poster requires format <Height>x<Width>" << std::endl;
+        parser.printHelp();
+        return false;
+    }
+    if (generator.size() != 0) {
+        if (!SceneGenerator::parseDistribution(
+                generator, m_params.generator.distribution)) {
+            std::cout << "Unknown scene generator " << generator
                       << std::endl;
             parser.printHelp();
             return false;
         }
+        m_params.generator.count = (size_t)std::max(count, 0);
+        m_params.generator.coverage = (float)std::max(coverage, 0.0);
+        m_params.generator.spread = (float)std::max(spread, 1.0);
+        m_params.generate = 1;
+    }
+    if (m_params.generate && m_params.scene.size() != 0) {
+        std::cout << "-gen can't be used with -scene" << std::endl;
+        parser.printHelp();
+        return false;
+    }
+#ifndef METABALLS_PROFILE
+    if (m_params.profile.size() != 0) {
+        std::cerr << "-profile needs a build with -DMETABALLS_PROFILE=ON, "
+                     "the trace will be empty"
+                  << std::endl;
+    }
+#endif
+    if (m_params.record.size() != 0 && m_params.replay.size() != 0) {
+        std::cout << "-record can't be used with -replay" << std::endl;
+        parser.printHelp();
+        return false;
+    }
+    return true;
+}
+
+/** Splits a size given as HeightxWidth
+ *  @param size The size to split
+ *  @param height Receives the height
+ *  @param width Receives the width
+ *  @return Whether the size was in the right format
+ */
+bool Application::parseSize(const std::string& size, int& height,
+                            int& width) {
+    size_t x_index = size.find('x');
+    if (x_index == std::string::npos) {
+        return false;
+    }
+    // attempt to convert substrings to integers
+    try {
+        height = std::stoi(size.substr(0, x_index));
+        width = std::stoi(size.substr(x_index + 1));
+    } catch (...) {
+        return false;
     }
     return true;
 }
\ No newline at end of file
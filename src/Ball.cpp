@@ -1,5 +1,36 @@
 #include "Ball.h"
 
+#include <algorithm>
+
+#include "CounterRNG.h"
+#include "Integrator.h"
+
+/// Moves a ball back inside the walls and points its velocity away from them
+static inline void bounce(Ball& ball, size_t width, size_t height) {
+    if (ball.position.x + ball.size >= width) {
+        ball.position.x = width - (ball.size + 1);
+        if (ball.velocity.x > 0.0f) {
+            ball.velocity.x *= -1;
+        }
+    } else if (ball.position.x - ball.size <= 0) {
+        ball.position.x = ball.size + 1;
+        if (ball.velocity.x < 0.0f) {
+            ball.velocity.x *= -1;
+        }
+    }
+    if (ball.position.y + ball.size >= height) {
+        ball.position.y = height - (ball.size + 1);
+        if (ball.velocity.y > 0.0f) {
+            ball.velocity.y *= -1;
+        }
+    } else if (ball.position.y - ball.size <= 0) {
+        ball.position.y = ball.size + 1;
+        if (ball.velocity.y < 0.0f) {
+            ball.velocity.y *= -1;
+        }
+    }
+}
+
 void updateMetaballs_StraightPath(std::vector<Ball>& balls, size_t width,
                                   size_t height) {
     updateMetaballs_StraightPath(balls.size(), balls.data(), width, height);
@@ -7,88 +38,95 @@ void updateMetaballs_StraightPath(std::vector<Ball>& balls, size_t width,
 
 void updateMetaballs_StraightPath(size_t numBalls, Ball* balls, size_t width,
                                   size_t height) {
-    for (int i = 0; i < numBalls; i++) {
+    for (size_t i = 0; i < numBalls; i++) {
         balls[i].position.x += balls[i].velocity.x;
         balls[i].position.y += balls[i].velocity.y;
-
-        if (balls[i].position.x + balls[i].size >= width) {
-            balls[i].position.x = width - (balls[i].size + 1);
-            if (balls[i].velocity.x > 0.0f) {
-                balls[i].velocity.x *= -1;
-            }
-        } else if (balls[i].position.x - balls[i].size <= 0) {
-            balls[i].position.x = balls[i].size + 1;
-            if (balls[i].velocity.x < 0.0f) {
-                balls[i].velocity.x *= -1;
-            }
-        }
-        if (balls[i].position.y + balls[i].size >= height) {
-            balls[i].position.y = height - (balls[i].size + 1);
-            if (balls[i].velocity.y > 0.0f) {
-                balls[i].velocity.y *= -1;
-            }
-        } else if (balls[i].position.y - balls[i].size <= 0) {
-            balls[i].position.y = balls[i].size + 1;
-            if (balls[i].velocity.y < 0.0f) {
-                balls[i].velocity.y *= -1;
-            }
-        }
+        bounce(balls[i], width, height);
     }
 }
 
-void updateMetaballs_RandomPath(std::vector<Ball>& balls, float theta, size_t width,
-                                  size_t height) {
-    updateMetaballs_RandomPath(balls.size(), balls.data(), theta, width, height);
+void updateMetaballs_Integrate(std::vector<Ball>& balls,
+                               IntegratorMethod method, float drag, float dt,
+                               int substeps, size_t width, size_t height) {
+    updateMetaballs_Integrate(balls.size(), balls.data(), method, drag, dt,
+                              substeps, width, height);
 }
 
-void updateMetaballs_RandomPath(size_t numBalls, Ball* balls, float theta,
-                                size_t width, size_t height) {
-    for (int i = 0; i < numBalls; i++) {
-        // get normalized vector of velocity
-        struct {
-            float x;
-            float y;
-        } normalVel = {balls[i].velocity.x, balls[i].velocity.y};
-        float mag = std::pow(normalVel.x, 2) + std::pow(normalVel.y, 2);
-        mag = std::sqrt(mag);
-        normalVel = {normalVel.x / mag, normalVel.y / mag};
-        float currAngle = std::atan(normalVel.y / normalVel.x);
+/** Moves every ball under linear drag with the chosen integrator
+ *  @param numBalls The number of balls
+ *  @param balls The balls to update
+ *  @param method The integrator to step with
+ *  @param drag The fraction of its velocity a ball loses per tick
+ *  @param dt The length of a substep in ticks
+ *  @param substeps The number of substeps to take
+ *  @param width The width of the area the balls are contained in
+ *  @param height The height of the area the balls are contained in
+ */
+void updateMetaballs_Integrate(size_t numBalls, Ball* balls,
+                               IntegratorMethod method, float drag, float dt,
+                               int substeps, size_t width, size_t height) {
+    Integrator::AoSState state = {balls};
+    Integrator::DragForce force = {drag, nullptr, nullptr};
+    Integrator::integrate(method, state, 0, numBalls, force, dt, substeps,
+                          (float)width, (float)height);
+}
+
+/** Sine and cosine of an angle in [-pi/2, pi/2]
+ *  Taylor polynomials are accurate to ~1e-6 over that range, and the
+ *  rotation is renormalized with one Newton step so speed never drifts.
+ */
+void headingRotation(float angle, float& sin, float& cos) {
+    float a2 = angle * angle;
+    sin = angle *
+          (1.0f + a2 * (-1.0f / 6 + a2 * (1.0f / 120 +
+                                          a2 * (-1.0f / 5040 +
+                                                a2 * (1.0f / 362880)))));
+    cos = 1.0f + a2 * (-1.0f / 2 +
+                       a2 * (1.0f / 24 + a2 * (-1.0f / 720 +
+                                               a2 * (1.0f / 40320))));
+    float norm = 1.5f - 0.5f * (sin * sin + cos * cos);
+    sin *= norm;
+    cos *= norm;
+}
+
+void updateMetaballs_RandomPath(std::vector<Ball>& balls, float theta,
+                                size_t width, size_t height, uint64_t seed,
+                                uint64_t frame) {
+    updateMetaballs_RandomPath(balls.size(), balls.data(), theta, width, height,
+                               seed, frame);
+}
 
-        // get degree change to new velocity
-        float degChange = (float)std::rand() / RAND_MAX;
-        degChange *= theta;
-        degChange -= theta / 2;
+/** Turns every ball by a random angle in [-theta/2, theta/2] then moves it
+ *  @param numBalls The number of balls
+ *  @param balls The balls to update
+ *  @param theta The widest allowed turn in radians, clamped to pi
+ *  @param width The width of the area the balls are contained in
+ *  @param height The height of the area the balls are contained in
+ *  @param seed The seed for the run
+ *  @param frame The frame number, each frame draws fresh random numbers
+ *
+ *  @note Ball i always draws the same angle for a given seed and frame, so
+ * the result doesn't depend on how the balls are split across threads
+ */
+void updateMetaballs_RandomPath(size_t numBalls, Ball* balls, float theta,
+                                size_t width, size_t height, uint64_t seed,
+                                uint64_t frame) {
+    uint32_t key = CounterRNG::key(seed, frame);
+    theta = std::min(std::fabs(theta), (float)M_PI);
+    for (size_t i = 0; i < numBalls; i++) {
+        float angle = (CounterRNG::uniform(key, (uint32_t)i) - 0.5f) * theta;
+        float sin, cos;
+        headingRotation(angle, sin, cos);
 
-        // set new velocity
-        currAngle += degChange;
-        normalVel = {std::sin(currAngle), std::cos(currAngle)};
+        // rotate the velocity, which keeps its magnitude
+        float velX = balls[i].velocity.x;
+        float velY = balls[i].velocity.y;
+        balls[i].velocity.x = cos * velX - sin * velY;
+        balls[i].velocity.y = sin * velX + cos * velY;
 
         // proceed as normal
-        balls[i].velocity = {normalVel.x * mag, normalVel.y * mag};
         balls[i].position.x += balls[i].velocity.x;
         balls[i].position.y += balls[i].velocity.y;
-
-        if (balls[i].position.x + balls[i].size >= width) {
-            balls[i].position.x = width - (balls[i].size + 1);
-            if (balls[i].velocity.x > 0.0f) {
-                balls[i].velocity.x *= -1;
-            }
-        } else if (balls[i].position.x - balls[i].size <= 0) {
-            balls[i].position.x = balls[i].size + 1;
-            if (balls[i].velocity.x < 0.0f) {
-                balls[i].velocity.x *= -1;
-            }
-        }
-        if (balls[i].position.y + balls[i].size >= height) {
-            balls[i].position.y = height - (balls[i].size + 1);
-            if (balls[i].velocity.y > 0.0f) {
-                balls[i].velocity.y *= -1;
-            }
-        } else if (balls[i].position.y - balls[i].size <= 0) {
-            balls[i].position.y = balls[i].size + 1;
-            if (balls[i].velocity.y < 0.0f) {
-                balls[i].velocity.y *= -1;
-            }
-        }
+        bounce(balls[i], width, height);
     }
-}
\ No newline at end of file
+}
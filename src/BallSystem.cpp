@@ -0,0 +1,350 @@
+#include "BallSystem.h"
+
+#include <algorithm>
+
+#include "CounterRNG.h"
+#include "Integrator.h"
+
+/// BallSystem default constructor
+BallSystem::BallSystem() : m_count(0) {}
+
+/// Returns the number of balls in the system
+size_t BallSystem::count() const { return m_count; }
+
+/** Resizes every array in the system
+ *  @param numBalls The new number of balls, new balls are zeroed
+ */
+void BallSystem::resize(size_t numBalls) {
+    m_count = numBalls;
+    m_size.resize(numBalls);
+    m_posX.resize(numBalls);
+    m_posY.resize(numBalls);
+    m_velX.resize(numBalls);
+    m_velY.resize(numBalls);
+    m_red.resize(numBalls);
+    m_green.resize(numBalls);
+    m_blue.resize(numBalls);
+    m_prevX.resize(numBalls);
+    m_prevY.resize(numBalls);
+}
+
+/// Reserves storage for the provided number of balls
+void BallSystem::reserve(size_t numBalls) {
+    m_size.reserve(numBalls);
+    m_posX.reserve(numBalls);
+    m_posY.reserve(numBalls);
+    m_velX.reserve(numBalls);
+    m_velY.reserve(numBalls);
+    m_red.reserve(numBalls);
+    m_green.reserve(numBalls);
+    m_blue.reserve(numBalls);
+    m_prevX.reserve(numBalls);
+    m_prevY.reserve(numBalls);
+}
+
+/// Removes every ball from the system
+void BallSystem::clear() { resize(0); }
+
+/// Appends a ball to the end of the system
+void BallSystem::push(const Ball& ball) {
+    resize(m_count + 1);
+    set(m_count - 1, ball);
+}
+
+/// Removes the last ball in the system
+void BallSystem::pop() {
+    if (m_count > 0) {
+        resize(m_count - 1);
+    }
+}
+
+/// Gathers the ball at the provided index
+Ball BallSystem::get(size_t index) const {
+    Ball ball;
+    ball.size = m_size[index];
+    ball.position.x = m_posX[index];
+    ball.position.y = m_posY[index];
+    ball.velocity.x = m_velX[index];
+    ball.velocity.y = m_velY[index];
+    ball.color.r = m_red[index];
+    ball.color.g = m_green[index];
+    ball.color.b = m_blue[index];
+    return ball;
+}
+
+/// Scatters a ball into the provided index
+void BallSystem::set(size_t index, const Ball& ball) {
+    m_size[index] = ball.size;
+    m_posX[index] = ball.position.x;
+    m_posY[index] = ball.position.y;
+    m_velX[index] = ball.velocity.x;
+    m_velY[index] = ball.velocity.y;
+    m_red[index] = ball.color.r;
+    m_green[index] = ball.color.g;
+    m_blue[index] = ball.color.b;
+    m_prevX[index] = ball.position.x;
+    m_prevY[index] = ball.position.y;
+}
+
+/** Replaces the contents of the system with an array of balls
+ *  @param numBalls The number of balls in the array
+ *  @param balls The array, laid out like the shader storage buffer
+ */
+void BallSystem::load(size_t numBalls, const Ball* balls) {
+    resize(numBalls);
+    for (size_t i = 0; i < numBalls; i++) {
+        set(i, balls[i]);
+    }
+}
+
+/** Writes the system into an array of balls
+ *  @param balls Destination with room for count() balls, such as the mapped
+ * shader storage buffer
+ */
+void BallSystem::store(Ball* balls) const { store(balls, 0, m_count); }
+
+/// Writes the balls in [first, last) into the matching slots of balls
+void BallSystem::store(Ball* balls, size_t first, size_t last) const {
+    for (size_t i = first; i < last; i++) {
+        balls[i] = get(i);
+    }
+}
+
+/** Writes the balls in [first, last) at a point between two ticks
+ *  @param balls Destination with room for count() balls
+ *  @param first Index of the first ball to write
+ *  @param last One past the last ball to write
+ *  @param alpha 0 writes the positions before the last tick, 1 the current
+ */
+void BallSystem::store(Ball* balls, size_t first, size_t last,
+                       float alpha) const {
+    for (size_t i = first; i < last; i++) {
+        Ball ball = get(i);
+        ball.position.x = m_prevX[i] + (m_posX[i] - m_prevX[i]) * alpha;
+        ball.position.y = m_prevY[i] + (m_posY[i] - m_prevY[i]) * alpha;
+        balls[i] = ball;
+    }
+}
+
+/// Remembers the positions of the balls in [first, last) before a tick
+void BallSystem::savePositions(size_t first, size_t last) {
+    std::copy(m_posX.begin() + first, m_posX.begin() + last,
+              m_prevX.begin() + first);
+    std::copy(m_posY.begin() + first, m_posY.begin() + last,
+              m_prevY.begin() + first);
+}
+
+/** Copies the system into out with positions between two ticks
+ *  @param alpha 0 copies the positions before the last tick, 1 the current
+ *  @param out The system to overwrite
+ */
+void BallSystem::interpolate(float alpha, BallSystem& out) const {
+    out.m_count = m_count;
+    out.m_size = m_size;
+    out.m_velX = m_velX;
+    out.m_velY = m_velY;
+    out.m_red = m_red;
+    out.m_green = m_green;
+    out.m_blue = m_blue;
+    out.m_prevX = m_prevX;
+    out.m_prevY = m_prevY;
+    out.m_posX.resize(m_count);
+    out.m_posY.resize(m_count);
+    for (size_t i = 0; i < m_count; i++) {
+        out.m_posX[i] = m_prevX[i] + (m_posX[i] - m_prevX[i]) * alpha;
+        out.m_posY[i] = m_prevY[i] + (m_posY[i] - m_prevY[i]) * alpha;
+    }
+}
+
+/** Moves every ball along its velocity and bounces it off the walls
+ *  @param width The width of the area the balls are contained in
+ *  @param height The height of the area the balls are contained in
+ *  @param scale The fraction of the velocity to move by
+ */
+void BallSystem::updateStraightPath(float width, float height, float scale) {
+    updateStraightPath(0, m_count, width, height, scale);
+}
+
+/** Moves the balls in [first, last) along their velocity
+ *  @param first Index of the first ball to update
+ *  @param last One past the last ball to update
+ *  @param width The width of the area the balls are contained in
+ *  @param height The height of the area the balls are contained in
+ *  @param scale The fraction of the velocity to move by
+ *
+ *  @note Disjoint ranges may be updated concurrently
+ */
+void BallSystem::updateStraightPath(size_t first, size_t last, float width,
+                                    float height, float scale) {
+    Integrator::SoAState state = {m_size.data(), m_posX.data(), m_posY.data(),
+                                  m_velX.data(), m_velY.data()};
+    Integrator::integrate<SemiImplicitEuler>(state, first, last,
+                                             Integrator::NoForce(), scale, 1,
+                                             width, height);
+}
+
+/** Moves the balls in [first, last) under drag and extra accelerations
+ *  @param first Index of the first ball to update
+ *  @param last One past the last ball to update
+ *  @param method The integrator to step with
+ *  @param drag The fraction of its velocity a ball loses per tick
+ *  @param accX Extra acceleration along x for every ball, or nullptr
+ *  @param accY Extra acceleration along y for every ball, or nullptr
+ *  @param dt The length of a substep in ticks
+ *  @param substeps The number of substeps to take, each range of balls runs
+ * all of them while it's in registers
+ *  @param width The width of the area the balls are contained in
+ *  @param height The height of the area the balls are contained in
+ *
+ *  @note Disjoint ranges may be updated concurrently
+ */
+void BallSystem::integrate(size_t first, size_t last, IntegratorMethod method,
+                           float drag, const float* accX, const float* accY,
+                           float dt, int substeps, float width,
+                           float height) {
+    Integrator::SoAState state = {m_size.data(), m_posX.data(), m_posY.data(),
+                                  m_velX.data(), m_velY.data()};
+    Integrator::DragForce force = {drag, accX, accY};
+    Integrator::integrate(method, state, first, last, force, dt, substeps,
+                          width, height);
+}
+
+/// headingRotation for a register of angles
+static inline void headingRotationSIMD(SIMD::floatv angle,
+                                       SIMD::floatv& sin, SIMD::floatv& cos) {
+    using namespace SIMD;
+    floatv a2 = mul(angle, angle);
+    floatv s = add(set1(-1.0f / 5040), mul(a2, set1(1.0f / 362880)));
+    s = add(set1(1.0f / 120), mul(a2, s));
+    s = add(set1(-1.0f / 6), mul(a2, s));
+    s = add(set1(1.0f), mul(a2, s));
+    sin = mul(angle, s);
+    floatv c = add(set1(-1.0f / 720), mul(a2, set1(1.0f / 40320)));
+    c = add(set1(1.0f / 24), mul(a2, c));
+    c = add(set1(-1.0f / 2), mul(a2, c));
+    cos = add(set1(1.0f), mul(a2, c));
+    floatv norm = sub(set1(1.5f),
+                      mul(set1(0.5f), add(mul(sin, sin), mul(cos, cos))));
+    sin = mul(sin, norm);
+    cos = mul(cos, norm);
+}
+
+/// Turns and moves one SIMD register of balls, random holds values in [0, 1)
+static inline void wiggle(const float* random, const float* size, float* posX,
+                          float* posY, float* velX, float* velY, float theta,
+                          float width, float height, float scale) {
+    using namespace SIMD;
+    floatv angle = mul(sub(loadu(random), set1(0.5f)), set1(theta));
+    floatv sin, cos;
+    headingRotationSIMD(angle, sin, cos);
+
+    floatv s = loadu(size);
+    floatv vx = loadu(velX);
+    floatv vy = loadu(velY);
+    floatv rx = sub(mul(cos, vx), mul(sin, vy));
+    floatv ry = add(mul(sin, vx), mul(cos, vy));
+    floatv x = add(loadu(posX), mul(rx, set1(scale)));
+    floatv y = add(loadu(posY), mul(ry, set1(scale)));
+
+    Integrator::bounce(x, rx, s, set1(width));
+    Integrator::bounce(y, ry, s, set1(height));
+
+    storeu(posX, x);
+    storeu(posY, y);
+    storeu(velX, rx);
+    storeu(velY, ry);
+}
+
+/** Turns every ball by a random angle then moves it
+ *  @see updateMetaballs_RandomPath
+ */
+void BallSystem::updateRandomPath(float theta, float width, float height,
+                                  uint64_t seed, uint64_t frame, float scale) {
+    updateRandomPath(0, m_count, theta, width, height, seed, frame, scale);
+}
+
+/** Turns the balls in [first, last) by a random angle then moves them
+ *  @param first Index of the first ball to update
+ *  @param last One past the last ball to update
+ *  @param theta The widest allowed turn in radians, clamped to pi
+ *  @param width The width of the area the balls are contained in
+ *  @param height The height of the area the balls are contained in
+ *  @param seed The seed for the run
+ *  @param frame The frame number, each frame draws fresh random numbers
+ *  @param scale The fraction of a full step to take, the widest turn is
+ * scaled along with the distance moved
+ *
+ *  @note The angle for a ball only depends on its index, the seed and the
+ * frame, so any split of the range across threads gives the same result
+ */
+void BallSystem::updateRandomPath(size_t first, size_t last, float theta,
+                                  float width, float height, uint64_t seed,
+                                  uint64_t frame, float scale) {
+    const size_t batchSize = 256;
+    alignas(64) float random[batchSize];
+
+    float* size = m_size.data();
+    float* posX = m_posX.data();
+    float* posY = m_posY.data();
+    float* velX = m_velX.data();
+    float* velY = m_velY.data();
+
+    uint32_t key = CounterRNG::key(seed, frame);
+    theta = std::min(std::fabs(theta), (float)M_PI) * scale;
+
+    for (size_t batch = first; batch < last; batch += batchSize) {
+        size_t end = std::min(batch + batchSize, last);
+        CounterRNG::uniform(key, (uint32_t)batch, end - batch, random);
+
+        size_t i = batch;
+        for (; i + SIMD::width <= end; i += SIMD::width) {
+            wiggle(random + (i - batch), size + i, posX + i, posY + i,
+                   velX + i, velY + i, theta, width, height, scale);
+        }
+        if (i == end) {
+            continue;
+        }
+
+        // the remainder goes through the same kernel on padded copies so a
+        // ball's result never depends on where the range was split
+        alignas(64) float tail[6][SIMD::width] = {};
+        size_t remaining = end - i;
+        for (size_t j = 0; j < remaining; j++) {
+            tail[0][j] = random[i - batch + j];
+            tail[1][j] = size[i + j];
+            tail[2][j] = posX[i + j];
+            tail[3][j] = posY[i + j];
+            tail[4][j] = velX[i + j];
+            tail[5][j] = velY[i + j];
+        }
+        wiggle(tail[0], tail[1], tail[2], tail[3], tail[4], tail[5], theta,
+               width, height, scale);
+        for (size_t j = 0; j < remaining; j++) {
+            posX[i + j] = tail[2][j];
+            posY[i + j] = tail[3][j];
+            velX[i + j] = tail[4][j];
+            velY[i + j] = tail[5][j];
+        }
+    }
+}
+
+float* BallSystem::size() { return m_size.data(); }
+float* BallSystem::posX() { return m_posX.data(); }
+float* BallSystem::posY() { return m_posY.data(); }
+float* BallSystem::velX() { return m_velX.data(); }
+float* BallSystem::velY() { return m_velY.data(); }
+float* BallSystem::red() { return m_red.data(); }
+float* BallSystem::green() { return m_green.data(); }
+float* BallSystem::blue() { return m_blue.data(); }
+float* BallSystem::prevX() { return m_prevX.data(); }
+float* BallSystem::prevY() { return m_prevY.data(); }
+const float* BallSystem::size() const { return m_size.data(); }
+const float* BallSystem::posX() const { return m_posX.data(); }
+const float* BallSystem::posY() const { return m_posY.data(); }
+const float* BallSystem::velX() const { return m_velX.data(); }
+const float* BallSystem::velY() const { return m_velY.data(); }
+const float* BallSystem::red() const { return m_red.data(); }
+const float* BallSystem::green() const { return m_green.data(); }
+const float* BallSystem::blue() const { return m_blue.data(); }
+const float* BallSystem::prevX() const { return m_prevX.data(); }
+const float* BallSystem::prevY() const { return m_prevY.data(); }
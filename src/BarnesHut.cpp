@@ -0,0 +1,192 @@
+#include "BarnesHut.h"
+
+#include <algorithm>
+#include <cmath>
+
+#include "JobSystem.h"
+#include "Profiler.h"
+#include "SIMD.h"
+
+const uint32_t BarnesHut::s_leafSize = 32;
+const float BarnesHut::s_softening = 10.0f;
+
+namespace {
+
+    const size_t s_grain = 16;  ///< leaves per force job
+
+}  // namespace
+
+/// BarnesHut default constructor
+BarnesHut::BarnesHut() : m_tree(s_leafSize) {}
+
+/// Returns the number of nodes in the last built tree
+size_t BarnesHut::nodeCount() const { return m_tree.nodes().size(); }
+
+/** Builds the quadtree for the current ball positions
+ *  @param balls The balls to build over, a ball's mass is its size
+ */
+void BarnesHut::build(const BallSystem& balls) {
+    PROFILE_SCOPE("BarnesHut::build");
+    size_t count = balls.count();
+    m_tree.build(balls.posX(), balls.posY(), count);
+    const std::vector<uint32_t>& order = m_tree.order();
+    const float* posX = balls.posX();
+    const float* posY = balls.posY();
+    const float* size = balls.size();
+
+    m_x.resize(count);
+    m_y.resize(count);
+    m_mass.resize(count);
+    JobSystem::parallelFor(0, count, 4096, [&](size_t first, size_t last) {
+        for (size_t k = first; k < last; k++) {
+            uint32_t i = order[k];
+            m_x[k] = posX[i];
+            m_y[k] = posY[i];
+            m_mass[k] = std::fabs(size[i]);
+        }
+    });
+
+    // children come after their parent, so walking backwards sums them first
+    const std::vector<Quadtree::Node>& nodes = m_tree.nodes();
+    m_moments.resize(nodes.size());
+    for (uint32_t n = (uint32_t)nodes.size(); n-- > 0;) {
+        const Quadtree::Node& node = nodes[n];
+        float mass = 0.0f, x = 0.0f, y = 0.0f;
+        if (m_tree.isLeaf(n)) {
+            for (uint32_t k = node.first; k < node.first + node.count; k++) {
+                mass += m_mass[k];
+                x += m_mass[k] * m_x[k];
+                y += m_mass[k] * m_y[k];
+            }
+        } else {
+            for (uint32_t child = n + 1; child < node.next;
+                 child = nodes[child].next) {
+                const Moment& moment = m_moments[child];
+                mass += moment.mass;
+                x += moment.mass * moment.x;
+                y += moment.mass * moment.y;
+            }
+        }
+        m_moments[n].mass = mass;
+        m_moments[n].x = mass > 0.0f ? x / mass : m_x[node.first];
+        m_moments[n].y = mass > 0.0f ? y / mass : m_y[node.first];
+    }
+}
+
+/** Computes the pull on every ball towards the others, by their size
+ *  @param balls The balls the tree was built from
+ *  @param theta Opening angle, cells narrower than theta times their
+ * distance are treated as a single ball. 0 is exact and slow
+ *  @param strength Acceleration from a ball of size 1 at distance 1 in
+ * pixels per tick squared, negative values push the balls apart
+ *  @param accX Receives the acceleration of each ball along x
+ *  @param accY Receives the acceleration of each ball along y
+ *
+ *  @note build() must be called after the positions last changed
+ */
+void BarnesHut::accelerations(const BallSystem& balls, float theta,
+                              float strength, float* accX,
+                              float* accY) const {
+    PROFILE_SCOPE("BarnesHut::accelerations");
+    const std::vector<Quadtree::Node>& nodes = m_tree.nodes();
+    if (nodes.empty()) {
+        std::fill(accX, accX + balls.count(), 0.0f);
+        std::fill(accY, accY + balls.count(), 0.0f);
+        return;
+    }
+    const float theta2 = theta * theta;
+    const uint32_t numNodes = (uint32_t)nodes.size();
+    const std::vector<uint32_t>& leaves = m_tree.leaves();
+    const std::vector<uint32_t>& order = m_tree.order();
+
+    // every leaf walks the tree once for all of its balls, measuring from
+    // the leaf's bounds, then the list is applied to each ball with SIMD
+    JobSystem::parallelFor(0, leaves.size(), s_grain, [&](size_t begin,
+                                                            size_t end) {
+        AlignedVector<float> listX, listY, listMass;
+        for (size_t leafIndex = begin; leafIndex < end; leafIndex++) {
+            uint32_t leaf = leaves[leafIndex];
+            uint32_t first = nodes[leaf].first;
+            uint32_t last = first + nodes[leaf].count;
+            float minX = m_x[first], maxX = m_x[first];
+            float minY = m_y[first], maxY = m_y[first];
+            for (uint32_t k = first + 1; k < last; k++) {
+                minX = std::min(minX, m_x[k]);
+                maxX = std::max(maxX, m_x[k]);
+                minY = std::min(minY, m_y[k]);
+                maxY = std::max(maxY, m_y[k]);
+            }
+
+            listX.clear();
+            listY.clear();
+            listMass.clear();
+            uint32_t n = 0;
+            while (n < numNodes) {
+                const Quadtree::Node& node = nodes[n];
+                const Moment& moment = m_moments[n];
+                float dx = std::max(
+                    std::max(minX - moment.x, moment.x - maxX), 0.0f);
+                float dy = std::max(
+                    std::max(minY - moment.y, moment.y - maxY), 0.0f);
+                if (node.width * node.width < theta2 * (dx * dx + dy * dy)) {
+                    listX.push_back(moment.x);
+                    listY.push_back(moment.y);
+                    listMass.push_back(moment.mass);
+                    n = node.next;
+                } else if (node.next == n + 1) {
+                    // the leaf's own balls land here too, a ball's pull on
+                    // itself is zero thanks to the softening
+                    uint32_t stop = node.first + node.count;
+                    for (uint32_t l = node.first; l < stop; l++) {
+                        listX.push_back(m_x[l]);
+                        listY.push_back(m_y[l]);
+                        listMass.push_back(m_mass[l]);
+                    }
+                    n = node.next;
+                } else {
+                    n++;
+                }
+            }
+            // massless padding fills out the last register
+            while (listX.size() % SIMD::width) {
+                listX.push_back(listX.back());
+                listY.push_back(listY.back());
+                listMass.push_back(0.0f);
+            }
+
+            for (uint32_t k = first; k < last; k++) {
+                float ax, ay;
+                pull(listX.data(), listY.data(), listMass.data(),
+                     listX.size(), m_x[k], m_y[k], ax, ay);
+                uint32_t ball = order[k];
+                accX[ball] = ax * strength;
+                accY[ball] = ay * strength;
+            }
+        }
+    });
+}
+
+/// Sums the softened pull of an interaction list on a single point
+void BarnesHut::pull(const float* listX, const float* listY,
+                     const float* listMass, size_t count, float x, float y,
+                     float& ax, float& ay) {
+    using namespace SIMD;
+    const floatv px = set1(x);
+    const floatv py = set1(y);
+    const floatv softening2 = set1(s_softening * s_softening);
+    const floatv one = set1(1.0f);
+    floatv sumX = set1(0.0f);
+    floatv sumY = set1(0.0f);
+    for (size_t i = 0; i < count; i += width) {
+        floatv dx = sub(load(listX + i), px);
+        floatv dy = sub(load(listY + i), py);
+        floatv inverse = div(
+            one, SIMD::sqrt(add(add(mul(dx, dx), mul(dy, dy)), softening2)));
+        floatv strength =
+            mul(load(listMass + i), mul(inverse, mul(inverse, inverse)));
+        sumX = add(sumX, mul(strength, dx));
+        sumY = add(sumY, mul(strength, dy));
+    }
+    ax = sum(sumX);
+    ay = sum(sumY);
+}
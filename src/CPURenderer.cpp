@@ -0,0 +1,321 @@
+#include "CPURenderer.h"
+
+#include <algorithm>
+#include <cmath>
+#include <stdexcept>
+
+#include "JobSystem.h"
+#include "PerfCounters.h"
+#include "Profiler.h"
+#include "SIMD.h"
+
+namespace {
+
+    /// Finds a parameter's uniform value by name, or the fallback if missing
+    float parameter(const Shader::ProgramEntry& entry,
+                    const std::string& uniform, float fallback) {
+        for (auto& param : entry.params) {
+            if (param.uniform == uniform) {
+                return Shader::uniformValue(param);
+            }
+        }
+        return fallback;
+    }
+
+    /// Returns the sum of size / distance over every ball
+    float fieldSum(const BallSystem& balls, float x, float y) {
+        const float* size = balls.size();
+        const float* posX = balls.posX();
+        const float* posY = balls.posY();
+        size_t count = balls.count();
+
+        size_t i = 0;
+        SIMD::floatv sum = SIMD::set1(0.0f);
+        const SIMD::floatv px = SIMD::set1(x);
+        const SIMD::floatv py = SIMD::set1(y);
+        for (; i + SIMD::width <= count; i += SIMD::width) {
+            SIMD::floatv dx = SIMD::sub(SIMD::loadu(posX + i), px);
+            SIMD::floatv dy = SIMD::sub(SIMD::loadu(posY + i), py);
+            SIMD::floatv dist = SIMD::sqrt(
+                SIMD::add(SIMD::mul(dx, dx), SIMD::mul(dy, dy)));
+            sum = SIMD::add(sum, SIMD::div(SIMD::loadu(size + i), dist));
+        }
+        float total = SIMD::sum(sum);
+        for (; i < count; i++) {
+            float dx = posX[i] - x;
+            float dy = posY[i] - y;
+            total += size[i] / std::sqrt(dx * dx + dy * dy);
+        }
+        return total;
+    }
+
+    /// Kernel for circles.comp, the first ball covering the pixel wins
+    struct Circles {
+        const BallSystem* balls;
+
+        void operator()(float x, float y, float* color) const {
+            for (size_t i = 0; i < balls->count(); i++) {
+                float dx = balls->posX()[i] - x;
+                float dy = balls->posY()[i] - y;
+                if (std::sqrt(dx * dx + dy * dy) <= balls->size()[i]) {
+                    color[0] = balls->red()[i];
+                    color[1] = balls->green()[i];
+                    color[2] = balls->blue()[i];
+                    return;
+                }
+            }
+        }
+    };
+
+    /// Kernel for cells.comp, colors by the closest ball inside the threshold
+    struct Cells {
+        const BallSystem* balls;
+        float threshold;
+
+        void operator()(float x, float y, float* color) const {
+            float sum = 0.0f;
+            float minDistance = 100000.0f;
+            size_t closest = 0;
+            for (size_t i = 0; i < balls->count(); i++) {
+                float dx = balls->posX()[i] - x;
+                float dy = balls->posY()[i] - y;
+                float dist = std::sqrt(dx * dx + dy * dy);
+                sum += balls->size()[i] / dist;
+                if (dist < minDistance) {
+                    minDistance = dist;
+                    closest = i;
+                }
+            }
+            if (sum > threshold) {
+                color[0] = balls->red()[closest];
+                color[1] = balls->green()[closest];
+                color[2] = balls->blue()[closest];
+            }
+        }
+    };
+
+    /// Kernel for meta_bg.comp
+    struct BlueGreen {
+        const BallSystem* balls;
+        float radiusMult;
+
+        void operator()(float x, float y, float* color) const {
+            float val = radiusMult * fieldSum(*balls, x, y) / 255;
+            color[1] = 1.0f - val;
+            color[2] = val;
+        }
+    };
+
+    /// Kernel for meta_ro.comp
+    struct RedOrange {
+        const BallSystem* balls;
+        float radiusMult;
+
+        void operator()(float x, float y, float* color) const {
+            float val = radiusMult * fieldSum(*balls, x, y) / 255;
+            color[0] = val + (1.0f - val);
+            color[1] = val * 0.2f;
+        }
+    };
+
+    /// Kernel for meta_rgb.comp, blends every ball's color by its weight
+    struct RGB {
+        const BallSystem* balls;
+        float radiusMult;
+
+        void operator()(float x, float y, float* color) const {
+            size_t count = balls->count();
+            if (count == 0) {
+                return;
+            }
+            for (size_t i = 0; i < count; i++) {
+                float dx = balls->posX()[i] - x;
+                float dy = balls->posY()[i] - y;
+                float dist = std::sqrt(dx * dx + dy * dy);
+                float mult = radiusMult * balls->size()[i] / dist;
+                color[0] += mult * balls->red()[i];
+                color[1] += mult * balls->green()[i];
+                color[2] += mult * balls->blue()[i];
+            }
+            for (int c = 0; c < 3; c++) {
+                color[c] /= 255.0f * count;
+            }
+        }
+    };
+
+    /// Kernel for meta_params.comp, and meta_fmm.comp through shade()
+    struct Parameterized {
+        const BallSystem* balls;
+        float radiusMult;
+        bool channels[3];
+        bool high;
+
+        void operator()(float x, float y, float* color) const {
+            shade(fieldSum(*balls, x, y), color);
+        }
+
+        /// Colors a pixel from its field sum
+        void shade(float field, float* color) const {
+            float val = radiusMult * field / 255;
+            for (int c = 0; c < 3; c++) {
+                color[c] = high ? 1.0f : 0.0f;
+                if (channels[c]) {
+                    color[c] = high ? 1.0f - val : val;
+                }
+            }
+        }
+    };
+
+    PerfCounters::Section s_renderCounters("CPU field", "pixel");
+
+}  // namespace
+
+/** CPURenderer constructor
+ *  @param tileSize The width and height of the tiles handed to each job
+ */
+CPURenderer::CPURenderer(int tileSize)
+    : m_width(0),
+      m_height(0),
+      m_tileSize(std::max(tileSize, 1)),
+      m_originX(0.0f),
+      m_originY(0.0f),
+      m_scaleX(1.0f),
+      m_scaleY(1.0f) {}
+
+/// Resizes the output image, the contents are undefined until render()
+void CPURenderer::resize(int width, int height) {
+    m_width = std::max(width, 0);
+    m_height = std::max(height, 0);
+    m_pixels.resize((size_t)m_width * m_height * 4);
+}
+
+int CPURenderer::width() const { return m_width; }
+
+int CPURenderer::height() const { return m_height; }
+
+/// Returns the rendered rows of RGBA floats
+const float* CPURenderer::pixels() const { return m_pixels.data(); }
+
+/** Maps the image's pixels to ball coordinates
+ *  @param originX Where the left column is shaded
+ *  @param originY Where the top row is shaded
+ *  @param scaleX Ball coordinates between neighbouring columns
+ *  @param scaleY Ball coordinates between neighbouring rows
+ */
+void CPURenderer::setView(float originX, float originY, float scaleX,
+                          float scaleY) {
+    m_originX = originX;
+    m_originY = originY;
+    m_scaleX = scaleX;
+    m_scaleY = scaleY;
+}
+
+/// Returns whether a kernel exists for the shader with the provided id
+bool CPURenderer::supports(const std::string& id) {
+    return id == "circles" || id == "cells" || id == "meta_bg" ||
+           id == "meta_ro" || id == "meta_rgb" || id == "meta_params" ||
+           id == "meta_fmm";
+}
+
+/** Renders a frame with the kernel matching a manifest entry
+ *  @param entry The selected shader, its parameters are used as uniforms
+ *  @param balls The balls to render
+ *
+ *  @note Throws a runtime error if there's no kernel for the entry
+ */
+void CPURenderer::render(const Shader::ProgramEntry& entry,
+                         const BallSystem& balls) {
+    PROFILE_SCOPE("CPURenderer::render");
+    PerfCounters::Scope counters(s_renderCounters,
+                                 (uint64_t)m_width * m_height);
+    const std::string& id = entry.id;
+    if (id == "circles") {
+        renderTiles(Circles{&balls});
+    } else if (id == "cells") {
+        renderTiles(Cells{&balls, parameter(entry, "sumThresh", 5.0f)});
+    } else if (id == "meta_bg") {
+        renderTiles(BlueGreen{&balls, parameter(entry, "radiusMult", 100.0f)});
+    } else if (id == "meta_ro") {
+        renderTiles(RedOrange{&balls, parameter(entry, "radiusMult", 400.0f)});
+    } else if (id == "meta_rgb") {
+        renderTiles(RGB{&balls, parameter(entry, "radiusMult", 1000.0f)});
+    } else if (id == "meta_params" || id == "meta_fmm") {
+        Parameterized kernel = {&balls,
+                                parameter(entry, "radiusMult", 400.0f),
+                                {parameter(entry, "red", 1.0f) != 0.0f,
+                                 parameter(entry, "green", 0.0f) != 0.0f,
+                                 parameter(entry, "blue", 0.0f) != 0.0f},
+                                parameter(entry, "high", 0.0f) != 0.0f};
+        if (id == "meta_fmm") {
+            m_fieldTree.build(balls);
+            renderFieldTiles(kernel, parameter(entry, "tolerance", 0.01f));
+        } else {
+            renderTiles(kernel);
+        }
+    } else {
+        throw std::runtime_error("No CPU kernel for shader " + id);
+    }
+}
+
+/// Runs a kernel over every pixel, one job per tile
+template <typename Kernel>
+void CPURenderer::renderTiles(const Kernel& kernel) {
+    int tilesX = (m_width + m_tileSize - 1) / m_tileSize;
+    int tilesY = (m_height + m_tileSize - 1) / m_tileSize;
+    JobSystem::parallelFor(
+        0, (size_t)tilesX * tilesY, 1, [&](size_t begin, size_t end) {
+            for (size_t tile = begin; tile < end; tile++) {
+                int x0 = (int)(tile % tilesX) * m_tileSize;
+                int y0 = (int)(tile / tilesX) * m_tileSize;
+                int x1 = std::min(x0 + m_tileSize, m_width);
+                int y1 = std::min(y0 + m_tileSize, m_height);
+                for (int y = y0; y < y1; y++) {
+                    float* row = &m_pixels[((size_t)y * m_width + x0) * 4];
+                    float posY = m_originY + y * m_scaleY;
+                    for (int x = x0; x < x1; x++, row += 4) {
+                        row[0] = row[1] = row[2] = 0.0f;
+                        kernel(m_originX + x * m_scaleX, posY, row);
+                        row[3] = 1.0f;
+                    }
+                }
+            }
+        });
+}
+
+/** Runs a kernel's shade() over every pixel with the field from the tree
+ *  @param kernel The kernel to color the pixels with
+ *  @param tolerance The error allowed for each node of the tree
+ *
+ *  @note Each tile gathers the balls and expansions acting on it once, then
+ * every pixel in it only sums that list
+ */
+template <typename Kernel>
+void CPURenderer::renderFieldTiles(const Kernel& kernel, float tolerance) {
+    int tilesX = (m_width + m_tileSize - 1) / m_tileSize;
+    int tilesY = (m_height + m_tileSize - 1) / m_tileSize;
+    JobSystem::parallelFor(
+        0, (size_t)tilesX * tilesY, 1, [&](size_t begin, size_t end) {
+            FieldTree::Terms terms;
+            for (size_t tile = begin; tile < end; tile++) {
+                int x0 = (int)(tile % tilesX) * m_tileSize;
+                int y0 = (int)(tile / tilesX) * m_tileSize;
+                int x1 = std::min(x0 + m_tileSize, m_width);
+                int y1 = std::min(y0 + m_tileSize, m_height);
+                m_fieldTree.gather(
+                    m_originX + x0 * m_scaleX, m_originY + y0 * m_scaleY,
+                    m_originX + (x1 - 1) * m_scaleX,
+                    m_originY + (y1 - 1) * m_scaleY, tolerance, terms);
+                for (int y = y0; y < y1; y++) {
+                    float* row = &m_pixels[((size_t)y * m_width + x0) * 4];
+                    float posY = m_originY + y * m_scaleY;
+                    for (int x = x0; x < x1; x++, row += 4) {
+                        row[0] = row[1] = row[2] = 0.0f;
+                        kernel.shade(FieldTree::evaluate(
+                                         terms, m_originX + x * m_scaleX, posY),
+                                     row);
+                        row[3] = 1.0f;
+                    }
+                }
+            }
+        });
+}
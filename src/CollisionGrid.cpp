@@ -0,0 +1,206 @@
+#include "CollisionGrid.h"
+
+#include <algorithm>
+#include <cmath>
+
+#include "JobSystem.h"
+#include "Profiler.h"
+#include "SIMD.h"
+
+namespace {
+
+    const size_t s_grain = 1024;  ///< balls per job
+
+}  // namespace
+
+/// CollisionGrid default constructor
+CollisionGrid::CollisionGrid() : m_cellSize(1.0f), m_cellsX(1), m_cellsY(1) {}
+
+/** Pushes overlapping balls apart and exchanges their momentum
+ *  @param balls The balls to collide, positions and velocities are updated
+ *  @param width The width of the area the balls are contained in
+ *  @param height The height of the area the balls are contained in
+ *
+ *  @note Mass is proportional to size squared, collisions are fully elastic
+ */
+void CollisionGrid::resolve(BallSystem& balls, float width, float height) {
+    PROFILE_SCOPE("CollisionGrid::resolve");
+    if (balls.count() < 2) {
+        return;
+    }
+    buildGrid(balls, width, height);
+    JobSystem::parallelFor(0, balls.count(), s_grain,
+                           [&](size_t first, size_t last) {
+                               resolveRange(balls, first, last);
+                           });
+}
+
+/// Bins every ball by cell and copies the balls into cell order
+void CollisionGrid::buildGrid(const BallSystem& balls, float width,
+                              float height) {
+    size_t count = balls.count();
+    const float* size = balls.size();
+    const float* posX = balls.posX();
+    const float* posY = balls.posY();
+
+    float maxSize = 0.0f;
+    for (size_t i = 0; i < count; i++) {
+        maxSize = std::max(maxSize, std::fabs(size[i]));
+    }
+    width = std::max(width, 1.0f);
+    height = std::max(height, 1.0f);
+
+    // two radii per cell, grown if tiny balls would need too many cells
+    m_cellSize = std::max(2.0f * maxSize, 1.0f);
+    float minArea = width * height / (4.0f * count + 16.0f);
+    m_cellSize = std::max(m_cellSize, std::sqrt(minArea));
+    m_cellsX = std::max<size_t>(1, (size_t)std::ceil(width / m_cellSize));
+    m_cellsY = std::max<size_t>(1, (size_t)std::ceil(height / m_cellSize));
+    size_t numCells = m_cellsX * m_cellsY;
+
+    m_cellOf.resize(count);
+    m_order.resize(count);
+    m_cellStart.assign(numCells + 1, 0);
+    // padded so the narrow phase can always load a full register
+    m_size.resize(count + SIMD::width);
+    m_posX.resize(count + SIMD::width);
+    m_posY.resize(count + SIMD::width);
+    m_velX.resize(count + SIMD::width);
+    m_velY.resize(count + SIMD::width);
+
+    float inverseCell = 1.0f / m_cellSize;
+    JobSystem::parallelFor(0, count, s_grain, [&](size_t first, size_t last) {
+        for (size_t i = first; i < last; i++) {
+            // balls past the walls are clamped into the edge cells
+            float fx = std::min(std::max(posX[i] * inverseCell, 0.0f),
+                                (float)(m_cellsX - 1));
+            float fy = std::min(std::max(posY[i] * inverseCell, 0.0f),
+                                (float)(m_cellsY - 1));
+            m_cellOf[i] = (uint32_t)fy * m_cellsX + (uint32_t)fx;
+        }
+    });
+
+    // counting sort, cheap enough to stay on one thread
+    for (size_t i = 0; i < count; i++) {
+        m_cellStart[m_cellOf[i] + 1]++;
+    }
+    for (size_t c = 0; c < numCells; c++) {
+        m_cellStart[c + 1] += m_cellStart[c];
+    }
+    std::vector<uint32_t> next(m_cellStart.begin(), m_cellStart.end() - 1);
+    for (size_t i = 0; i < count; i++) {
+        m_order[next[m_cellOf[i]]++] = (uint32_t)i;
+    }
+
+    const float* velX = balls.velX();
+    const float* velY = balls.velY();
+    JobSystem::parallelFor(0, count, s_grain, [&](size_t first, size_t last) {
+        for (size_t k = first; k < last; k++) {
+            uint32_t i = m_order[k];
+            m_size[k] = std::fabs(size[i]);
+            m_posX[k] = posX[i];
+            m_posY[k] = posY[i];
+            m_velX[k] = velX[i];
+            m_velY[k] = velY[i];
+        }
+    });
+}
+
+/** Resolves the collisions of the sorted balls in [first, last)
+ *  Reads only the sorted copies and writes only the balls owned by the range
+ */
+void CollisionGrid::resolveRange(BallSystem& balls, size_t first,
+                                 size_t last) const {
+    using namespace SIMD;
+    const float* size = m_size.data();
+    const float* posX = m_posX.data();
+    const float* posY = m_posY.data();
+    const float* velX = m_velX.data();
+    const float* velY = m_velY.data();
+    float* outPosX = balls.posX();
+    float* outPosY = balls.posY();
+    float* outVelX = balls.velX();
+    float* outVelY = balls.velY();
+
+    alignas(64) float lanes[width];
+    for (size_t i = 0; i < width; i++) {
+        lanes[i] = (float)i;
+    }
+    const floatv laneIndex = load(lanes);
+    const floatv zero = set1(0.0f);
+    const floatv one = set1(1.0f);
+    const floatv two = set1(2.0f);
+
+    for (size_t k = first; k < last; k++) {
+        uint32_t ball = m_order[k];
+        size_t cell = m_cellOf[ball];
+        size_t cx = cell % m_cellsX;
+        size_t cy = cell / m_cellsX;
+
+        const floatv x = set1(posX[k]);
+        const floatv y = set1(posY[k]);
+        const floatv vx = set1(velX[k]);
+        const floatv vy = set1(velY[k]);
+        const floatv radius = set1(size[k]);
+        const floatv mass = mul(radius, radius);
+        const floatv self = set1((float)k);
+        floatv moveX = zero, moveY = zero;
+        floatv pushX = zero, pushY = zero;
+
+        size_t x0 = cx > 0 ? cx - 1 : 0;
+        size_t y0 = cy > 0 ? cy - 1 : 0;
+        size_t x1 = std::min(cx + 1, m_cellsX - 1);
+        size_t y1 = std::min(cy + 1, m_cellsY - 1);
+        for (size_t row = y0; row <= y1; row++) {
+            // cells in a row are contiguous in the sorted order
+            size_t begin = m_cellStart[row * m_cellsX + x0];
+            size_t end = m_cellStart[row * m_cellsX + x1 + 1];
+            const floatv rowEnd = set1((float)end);
+            for (size_t l = begin; l < end; l += width) {
+                // lanes past the row or on the ball itself are masked off
+                floatv index = add(set1((float)l), laneIndex);
+                floatv valid = andNot(cmplt(abs(sub(index, self)), one),
+                                      cmplt(index, rowEnd));
+
+                floatv otherRadius = loadu(size + l);
+                floatv reach = add(radius, otherRadius);
+                floatv dx = sub(x, loadu(posX + l));
+                floatv dy = sub(y, loadu(posY + l));
+                floatv distSq = add(mul(dx, dx), mul(dy, dy));
+                floatv hit = bitAnd(valid, cmplt(distSq, mul(reach, reach)));
+
+                // stacked balls are split along x by sorted order
+                floatv dist = sqrt(distSq);
+                floatv stacked = cmple(dist, zero);
+                floatv side = blend(one, set1(-1.0f), cmplt(self, index));
+                floatv inverse = div(one, blend(dist, one, stacked));
+                floatv nx = blend(mul(dx, inverse), side, stacked);
+                floatv ny = andNot(stacked, mul(dy, inverse));
+
+                floatv otherMass = mul(otherRadius, otherRadius);
+                floatv totalMass = add(mass, otherMass);
+                floatv share = blend(set1(0.5f), div(otherMass, totalMass),
+                                     cmplt(zero, totalMass));
+
+                // each ball moves its share of the overlap out of the way
+                floatv overlap = bitAnd(hit, mul(sub(reach, dist), share));
+                moveX = add(moveX, mul(nx, overlap));
+                moveY = add(moveY, mul(ny, overlap));
+
+                // elastic impulse, only while the pair is approaching
+                floatv approach =
+                    add(mul(sub(vx, loadu(velX + l)), nx),
+                        mul(sub(vy, loadu(velY + l)), ny));
+                floatv impulse = bitAnd(bitAnd(hit, cmplt(approach, zero)),
+                                        mul(two, mul(share, approach)));
+                pushX = sub(pushX, mul(impulse, nx));
+                pushY = sub(pushY, mul(impulse, ny));
+            }
+        }
+
+        outPosX[ball] = posX[k] + sum(moveX);
+        outPosY[ball] = posY[k] + sum(moveY);
+        outVelX[ball] = velX[k] + sum(pushX);
+        outVelY[ball] = velY[k] + sum(pushY);
+    }
+}
@@ -0,0 +1,231 @@
+#include "FieldTree.h"
+
+#include <algorithm>
+#include <cmath>
+
+#include "JobSystem.h"
+#include "Profiler.h"
+#include "SIMD.h"
+
+const uint32_t FieldTree::s_leafSize = 16;
+
+static_assert(sizeof(FieldTree::Node) == 48,
+              "FieldTree::Node must match the node struct in meta_fmm.comp");
+static_assert(sizeof(FieldTree::Point) == 16,
+              "FieldTree::Point must be a vec4 in meta_fmm.comp");
+
+namespace {
+
+    /** Pads a list with zero weight entries to a multiple of SIMD::width
+     *  @note They sit far outside the image so no pixel divides 0 by 0
+     */
+    void pad(AlignedVector<float>& x, AlignedVector<float>& y,
+             AlignedVector<float>& weight) {
+        while (x.size() % SIMD::width) {
+            x.push_back(1e18f);
+            y.push_back(1e18f);
+            weight.push_back(0.0f);
+        }
+    }
+
+}  // namespace
+
+/// FieldTree default constructor
+FieldTree::FieldTree() : m_tree(s_leafSize) {}
+
+/// Returns the expansion of every node, in the Quadtree's order
+const std::vector<FieldTree::Node>& FieldTree::nodes() const {
+    return m_nodes;
+}
+
+/// Returns the balls sorted into tree order
+const std::vector<FieldTree::Point>& FieldTree::points() const {
+    return m_points;
+}
+
+/** Converts an error tolerance to the radius / distance ratio under which a
+ *  node is summed through its expansion
+ *
+ *  The first term left out of the expansion is about (radius / distance)^3
+ *  of the node's contribution.
+ */
+float FieldTree::openingRatio(float tolerance) {
+    return std::cbrt(std::max(tolerance, 0.0f));
+}
+
+/** Builds the tree and expansions for the current ball positions
+ *  @param balls The balls to build over, sizes are expected to be positive
+ */
+void FieldTree::build(const BallSystem& balls) {
+    PROFILE_SCOPE("FieldTree::build");
+    size_t count = balls.count();
+    m_tree.build(balls.posX(), balls.posY(), count);
+    const std::vector<uint32_t>& order = m_tree.order();
+    const float* posX = balls.posX();
+    const float* posY = balls.posY();
+    const float* size = balls.size();
+
+    m_points.resize(count);
+    JobSystem::parallelFor(0, count, 4096, [&](size_t first, size_t last) {
+        for (size_t k = first; k < last; k++) {
+            uint32_t i = order[k];
+            m_points[k] = {posX[i], posY[i], size[i], 0.0f};
+        }
+    });
+
+    // children come after their parent, so walking backwards sums them
+    // first, and the parallel axis theorem moves their moments over
+    const std::vector<Quadtree::Node>& cells = m_tree.nodes();
+    m_nodes.resize(cells.size());
+    for (uint32_t n = (uint32_t)cells.size(); n-- > 0;) {
+        const Quadtree::Node& cell = cells[n];
+        Node& node = m_nodes[n];
+        node.first = cell.first;
+        node.count = cell.count;
+        node.next = cell.next;
+        node.pad = 0.0f;
+        node.pad2 = 0;
+
+        float mass = 0.0f, x = 0.0f, y = 0.0f;
+        bool leaf = m_tree.isLeaf(n);
+        if (leaf) {
+            for (uint32_t k = cell.first; k < cell.first + cell.count; k++) {
+                mass += m_points[k].size;
+                x += m_points[k].size * m_points[k].x;
+                y += m_points[k].size * m_points[k].y;
+            }
+        } else {
+            for (uint32_t child = n + 1; child < cell.next;
+                 child = cells[child].next) {
+                mass += m_nodes[child].mass;
+                x += m_nodes[child].mass * m_nodes[child].x;
+                y += m_nodes[child].mass * m_nodes[child].y;
+            }
+        }
+        node.mass = mass;
+        node.x = mass != 0.0f ? x / mass : m_points[cell.first].x;
+        node.y = mass != 0.0f ? y / mass : m_points[cell.first].y;
+
+        node.xx = node.xy = node.yy = node.radius = 0.0f;
+        if (leaf) {
+            for (uint32_t k = cell.first; k < cell.first + cell.count; k++) {
+                float dx = m_points[k].x - node.x;
+                float dy = m_points[k].y - node.y;
+                node.xx += m_points[k].size * dx * dx;
+                node.xy += m_points[k].size * dx * dy;
+                node.yy += m_points[k].size * dy * dy;
+                node.radius =
+                    std::max(node.radius, std::sqrt(dx * dx + dy * dy));
+            }
+        } else {
+            for (uint32_t child = n + 1; child < cell.next;
+                 child = cells[child].next) {
+                const Node& other = m_nodes[child];
+                float dx = other.x - node.x;
+                float dy = other.y - node.y;
+                node.xx += other.xx + other.mass * dx * dx;
+                node.xy += other.xy + other.mass * dx * dy;
+                node.yy += other.yy + other.mass * dy * dy;
+                node.radius = std::max(
+                    node.radius, std::sqrt(dx * dx + dy * dy) + other.radius);
+            }
+        }
+    }
+}
+
+/** Collects the balls and expansions acting on a rectangle of pixels
+ *  @param minX The left edge of the rectangle
+ *  @param minY The top edge of the rectangle
+ *  @param maxX The right edge of the rectangle
+ *  @param maxY The bottom edge of the rectangle
+ *  @param tolerance The error allowed for each node, 0 sums every ball
+ *  @param terms Receives the lists, cleared first
+ */
+void FieldTree::gather(float minX, float minY, float maxX, float maxY,
+                       float tolerance, Terms& terms) const {
+    terms.nearX.clear();
+    terms.nearY.clear();
+    terms.nearSize.clear();
+    terms.farX.clear();
+    terms.farY.clear();
+    terms.farMass.clear();
+    terms.farXX.clear();
+    terms.farXY.clear();
+    terms.farYY.clear();
+
+    // a node is accepted if it's narrow enough seen from the nearest pixel
+    float ratio = openingRatio(tolerance);
+    float ratio2 = ratio * ratio;
+    uint32_t numNodes = (uint32_t)m_nodes.size();
+    uint32_t n = 0;
+    while (n < numNodes) {
+        const Node& node = m_nodes[n];
+        float dx = std::max(std::max(minX - node.x, node.x - maxX), 0.0f);
+        float dy = std::max(std::max(minY - node.y, node.y - maxY), 0.0f);
+        if (node.radius * node.radius < ratio2 * (dx * dx + dy * dy)) {
+            terms.farX.push_back(node.x);
+            terms.farY.push_back(node.y);
+            terms.farMass.push_back(node.mass);
+            terms.farXX.push_back(node.xx);
+            terms.farXY.push_back(node.xy);
+            terms.farYY.push_back(node.yy);
+            n = node.next;
+        } else if (node.next == n + 1) {
+            for (uint32_t k = node.first; k < node.first + node.count; k++) {
+                terms.nearX.push_back(m_points[k].x);
+                terms.nearY.push_back(m_points[k].y);
+                terms.nearSize.push_back(m_points[k].size);
+            }
+            n = node.next;
+        } else {
+            n++;
+        }
+    }
+
+    pad(terms.nearX, terms.nearY, terms.nearSize);
+    pad(terms.farX, terms.farY, terms.farMass);
+    terms.farXX.resize(terms.farX.size(), 0.0f);
+    terms.farXY.resize(terms.farX.size(), 0.0f);
+    terms.farYY.resize(terms.farX.size(), 0.0f);
+}
+
+/** Sums the field of a set of terms at a pixel
+ *  @param terms Lists from gather() for a region containing the pixel
+ *  @param x The x coordinate of the pixel
+ *  @param y The y coordinate of the pixel
+ */
+float FieldTree::evaluate(const Terms& terms, float x, float y) {
+    using namespace SIMD;
+    const floatv px = set1(x);
+    const floatv py = set1(y);
+    const floatv one = set1(1.0f);
+    floatv total = set1(0.0f);
+
+    for (size_t i = 0; i < terms.nearX.size(); i += width) {
+        floatv dx = sub(load(terms.nearX.data() + i), px);
+        floatv dy = sub(load(terms.nearY.data() + i), py);
+        floatv dist = SIMD::sqrt(add(mul(dx, dx), mul(dy, dy)));
+        total = add(total, div(load(terms.nearSize.data() + i), dist));
+    }
+
+    // mass / r + (3 (r . Q . r) / r^2 - trace Q) / (2 r^3)
+    const floatv three = set1(3.0f);
+    const floatv half = set1(0.5f);
+    for (size_t i = 0; i < terms.farX.size(); i += width) {
+        floatv dx = sub(px, load(terms.farX.data() + i));
+        floatv dy = sub(py, load(terms.farY.data() + i));
+        floatv xx = load(terms.farXX.data() + i);
+        floatv xy = load(terms.farXY.data() + i);
+        floatv yy = load(terms.farYY.data() + i);
+        floatv r2 = add(mul(dx, dx), mul(dy, dy));
+        floatv inverse = div(one, SIMD::sqrt(r2));
+        floatv inverse2 = mul(inverse, inverse);
+        floatv rQr = add(add(mul(mul(dx, dx), xx), mul(mul(dy, dy), yy)),
+                         mul(mul(add(dx, dx), dy), xy));
+        floatv quad = sub(mul(mul(three, rQr), inverse2), add(xx, yy));
+        quad = mul(mul(quad, half), mul(inverse, inverse2));
+        total = add(total,
+                    add(mul(load(terms.farMass.data() + i), inverse), quad));
+    }
+    return SIMD::sum(total);
+}
@@ -0,0 +1,197 @@
+#include "FrameStats.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <stdexcept>
+
+namespace {
+
+    const char* s_phaseNames[] = {"wait", "events", "update", "draw",
+                                  "gui",  "swap",   "total"};
+    const float s_firstEdge = 0.5f;  // ms, the top of the first bin
+
+    /// Returns the time in a phase, or the whole frame for Phases
+    float value(const FrameStats::Frame& frame, int phase) {
+        return phase < FrameStats::Phases ? frame.phases[phase] : frame.total;
+    }
+
+    /// Nearest rank percentile of sorted values
+    float percentile(const std::vector<float>& sorted, float p) {
+        size_t rank = (size_t)std::ceil(p / 100.0f * sorted.size());
+        return sorted[std::min(std::max<size_t>(rank, 1), sorted.size()) - 1];
+    }
+
+}  // namespace
+
+/** FrameStats constructor
+ *  @param capacity The number of recent frames to keep
+ */
+FrameStats::FrameStats(size_t capacity)
+    : m_ring(std::max<size_t>(capacity, 1)), m_count(0) {
+    std::memset(&m_frame, 0, sizeof(m_frame));
+    m_start = m_last = clock::now();
+}
+
+/// Starts timing a frame
+void FrameStats::begin() {
+    std::memset(&m_frame, 0, sizeof(m_frame));
+    m_start = m_last = clock::now();
+}
+
+/** Ends a phase of the frame, the time since the last mark() or begin()
+ *  is added to it
+ */
+void FrameStats::mark(Phase phase) {
+    clock::time_point now = clock::now();
+    m_frame.phases[phase] +=
+        std::chrono::duration<float, std::milli>(now - m_last).count();
+    m_last = now;
+}
+
+/// Ends the frame and writes it into the ring, returns the frame
+const FrameStats::Frame& FrameStats::end() {
+    m_frame.total =
+        std::chrono::duration<float, std::milli>(clock::now() - m_start)
+            .count();
+    size_t count = m_count.load(std::memory_order_relaxed);
+    m_ring[count % m_ring.size()] = m_frame;
+    m_count.store(count + 1, std::memory_order_release);
+    return m_frame;
+}
+
+/// Returns the number of frames ever recorded
+size_t FrameStats::count() const {
+    return m_count.load(std::memory_order_acquire);
+}
+
+/// Returns the number of recent frames kept
+size_t FrameStats::capacity() const { return m_ring.size(); }
+
+/** Copies the recent frames out of the ring
+ *  @param frames Receives up to capacity() frames, oldest first
+ *
+ *  @note Only call this from the thread writing frames, another thread
+ * could copy a slot while end() overwrites it
+ */
+void FrameStats::recent(std::vector<Frame>& frames) const {
+    size_t count = m_count.load(std::memory_order_acquire);
+    size_t kept = std::min(count, m_ring.size());
+    frames.resize(kept);
+    for (size_t i = 0; i < kept; i++) {
+        frames[i] = m_ring[(count - kept + i) % m_ring.size()];
+    }
+}
+
+/// Returns the name of a phase, Phases is the whole frame
+const char* FrameStats::phaseName(Phase phase) { return s_phaseNames[phase]; }
+
+/** Summarizes the time spent in a phase
+ *  @param frames The frames to summarize
+ *  @param phase The phase, or Phases for whole frames
+ */
+FrameStats::Summary FrameStats::summarize(const std::vector<Frame>& frames,
+                                          int phase) {
+    Summary summary;
+    std::memset(&summary, 0, sizeof(summary));
+    summary.frames = frames.size();
+    if (frames.empty()) {
+        return summary;
+    }
+    std::vector<float> values(frames.size());
+    double sum = 0;
+    for (size_t i = 0; i < frames.size(); i++) {
+        values[i] = value(frames[i], phase);
+        sum += values[i];
+    }
+    std::sort(values.begin(), values.end());
+    summary.mean = (float)(sum / values.size());
+    summary.p50 = percentile(values, 50);
+    summary.p95 = percentile(values, 95);
+    summary.p99 = percentile(values, 99);
+    summary.max = values.back();
+    return summary;
+}
+
+/** Counts the frames falling in each log scaled bin, see binEdge()
+ *  @param frames The frames to count
+ *  @param phase The phase, or Phases for whole frames
+ */
+FrameStats::Histogram FrameStats::histogram(const std::vector<Frame>& frames,
+                                            int phase) {
+    Histogram bins;
+    bins.fill(0);
+    for (const Frame& frame : frames) {
+        float ms = value(frame, phase);
+        // bin b covers (binEdge(b - 1), binEdge(b)]
+        float octaves = ms > s_firstEdge ? std::log2(ms / s_firstEdge) : 0;
+        size_t bin = (size_t)std::ceil(octaves * 2.0f);
+        bins[std::min(bin, s_bins - 1)]++;
+    }
+    return bins;
+}
+
+/// Returns the top of a histogram bin in milliseconds, the last is open
+float FrameStats::binEdge(size_t bin) {
+    return s_firstEdge * std::pow(2.0f, bin / 2.0f);
+}
+
+/** Writes one line per frame with the time spent in each phase
+ *  @note Throws a runtime error if the file can't be written
+ */
+void FrameStats::writeCSV(const std::string& path,
+                          const std::vector<Frame>& frames) {
+    std::ofstream file(path);
+    file << "frame";
+    for (int phase = 0; phase <= Phases; phase++) {
+        file << ',' << s_phaseNames[phase] << "_ms";
+    }
+    file << '\n';
+    char number[32];
+    for (size_t i = 0; i < frames.size(); i++) {
+        file << i;
+        for (int phase = 0; phase <= Phases; phase++) {
+            snprintf(number, sizeof(number), ",%.4f", value(frames[i], phase));
+            file << number;
+        }
+        file << '\n';
+    }
+    if (!file) {
+        throw std::runtime_error("Unable to write " + path);
+    }
+}
+
+/** Writes the summary and histogram of every phase
+ *  @note Throws a runtime error if the file can't be written
+ */
+void FrameStats::writeJSON(const std::string& path,
+                           const std::vector<Frame>& frames) {
+    std::ofstream file(path);
+    char line[256];
+    file << "{\n  \"frames\": " << frames.size() << ",\n  \"bin_edges_ms\": [";
+    for (size_t bin = 0; bin + 1 < s_bins; bin++) {
+        snprintf(line, sizeof(line), "%s%.4g", bin ? ", " : "", binEdge(bin));
+        file << line;
+    }
+    file << "],\n  \"phases\": {";
+    for (int phase = 0; phase <= Phases; phase++) {
+        Summary summary = summarize(frames, phase);
+        snprintf(line, sizeof(line),
+                 "%s\n    \"%s\": {\"mean_ms\": %.4f, \"p50_ms\": %.4f, "
+                 "\"p95_ms\": %.4f, \"p99_ms\": %.4f, \"max_ms\": %.4f, ",
+                 phase ? "," : "", s_phaseNames[phase], summary.mean,
+                 summary.p50, summary.p95, summary.p99, summary.max);
+        file << line << "\"histogram\": [";
+        Histogram bins = histogram(frames, phase);
+        for (size_t bin = 0; bin < s_bins; bin++) {
+            file << (bin ? ", " : "") << bins[bin];
+        }
+        file << "]}";
+    }
+    file << "\n  }\n}\n";
+    if (!file) {
+        throw std::runtime_error("Unable to write " + path);
+    }
+}
@@ -0,0 +1,150 @@
+#include "GoldenImage.h"
+
+#include <algorithm>
+#include <cctype>
+#include <cmath>
+#include <cstdlib>
+#include <fstream>
+#include <limits>
+#include <stdexcept>
+
+#include "ImageWriter.h"
+
+namespace {
+
+    /// Reads the next number of a PPM header, skipping # comments
+    int readHeaderValue(std::istream& file) {
+        int c = file.get();
+        while (file && (std::isspace(c) || c == '#')) {
+            if (c == '#') {
+                while (file && c != '\n') {
+                    c = file.get();
+                }
+            }
+            c = file.get();
+        }
+        int value = 0;
+        if (!std::isdigit(c)) {
+            return -1;
+        }
+        while (file && std::isdigit(c)) {
+            value = value * 10 + (c - '0');
+            c = file.get();
+        }
+        // a single whitespace ends the number, and the header
+        return value;
+    }
+
+    /// Returns the luminance of a pixel
+    int grey(const uint8_t* pixel) {
+        return (pixel[0] * 77 + pixel[1] * 150 + pixel[2] * 29) >> 8;
+    }
+
+}  // namespace
+
+/** Measures how far a frame is from its reference
+ *  @param rgba The frame, 8 bit RGBA
+ *  @param reference The reference, the same size
+ *  @param threshold Pixels with a channel off by more than this are
+ * counted as outliers
+ */
+GoldenImage::Comparison GoldenImage::compare(const uint8_t* rgba,
+                                             const uint8_t* reference,
+                                             int width, int height,
+                                             int threshold) {
+    Comparison comparison;
+    comparison.maxError = 0;
+    comparison.differing = 0;
+    comparison.outliers = 0;
+    double squares = 0;
+    size_t pixels = (size_t)width * height;
+    for (size_t i = 0; i < pixels * 4; i += 4) {
+        int pixelError = 0;
+        for (size_t c = i; c < i + 3; c++) {
+            int error = std::abs((int)rgba[c] - (int)reference[c]);
+            pixelError = std::max(pixelError, error);
+            squares += (double)error * error;
+        }
+        comparison.maxError = std::max(comparison.maxError, pixelError);
+        comparison.differing += pixelError != 0;
+        comparison.outliers += pixelError > threshold;
+    }
+    double mse = squares / ((double)pixels * 3);
+    comparison.psnr = mse > 0 ? 10 * std::log10(255.0 * 255.0 / mse)
+                              : std::numeric_limits<double>::infinity();
+    return comparison;
+}
+
+/** Draws where a frame differs from its reference
+ *  The reference is shown dimmed and grey, with every differing pixel in
+ *  red, brighter the larger its error.
+ *
+ *  @param out Receives the 8 bit RGBA image
+ */
+void GoldenImage::diff(const uint8_t* rgba, const uint8_t* reference,
+                       int width, int height, std::vector<uint8_t>& out) {
+    size_t pixels = (size_t)width * height;
+    out.resize(pixels * 4);
+    for (size_t i = 0; i < pixels * 4; i += 4) {
+        int error = 0;
+        for (size_t c = i; c < i + 3; c++) {
+            error = std::max(error, std::abs((int)rgba[c] - reference[c]));
+        }
+        uint8_t background = (uint8_t)(grey(&reference[i]) / 4);
+        out[i] = error ? (uint8_t)(128 + error / 2) : background;
+        out[i + 1] = background;
+        out[i + 2] = background;
+        out[i + 3] = 255;
+    }
+}
+
+/** Reads a binary PPM, as written by writePPM()
+ *  @param rgba Receives the 8 bit RGBA pixels, alpha is opaque
+ *  @return False if the file doesn't exist
+ *
+ *  @note Throws a runtime error if the file isn't an 8 bit binary PPM
+ */
+bool GoldenImage::readPPM(const std::string& path, std::vector<uint8_t>& rgba,
+                          int& width, int& height) {
+    std::ifstream file(path, std::ios::binary);
+    if (!file) {
+        return false;
+    }
+    char magic[2];
+    file.read(magic, 2);
+    width = readHeaderValue(file);
+    height = readHeaderValue(file);
+    int maxValue = readHeaderValue(file);
+    if (!file || magic[0] != 'P' || magic[1] != '6' || width <= 0 ||
+        height <= 0 || maxValue != 255) {
+        throw std::runtime_error(path + " is not an 8 bit binary PPM");
+    }
+    size_t pixels = (size_t)width * height;
+    std::vector<uint8_t> rgb(pixels * 3);
+    file.read((char*)rgb.data(), rgb.size());
+    if ((size_t)file.gcount() != rgb.size()) {
+        throw std::runtime_error(path + " is truncated");
+    }
+    rgba.resize(pixels * 4);
+    for (size_t i = 0; i < pixels; i++) {
+        rgba[i * 4] = rgb[i * 3];
+        rgba[i * 4 + 1] = rgb[i * 3 + 1];
+        rgba[i * 4 + 2] = rgb[i * 3 + 2];
+        rgba[i * 4 + 3] = 255;
+    }
+    return true;
+}
+
+/** Writes a frame as a binary PPM, alpha is dropped
+ *  @note Throws a runtime error if the file can't be written
+ */
+void GoldenImage::writePPM(const std::string& path, const uint8_t* rgba,
+                           int width, int height) {
+    std::vector<uint8_t> encoded;
+    ImageWriter::encode(ImageWriter::PPM, rgba, width, height, encoded);
+    std::ofstream file(path, std::ios::binary);
+    file.write((const char*)encoded.data(), encoded.size());
+    if (!file) {
+        throw std::runtime_error("Unable to write " + path);
+    }
+}
@@ -1,34 +1,88 @@
 #include "Graphics.h"
 
+#include "PerfCounters.h"
+#include "Profiler.h"
+
 GLfloat Graphics::s_quadVertexBufferData[8] = {-1.0f, 1.0f, -1.0f, -1.0f,
                                                1.0f, 1.0f, 1.0f, -1.0f};
+const size_t Graphics::s_updateGrain = 1024;
+const uint64_t Graphics::s_spawnStream = 1ull << 63;
+
+static PerfCounters::Section s_guiCounters("GUI build", "frame");
 
-Graphics::Graphics(int height, int width)
+/// Returns whether the current context supports an extension
+static bool hasExtension(const char *name)
+{
+    GLint count = 0;
+    glGetIntegerv(GL_NUM_EXTENSIONS, &count);
+    for (GLint i = 0; i < count; i++)
+    {
+        const char *extension = (const char *)glGetStringi(GL_EXTENSIONS, i);
+        if (extension && strcmp(extension, name) == 0)
+        {
+            return true;
+        }
+    }
+    return false;
+}
+
+/// Returns whether buffers can stay mapped, which takes buffer storage
+static bool hasBufferStorage()
+{
+    GLint major = 0, minor = 0;
+    glGetIntegerv(GL_MAJOR_VERSION, &major);
+    glGetIntegerv(GL_MINOR_VERSION, &minor);
+    return major > 4 || (major == 4 && minor >= 4) ||
+           hasExtension("GL_ARB_buffer_storage");
+}
+
+Graphics::Graphics(int height, int width, uint64_t seed)
     : m_height(height),
       m_width(width),
       m_menuWidth(400),
       m_texOut(0),
       m_timeOffset(0),
       m_sizeChanged(true),
+      m_fieldDirty(true),
+      m_fieldTick(0),
+      m_fieldCommands(0),
+      m_fieldAlpha(0),
+      m_paused(false),
       m_wigglyMovement(false),
-      m_numBalls(0),
-      m_metaballs(0),
-      m_colors(0),
+      m_wiggleAngle(2.0f),
+      m_cpuRender(false),
+      m_collisions(false),
+      m_gravity(false),
+      m_gravityStrength(0.01f),
+      m_theta(0.7f),
+      m_integrator(SemiImplicitEuler),
+      m_drag(0.0f),
+      m_simulation(seed),
+      m_seed(seed),
+      m_spawned(0),
+      m_recorder(nullptr),
+      m_replay(nullptr),
+      m_replayCommand(0),
+      m_replayEvent(0),
+      m_replayTick(0),
+      m_sceneFile{"scene.mbs"},
+      m_quantizeScene(false),
+      m_alpha(1.0f),
+      m_ssboCount(0),
+      m_ssboCapacity(0),
       m_metaballsSSBO(0),
-      m_genSSBO(true),
+      m_ssboPersistent(false),
+      m_ssboFences{0, 0, 0},
+      m_ssboRegion(0),
+      m_ssboRegionBytes(0),
+      m_ssboStale(true),
       m_ssboBindingIndex(1),
-      m_currentShader(Default),
-      m_shaderName("Circles"),
-      m_cellsThresh(1),
-      m_metaBGRadiusMult(100),
-      m_metaRORadiusMult(400),
-      m_metaRGBRadiusMult(1000),
-      m_metaParamRadiusMult(100),
-      m_metaParamRed(true),
-      m_metaParamGreen(false),
-      m_metaParamBlue(false),
-      m_metaParamHigh(false),
-      m_ssboData(NULL)
+      m_currentShader(0),
+      m_ssboData(NULL),
+      m_fieldTreeSSBOs{0, 0},
+      m_tileOrigin{0.0f, 0.0f},
+      m_tileScale{1.0f, 1.0f},
+      m_frameStats(nullptr)
 {
 #if GRAPHICS_USE_SPIRV
     m_ubo = 0;
@@ -44,60 +98,35 @@ Graphics::Graphics(int height, int width)
     m_window->setDrawFunc(m_drawFunc);
     m_window->setGUIFunc(m_drawGUIFunc);
 
-    // prepare the compute shaders
-    // Circles, Cells, Meta_BlueGreen, Meta_RegOrange, Meta_RGB
-#if GRAPHICS_USE_SPIRV
-    std::vector<std::string> shaderFiles = {
-        "circles.comp.spv", "cells.comp.spv", "meta_bg.comp.spv",
-        "meta_ro.comp.spv", "meta_rgb.comp.spv", "meta_params.comp.spv"};
-#else
-    std::vector<std::string> shaderFiles = {
-        "circles.comp", "cells.comp", "meta_bg.comp",
-        "meta_ro.comp", "meta_rgb.comp", "meta_params.comp"};
-#endif
-    m_computeShaders.resize(NumShaderTypes);
-    for (int i = 0; i < NumShaderTypes; i++)
+    // load the list of compute shaders, programs are built once selected
+    try
     {
-        try
-        {
-            std::ifstream computeFS(std::string("shaders/") + shaderFiles[i]);
-            Shader::shader computeShader(computeFS, GL_COMPUTE_SHADER, GRAPHICS_USE_SPIRV);
+        m_shaders.load("shaders/shaders.manifest");
+    }
+    catch (std::exception &e)
+    {
+        printf("Error occurred while loading the shader manifest\n");
+        printf("%s\n", e.what());
+        exit(-1);
+    }
+    // start on the default program, or the first one this build can run
+    size_t first = m_shaders.defaultProgram();
+    for (size_t i = 0;
+         i < m_shaders.size() && !m_shaders.supports(first, GRAPHICS_BACKEND);
+         i++)
+    {
+        first = i;
+    }
+    if (!m_shaders.supports(first, GRAPHICS_BACKEND))
+    {
+        printf("No shader in the manifest lists the %s backend\n",
+               GRAPHICS_BACKEND);
 #if GRAPHICS_USE_SPIRV
-            computeShader.specialize();
-#else
-            computeShader.compile();
+        printf("List spirv in its backends and run compile_shaders.py\n");
 #endif
-
-            m_computeShaders[i] = new Shader::ComputeProgram(computeShader);
-            m_computeShaders[i]->build();
-        }
-        catch (std::exception &e)
-        {
-            printf("Error occurred while compiling %s\n",
-                   shaderFiles[i].c_str());
-            printf("%s", e.what());
-            exit(-1);
-        }
+        exit(-1);
     }
-
-    m_cellsUniform_thresh =
-        glGetUniformLocation(*m_computeShaders[Cells], "sumThresh");
-    m_metaBGUniform_radiusMult =
-        glGetUniformLocation(*m_computeShaders[Meta_BlueGreen], "radiusMult");
-    m_metaROUniform_radiusMult =
-        glGetUniformLocation(*m_computeShaders[Meta_RedOrange], "radiusMult");
-    m_metaRGBUniform_radiusMult =
-        glGetUniformLocation(*m_computeShaders[Meta_RGB], "radiusMult");
-    m_metaParamUniform_radiusMult =
-        glGetUniformLocation(*m_computeShaders[Meta_Params], "radiusMult");
-    m_metaParamUniform_red =
-        glGetUniformLocation(*m_computeShaders[Meta_Params], "red");
-    m_metaParamUniform_green =
-        glGetUniformLocation(*m_computeShaders[Meta_Params], "green");
-    m_metaParamUniform_blue =
-        glGetUniformLocation(*m_computeShaders[Meta_Params], "blue");
-    m_metaParamUniform_high =
-        glGetUniformLocation(*m_computeShaders[Meta_Params], "high");
+    selectShader(first);
 
     // prepare vertex array
     /*no longer needed
@@ -119,23 +148,26 @@ Graphics::Graphics(int height, int width)
     m_window->setDrawParams((void *)&m_params);
     m_window->setGUIParams((void *)&m_params);
 
+    // keep the metaball SSBO mapped where possible, see bindSSBO
+    m_ssboPersistent = hasBufferStorage();
+
     for (int i = 0; i < 5; i++)
     {
         pushBall(height, width);
     }
+    m_snapshot = &m_simulation.snapshot();
     bindSSBO();
 }
 
 Graphics::~Graphics()
 {
+    stopRecording();
+    releaseSSBO();
     glDeleteTextures(1, &m_texOut);
     glDeleteVertexArrays(1, &m_quadVAO);
-    glDeleteBuffers(1, &m_metaballsSSBO);
+    glDeleteBuffers(2, m_fieldTreeSSBOs);
+    m_shaders.release();
     delete m_window;
-    for (auto ptr : m_computeShaders)
-    {
-        delete ptr;
-    }
 }
 
 GUIWindow *Graphics::Window() { return m_window; }
@@ -146,56 +178,543 @@ int Graphics::width() { return m_width; }
 
 void Graphics::updateDimensions()
 {
-    SDL_GetWindowSize(*m_window, &m_width, &m_height);
+    m_width = m_window->getWidth();
+    m_height = m_window->getHeight();
     m_sizeChanged = true;
+    if (m_recorder)
+    {
+        m_recorder->resize(imageWidth(), imageHeight());
+    }
 }
 
-void Graphics::update()
+/** Sets how often the simulation ticks
+ *  @param hz Ticks per second
+ *  @param substeps Number of smaller steps each tick is split into
+ */
+void Graphics::setTickRate(double hz, int substeps)
 {
-    if (m_wigglyMovement)
+    m_simulation.setTickRate(hz, substeps);
+}
+
+/** Moves the simulation to its own thread or back onto the caller's
+ *  @param threaded Whether the simulation ticks on its own thread
+ */
+void Graphics::setSimulationThread(bool threaded)
+{
+    if (threaded)
     {
-        if (!m_ssboData)
-        {
-            updateMetaballs_RandomPath(m_metaballs, 2.0f, m_width - m_menuWidth,
-                                       m_height);
-        }
-        else
+        m_simulation.start();
+    }
+    else
+    {
+        m_simulation.stop();
+    }
+}
+
+/** Stops or restarts the simulation, the balls can still be edited
+ *  @note A paused window with no input redraws nothing, see fieldChanged
+ */
+void Graphics::setPaused(bool paused)
+{
+    m_paused = paused;
+    m_simulation.setPaused(paused);
+}
+
+/// Returns whether the simulation is paused
+bool Graphics::paused() { return m_paused; }
+
+/** Returns whether the field needs rendering again, rather than showing the
+ *  last one left in the output texture
+ */
+bool Graphics::fieldChanged()
+{
+    return m_fieldDirty || m_sizeChanged || m_texOut == 0 ||
+           m_snapshot->tick != m_fieldTick ||
+           m_snapshot->commands != m_fieldCommands || m_alpha != m_fieldAlpha;
+}
+
+/** Picks up the newest simulation snapshot for this frame
+ *  @param elapsed Seconds since the last call, used to advance the
+ * simulation when it doesn't have its own thread
+ */
+void Graphics::update(double elapsed)
+{
+    PROFILE_SCOPE("Graphics::update");
+    m_simulation.setBounds(m_width - m_menuWidth, m_height);
+    if (!m_simulation.threaded())
+    {
+        m_simulation.advance(elapsed);
+    }
+    m_snapshot = &m_simulation.snapshot();
+    uploadSnapshot(Simulation::alpha(*m_snapshot));
+}
+
+/** Runs whole simulation ticks and picks up the result, ignoring real time
+ *  @param ticks The number of ticks to run
+ *
+ *  @note The simulation must not have its own thread
+ */
+void Graphics::step(uint64_t ticks)
+{
+    m_simulation.setBounds(m_width - m_menuWidth, m_height);
+    m_simulation.advanceTicks(ticks);
+    m_snapshot = &m_simulation.snapshot();
+    uploadSnapshot(1.0f);
+}
+
+/** Copies the current snapshot into the metaball SSBO
+ *  @param alpha How far between its last two ticks the snapshot is drawn
+ */
+void Graphics::uploadSnapshot(float alpha)
+{
+    m_alpha = alpha;
+    if (m_recorder)
+    {
+        m_recorder->frame(m_snapshot->tick, m_snapshot->commands, alpha);
+    }
+
+    if (m_cpuRender && m_shaders.supports(m_currentShader, "cpu"))
+    {
+        // nothing reads the SSBO, it's caught up once the GPU renders again
+        m_ssboStale = true;
+        return;
+    }
+    bindSSBO();
+}
+
+/** Renders the metaball field into the output texture
+ *  The texture covers the window beside the menu and is recreated whenever
+ *  the window changes size.
+ */
+void Graphics::renderField()
+{
+    PROFILE_SCOPE("Graphics::renderField");
+    int width = m_window->getWidth();
+    int height = m_window->getHeight();
+    // this is made of memory leaks, should be stored in object
+    // when finalized for proper resource freeing
+    if (m_sizeChanged || m_texOut == 0)
+    {
+        if (m_texOut != 0)
         {
-            updateMetaballs_RandomPath(m_metaballs.size(), m_ssboData, 2.0f,
-                                       m_width - m_menuWidth, m_height);
+            glDeleteTextures(1, &m_texOut);
         }
+        glGenTextures(1, &m_texOut);
+        glActiveTexture(GL_TEXTURE0);
+        glBindTexture(GL_TEXTURE_2D, m_texOut);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+        glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA32F, width - m_menuWidth,
+                     height, 0, GL_RGBA, GL_FLOAT, NULL);
+        glBindImageTexture(0, m_texOut, 0, GL_FALSE, 0, GL_WRITE_ONLY,
+                           GL_RGBA32F);
+        m_height = height;
+        m_width = width;
+        m_sizeChanged = false;
+    }
+
+    m_fieldDirty = false;
+    m_fieldTick = m_snapshot->tick;
+    m_fieldCommands = m_snapshot->commands;
+    m_fieldAlpha = m_alpha;
+    if (m_cpuRender && m_shaders.supports(m_currentShader, "cpu"))
+    {
+        m_cpuRenderer.setView(m_tileOrigin[0], m_tileOrigin[1],
+                              m_tileScale[0], m_tileScale[1]);
+        renderCPU(width - m_menuWidth, height);
     }
     else
     {
-        if (!m_ssboData)
+        if (m_ssboStale)
         {
-            updateMetaballs_StraightPath(m_metaballs, m_width - m_menuWidth,
-                                         m_height);
+            bindSSBO();
         }
-        else
+        program(m_currentShader)->setActiveProgram();
+        // explicit locations shared by every shader, see circles.comp
+        glUniform2f(14, m_tileOrigin[0], m_tileOrigin[1]);
+        glUniform2f(15, m_tileScale[0], m_tileScale[1]);
+        if (m_shaders[m_currentShader].fieldTree)
         {
-            updateMetaballs_StraightPath(m_metaballs.size(), m_ssboData,
-                                         m_width - m_menuWidth, m_height);
+            bindFieldTree();
         }
+        glDispatchCompute((GLuint)width - m_menuWidth, (GLuint)height, 1);
+        glMemoryBarrier(GL_SHADER_IMAGE_ACCESS_BARRIER_BIT);
+        if (m_ssboPersistent)
+        {
+            // the balls are written in place, so their region can't be
+            // written again until this is done with it, see bindSSBO
+            GLsync &fence = m_ssboFences[m_ssboRegion];
+            if (fence)
+            {
+                glDeleteSync(fence);
+            }
+            fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+        }
+    }
+}
+
+/** Renders a frame without the GUI and reads it back
+ *  @param pixels Receives imageWidth() x imageHeight() 8 bit RGBA pixels,
+ * rows top to bottom
+ */
+void Graphics::renderImage(uint8_t *pixels)
+{
+    renderField();
+    glMemoryBarrier(GL_TEXTURE_UPDATE_BARRIER_BIT);
+    glBindTexture(GL_TEXTURE_2D, m_texOut);
+    glPixelStorei(GL_PACK_ALIGNMENT, 1);
+    glGetTexImage(GL_TEXTURE_2D, 0, GL_RGBA, GL_UNSIGNED_BYTE, pixels);
+}
+
+/** Renders a frame without the GUI and starts reading it back
+ *  @param readback Receives the frame once the GPU is done with it
+ */
+void Graphics::renderImage(PixelReadback &readback)
+{
+    renderField();
+    readback.start(m_texOut, imageWidth(), imageHeight());
+}
+
+/** Shows frame times in the side panel
+ *  @param stats The frames to show, nullptr to hide the panel
+ */
+void Graphics::setFrameStats(const FrameStats *stats)
+{
+    m_frameStats = stats;
+}
+
+/// Returns the number of shaders in the manifest
+size_t Graphics::shaderCount() { return m_shaders.size(); }
+
+/// Returns the manifest entry of a shader
+const Shader::ProgramEntry &Graphics::shaderEntry(size_t index)
+{
+    return m_shaders[index];
+}
+
+/** Renders with a shader from now on, without going through the GUI
+ *  @param index The index of the program in the shader manifest
+ *  @param cpu Whether to use its CPU kernel rather than the compute shader
+ *  @return Whether the shader has the requested backend
+ */
+bool Graphics::useShader(size_t index, bool cpu)
+{
+    if (!m_shaders.supports(index, cpu ? "cpu" : GRAPHICS_BACKEND))
+    {
+        return false;
     }
+    selectShader(index);
+    uploadShaderParameters();
+    m_cpuRender = cpu;
+    m_fieldDirty = true;
+    return true;
+}
 
-    if (!m_ssboData)
+/** Switches how the balls are uploaded, see bindSSBO
+ *  @param persistent Whether to keep the SSBO mapped, rather than mapping
+ * it for every upload
+ *  @return Whether the context supports the requested way
+ */
+bool Graphics::setPersistentSSBO(bool persistent)
+{
+    if (persistent && !hasBufferStorage())
     {
-        for (int i = 0; i < m_numBalls; i++)
-        {
-            m_metaballs[i].color = {m_colors[i].x, m_colors[i].y,
-                                    m_colors[i].z};
-        }
+        return false;
     }
-    else
+    if (persistent != m_ssboPersistent && m_metaballsSSBO)
+    {
+        // buffer storage can't be respecified, start over
+        glFinish();
+        releaseSSBO();
+    }
+    m_ssboPersistent = persistent;
+    bindSSBO();
+    return true;
+}
+
+/** Copies the current snapshot into the SSBO again, without ticking or
+ *  rendering, so the upload can be timed on its own
+ */
+void Graphics::uploadBalls() { bindSSBO(); }
+
+/** Renders a frame without the GUI and waits for the GPU to finish it
+ *  @note Only meant for timing, the image stays in the output texture
+ */
+void Graphics::render()
+{
+    renderField();
+    glFinish();
+}
+
+/** Places the rendered image on a larger canvas, for tiled rendering
+ *  Pixel (x, y) of the image is shaded at origin + (x, y) * scale in ball
+ *  coordinates, (0, 0) and (1, 1) draw the scene as it is.
+ */
+void Graphics::setView(float originX, float originY, float scaleX,
+                       float scaleY)
+{
+    m_tileOrigin[0] = originX;
+    m_tileOrigin[1] = originY;
+    m_tileScale[0] = scaleX;
+    m_tileScale[1] = scaleY;
+}
+
+/// Returns the width of the rendered image, the window without the menu
+int Graphics::imageWidth() { return m_window->getWidth() - (int)m_menuWidth; }
+
+/// Returns the height of the rendered image
+int Graphics::imageHeight() { return m_window->getHeight(); }
+
+/** Shows or hides the side menu, the image takes up the whole window
+ *  without it
+ */
+void Graphics::setMenuVisible(bool visible)
+{
+    m_menuWidth = visible ? 400 : 0;
+    m_sizeChanged = true;
+}
+
+/** Starts logging the run to a file, see Recorder
+ *  The renderer's current state is logged first, the starting balls are
+ *  still queued as commands as long as the simulation hasn't been advanced.
+ *
+ *  @note Throws a runtime error if the file can't be created
+ */
+void Graphics::record(const std::string &path)
+{
+    stopRecording();
+    // the recorder can't be swapped under a running simulation thread
+    bool threaded = m_simulation.threaded();
+    m_simulation.stop();
+    m_recorder = new Recorder(path, m_seed, imageWidth(), imageHeight(),
+                              m_scene);
+    m_simulation.setRecorder(m_recorder);
+    if (threaded)
+    {
+        m_simulation.start();
+    }
+
+    m_recorder->selectShader(m_currentShader);
+    const Shader::ProgramEntry &entry = m_shaders[m_currentShader];
+    for (size_t i = 0; i < entry.params.size(); i++)
+    {
+        m_recorder->shaderParameter(i, entry.params[i].value);
+    }
+    m_recorder->cpuRender(m_cpuRender);
+}
+
+/** Ends the recording with the checksum of the last frame's balls
+ *  @note Throws a runtime error if the log couldn't be written
+ */
+void Graphics::stopRecording()
+{
+    if (!m_recorder)
+    {
+        return;
+    }
+    bool threaded = m_simulation.threaded();
+    m_simulation.stop();
+    m_simulation.setRecorder(nullptr);
+    Recorder *recorder = m_recorder;
+    m_recorder = nullptr;
+    if (threaded)
+    {
+        m_simulation.start();
+    }
+    try
+    {
+        recorder->finish(checksum());
+    }
+    catch (std::exception &e)
+    {
+        delete recorder;
+        throw;
+    }
+    delete recorder;
+}
+
+/// Returns the number of frames recorded so far
+size_t Graphics::recordedFrames()
+{
+    return m_recorder ? m_recorder->frames() : 0;
+}
+
+/// Returns the size of the recording so far
+size_t Graphics::recordedBytes()
+{
+    return m_recorder ? m_recorder->bytes() : 0;
+}
+
+/** Starts replaying a recording instead of taking commands from the GUI
+ *  @param replay The recording, it must outlive the replay
+ *
+ *  @note The simulation must not have its own thread or have been advanced
+ */
+void Graphics::startReplay(const Replayer &replay)
+{
+    // the starting balls come from the recording
+    m_simulation.discardCommands();
+    m_replay = &replay;
+    m_replayCommand = 0;
+    m_replayEvent = 0;
+    m_replayTick = 0;
+}
+
+/** Runs the replay up to its next frame and picks up that frame's balls
+ *  Renderer changes before the frame are applied, then recorded commands
+ *  are sent on the ticks they were applied at until the simulation is where
+ *  it was when the frame was drawn.
+ *
+ *  @return Whether there was another frame
+ */
+bool Graphics::replayFrame()
+{
+    const std::vector<Replayer::TimedCommand> &commands = m_replay->commands();
+    const std::vector<Replayer::Event> &events = m_replay->events();
+    while (m_replayEvent < events.size())
     {
-        for (int i = 0; i < m_numBalls; i++)
+        const Replayer::Event &event = events[m_replayEvent++];
+        switch (event.type)
         {
-            m_ssboData[i].color = {m_colors[i].x, m_colors[i].y, m_colors[i].z};
+        case Recorder::SelectShader:
+            if (event.index < m_shaders.size())
+            {
+                selectShader(event.index);
+            }
+            break;
+        case Recorder::ShaderParameter:
+            if (event.index < m_shaders[m_currentShader].params.size())
+            {
+                m_shaders[m_currentShader].params[event.index].value =
+                    event.value;
+                m_fieldDirty = true;
+            }
+            break;
+        case Recorder::CPURender:
+            m_cpuRender = event.index != 0;
+            m_fieldDirty = true;
+            break;
+        case Recorder::Resize:
+            m_window->resize(event.height, event.width + (int)m_menuWidth);
+            updateDimensions();
+            break;
+        case Recorder::Frame:
+            while (true)
+            {
+                // commands are applied before the tick they were logged at
+                while (m_replayCommand < event.commands &&
+                       m_replayCommand < commands.size() &&
+                       commands[m_replayCommand].tick == m_replayTick)
+                {
+                    m_simulation.replay(commands[m_replayCommand++].command);
+                }
+                if (m_replayTick >= event.tick)
+                {
+                    break;
+                }
+                m_simulation.advanceTicks(1);
+                m_replayTick++;
+            }
+            m_simulation.advanceTicks(0);
+            m_snapshot = &m_simulation.snapshot();
+            uploadSnapshot(event.value);
+            uploadShaderParameters();
+            return true;
+        default:
+            break;
         }
     }
+    return false;
+}
+
+/** Replaces the balls with a saved scene, see SceneFile
+ *  @param path The scene to load
+ *  @return The number of balls loaded
+ *
+ *  @note Must be called before the simulation is started or advanced, the
+ * starting balls are dropped
+ *  @note Throws a runtime error if the scene can't be loaded
+ */
+size_t Graphics::loadScene(const std::string &path)
+{
+    BallSystem balls;
+    {
+        SceneFile scene(path);
+        scene.load(balls);
+    }
+    snprintf(m_sceneFile, sizeof(m_sceneFile), "%s", path.c_str());
+    return replaceBalls(balls, path);
 }
 
+/** Replaces the balls with a generated scene, see SceneGenerator
+ *  @param settings What to generate, a field of 0 by 0 is filled in with
+ * the size of the image
+ *  @return The number of balls generated
+ *
+ *  @note Must be called before the simulation is started or advanced, the
+ * starting balls are dropped
+ */
+size_t Graphics::generateScene(SceneGenerator::Settings settings)
+{
+    if (settings.width <= 0 || settings.height <= 0)
+    {
+        settings.width = imageWidth();
+        settings.height = imageHeight();
+    }
+    BallSystem balls;
+    SceneGenerator::generate(settings, balls);
+    return replaceBalls(balls, SceneGenerator::describe(settings));
+}
+
+/** Loads either a scene file or a generated scene
+ *  @param scene A scene file path or a SceneGenerator description, as
+ * recorded by Recorder
+ *  @return The number of balls in the scene
+ */
+size_t Graphics::openScene(const std::string &scene)
+{
+    SceneGenerator::Settings settings;
+    if (SceneGenerator::parse(scene, settings))
+    {
+        return generateScene(settings);
+    }
+    return loadScene(scene);
+}
+
+/** Hands a new set of balls to the simulation and shows them
+ *  @param balls The balls, they are moved out
+ *  @param source Where they came from, logged by record()
+ */
+size_t Graphics::replaceBalls(BallSystem &balls, const std::string &source)
+{
+    size_t count = balls.count();
+    m_simulation.discardCommands();
+    m_simulation.loadBalls(balls);
+    m_snapshot = &m_simulation.snapshot();
+    m_alpha = 1.0f;
+    m_ssboStale = true;  // uploaded by the next render
+    m_fieldDirty = true;
+    m_scene = source;
+    return count;
+}
+
+/** Saves the balls of the last frame as a scene, see SceneFile
+ *  @param path The file to write
+ *  @param quantize Whether to quantize the balls to 13 bytes each
+ *
+ *  @note Throws a runtime error if the scene can't be written
+ */
+void Graphics::saveScene(const std::string &path, bool quantize)
+{
+    SceneFile::save(path, m_snapshot->balls, imageWidth(), imageHeight(),
+                    quantize);
+}
+
+/// Returns the checksum of the balls drawn last, see Recorder::checksum
+uint64_t Graphics::checksum() { return Recorder::checksum(m_snapshot->balls); }
+
 void Graphics::m_drawFunc(void *_params)
 {
     drawParams *params = (drawParams *)_params;
@@ -205,45 +724,15 @@ void Graphics::m_drawFunc(void *_params)
     // start the frame for both render functions
     GUIWindow::NewFrame(*graphics->m_window);
 
-    int width = graphics->m_window->getWidth();
-    int height = graphics->m_window->getHeight();
-    // this is made of memory leaks, should be stored in object
-    // when finalized for proper resource freeing
-    if (graphics->m_sizeChanged || graphics->m_texOut == 0)
-    {
-        if (graphics->m_texOut != 0)
-        {
-            glDeleteTextures(1, &graphics->m_texOut);
-        }
-        glGenTextures(1, &graphics->m_texOut);
-        glActiveTexture(GL_TEXTURE0);
-        glBindTexture(GL_TEXTURE_2D, graphics->m_texOut);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
-        glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA32F,
-                     width - graphics->m_menuWidth, height, 0, GL_RGBA,
-                     GL_FLOAT, NULL);
-        glBindImageTexture(0, graphics->m_texOut, 0, GL_FALSE, 0, GL_WRITE_ONLY,
-                           GL_RGBA32F);
-        graphics->m_height = height;
-        graphics->m_width = width;
-        graphics->m_sizeChanged = false;
-    }
-
     // empty the window
     glClearColor(0, 123, 225, 225);
     glClear(GL_COLOR_BUFFER_BIT);
 
-    // compute the gradient
+    // compute the gradient, unless the last one is still up to date
+    if (graphics->fieldChanged())
     {
-        graphics->m_computeShaders[graphics->m_currentShader]
-            ->setActiveProgram();
-        glDispatchCompute((GLuint)width - graphics->m_menuWidth, (GLuint)height,
-                          1);
+        graphics->renderField();
     }
-    glMemoryBarrier(GL_SHADER_IMAGE_ACCESS_BARRIER_BIT);
 
     // render the texture
     {
@@ -284,6 +773,8 @@ void Graphics::m_drawFunc(void *_params)
 // draw the test panel
 void Graphics::m_drawGUIFunc(void *_params)
 {
+    PROFILE_SCOPE("Graphics::drawGUI");
+    PerfCounters::Scope counters(s_guiCounters, 1);
     drawParams *params = (drawParams *)_params;
     Graphics *graphics = params->graphics;
 
@@ -311,248 +802,120 @@ void Graphics::m_drawGUIFunc(void *_params)
     ImGui::Text(" ");
     ImGui::Text(" Currently selected shader: ");
     ImGui::SameLine();
-    if (ImGui::CollapsingHeader(graphics->m_shaderName.c_str()))
+    if (ImGui::CollapsingHeader(
+            graphics->m_shaders[graphics->m_currentShader].name.c_str()))
     {
-        auto activateProgram = [&]() {
-            graphics->m_computeShaders[graphics->m_currentShader]->setActiveProgram();
-        };
-        if (ImGui::Button("Circles"))
+        for (size_t i = 0; i < graphics->m_shaders.size(); i++)
         {
-            graphics->m_currentShader = Circles;
-            activateProgram();
-            graphics->m_shaderName = "Circles";
-#if GRAPHICS_USE_SPIRV
-            if (graphics->m_ubo)
-            {
-                glDeleteBuffers(1, &graphics->m_ubo);
-                graphics->m_ubo = 0;
-            }
-#endif
-        }
-        if (ImGui::Button("Cells"))
-        {
-            graphics->m_currentShader = Cells;
-            activateProgram();
-            graphics->m_shaderName = "Cells";
-#if GRAPHICS_USE_SPIRV
-            if (graphics->m_ubo)
-            {
-                glDeleteBuffers(1, &graphics->m_ubo);
-                graphics->m_ubo = 0;
-            }
-            glGenBuffers(1, &graphics->m_ubo);
-            GLenum err = glGetError();
-            if (err != GL_NO_ERROR) {
-                printf("\n------------------------\n1) OpenGL Error: %d\n------------------------\n", err);
-            }
-            glBindBuffer(GL_UNIFORM_BUFFER, graphics->m_ubo);
-            err = glGetError();
-            if (err != GL_NO_ERROR) {
-                printf("\n------------------------\n2) OpenGL Error: %d\n------------------------\n", err);
-            }
-            glBufferData(GL_UNIFORM_BLOCK, sizeof(float), NULL, GL_DYNAMIC_COPY);
-            err = glGetError();
-            if (err != GL_NO_ERROR) {
-                printf("\n------------------------\n3) OpenGL Error: %d\n------------------------\n", err);
-            }
-            GLuint binding_index = 2;
-            glBindBufferBase(GL_SHADER_STORAGE_BUFFER, binding_index,
-                         graphics->m_ubo);
-            err = glGetError();
-            if (err != GL_NO_ERROR) {
-                printf("\n------------------------\n4) OpenGL Error: %d\n------------------------\n", err);
-            }
-            GLuint index = glGetProgramResourceIndex(*graphics->m_computeShaders[Cells],
-                                                 GL_UNIFORM_BLOCK,
-                                                 "uniforms_buffer");
-            err = glGetError();
-            if (err != GL_NO_ERROR) {
-                printf("\n------------------------\n5) OpenGL Error: %d\n------------------------\n", err);
-            }
-            glUniformBlockBinding(*graphics->m_computeShaders[Cells], index,
-                                    binding_index);
-            err = glGetError();
-            if (err != GL_NO_ERROR) {
-                printf("\n------------------------\n6) OpenGL Error: %d\n------------------------\n", err);
-            }
-#endif
-        }
-        if (ImGui::Button("Blue/Green Metaballs"))
-        {
-            graphics->m_currentShader = Meta_BlueGreen;
-            activateProgram();
-            graphics->m_shaderName = "Blue/Green Metaballs";
-#if GRAPHICS_USE_SPIRV
-            if (graphics->m_ubo)
+            if (!graphics->m_shaders.supports(i, GRAPHICS_BACKEND))
             {
-                glDeleteBuffers(1, &graphics->m_ubo);
+                continue;
             }
-            glGenBuffers(1, &graphics->m_ubo);
-            glBindBuffer(GL_UNIFORM_BUFFER, graphics->m_ubo);
-#endif
-        }
-        if (ImGui::Button("Red/Orange Metaballs"))
-        {
-            graphics->m_currentShader = Meta_RedOrange;
-            activateProgram();
-            graphics->m_shaderName = "Red/Orange Metaballs";
-#if GRAPHICS_USE_SPIRV
-            if (graphics->m_ubo)
+            if (ImGui::Button(graphics->m_shaders[i].name.c_str()))
             {
-                glDeleteBuffers(1, &graphics->m_ubo);
+                graphics->selectShader(i);
             }
-            glGenBuffers(1, &graphics->m_ubo);
-            glBindBuffer(GL_UNIFORM_BUFFER, graphics->m_ubo);
-#endif
-        }
-        if (ImGui::Button("RGB Metaballs"))
-        {
-            graphics->m_currentShader = Meta_RGB;
-            activateProgram();
-            graphics->m_shaderName = "RGB Metaballs";
-#if GRAPHICS_USE_SPIRV
-            if (graphics->m_ubo)
-            {
-                glDeleteBuffers(1, &graphics->m_ubo);
-            }
-            glGenBuffers(1, &graphics->m_ubo);
-            glBindBuffer(GL_UNIFORM_BUFFER, graphics->m_ubo);
-#endif
-        }
-        if (ImGui::Button("Parameterized Metaballs"))
-        {
-            graphics->m_currentShader = Meta_Params;
-            activateProgram();
-            graphics->m_shaderName = "Parameterized Metaballs";
-#if GRAPHICS_USE_SPIRV
-            if (graphics->m_ubo)
-            {
-                glDeleteBuffers(1, &graphics->m_ubo);
-            }
-            glGenBuffers(1, &graphics->m_ubo);
-            glBindBuffer(GL_UNIFORM_BUFFER, graphics->m_ubo);
-#endif
         }
     }
 
-    switch (graphics->m_currentShader)
+    graphics->drawShaderParameters();
+    if (graphics->m_shaders.supports(graphics->m_currentShader, "cpu"))
     {
-    case Cells:
-        ImGui::SliderFloat("Threshold", &graphics->m_cellsThresh, 0.1, 5,
-                           "");
-#if GRAPHICS_USE_SPIRV
+        if (ImGui::Checkbox("Render on CPU", &graphics->m_cpuRender))
         {
-            float* p = (float*)glMapBuffer(GL_UNIFORM_BLOCK, GL_WRITE_ONLY);
-            GLenum err = glGetError();
-            if (err != GL_NO_ERROR) {
-                printf("\n------------------------\nOpenGL Error: %d\n------------------------\n", err);
+            graphics->m_fieldDirty = true;
+            if (graphics->m_recorder)
+            {
+                graphics->m_recorder->cpuRender(graphics->m_cpuRender);
             }
-            *p = graphics->m_cellsThresh;
-            glUnmapBuffer(GL_UNIFORM_BLOCK);
         }
-#else
-        glUniform1f(graphics->m_cellsUniform_thresh,
-                    1.0f / graphics->m_cellsThresh);
-#endif
-        break;
-
-    case Meta_BlueGreen:
-        ImGui::SliderFloat("Radius Multiplier",
-                           &graphics->m_metaBGRadiusMult, 0.01, 1000, "");
-#if GRAPHICS_USE_SPIRV
-        glBufferData(GL_UNIFORM_BUFFER, sizeof(float), &graphics->m_metaBGRadiusMult, GL_DYNAMIC_DRAW);
-#else
-        glUniform1f(graphics->m_metaBGUniform_radiusMult,
-                    graphics->m_metaBGRadiusMult);
-#endif
-        break;
-
-    case Meta_RedOrange:
-        ImGui::SliderFloat("Radius Multiplier",
-                           &graphics->m_metaRORadiusMult, 0.01, 1000, "");
-#if GRAPHICS_USE_SPIRV
-        glBufferData(GL_UNIFORM_BUFFER, sizeof(float), &graphics->m_metaRORadiusMult, GL_DYNAMIC_DRAW);
-#else
-        glUniform1f(graphics->m_metaROUniform_radiusMult,
-                    graphics->m_metaRORadiusMult);
-#endif
-        break;
-
-    case Meta_RGB:
-        ImGui::SliderFloat("Radius Multiplier",
-                           &graphics->m_metaRGBRadiusMult, 0.01, 2000, "");
-#if GRAPHICS_USE_SPIRV
-        glBufferData(GL_UNIFORM_BUFFER, sizeof(float), &graphics->m_metaRGBRadiusMult, GL_DYNAMIC_DRAW);
-#else
-        glUniform1f(graphics->m_metaRGBUniform_radiusMult,
-                    graphics->m_metaRGBRadiusMult);
-#endif
-        break;
-
-    case Meta_Params:
-        ImGui::SliderFloat("Radius Multiplier",
-                           &graphics->m_metaParamRadiusMult, 0.01, 1000,
-                           "");
-        ImGui::Text(" Affected channels: ");
-        ImGui::SameLine();
-        ImGui::Checkbox("Red", &graphics->m_metaParamRed);
         ImGui::SameLine();
-        ImGui::Checkbox("Green", &graphics->m_metaParamGreen);
-        ImGui::SameLine();
-        ImGui::Checkbox("Blue", &graphics->m_metaParamBlue);
-        ImGui::Checkbox("Default values to high",
-                        &graphics->m_metaParamHigh);
-#if GRAPHICS_USE_SPIRV
-        {
-            typedef struct
-            {
-                float radiusMult;
-                bool red;
-                bool green;
-                bool blue;
-                bool high;
-            } ParametersStruct;
-            ParametersStruct params = {
-                graphics->m_metaParamRadiusMult,
-                graphics->m_metaParamRed,
-                graphics->m_metaParamGreen,
-                graphics->m_metaParamBlue,
-                graphics->m_metaParamHigh
-            }; 
-            glBufferData(GL_UNIFORM_BUFFER, sizeof(ParametersStruct), &params, GL_DYNAMIC_DRAW);
-        }
-#else
-        glUniform1f(graphics->m_metaParamUniform_radiusMult,
-                    graphics->m_metaParamRadiusMult);
-        glUniform1i(graphics->m_metaParamUniform_red,
-                    graphics->m_metaParamRed);
-        glUniform1i(graphics->m_metaParamUniform_green,
-                    graphics->m_metaParamGreen);
-        glUniform1i(graphics->m_metaParamUniform_blue,
-                    graphics->m_metaParamBlue);
-        glUniform1i(graphics->m_metaParamUniform_high,
-                    graphics->m_metaParamHigh);
-#endif
-        break;
+        ImGui::Text("(%zu threads)", JobSystem::threadCount());
     }
 
     if (ImGui::Button("Add Ball"))
     {
         graphics->pushBall(graphics->m_height, graphics->m_width);
-        graphics->bindSSBO();
-        graphics->m_ssboData[graphics->m_numBalls - 1].size = std::rand() % 100;
-        graphics->m_ssboData[graphics->m_numBalls - 1].position = {(float)(std::rand() % graphics->m_width),
-                                                                   (float)(std::rand() % graphics->m_height)};
-        graphics->m_ssboData[graphics->m_numBalls - 1].velocity = {(float)(std::rand() % 10) - 5,
-                                                                   (float)(std::rand() % 10) - 5};
     }
     ImGui::SameLine();
     if (ImGui::Button("Remove Ball"))
     {
         graphics->popBall();
-        graphics->bindSSBO();
+    }
+    if (ImGui::Button("Save Scene"))
+    {
+        try
+        {
+            graphics->saveScene(graphics->m_sceneFile,
+                                graphics->m_quantizeScene);
+        }
+        catch (std::exception &e)
+        {
+            printf("%s\n", e.what());
+        }
+    }
+    ImGui::SameLine();
+    ImGui::PushItemWidth(150);
+    ImGui::InputText("##scene", graphics->m_sceneFile,
+                     sizeof(graphics->m_sceneFile));
+    ImGui::PopItemWidth();
+    ImGui::SameLine();
+    ImGui::Checkbox("Quantize", &graphics->m_quantizeScene);
+    if (ImGui::Checkbox("Pause", &graphics->m_paused))
+    {
+        graphics->setPaused(graphics->m_paused);
+    }
+    ImGui::SameLine();
+    bool wiggleChanged =
+        ImGui::Checkbox("Wiggly movement", &graphics->m_wigglyMovement);
+    ImGui::SameLine();
+    if (ImGui::Checkbox("Collisions", &graphics->m_collisions))
+    {
+        graphics->m_simulation.setCollisions(graphics->m_collisions);
+    }
+    ImGui::SameLine();
+    bool gravityChanged = ImGui::Checkbox("Gravity", &graphics->m_gravity);
+    if (graphics->m_wigglyMovement)
+    {
+        wiggleChanged |= ImGui::SliderFloat("Wiggle", &graphics->m_wiggleAngle,
+                                            0.0f, M_PI, "%.2f rad");
+    }
+    if (wiggleChanged)
+    {
+        graphics->m_simulation.setWiggly(graphics->m_wigglyMovement,
+                                         graphics->m_wiggleAngle);
+    }
+    if (graphics->m_gravity)
+    {
+        // negative strengths push the balls apart
+        gravityChanged |=
+            ImGui::SliderFloat("Strength", &graphics->m_gravityStrength, -1.0f,
+                               1.0f, "%.4f", 4.0f);
+        gravityChanged |= ImGui::SliderFloat(
+            "Opening angle", &graphics->m_theta, 0.1f, 1.5f, "%.2f");
+    }
+    if (gravityChanged)
+    {
+        graphics->m_simulation.setGravity(graphics->m_gravity,
+                                          graphics->m_gravityStrength,
+                                          graphics->m_theta);
+    }
+    // must match the order of IntegratorMethod
+    bool integratorChanged =
+        ImGui::Combo("Integrator", &graphics->m_integrator,
+                     "Explicit Euler\0Semi-implicit Euler\0Velocity Verlet\0"
+                     "Runge-Kutta 4\0");
+    integratorChanged |= ImGui::SliderFloat("Drag", &graphics->m_drag, 0.0f,
+                                            1.0f, "%.3f", 2.0f);
+    if (integratorChanged)
+    {
+        graphics->m_simulation.setIntegrator(
+            (IntegratorMethod)graphics->m_integrator, graphics->m_drag);
     }
 
+    graphics->drawFrameStats();
+    graphics->drawPerfCounters();
+
     // block of graphs (scrollable)
     window_flags = 0;
     window_flags |= ImGuiWindowFlags_NoCollapse;
@@ -573,79 +936,211 @@ void Graphics::m_drawGUIFunc(void *_params)
 
 void Graphics::pushBall(Ball ball)
 {
-    m_metaballs.resize(++m_numBalls);
-    m_colors.resize(m_numBalls);
-    m_metaballs[m_numBalls - 1] = ball;
-    m_colors[m_numBalls - 1] =
-        ImVec4(ball.color.r, ball.color.g, ball.color.b, 1.0f);
-
-    m_genSSBO = true;
+    m_simulation.pushBall(ball);
 }
 
 void Graphics::pushBall(int &height, int &width)
 {
+    // every spawn draws from its own stream, so runs with the same seed add
+    // the same balls
+    uint32_t key = CounterRNG::key(m_seed, s_spawnStream + m_spawned++);
+    auto random = [&](uint32_t counter, int range)
+    {
+        return (float)(int)(CounterRNG::uniform(key, counter) * range);
+    };
     Ball ball;
-    ball.size = std::rand() % 100;
-    // for some reason this allocation results in unknown address w/ address
-    // sanitizer ball.position = {(float)(std::rand() % m_width),
-    //                 (float)(std::rand() % m_height)};
-    ball.position.x = (float)(std::rand() % (width > 0 ? width : 300));
-    ball.position.y = (float)(std::rand() % (height > 0 ? height : 300));
-    ball.velocity = {(float)(std::rand() % 10) - 5,
-                     (float)(std::rand() % 10) - 5};
-    ball.color = {(float)std::rand() / RAND_MAX, (float)std::rand() / RAND_MAX,
-                  (float)std::rand() / RAND_MAX};
+    ball.size = random(0, 100);
+    ball.position.x = random(1, width > 0 ? width : 300);
+    ball.position.y = random(2, height > 0 ? height : 300);
+    ball.velocity = {random(3, 10) - 5, random(4, 10) - 5};
+    ball.color = {CounterRNG::uniform(key, 5), CounterRNG::uniform(key, 6),
+                  CounterRNG::uniform(key, 7)};
     pushBall(ball);
 }
 
 void Graphics::popBall()
 {
-    m_metaballs.pop_back();
-    m_colors.pop_back();
-    m_numBalls--;
+    m_simulation.popBall();
+}
+
+// percentiles of the recent frames, the tails are what stutter looks like
+void Graphics::drawFrameStats()
+{
+    if (!m_frameStats || !ImGui::CollapsingHeader("Frame times"))
+    {
+        return;
+    }
+    m_frameStats->recent(m_recentFrames);
+    if (m_recentFrames.empty())
+    {
+        return;
+    }
+    FrameStats::Summary total =
+        FrameStats::summarize(m_recentFrames, FrameStats::Phases);
+    ImGui::Text("Last %zu frames, %.1f fps at the median", total.frames,
+                total.p50 > 0 ? 1000.0f / total.p50 : 0.0f);
+
+    // every frame, oldest on the left
+    m_plotValues.resize(m_recentFrames.size());
+    for (size_t i = 0; i < m_recentFrames.size(); i++)
+    {
+        m_plotValues[i] = m_recentFrames[i].total;
+    }
+    char overlay[64];
+    snprintf(overlay, sizeof(overlay), "max %.2f ms", total.max);
+    ImGui::PlotLines("##frames", m_plotValues.data(),
+                     (int)m_plotValues.size(), 0, overlay, 0.0f,
+                     std::max(total.max, 1.0f), ImVec2(m_menuWidth - 20, 60));
 
-    m_genSSBO = true;
+    // log scaled, a bin for every half octave from 0.5ms
+    FrameStats::Histogram bins =
+        FrameStats::histogram(m_recentFrames, FrameStats::Phases);
+    m_plotValues.assign(bins.begin(), bins.end());
+    snprintf(overlay, sizeof(overlay), "log scale, %.1f ms to %.0f ms",
+             FrameStats::binEdge(0),
+             FrameStats::binEdge(FrameStats::s_bins - 2));
+    ImGui::PlotHistogram("##histogram", m_plotValues.data(),
+                         (int)m_plotValues.size(), 0, overlay, 0.0f, FLT_MAX,
+                         ImVec2(m_menuWidth - 20, 60));
+
+    ImGui::Columns(5, "##phases", false);
+    const char *headings[] = {"ms", "p50", "p95", "p99", "max"};
+    for (const char *heading : headings)
+    {
+        ImGui::Text("%s", heading);
+        ImGui::NextColumn();
+    }
+    for (int phase = 0; phase <= FrameStats::Phases; phase++)
+    {
+        FrameStats::Summary summary =
+            FrameStats::summarize(m_recentFrames, phase);
+        ImGui::Text("%s", FrameStats::phaseName((FrameStats::Phase)phase));
+        ImGui::NextColumn();
+        float values[] = {summary.p50, summary.p95, summary.p99, summary.max};
+        for (float value : values)
+        {
+            ImGui::Text("%.2f", value);
+            ImGui::NextColumn();
+        }
+    }
+    ImGui::Columns(1);
 }
 
-void Graphics::drawBallInterface()
+/** Shows what the hardware counters counted in each instrumented section,
+ *  as instructions per cycle and misses per item
+ */
+void Graphics::drawPerfCounters()
 {
-    if (m_ssboData)
+    if (!PerfCounters::enabled() || !ImGui::CollapsingHeader("CPU counters"))
+    {
+        return;
+    }
+    ImGui::TextWrapped("%s", PerfCounters::status().c_str());
+    if (ImGui::Button("Reset counters"))
     {
-        for (int i = 0; i < m_numBalls; i++)
+        for (PerfCounters::Section *section : PerfCounters::sections())
         {
-            ImGui::PushID(i + 42);
+            section->reset();
+        }
+    }
 
-            ImGui::SliderFloat("Radius", &m_ssboData[i].size, 1.0f, 100.0f, "");
-            ImGui::SliderFloat2("Velocity", (float *)&m_ssboData[i].velocity, -5.0f,
-                                5.0f, "");
-            ImGui::SliderFloat("Pos X", (float *)&m_ssboData[i].position.x, 0.0f,
-                               m_width - m_menuWidth, "");
-            ImGui::SliderFloat("Pos Y", (float *)&m_ssboData[i].position.y, 0.0f,
-                               m_height, "");
-            ImGui::ColorEdit3("Color", &m_colors[i].x);
-            if (i < m_numBalls - 1)
+    ImGui::Columns(5, "##counters", false);
+    const char *headings[] = {"per item", "IPC", "L1d miss", "LLC miss",
+                              "br miss"};
+    for (const char *heading : headings)
+    {
+        ImGui::Text("%s", heading);
+        ImGui::NextColumn();
+    }
+    const PerfCounters::Counter misses[] = {PerfCounters::L1Misses,
+                                            PerfCounters::LLCMisses,
+                                            PerfCounters::BranchMisses};
+    for (PerfCounters::Section *section : PerfCounters::sections())
+    {
+        uint64_t items = section->items();
+        if (items == 0)
+        {
+            continue;
+        }
+        PerfCounters::Reading totals = section->totals();
+        ImGui::Text("%s", section->name());
+        if (ImGui::IsItemHovered())
+        {
+            ImGui::SetTooltip("%llu calls, per %s",
+                              (unsigned long long)section->calls(),
+                              section->item());
+        }
+        ImGui::NextColumn();
+        uint64_t cycles = totals.counts[PerfCounters::Cycles];
+        if (cycles && PerfCounters::available(PerfCounters::Instructions))
+        {
+            ImGui::Text("%.2f",
+                        (double)totals.counts[PerfCounters::Instructions] /
+                            cycles);
+        }
+        else
+        {
+            ImGui::Text("-");
+        }
+        ImGui::NextColumn();
+        for (PerfCounters::Counter counter : misses)
+        {
+            if (PerfCounters::available(counter))
             {
-                ImGui::Separator();
+                ImGui::Text("%.3g", (double)totals.counts[counter] / items);
             }
-
-            ImGui::PopID();
+            else
+            {
+                ImGui::Text("-");
+            }
+            ImGui::NextColumn();
         }
     }
-    else
+    ImGui::Columns(1);
+}
+
+// edits are sent to the simulation, the sliders show the latest snapshot
+void Graphics::drawBallInterface()
+{
+    const BallSystem &balls = m_snapshot->balls;
+    size_t numBalls = balls.count();
+    // only the balls scrolled into view get widgets, scenes can have millions
+    ImGuiListClipper clipper((int)numBalls);
+    while (clipper.Step())
     {
-        for (int i = 0; i < m_numBalls; i++)
+        for (size_t i = clipper.DisplayStart; i < (size_t)clipper.DisplayEnd;
+             i++)
         {
             ImGui::PushID(i + 42);
 
-            ImGui::SliderFloat("Radius", &m_metaballs[i].size, 1.0f, 100.0f, "");
-            ImGui::SliderFloat2("Velocity", (float *)&m_metaballs[i].velocity, -5.0f,
-                                5.0f, "");
-            ImGui::SliderFloat("Pos X", (float *)&m_metaballs[i].position.x, 0.0f,
-                               m_width - m_menuWidth, "");
-            ImGui::SliderFloat("Pos Y", (float *)&m_metaballs[i].position.y, 0.0f,
-                               m_height, "");
-            ImGui::ColorEdit3("Color", &m_colors[i].x);
-            if (i < m_numBalls - 1)
+            Ball ball = balls.get(i);
+            float velocity[2] = {ball.velocity.x, ball.velocity.y};
+            float color[3] = {ball.color.r, ball.color.g, ball.color.b};
+            bool changed = false;
+            changed |=
+                ImGui::SliderFloat("Radius", &ball.size, 1.0f, 100.0f, "");
+            if (ImGui::SliderFloat2("Velocity", velocity, -5.0f, 5.0f, ""))
+            {
+                ball.velocity = {velocity[0], velocity[1]};
+                changed = true;
+            }
+            changed |= ImGui::SliderFloat("Pos X", &ball.position.x, 0.0f,
+                                          m_width - m_menuWidth, "");
+            changed |= ImGui::SliderFloat("Pos Y", &ball.position.y, 0.0f,
+                                          m_height, "");
+            if (ImGui::ColorEdit3("Color", color))
+            {
+                ball.color = {color[0], color[1], color[2]};
+                changed = true;
+            }
+            if (changed)
+            {
+                // setting a ball also resets its previous position, so
+                // moved balls jump instead of sliding over from where they
+                // were
+                m_simulation.setBall(i, ball);
+            }
+            if (i < numBalls - 1)
             {
                 ImGui::Separator();
             }
@@ -655,57 +1150,345 @@ void Graphics::drawBallInterface()
     }
 }
 
+/** Copies the current snapshot into the metaball SSBO
+ *  With buffer storage (GL 4.4) the SSBO is mapped once for its lifetime
+ *  and split into s_ssboRegions regions, each upload writes the next one in
+ *  place and binds it, only waiting if the GPU is still reading it from
+ *  that many frames ago. Otherwise it's mapped for each copy and the driver
+ *  orphans the old contents. Either way it's only reallocated when it has
+ *  to grow.
+ */
 void Graphics::bindSSBO()
 {
-    if (m_ssboData)
+    PROFILE_SCOPE("Graphics::bindSSBO");
+    const BallSystem &balls = m_snapshot->balls;
+    size_t numBalls = balls.count();
+    if (!m_metaballsSSBO || numBalls > m_ssboCapacity)
     {
-        for (int i = 0; i < m_numBalls; i++)
+        // grow by half again, so balls added one at a time don't
+        // reallocate every frame
+        size_t capacity = std::max(numBalls, m_ssboCapacity * 3 / 2);
+        releaseSSBO();
+        m_ssboCapacity = capacity;
+        glGenBuffers(1, &m_metaballsSSBO);
+        glBindBuffer(GL_SHADER_STORAGE_BUFFER, m_metaballsSSBO);
+        size_t bytes = sizeof(GLuint) + sizeof(Ball) * m_ssboCapacity;
+        if (m_ssboPersistent)
         {
-            m_metaballs[i] = m_ssboData[i];
+            // regions start on offsets glBindBufferRange accepts
+            GLint alignment = 1;
+            glGetIntegerv(GL_SHADER_STORAGE_BUFFER_OFFSET_ALIGNMENT,
+                          &alignment);
+            alignment = std::max(alignment, 1);
+            m_ssboRegionBytes = (bytes + alignment - 1) / alignment * alignment;
+            bytes = m_ssboRegionBytes * s_ssboRegions;
+            GLbitfield flags = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT |
+                               GL_MAP_COHERENT_BIT;
+            glBufferStorage(GL_SHADER_STORAGE_BUFFER, bytes, NULL, flags);
+            m_ssboData = (GLuint *)glMapBufferRange(GL_SHADER_STORAGE_BUFFER,
+                                                    0, bytes, flags);
         }
-        glUnmapBuffer(GL_SHADER_STORAGE_BUFFER);
-        if (m_metaballsSSBO)
+        else
         {
-            glDeleteBuffers(1, &m_metaballsSSBO);
+            glBufferData(GL_SHADER_STORAGE_BUFFER, bytes, NULL,
+                         GL_DYNAMIC_DRAW);
         }
-        m_ssboData = NULL;
-        m_genSSBO = true;
     }
 
-    if (m_genSSBO)
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, m_metaballsSSBO);
+    size_t used = sizeof(GLuint) + sizeof(Ball) * numBalls;
+    GLuint *data = NULL;
+    if (m_ssboPersistent && m_ssboData)
     {
-        m_genSSBO = false;
-        if (m_metaballsSSBO)
+        m_ssboRegion = (m_ssboRegion + 1) % s_ssboRegions;
+        GLsync &fence = m_ssboFences[m_ssboRegion];
+        if (fence)
         {
-            glDeleteBuffers(1, &m_metaballsSSBO);
+            // a dispatch from s_ssboRegions uploads ago may still be
+            // reading this region
+            while (glClientWaitSync(fence, GL_SYNC_FLUSH_COMMANDS_BIT,
+                                    1000000000) == GL_TIMEOUT_EXPIRED)
+            {
+            }
+            glDeleteSync(fence);
+            fence = 0;
         }
-        glGenBuffers(1, &m_metaballsSSBO);
-        glBindBuffer(GL_SHADER_STORAGE_BUFFER, m_metaballsSSBO);
-        glBufferData(GL_SHADER_STORAGE_BUFFER,
-                     sizeof(size_t) + sizeof(Ball) * m_metaballs.size(), NULL,
-                     GL_DYNAMIC_COPY);
+        size_t offset = m_ssboRegion * m_ssboRegionBytes;
+        data = (GLuint *)((char *)m_ssboData + offset);
+        glBindBufferRange(GL_SHADER_STORAGE_BUFFER, m_ssboBindingIndex,
+                          m_metaballsSSBO, offset, used);
+    }
+    else if (!m_ssboPersistent)
+    {
         glBindBufferBase(GL_SHADER_STORAGE_BUFFER, m_ssboBindingIndex,
                          m_metaballsSSBO);
-        GLuint index = glGetProgramResourceIndex(*m_computeShaders[Default],
-                                                 GL_SHADER_STORAGE_BUFFER,
-                                                 "metaball_data");
-        glShaderStorageBlockBinding(*m_computeShaders[Default], index,
+        data = (GLuint *)glMapBufferRange(
+            GL_SHADER_STORAGE_BUFFER, 0, used,
+            GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_BUFFER_BIT);
+    }
+    if (!data)
+    {
+        printf("Unable to map the metaball SSBO\n");
+        exit(-1);
+    }
+
+    // the count comes first, then the balls
+    *data = (GLuint)numBalls;
+    Ball *ssboBalls = (Ball *)(data + 1);
+    JobSystem::parallelFor(0, numBalls, s_updateGrain,
+                           [&](size_t first, size_t last)
+                           {
+                               balls.store(ssboBalls, first, last, m_alpha);
+                           });
+    if (!m_ssboPersistent)
+    {
+        glUnmapBuffer(GL_SHADER_STORAGE_BUFFER);
+    }
+    m_ssboCount = numBalls;
+    m_ssboStale = false;
+}
+
+/// Deletes the metaball SSBO and any fences on it
+void Graphics::releaseSSBO()
+{
+    for (GLsync &fence : m_ssboFences)
+    {
+        if (fence)
+        {
+            glDeleteSync(fence);
+            fence = 0;
+        }
+    }
+    if (m_metaballsSSBO)
+    {
+        glDeleteBuffers(1, &m_metaballsSSBO);
+        m_metaballsSSBO = 0;
+    }
+    m_ssboData = NULL;
+    m_ssboCapacity = 0;
+    m_ssboRegion = 0;
+}
+
+/** Builds the FieldTree of this frame's balls and uploads it for shaders
+ *  with fieldtree set in the manifest
+ */
+void Graphics::bindFieldTree()
+{
+    PROFILE_SCOPE("Graphics::bindFieldTree");
+    m_snapshot->balls.interpolate(m_alpha, m_frameBalls);
+    m_fieldTree.build(m_frameBalls);
+    const std::vector<FieldTree::Node> &nodes = m_fieldTree.nodes();
+    const std::vector<FieldTree::Point> &points = m_fieldTree.points();
+
+    if (!m_fieldTreeSSBOs[0])
+    {
+        glGenBuffers(2, m_fieldTreeSSBOs);
+    }
+
+    // the node count is padded to 16 bytes, the alignment of the nodes
+    GLuint header[4] = {(GLuint)nodes.size(), 0, 0, 0};
+    size_t nodeBytes = sizeof(FieldTree::Node) * nodes.size();
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, m_fieldTreeSSBOs[0]);
+    glBufferData(GL_SHADER_STORAGE_BUFFER, sizeof(header) + nodeBytes, NULL,
+                 GL_STREAM_DRAW);
+    glBufferSubData(GL_SHADER_STORAGE_BUFFER, 0, sizeof(header), header);
+    glBufferSubData(GL_SHADER_STORAGE_BUFFER, sizeof(header), nodeBytes,
+                    nodes.data());
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 3, m_fieldTreeSSBOs[0]);
+
+    // an empty buffer can't be bound, so there's always room for one ball
+    size_t pointBytes =
+        sizeof(FieldTree::Point) * std::max(points.size(), (size_t)1);
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, m_fieldTreeSSBOs[1]);
+    glBufferData(GL_SHADER_STORAGE_BUFFER, pointBytes, NULL, GL_STREAM_DRAW);
+    glBufferSubData(GL_SHADER_STORAGE_BUFFER, 0,
+                    sizeof(FieldTree::Point) * points.size(), points.data());
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 4, m_fieldTreeSSBOs[1]);
+}
+
+/** Renders the current shader with the CPU kernels and uploads the result
+ *  @param width The width of the output texture
+ *  @param height The height of the output texture
+ */
+void Graphics::renderCPU(int width, int height)
+{
+    PROFILE_SCOPE("Graphics::renderCPU");
+    if (m_cpuRenderer.width() != width || m_cpuRenderer.height() != height)
+    {
+        m_cpuRenderer.resize(width, height);
+    }
+    m_snapshot->balls.interpolate(m_alpha, m_frameBalls);
+    m_cpuRenderer.render(m_shaders[m_currentShader], m_frameBalls);
+
+    glBindTexture(GL_TEXTURE_2D, m_texOut);
+    glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, width, height, GL_RGBA, GL_FLOAT,
+                    m_cpuRenderer.pixels());
+}
+
+/** Returns the compute program at the provided manifest index
+ *  The program is compiled and linked the first time it is requested,
+ *  so startup only pays for the shaders that are actually used.
+ *
+ *  @note Exits if the program fails to build, matching startup behaviour
+ */
+Shader::ComputeProgram *Graphics::program(size_t index)
+{
+    Shader::ProgramEntry &entry = m_shaders[index];
+    if (entry.program)
+    {
+        return entry.program;
+    }
+
+#if GRAPHICS_USE_SPIRV
+    std::string file = entry.file + ".spv";
+#else
+    std::string file = entry.file;
+#endif
+    try
+    {
+        std::ifstream computeFS(std::string("shaders/") + file);
+        if (!computeFS.is_open())
+        {
+            throw std::runtime_error(std::string("Unable to open shaders/") +
+                                     file + "\n");
+        }
+        Shader::shader computeShader(computeFS, GL_COMPUTE_SHADER,
+                                     GRAPHICS_USE_SPIRV);
+#if GRAPHICS_USE_SPIRV
+        computeShader.specialize();
+#else
+        computeShader.compile();
+#endif
+
+        entry.program = new Shader::ComputeProgram(computeShader);
+        entry.program->build();
+    }
+    catch (std::exception &e)
+    {
+        delete entry.program;
+        entry.program = nullptr;
+        printf("Error occurred while compiling %s\n", file.c_str());
+        printf("%s", e.what());
+        exit(-1);
+    }
+
+    for (auto &param : entry.params)
+    {
+        param.location =
+            glGetUniformLocation(*entry.program, param.uniform.c_str());
+    }
+    GLuint index_ssbo = glGetProgramResourceIndex(
+        *entry.program, GL_SHADER_STORAGE_BUFFER, "metaball_data");
+    if (index_ssbo != GL_INVALID_INDEX)
+    {
+        glShaderStorageBlockBinding(*entry.program, index_ssbo,
                                     m_ssboBindingIndex);
     }
+    return entry.program;
+}
 
-    glBindBuffer(GL_SHADER_STORAGE_BUFFER, m_metaballsSSBO);
-    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, m_ssboBindingIndex,
-                     m_metaballsSSBO);
-    uint *lenptr = (uint *)glMapBufferRange(
-        GL_SHADER_STORAGE_BUFFER, 0, sizeof(uint),
-        GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_BUFFER_BIT);
-    *lenptr = (uint)m_numBalls;
-    glUnmapBuffer(GL_SHADER_STORAGE_BUFFER);
-    m_ssboData = (Ball *)glMapBufferRange(
-        GL_SHADER_STORAGE_BUFFER, sizeof(uint), sizeof(Ball) * m_numBalls,
-        GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_BUFFER_BIT);
-    for (int i = 0; i < m_numBalls; i++)
-    {
-        m_ssboData[i] = m_metaballs[i];
-    }
-}
\ No newline at end of file
+/** Makes the program at the provided manifest index the active shader
+ *  @param index The index of the program in the shader manifest
+ */
+void Graphics::selectShader(size_t index)
+{
+    m_currentShader = index;
+    m_fieldDirty = true;
+    program(index)->setActiveProgram();
+    if (m_recorder)
+    {
+        m_recorder->selectShader(index);
+    }
+#if GRAPHICS_USE_SPIRV
+    if (m_ubo)
+    {
+        glDeleteBuffers(1, &m_ubo);
+        m_ubo = 0;
+    }
+    if (!m_shaders[index].params.empty())
+    {
+        glGenBuffers(1, &m_ubo);
+        glBindBuffer(GL_UNIFORM_BUFFER, m_ubo);
+        glBindBufferBase(GL_UNIFORM_BUFFER, 2, m_ubo);
+    }
+#endif
+}
+
+/// Draws the widgets for the current shader's parameters and uploads them
+void Graphics::drawShaderParameters()
+{
+    Shader::ProgramEntry &entry = m_shaders[m_currentShader];
+    for (size_t i = 0; i < entry.params.size(); i++)
+    {
+        Shader::Parameter &param = entry.params[i];
+        if (param.sameLine)
+        {
+            ImGui::SameLine();
+        }
+        ImGui::PushID(param.uniform.c_str());
+        bool changed;
+        if (param.type == Shader::FloatParam)
+        {
+            changed = ImGui::SliderFloat(param.label.c_str(), &param.value,
+                                         param.min, param.max, "");
+        }
+        else
+        {
+            bool checked = param.value != 0.0f;
+            changed = ImGui::Checkbox(param.label.c_str(), &checked);
+            param.value = checked ? 1.0f : 0.0f;
+        }
+        if (changed)
+        {
+            m_fieldDirty = true;
+            if (m_recorder)
+            {
+                m_recorder->shaderParameter(i, param.value);
+            }
+        }
+        ImGui::PopID();
+    }
+    uploadShaderParameters();
+}
+
+/// Uploads the current shader's parameters to its uniforms
+void Graphics::uploadShaderParameters()
+{
+    Shader::ProgramEntry &entry = m_shaders[m_currentShader];
+    if (entry.params.empty())
+    {
+        return;
+    }
+#if GRAPHICS_USE_SPIRV
+    // every parameter is a 4 byte scalar, so std140 packs them back to back
+    std::vector<GLuint> block(entry.params.size());
+    for (size_t i = 0; i < entry.params.size(); i++)
+    {
+        Shader::Parameter &param = entry.params[i];
+        if (param.type == Shader::FloatParam)
+        {
+            float value = Shader::uniformValue(param);
+            memcpy(&block[i], &value, sizeof(float));
+        }
+        else
+        {
+            block[i] = param.value != 0.0f;
+        }
+    }
+    glBindBuffer(GL_UNIFORM_BUFFER, m_ubo);
+    glBufferData(GL_UNIFORM_BUFFER, sizeof(GLuint) * block.size(),
+                 block.data(), GL_DYNAMIC_DRAW);
+#else
+    for (auto &param : entry.params)
+    {
+        if (param.type == Shader::FloatParam)
+        {
+            glUniform1f(param.location, Shader::uniformValue(param));
+        }
+        else
+        {
+            glUniform1i(param.location, param.value != 0.0f);
+        }
+    }
+#endif
+}
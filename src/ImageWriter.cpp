@@ -0,0 +1,394 @@
+#include "ImageWriter.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <stdexcept>
+#include <thread>
+
+#ifdef METABALLS_ZLIB
+#include <zlib.h>
+#endif
+
+#include "JobSystem.h"
+#include "Profiler.h"
+
+namespace {
+
+    void putBE32(std::vector<uint8_t>& out, uint32_t value) {
+        out.push_back((uint8_t)(value >> 24));
+        out.push_back((uint8_t)(value >> 16));
+        out.push_back((uint8_t)(value >> 8));
+        out.push_back((uint8_t)value);
+    }
+
+    /// CRC-32 of a PNG chunk's type and data
+    uint32_t crc32(const uint8_t* data, size_t size) {
+#ifdef METABALLS_ZLIB
+        return (uint32_t)::crc32(0L, data, (uInt)size);
+#else
+        static uint32_t table[256];
+        static bool init = [] {
+            for (uint32_t n = 0; n < 256; n++) {
+                uint32_t c = n;
+                for (int k = 0; k < 8; k++) {
+                    c = c & 1 ? 0xedb88320u ^ (c >> 1) : c >> 1;
+                }
+                table[n] = c;
+            }
+            return true;
+        }();
+        (void)init;
+        uint32_t c = 0xffffffffu;
+        for (size_t i = 0; i < size; i++) {
+            c = table[(c ^ data[i]) & 0xff] ^ (c >> 8);
+        }
+        return c ^ 0xffffffffu;
+#endif
+    }
+
+    /// Appends a PNG chunk whose data is already at the end of out
+    void closeChunk(std::vector<uint8_t>& out, size_t start) {
+        uint32_t length = (uint32_t)(out.size() - start - 8);
+        for (int i = 0; i < 4; i++) {
+            out[start + i] = (uint8_t)(length >> (24 - 8 * i));
+        }
+        putBE32(out, crc32(out.data() + start + 4, length + 4));
+    }
+
+    size_t openChunk(std::vector<uint8_t>& out, const char* type) {
+        size_t start = out.size();
+        out.insert(out.end(), 4, 0);
+        out.insert(out.end(), type, type + 4);
+        return start;
+    }
+
+    /** Encodes an 8 bit RGBA PNG
+     *  Rows are filtered by their left neighbour and deflated at zlib's
+     *  fastest level, or stored uncompressed when zlib wasn't found.
+     */
+    void encodePNG(const uint8_t* rgba, int width, int height,
+                   std::vector<uint8_t>& out) {
+        static const uint8_t signature[8] = {0x89, 'P',  'N',  'G',
+                                             '\r', '\n', 0x1a, '\n'};
+        out.insert(out.end(), signature, signature + 8);
+
+        size_t chunk = openChunk(out, "IHDR");
+        putBE32(out, (uint32_t)width);
+        putBE32(out, (uint32_t)height);
+        const uint8_t header[5] = {8, 6, 0, 0, 0};  // 8 bit RGBA
+        out.insert(out.end(), header, header + 5);
+        closeChunk(out, chunk);
+
+        size_t stride = (size_t)width * 4;
+        std::vector<uint8_t> filtered((stride + 1) * height);
+        for (int y = 0; y < height; y++) {
+            const uint8_t* row = rgba + stride * y;
+            uint8_t* dst = filtered.data() + (stride + 1) * y;
+#ifdef METABALLS_ZLIB
+            dst[0] = 1;  // sub
+            std::memcpy(dst + 1, row, std::min<size_t>(stride, 4));
+            for (size_t x = 4; x < stride; x++) {
+                dst[1 + x] = (uint8_t)(row[x] - row[x - 4]);
+            }
+#else
+            dst[0] = 0;  // none
+            std::memcpy(dst + 1, row, stride);
+#endif
+        }
+
+        chunk = openChunk(out, "IDAT");
+#ifdef METABALLS_ZLIB
+        size_t start = out.size();
+        uLongf size = compressBound((uLong)filtered.size());
+        out.resize(start + size);
+        if (compress2(out.data() + start, &size, filtered.data(),
+                      (uLong)filtered.size(), Z_BEST_SPEED) != Z_OK) {
+            throw std::runtime_error("PNG compression failed");
+        }
+        out.resize(start + size);
+#else
+        // zlib stream of stored blocks
+        out.push_back(0x78);
+        out.push_back(0x01);
+        for (size_t i = 0; i < filtered.size(); i += 65535) {
+            size_t size = std::min<size_t>(65535, filtered.size() - i);
+            out.push_back(i + size == filtered.size() ? 1 : 0);
+            out.push_back((uint8_t)size);
+            out.push_back((uint8_t)(size >> 8));
+            out.push_back((uint8_t)~size);
+            out.push_back((uint8_t)(~size >> 8));
+            out.insert(out.end(), filtered.begin() + i,
+                       filtered.begin() + i + size);
+        }
+        // Adler-32, 5552 bytes is the most that can't overflow b
+        uint32_t a = 1, b = 0;
+        for (size_t i = 0; i < filtered.size(); i += 5552) {
+            size_t end = std::min<size_t>(i + 5552, filtered.size());
+            for (size_t k = i; k < end; k++) {
+                a += filtered[k];
+                b += a;
+            }
+            a %= 65521;
+            b %= 65521;
+        }
+        putBE32(out, (b << 16) | a);
+#endif
+        closeChunk(out, chunk);
+
+        closeChunk(out, openChunk(out, "IEND"));
+    }
+
+    /// Encodes a binary RGB PPM, alpha is dropped
+    void encodePPM(const uint8_t* rgba, int width, int height,
+                   std::vector<uint8_t>& out) {
+        char header[64];
+        int length = snprintf(header, sizeof(header), "P6\n%d %d\n255\n",
+                              width, height);
+        out.insert(out.end(), header, header + length);
+        size_t start = out.size();
+        size_t count = (size_t)width * height;
+        out.resize(start + count * 3);
+        uint8_t* dst = out.data() + start;
+        for (size_t i = 0; i < count; i++) {
+            dst[i * 3] = rgba[i * 4];
+            dst[i * 3 + 1] = rgba[i * 4 + 1];
+            dst[i * 3 + 2] = rgba[i * 4 + 2];
+        }
+    }
+
+    /// Encodes a QOI image, see https://qoiformat.org/qoi-specification.pdf
+    void encodeQOI(const uint8_t* rgba, int width, int height,
+                   std::vector<uint8_t>& out) {
+        const char magic[4] = {'q', 'o', 'i', 'f'};
+        out.insert(out.end(), magic, magic + 4);
+        putBE32(out, (uint32_t)width);
+        putBE32(out, (uint32_t)height);
+        out.push_back(4);  // RGBA
+        out.push_back(0);  // sRGB
+
+        // worst case is 5 bytes a pixel
+        size_t count = (size_t)width * height;
+        size_t start = out.size();
+        out.resize(start + count * 5 + 8);
+        uint8_t* dst = out.data() + start;
+        size_t p = 0;
+
+        uint32_t index[64] = {};
+        uint8_t prev[4] = {0, 0, 0, 255};
+        uint32_t prevValue;
+        std::memcpy(&prevValue, prev, 4);
+        int run = 0;
+        for (size_t i = 0; i < count; i++) {
+            const uint8_t* px = rgba + i * 4;
+            uint32_t value;
+            std::memcpy(&value, px, 4);
+            if (value == prevValue) {
+                run++;
+                if (run == 62 || i + 1 == count) {
+                    dst[p++] = 0xc0 | (run - 1);
+                    run = 0;
+                }
+                continue;
+            }
+            if (run > 0) {
+                dst[p++] = 0xc0 | (run - 1);
+                run = 0;
+            }
+
+            int hash = (px[0] * 3 + px[1] * 5 + px[2] * 7 + px[3] * 11) % 64;
+            if (index[hash] == value) {
+                dst[p++] = (uint8_t)hash;
+            } else {
+                index[hash] = value;
+                if (px[3] == prev[3]) {
+                    int8_t dr = (int8_t)(px[0] - prev[0]);
+                    int8_t dg = (int8_t)(px[1] - prev[1]);
+                    int8_t db = (int8_t)(px[2] - prev[2]);
+                    int8_t drg = (int8_t)(dr - dg);
+                    int8_t dbg = (int8_t)(db - dg);
+                    if (dr >= -2 && dr <= 1 && dg >= -2 && dg <= 1 &&
+                        db >= -2 && db <= 1) {
+                        dst[p++] =
+                            0x40 | (dr + 2) << 4 | (dg + 2) << 2 | (db + 2);
+                    } else if (dg >= -32 && dg <= 31 && drg >= -8 &&
+                               drg <= 7 && dbg >= -8 && dbg <= 7) {
+                        dst[p++] = 0x80 | (dg + 32);
+                        dst[p++] = (drg + 8) << 4 | (dbg + 8);
+                    } else {
+                        dst[p++] = 0xfe;
+                        dst[p++] = px[0];
+                        dst[p++] = px[1];
+                        dst[p++] = px[2];
+                    }
+                } else {
+                    dst[p++] = 0xff;
+                    std::memcpy(dst + p, px, 4);
+                    p += 4;
+                }
+            }
+            std::memcpy(prev, px, 4);
+            prevValue = value;
+        }
+        std::memset(dst + p, 0, 7);
+        dst[p + 7] = 1;
+        out.resize(start + p + 8);
+    }
+
+}  // namespace
+
+/** ImageWriter constructor
+ *  @param format The format every frame is written in
+ *  @param depth Frames that can be encoding at once, 0 for one per thread
+ */
+ImageWriter::ImageWriter(Format format, size_t depth)
+    : m_format(format), m_next(0), m_written(0) {
+    if (depth == 0) {
+        depth = std::max<size_t>(JobSystem::threadCount(), 2);
+    }
+    for (size_t i = 0; i < depth; i++) {
+        m_slots.emplace_back(new Slot());
+        m_slots.back()->busy.store(false);
+    }
+}
+
+/// ImageWriter destructor, waits for the frames still being written
+ImageWriter::~ImageWriter() {
+    for (std::unique_ptr<Slot>& slot : m_slots) {
+        while (slot->busy.load(std::memory_order_acquire)) {
+            std::this_thread::yield();
+        }
+    }
+}
+
+/** Returns a buffer for the next frame, rows top to bottom in RGBA
+ *  @param width The width of the frame in pixels
+ *  @param height The height of the frame in pixels
+ *
+ *  @note Blocks while the buffer's previous frame is still being written
+ */
+uint8_t* ImageWriter::acquire(int width, int height) {
+    Slot& slot = *m_slots[m_next];
+    wait(slot);
+    slot.width = width;
+    slot.height = height;
+    slot.pixels.resize((size_t)width * height * 4);
+    return slot.pixels.data();
+}
+
+/** Encodes and writes the frame from the last acquire()
+ *  @param path The file to write, its extension isn't checked
+ */
+void ImageWriter::submit(const std::string& path) {
+    Slot* slot = m_slots[m_next].get();
+    m_next = (m_next + 1) % m_slots.size();
+    slot->path = path;
+    m_written++;
+
+    if (JobSystem::threadCount() <= 1) {
+        write(m_format, slot);
+        return;
+    }
+    slot->busy.store(true, std::memory_order_relaxed);
+    Format format = m_format;
+    JobSystem::run(JobSystem::create([format, slot]() {
+        write(format, slot);
+        slot->busy.store(false, std::memory_order_release);
+    }));
+}
+
+/** Waits for every submitted frame to be written
+ *  @note Throws a runtime error if any of them failed
+ */
+void ImageWriter::finish() {
+    for (std::unique_ptr<Slot>& slot : m_slots) {
+        wait(*slot);
+    }
+}
+
+/// Returns the number of frames submitted so far
+size_t ImageWriter::written() const { return m_written; }
+
+/** Looks up a format by name
+ *  @param name png, ppm or qoi
+ *  @param format Receives the format if the name is known
+ */
+bool ImageWriter::parseFormat(const std::string& name, Format& format) {
+    if (name == "png") {
+        format = PNG;
+    } else if (name == "ppm") {
+        format = PPM;
+    } else if (name == "qoi") {
+        format = QOI;
+    } else {
+        return false;
+    }
+    return true;
+}
+
+/// Returns the file extension for a format, without the dot
+const char* ImageWriter::extension(Format format) {
+    switch (format) {
+        case PNG:
+            return "png";
+        case PPM:
+            return "ppm";
+        default:
+            return "qoi";
+    }
+}
+
+/** Encodes an image into memory
+ *  @param format The file format
+ *  @param rgba Pixels, rows top to bottom
+ *  @param width The width of the image
+ *  @param height The height of the image
+ *  @param out Receives the file's bytes, cleared first
+ */
+void ImageWriter::encode(Format format, const uint8_t* rgba, int width,
+                         int height, std::vector<uint8_t>& out) {
+    out.clear();
+    switch (format) {
+        case PNG:
+            encodePNG(rgba, width, height, out);
+            break;
+        case PPM:
+            encodePPM(rgba, width, height, out);
+            break;
+        case QOI:
+            encodeQOI(rgba, width, height, out);
+            break;
+    }
+}
+
+/// Encodes and writes a slot's frame, recording any error in the slot
+void ImageWriter::write(Format format, Slot* slot) {
+    PROFILE_SCOPE("ImageWriter::write");
+    try {
+        encode(format, slot->pixels.data(), slot->width, slot->height,
+               slot->encoded);
+        FILE* file = fopen(slot->path.c_str(), "wb");
+        if (!file) {
+            throw std::runtime_error("Unable to open " + slot->path);
+        }
+        size_t size = fwrite(slot->encoded.data(), 1, slot->encoded.size(),
+                             file);
+        if (fclose(file) != 0 || size != slot->encoded.size()) {
+            throw std::runtime_error("Unable to write " + slot->path);
+        }
+    } catch (std::exception& e) {
+        slot->error = e.what();
+    }
+}
+
+/// Blocks until a slot is free, rethrowing the error from its last frame
+void ImageWriter::wait(Slot& slot) {
+    while (slot.busy.load(std::memory_order_acquire)) {
+        std::this_thread::yield();
+    }
+    if (!slot.error.empty()) {
+        std::string error = slot.error;
+        slot.error.clear();
+        throw std::runtime_error(error);
+    }
+}
@@ -0,0 +1,129 @@
+#include "PixelReadback.h"
+
+#include <algorithm>
+#include <stdexcept>
+
+/** PixelReadback constructor
+ *  @param depth The most copies in flight at once
+ */
+PixelReadback::PixelReadback(size_t depth)
+    : m_slots(std::max<size_t>(depth, 1)),
+      m_first(0),
+      m_count(0),
+      m_mapped(false) {
+    for (Slot& slot : m_slots) {
+        glGenBuffers(1, &slot.buffer);
+        slot.fence = nullptr;
+        slot.size = 0;
+        slot.width = 0;
+        slot.height = 0;
+    }
+}
+
+/// PixelReadback destructor, drops any copies still in flight
+PixelReadback::~PixelReadback() {
+    if (m_mapped) {
+        release();
+    }
+    for (Slot& slot : m_slots) {
+        if (slot.fence) {
+            glDeleteSync(slot.fence);
+        }
+        glDeleteBuffers(1, &slot.buffer);
+    }
+}
+
+/** Queues a copy of a texture's first level as 8 bit RGBA
+ *  @param texture The texture to copy, it must be complete and rendered
+ *  @param width The width of the texture
+ *  @param height The height of the texture
+ *
+ *  @note Throws a runtime error if every buffer is in flight
+ */
+void PixelReadback::start(GLuint texture, int width, int height) {
+    if (full()) {
+        throw std::runtime_error("PixelReadback has no free buffer");
+    }
+    Slot& slot = m_slots[(m_first + m_count) % m_slots.size()];
+    size_t size = (size_t)width * height * 4;
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, slot.buffer);
+    if (slot.size != size) {
+        glBufferData(GL_PIXEL_PACK_BUFFER, size, nullptr, GL_STREAM_READ);
+        slot.size = size;
+    }
+    slot.width = width;
+    slot.height = height;
+
+    glMemoryBarrier(GL_TEXTURE_UPDATE_BARRIER_BIT |
+                    GL_PIXEL_BUFFER_BARRIER_BIT);
+    glBindTexture(GL_TEXTURE_2D, texture);
+    glPixelStorei(GL_PACK_ALIGNMENT, 1);
+    glGetTexImage(GL_TEXTURE_2D, 0, GL_RGBA, GL_UNSIGNED_BYTE, nullptr);
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+    slot.fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+    // make sure the fence reaches the GPU, or polling it never succeeds
+    glFlush();
+    m_count++;
+}
+
+/// Returns whether the oldest copy has finished, never blocks
+bool PixelReadback::ready() {
+    if (empty()) {
+        return false;
+    }
+    GLenum status = glClientWaitSync(m_slots[m_first].fence, 0, 0);
+    return status == GL_ALREADY_SIGNALED || status == GL_CONDITION_SATISFIED;
+}
+
+/** Maps the oldest copy's pixels, rows top to bottom in RGBA
+ *  @note Blocks until the copy has finished if ready() wasn't true
+ *  @note The pointer is valid until release()
+ */
+const uint8_t* PixelReadback::map() {
+    if (empty()) {
+        throw std::runtime_error("PixelReadback has nothing to map");
+    }
+    Slot& slot = m_slots[m_first];
+    while (glClientWaitSync(slot.fence, GL_SYNC_FLUSH_COMMANDS_BIT,
+                            1000000000) == GL_TIMEOUT_EXPIRED) {
+    }
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, slot.buffer);
+    const uint8_t* pixels = (const uint8_t*)glMapBufferRange(
+        GL_PIXEL_PACK_BUFFER, 0, slot.size, GL_MAP_READ_BIT);
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+    if (!pixels) {
+        throw std::runtime_error("Unable to map a pixel buffer");
+    }
+    m_mapped = true;
+    return pixels;
+}
+
+/// Unmaps the oldest copy and frees its buffer for another start()
+void PixelReadback::release() {
+    if (empty()) {
+        return;
+    }
+    Slot& slot = m_slots[m_first];
+    if (m_mapped) {
+        glBindBuffer(GL_PIXEL_PACK_BUFFER, slot.buffer);
+        glUnmapBuffer(GL_PIXEL_PACK_BUFFER);
+        glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+        m_mapped = false;
+    }
+    glDeleteSync(slot.fence);
+    slot.fence = nullptr;
+    m_first = (m_first + 1) % m_slots.size();
+    m_count--;
+}
+
+/// Returns whether no copies are in flight
+bool PixelReadback::empty() const { return m_count == 0; }
+
+/// Returns whether every buffer is in flight
+bool PixelReadback::full() const { return m_count == m_slots.size(); }
+
+/// Returns the width of the oldest copy
+int PixelReadback::width() const { return m_slots[m_first].width; }
+
+/// Returns the height of the oldest copy
+int PixelReadback::height() const { return m_slots[m_first].height; }
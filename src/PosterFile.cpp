@@ -0,0 +1,121 @@
+#include "PosterFile.h"
+
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+#include <stdexcept>
+
+#ifdef UNIX
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+#endif
+
+/** PosterFile constructor, creates the file at its full size
+ *  @param path The file to create, it is replaced if it exists
+ *  @param width The width of the image
+ *  @param height The height of the image
+ *
+ *  @note Throws a runtime error if the file can't be created
+ */
+PosterFile::PosterFile(const std::string& path, int width, int height)
+    : m_path(path), m_width(width), m_height(height), m_rows(nullptr) {
+    char header[64];
+    m_headerSize = (size_t)snprintf(header, sizeof(header),
+                                    "P6\n%d %d\n255\n", width, height);
+    size_t size = m_headerSize + (size_t)width * height * 3;
+#ifdef UNIX
+    m_map = nullptr;
+    m_mapSize = 0;
+    m_file = open(path.c_str(), O_RDWR | O_CREAT | O_TRUNC, 0644);
+    if (m_file < 0) {
+        throw std::runtime_error("Unable to create " + path + ": " +
+                                 strerror(errno));
+    }
+    // the pixels are left as a hole until each band is written
+    if (write(m_file, header, m_headerSize) != (ssize_t)m_headerSize ||
+        ftruncate(m_file, (off_t)size) != 0) {
+        std::string error = strerror(errno);
+        close(m_file);
+        throw std::runtime_error("Unable to size " + path + ": " + error);
+    }
+#else
+    m_bandOffset = 0;
+    m_file.open(path, std::ios::in | std::ios::out | std::ios::binary |
+                          std::ios::trunc);
+    m_file.write(header, m_headerSize);
+    m_file.seekp(size - 1);
+    m_file.put(0);
+    if (!m_file) {
+        throw std::runtime_error("Unable to create " + path);
+    }
+#endif
+}
+
+/// PosterFile destructor, writes out the last band
+PosterFile::~PosterFile() {
+    try {
+        unmapRows();
+    } catch (std::exception&) {
+    }
+#ifdef UNIX
+    close(m_file);
+#endif
+}
+
+/** Maps a band of rows to fill in, unmapping the previous one
+ *  @param first The first row of the band
+ *  @param count The number of rows in the band
+ *  @return width * 3 bytes of RGB for each row
+ *
+ *  @note Throws a runtime error if the band can't be mapped
+ */
+uint8_t* PosterFile::mapRows(int first, int count) {
+    unmapRows();
+    size_t offset = m_headerSize + (size_t)first * m_width * 3;
+    size_t size = (size_t)count * m_width * 3;
+#ifdef UNIX
+    // mappings start on a page
+    size_t page = (size_t)sysconf(_SC_PAGESIZE);
+    size_t skip = offset % page;
+    m_mapSize = size + skip;
+    m_map = mmap(nullptr, m_mapSize, PROT_READ | PROT_WRITE, MAP_SHARED,
+                 m_file, (off_t)(offset - skip));
+    if (m_map == MAP_FAILED) {
+        m_map = nullptr;
+        throw std::runtime_error("Unable to map " + m_path + ": " +
+                                 strerror(errno));
+    }
+    m_rows = (uint8_t*)m_map + skip;
+#else
+    m_band.resize(size);
+    m_bandOffset = offset;
+    m_rows = m_band.data();
+#endif
+    return m_rows;
+}
+
+/** Hands the mapped band back to be written out
+ *  @note Throws a runtime error if the band can't be written
+ */
+void PosterFile::unmapRows() {
+    if (!m_rows) {
+        return;
+    }
+    m_rows = nullptr;
+#ifdef UNIX
+    // the kernel writes the dirty pages back on its own time
+    munmap(m_map, m_mapSize);
+    m_map = nullptr;
+#else
+    m_file.seekp(m_bandOffset);
+    m_file.write((const char*)m_band.data(), m_band.size());
+    if (!m_file) {
+        throw std::runtime_error("Unable to write " + m_path);
+    }
+#endif
+}
+
+int PosterFile::width() const { return m_width; }
+
+int PosterFile::height() const { return m_height; }
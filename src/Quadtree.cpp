@@ -0,0 +1,146 @@
+#include "Quadtree.h"
+
+#include <algorithm>
+
+#include "JobSystem.h"
+
+const uint32_t Quadtree::s_maxDepth = 16;
+
+namespace {
+
+    /// Spreads the low 16 bits of v out to the even bits
+    inline uint32_t spreadBits(uint32_t v) {
+        v &= 0xffff;
+        v = (v | (v << 8)) & 0x00ff00ff;
+        v = (v | (v << 4)) & 0x0f0f0f0f;
+        v = (v | (v << 2)) & 0x33333333;
+        v = (v | (v << 1)) & 0x55555555;
+        return v;
+    }
+
+}  // namespace
+
+/** Quadtree constructor
+ *  @param leafSize The most points a node holds before it is split
+ */
+Quadtree::Quadtree(uint32_t leafSize)
+    : m_leafSize(std::max(leafSize, 1u)), m_width(1) {}
+
+/// Returns the nodes of the last built tree in depth first order
+const std::vector<Quadtree::Node>& Quadtree::nodes() const { return m_nodes; }
+
+/// Returns the index of every leaf node
+const std::vector<uint32_t>& Quadtree::leaves() const { return m_leaves; }
+
+/// Returns the index of the point in each sorted slot
+const std::vector<uint32_t>& Quadtree::order() const { return m_order; }
+
+/// Returns whether a node has no children
+bool Quadtree::isLeaf(uint32_t node) const {
+    return m_nodes[node].next == node + 1;
+}
+
+/** Builds the tree for a set of points
+ *  @param posX The x coordinate of every point
+ *  @param posY The y coordinate of every point
+ *  @param count The number of points
+ */
+void Quadtree::build(const float* posX, const float* posY, size_t count) {
+    m_nodes.clear();
+    m_leaves.clear();
+    m_order.resize(count);
+    if (count == 0) {
+        return;
+    }
+
+    // the root cell is a square around every point
+    float minX = posX[0], maxX = posX[0];
+    float minY = posY[0], maxY = posY[0];
+    for (size_t i = 1; i < count; i++) {
+        minX = std::min(minX, posX[i]);
+        maxX = std::max(maxX, posX[i]);
+        minY = std::min(minY, posY[i]);
+        maxY = std::max(maxY, posY[i]);
+    }
+    m_width = std::max(std::max(maxX - minX, maxY - minY), 1.0f) * 1.0001f;
+
+    m_codes.resize(count);
+    float quantize = 65536.0f / m_width;
+    JobSystem::parallelFor(0, count, 4096, [&](size_t first, size_t last) {
+        for (size_t i = first; i < last; i++) {
+            uint32_t qx = std::min((uint32_t)((posX[i] - minX) * quantize),
+                                   0xffffu);
+            uint32_t qy = std::min((uint32_t)((posY[i] - minY) * quantize),
+                                   0xffffu);
+            m_codes[i] = spreadBits(qx) | (spreadBits(qy) << 1);
+            m_order[i] = (uint32_t)i;
+        }
+    });
+    sortByCode(count);
+
+    m_nodes.reserve(count / m_leafSize * 2 + 1);
+    buildNode(0, (uint32_t)count, 0);
+}
+
+/// Least significant digit radix sort of the points by Morton code
+void Quadtree::sortByCode(size_t count) {
+    m_scratch.resize(count * 2);
+    uint32_t* codes = m_codes.data();
+    uint32_t* order = m_order.data();
+    uint32_t* tempCodes = m_scratch.data();
+    uint32_t* tempOrder = m_scratch.data() + count;
+
+    for (uint32_t shift = 0; shift < 32; shift += 8) {
+        size_t offsets[256] = {};
+        for (size_t i = 0; i < count; i++) {
+            offsets[(codes[i] >> shift) & 0xff]++;
+        }
+        size_t total = 0;
+        for (size_t& offset : offsets) {
+            size_t bucket = offset;
+            offset = total;
+            total += bucket;
+        }
+        for (size_t i = 0; i < count; i++) {
+            size_t slot = offsets[(codes[i] >> shift) & 0xff]++;
+            tempCodes[slot] = codes[i];
+            tempOrder[slot] = order[i];
+        }
+        std::swap(codes, tempCodes);
+        std::swap(order, tempOrder);
+    }
+    // an even number of passes leaves the result back in the members
+}
+
+/// Appends the node covering sorted points [first, last) and its subtree
+void Quadtree::buildNode(uint32_t first, uint32_t last, uint32_t depth) {
+    uint32_t index = (uint32_t)m_nodes.size();
+    m_nodes.push_back(Node());
+
+    if (last - first <= m_leafSize || depth == s_maxDepth) {
+        m_leaves.push_back(index);
+    } else {
+        // children are the runs sharing the next two bits of the code
+        uint32_t shift = 2 * (s_maxDepth - 1 - depth);
+        uint32_t begin = first;
+        for (uint32_t quadrant = 0; quadrant < 4 && begin < last; quadrant++) {
+            uint32_t end = (uint32_t)(
+                std::partition_point(
+                    m_codes.begin() + begin, m_codes.begin() + last,
+                    [&](uint32_t code) {
+                        return ((code >> shift) & 3) <= quadrant;
+                    }) -
+                m_codes.begin());
+            if (end > begin) {
+                buildNode(begin, end, depth + 1);
+            }
+            begin = end;
+        }
+    }
+
+    Node& node = m_nodes[index];
+    node.width = m_width / (float)(1u << depth);
+    node.first = first;
+    node.count = last - first;
+    node.next = (uint32_t)m_nodes.size();
+}
@@ -0,0 +1,499 @@
+#include "Recorder.h"
+
+#include <algorithm>
+#include <cstring>
+#include <iterator>
+#include <stdexcept>
+
+const char Recorder::s_magic[4] = {'M', 'B', 'R', 'L'};
+const uint64_t Recorder::s_version = 2;
+
+namespace {
+
+    // bytes gathered before they're written out
+    const size_t s_flushSize = 1 << 16;
+
+    uint32_t floatBits(float value) {
+        uint32_t bits;
+        std::memcpy(&bits, &value, sizeof(bits));
+        return bits;
+    }
+
+    // FNV-1a over the bits of an array
+    uint64_t hashFloats(uint64_t hash, const float* values, size_t count) {
+        for (size_t i = 0; i < count; i++) {
+            uint32_t bits = floatBits(values[i]);
+            for (int byte = 0; byte < 4; byte++) {
+                hash = (hash ^ ((bits >> (byte * 8)) & 0xff)) *
+                       0x100000001b3ull;
+            }
+        }
+        return hash;
+    }
+
+}  // namespace
+
+/** Recorder constructor, creates the log and writes its header
+ *  @param path The file to record to, it is replaced if it exists
+ *  @param seed The simulation's seed
+ *  @param width The width of the rendered image
+ *  @param height The height of the rendered image
+ *  @param scene The scene file loaded before the run, if any
+ *
+ *  @note Throws a runtime error if the file can't be created
+ */
+Recorder::Recorder(const std::string& path, uint64_t seed, int width,
+                   int height, const std::string& scene)
+    : m_path(path),
+      m_file(path, std::ios::binary | std::ios::trunc),
+      m_bytes(0),
+      m_frames(0),
+      m_commandTick(0),
+      m_frameTick(0),
+      m_frameCommands(0),
+      m_finished(false) {
+    if (!m_file.is_open()) {
+        throw std::runtime_error("Unable to create " + path);
+    }
+    for (char c : s_magic) {
+        m_buffer.push_back((uint8_t)c);
+    }
+    putVarint(s_version);
+    putVarint(seed);
+    putVarint((uint64_t)std::max(width, 0));
+    putVarint((uint64_t)std::max(height, 0));
+    putVarint(scene.size());
+    m_buffer.insert(m_buffer.end(), scene.begin(), scene.end());
+}
+
+/// Recorder destructor, writes out what's left without a checksum
+Recorder::~Recorder() {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    flush(true);
+}
+
+/** Logs a simulation command as it's applied
+ *  @param tick The simulation's tick count when it was applied
+ *  @param command The command
+ */
+void Recorder::command(uint64_t tick, const Simulation::Command& command) {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    if (m_finished) {
+        return;
+    }
+    m_buffer.push_back((uint8_t)command.type);
+    putVarint(tick - m_commandTick);
+    m_commandTick = tick;
+    switch (command.type) {
+        case Simulation::PushBall:
+            putBall(command.ball);
+            break;
+        case Simulation::PopBall:
+            break;
+        case Simulation::SetBall:
+            putVarint(command.index);
+            putBall(command.ball);
+            break;
+        case Simulation::SetBounds:
+            putFloat((float)command.value);
+            putFloat((float)command.value2);
+            break;
+        case Simulation::SetWiggly:
+            m_buffer.push_back(command.flag);
+            putFloat((float)command.value);
+            break;
+        case Simulation::SetCollisions:
+            m_buffer.push_back(command.flag);
+            break;
+        case Simulation::SetGravity:
+            m_buffer.push_back(command.flag);
+            putFloat((float)command.value);
+            putFloat((float)command.value2);
+            break;
+        case Simulation::SetIntegrator:
+            putVarint((uint64_t)command.value);
+            putFloat((float)command.value2);
+            break;
+        case Simulation::SetTickRate:
+            putDouble(command.value);
+            putVarint((uint64_t)std::max(command.value2, 0.0));
+            break;
+        case Simulation::SetPaused:
+            m_buffer.push_back(command.flag);
+            break;
+    }
+    flush(false);
+}
+
+/** Logs a drawn frame
+ *  @param tick The tick of the snapshot it drew
+ *  @param commands The commands applied before that snapshot
+ *  @param alpha How far between the last two ticks it was drawn
+ */
+void Recorder::frame(uint64_t tick, uint64_t commands, float alpha) {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    if (m_finished) {
+        return;
+    }
+    m_buffer.push_back(Frame);
+    putVarint(tick - m_frameTick);
+    putVarint(commands - m_frameCommands);
+    putFloat(alpha);
+    m_frameTick = tick;
+    m_frameCommands = commands;
+    m_frames++;
+    flush(false);
+}
+
+/// Logs a change of shader, by its index in the manifest
+void Recorder::selectShader(size_t index) {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_buffer.push_back(SelectShader);
+    putVarint(index);
+}
+
+/// Logs a change to one of the current shader's parameters
+void Recorder::shaderParameter(size_t index, float value) {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_buffer.push_back(ShaderParameter);
+    putVarint(index);
+    putFloat(value);
+}
+
+/// Logs switching between CPU and GPU rendering
+void Recorder::cpuRender(bool enabled) {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_buffer.push_back(CPURender);
+    m_buffer.push_back(enabled);
+}
+
+/// Logs a change to the size of the rendered image
+void Recorder::resize(int width, int height) {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_buffer.push_back(Resize);
+    putVarint((uint64_t)std::max(width, 0));
+    putVarint((uint64_t)std::max(height, 0));
+}
+
+/** Ends the log and writes it out, nothing is logged after
+ *  @param checksum The checksum of the last frame's balls, which replays
+ * compare against
+ *
+ *  @note Throws a runtime error if the log couldn't be written
+ */
+void Recorder::finish(uint64_t checksum) {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    if (m_finished) {
+        return;
+    }
+    m_finished = true;
+    m_buffer.push_back(End);
+    for (int byte = 0; byte < 8; byte++) {
+        m_buffer.push_back((uint8_t)(checksum >> (byte * 8)));
+    }
+    flush(true);
+    m_file.close();
+    if (m_file.fail()) {
+        throw std::runtime_error("Unable to write " + m_path);
+    }
+}
+
+/// Returns the number of frames logged
+size_t Recorder::frames() const { return m_frames; }
+
+/// Returns the size of the log so far
+size_t Recorder::bytes() const { return m_bytes + m_buffer.size(); }
+
+/// Returns a hash of every ball's state, to check replays against
+uint64_t Recorder::checksum(const BallSystem& balls) {
+    size_t count = balls.count();
+    uint64_t hash = 0xcbf29ce484222325ull;
+    hash = (hash ^ count) * 0x100000001b3ull;
+    hash = hashFloats(hash, balls.size(), count);
+    hash = hashFloats(hash, balls.posX(), count);
+    hash = hashFloats(hash, balls.posY(), count);
+    hash = hashFloats(hash, balls.velX(), count);
+    hash = hashFloats(hash, balls.velY(), count);
+    hash = hashFloats(hash, balls.red(), count);
+    hash = hashFloats(hash, balls.green(), count);
+    hash = hashFloats(hash, balls.blue(), count);
+    return hash;
+}
+
+/// Appends an unsigned LEB128 varint
+void Recorder::putVarint(uint64_t value) {
+    while (value >= 0x80) {
+        m_buffer.push_back((uint8_t)(value | 0x80));
+        value >>= 7;
+    }
+    m_buffer.push_back((uint8_t)value);
+}
+
+/// Appends a float's bits, little endian
+void Recorder::putFloat(float value) {
+    uint32_t bits = floatBits(value);
+    for (int byte = 0; byte < 4; byte++) {
+        m_buffer.push_back((uint8_t)(bits >> (byte * 8)));
+    }
+}
+
+/// Appends a double's bits, little endian
+void Recorder::putDouble(double value) {
+    uint64_t bits;
+    std::memcpy(&bits, &value, sizeof(bits));
+    for (int byte = 0; byte < 8; byte++) {
+        m_buffer.push_back((uint8_t)(bits >> (byte * 8)));
+    }
+}
+
+/// Appends every field of a ball
+void Recorder::putBall(const Ball& ball) {
+    putFloat(ball.size);
+    putFloat(ball.position.x);
+    putFloat(ball.position.y);
+    putFloat(ball.velocity.x);
+    putFloat(ball.velocity.y);
+    putFloat(ball.color.r);
+    putFloat(ball.color.g);
+    putFloat(ball.color.b);
+}
+
+/// Writes out the buffered events once there are enough, or if forced
+void Recorder::flush(bool force) {
+    if (m_buffer.empty() || (!force && m_buffer.size() < s_flushSize)) {
+        return;
+    }
+    m_file.write((const char*)m_buffer.data(), m_buffer.size());
+    m_bytes += m_buffer.size();
+    m_buffer.clear();
+}
+
+/** Replayer constructor, reads and decodes a whole log
+ *  @param path The log to read
+ *
+ *  @note Throws a runtime error if the file can't be read or isn't a log
+ */
+Replayer::Replayer(const std::string& path)
+    : m_path(path),
+      m_offset(0),
+      m_frames(0),
+      m_finished(false),
+      m_checksum(0) {
+    std::ifstream file(path, std::ios::binary);
+    if (!file.is_open()) {
+        throw std::runtime_error("Unable to open " + path);
+    }
+    m_data.assign(std::istreambuf_iterator<char>(file),
+                  std::istreambuf_iterator<char>());
+
+    char magic[sizeof(Recorder::s_magic)];
+    for (char& c : magic) {
+        c = (char)getByte();
+    }
+    if (std::memcmp(magic, Recorder::s_magic, sizeof(magic)) != 0) {
+        throw std::runtime_error(path + " isn't a recording");
+    }
+    uint64_t version = getVarint();
+    if (version != Recorder::s_version) {
+        throw std::runtime_error(path + " is recording version " +
+                                 std::to_string(version) + ", expected " +
+                                 std::to_string(Recorder::s_version));
+    }
+    m_seed = getVarint();
+    m_width = (int)getVarint();
+    m_height = (int)getVarint();
+    m_scene.resize(getVarint());
+    for (char& c : m_scene) {
+        c = (char)getByte();
+    }
+
+    uint64_t commandTick = 0;
+    uint64_t frameTick = 0;
+    uint64_t frameCommands = 0;
+    // a log cut short by a crash still replays up to where it stopped
+    try {
+        while (m_offset < m_data.size() && !m_finished) {
+            uint8_t type = getByte();
+            if (type < Recorder::Frame) {
+                TimedCommand timed{};
+                Simulation::Command& command = timed.command;
+                command.type = (Simulation::CommandType)type;
+                commandTick += getVarint();
+                timed.tick = commandTick;
+                switch (type) {
+                    case Simulation::PushBall:
+                        command.ball = getBall();
+                        break;
+                    case Simulation::PopBall:
+                        break;
+                    case Simulation::SetBall:
+                        command.index = getVarint();
+                        command.ball = getBall();
+                        break;
+                    case Simulation::SetBounds:
+                        command.value = getFloat();
+                        command.value2 = getFloat();
+                        break;
+                    case Simulation::SetWiggly:
+                        command.flag = getByte() != 0;
+                        command.value = getFloat();
+                        break;
+                    case Simulation::SetCollisions:
+                        command.flag = getByte() != 0;
+                        break;
+                    case Simulation::SetGravity:
+                        command.flag = getByte() != 0;
+                        command.value = getFloat();
+                        command.value2 = getFloat();
+                        break;
+                    case Simulation::SetIntegrator:
+                        command.value = (double)getVarint();
+                        command.value2 = getFloat();
+                        break;
+                    case Simulation::SetTickRate:
+                        command.value = getDouble();
+                        command.value2 = (double)getVarint();
+                        break;
+                    case Simulation::SetPaused:
+                        command.flag = getByte() != 0;
+                        break;
+                    default:
+                        throw std::runtime_error(path +
+                                                 " has an unknown command");
+                }
+                m_commands.push_back(timed);
+                continue;
+            }
+
+            Event event = {(Recorder::EventType)type, frameTick, frameCommands,
+                           0, 0.0f, 0, 0};
+            switch (type) {
+                case Recorder::Frame:
+                    frameTick += getVarint();
+                    frameCommands += getVarint();
+                    event.tick = frameTick;
+                    event.commands = frameCommands;
+                    event.value = getFloat();
+                    m_frames++;
+                    break;
+                case Recorder::SelectShader:
+                    event.index = getVarint();
+                    break;
+                case Recorder::ShaderParameter:
+                    event.index = getVarint();
+                    event.value = getFloat();
+                    break;
+                case Recorder::CPURender:
+                    event.index = getByte();
+                    break;
+                case Recorder::Resize:
+                    event.width = (int)getVarint();
+                    event.height = (int)getVarint();
+                    break;
+                case Recorder::End:
+                    for (int byte = 0; byte < 8; byte++) {
+                        m_checksum |= (uint64_t)getByte() << (byte * 8);
+                    }
+                    m_finished = true;
+                    continue;
+                default:
+                    throw std::runtime_error(path + " has an unknown event");
+            }
+            m_events.push_back(event);
+        }
+    } catch (std::runtime_error&) {
+        if (m_offset < m_data.size()) {
+            throw;
+        }
+    }
+    m_data.clear();
+    m_data.shrink_to_fit();
+}
+
+/// Returns the seed the run was recorded with
+uint64_t Replayer::seed() const { return m_seed; }
+
+/// Returns the scene loaded before the run, empty if there wasn't one
+const std::string& Replayer::scene() const { return m_scene; }
+
+/// Returns the width of the image when recording started
+int Replayer::width() const { return m_width; }
+
+/// Returns the height of the image when recording started
+int Replayer::height() const { return m_height; }
+
+/// Returns every command, in the order they were applied
+const std::vector<Replayer::TimedCommand>& Replayer::commands() const {
+    return m_commands;
+}
+
+/// Returns every frame and renderer change, in order
+const std::vector<Replayer::Event>& Replayer::events() const {
+    return m_events;
+}
+
+/// Returns the number of frames recorded
+size_t Replayer::frames() const { return m_frames; }
+
+/// Returns whether the log was finished, with a checksum to compare to
+bool Replayer::finished() const { return m_finished; }
+
+/// Returns the checksum of the last frame's balls, see finished()
+uint64_t Replayer::checksum() const { return m_checksum; }
+
+/// Reads a byte, throws a runtime error past the end of the log
+uint8_t Replayer::getByte() {
+    if (m_offset >= m_data.size()) {
+        throw std::runtime_error(m_path + " ends in the middle of an event");
+    }
+    return m_data[m_offset++];
+}
+
+/// Reads an unsigned LEB128 varint
+uint64_t Replayer::getVarint() {
+    uint64_t value = 0;
+    for (int shift = 0; shift < 64; shift += 7) {
+        uint8_t byte = getByte();
+        value |= (uint64_t)(byte & 0x7f) << shift;
+        if (!(byte & 0x80)) {
+            break;
+        }
+    }
+    return value;
+}
+
+/// Reads a float's bits, little endian
+float Replayer::getFloat() {
+    uint32_t bits = 0;
+    for (int byte = 0; byte < 4; byte++) {
+        bits |= (uint32_t)getByte() << (byte * 8);
+    }
+    float value;
+    std::memcpy(&value, &bits, sizeof(value));
+    return value;
+}
+
+/// Reads a double's bits, little endian
+double Replayer::getDouble() {
+    uint64_t bits = 0;
+    for (int byte = 0; byte < 8; byte++) {
+        bits |= (uint64_t)getByte() << (byte * 8);
+    }
+    double value;
+    std::memcpy(&value, &bits, sizeof(value));
+    return value;
+}
+
+/// Reads every field of a ball
+Ball Replayer::getBall() {
+    Ball ball;
+    ball.size = getFloat();
+    ball.position.x = getFloat();
+    ball.position.y = getFloat();
+    ball.velocity.x = getFloat();
+    ball.velocity.y = getFloat();
+    ball.color.r = getFloat();
+    ball.color.g = getFloat();
+    ball.color.b = getFloat();
+    return ball;
+}
@@ -0,0 +1,328 @@
+#include "SceneFile.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <cmath>
+#include <cstring>
+#include <fstream>
+#include <stdexcept>
+
+#include "JobSystem.h"
+
+#ifdef UNIX
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+const char SceneFile::s_magic[4] = {'M', 'B', 'S', 'C'};
+const uint32_t SceneFile::s_version = 1;
+
+static_assert(sizeof(SceneFile::Header) == 64,
+              "scene headers are 64 bytes");
+
+namespace {
+
+    const size_t s_members = 8;   // arrays in a scene, in BallSystem order
+    const size_t s_align = 64;    // arrays start on a cache line
+    const size_t s_grain = 1 << 16;  // balls per load or save job
+
+    // bytes per ball of each array when quantized
+    const size_t s_quantizedBytes[s_members] = {2, 2, 2, 2, 2, 1, 1, 1};
+
+    /// Finds where each array starts, returns the size of the file
+    size_t arrayOffsets(size_t count, bool quantized,
+                        size_t offsets[s_members]) {
+        size_t offset = sizeof(SceneFile::Header);
+        for (size_t i = 0; i < s_members; i++) {
+            offsets[i] = offset;
+            size_t bytes = quantized ? s_quantizedBytes[i] : sizeof(float);
+            offset = (offset + count * bytes + s_align - 1) & ~(s_align - 1);
+        }
+        return offset;
+    }
+
+    /// The arrays of a BallSystem, in file order
+    void members(BallSystem& balls, float* arrays[s_members]) {
+        float* all[s_members] = {balls.size(), balls.posX(),  balls.posY(),
+                                 balls.velX(), balls.velY(),  balls.red(),
+                                 balls.green(), balls.blue()};
+        std::copy(all, all + s_members, arrays);
+    }
+
+    uint16_t toUnsigned16(float value, float scale) {
+        float q = std::round(value * scale);
+        return (uint16_t)std::min(std::max(q, 0.0f), 65535.0f);
+    }
+
+    int16_t toSigned16(float value, float scale) {
+        float q = std::round(value * scale);
+        return (int16_t)std::min(std::max(q, -32767.0f), 32767.0f);
+    }
+
+    uint8_t toUnsigned8(float value) {
+        float q = std::round(value * 255.0f);
+        return (uint8_t)std::min(std::max(q, 0.0f), 255.0f);
+    }
+
+}  // namespace
+
+/** SceneFile constructor, maps a scene and checks its header
+ *  @param path The scene to open
+ *
+ *  @note Throws a runtime error if the file can't be mapped or isn't a
+ * scene
+ */
+SceneFile::SceneFile(const std::string& path)
+    : m_path(path), m_data(nullptr), m_size(0) {
+#ifdef UNIX
+    m_map = nullptr;
+    int file = open(path.c_str(), O_RDONLY);
+    struct stat info;
+    if (file < 0 || fstat(file, &info) != 0) {
+        std::string error = strerror(errno);
+        if (file >= 0) {
+            close(file);
+        }
+        throw std::runtime_error("Unable to open " + path + ": " + error);
+    }
+    m_size = (size_t)info.st_size;
+    if (m_size > 0) {
+        m_map = mmap(nullptr, m_size, PROT_READ, MAP_PRIVATE, file, 0);
+    }
+    close(file);
+    if (m_map == MAP_FAILED || !m_map) {
+        m_map = nullptr;
+        throw std::runtime_error("Unable to map " + path);
+    }
+    // start reading the whole file in before load() needs it
+    madvise(m_map, m_size, MADV_WILLNEED);
+    m_data = (const uint8_t*)m_map;
+#else
+    std::ifstream file(path, std::ios::binary | std::ios::ate);
+    if (!file.is_open()) {
+        throw std::runtime_error("Unable to open " + path);
+    }
+    m_buffer.resize((size_t)file.tellg());
+    file.seekg(0);
+    file.read((char*)m_buffer.data(), m_buffer.size());
+    m_data = m_buffer.data();
+    m_size = m_buffer.size();
+#endif
+
+    // the destructor won't run if this throws, so unmap here
+    try {
+        checkHeader();
+    } catch (...) {
+        unmap();
+        throw;
+    }
+}
+
+/// SceneFile destructor, unmaps the file
+SceneFile::~SceneFile() { unmap(); }
+
+/** Reads the header and checks the file is a whole scene this version
+ *  reads
+ *  @note Throws a runtime error if it isn't
+ */
+void SceneFile::checkHeader() {
+    if (m_size < sizeof(Header)) {
+        throw std::runtime_error(m_path + " isn't a scene");
+    }
+    std::memcpy(&m_header, m_data, sizeof(Header));
+    if (std::memcmp(m_header.magic, s_magic, sizeof(s_magic)) != 0) {
+        throw std::runtime_error(m_path + " isn't a scene");
+    }
+    if (m_header.version != s_version) {
+        throw std::runtime_error(m_path + " is scene version " +
+                                 std::to_string(m_header.version) +
+                                 ", expected " + std::to_string(s_version));
+    }
+    if (m_size < fileSize(m_header.count, quantized())) {
+        throw std::runtime_error(m_path + " is cut short");
+    }
+}
+
+/// Unmaps the file, if it's mapped
+void SceneFile::unmap() {
+#ifdef UNIX
+    if (m_map) {
+        munmap(m_map, m_size);
+        m_map = nullptr;
+    }
+#endif
+}
+
+/// Returns the number of balls in the scene
+size_t SceneFile::count() const { return m_header.count; }
+
+/// Returns whether the scene is quantized
+bool SceneFile::quantized() const { return m_header.flags & Quantized; }
+
+/// Returns the width of the bounds the scene was saved with
+float SceneFile::width() const { return m_header.width; }
+
+/// Returns the height of the bounds the scene was saved with
+float SceneFile::height() const { return m_header.height; }
+
+/** Replaces the contents of a BallSystem with the scene
+ *  @param balls The system to overwrite, the positions before the last
+ * tick are set to the current ones
+ */
+void SceneFile::load(BallSystem& balls) const {
+    size_t count = m_header.count;
+    bool quantize = quantized();
+    size_t offsets[s_members];
+    arrayOffsets(count, quantize, offsets);
+    balls.resize(count);
+    float* arrays[s_members];
+    members(balls, arrays);
+
+    const Header& header = m_header;
+    const uint8_t* data = m_data;
+    JobSystem::parallelFor(0, count, s_grain, [&](size_t first, size_t last) {
+        size_t n = last - first;
+        if (!quantize) {
+            for (size_t m = 0; m < s_members; m++) {
+                std::memcpy(arrays[m] + first,
+                            data + offsets[m] + first * sizeof(float),
+                            n * sizeof(float));
+            }
+        } else {
+            const uint16_t* size = (const uint16_t*)(data + offsets[0]);
+            const uint16_t* posX = (const uint16_t*)(data + offsets[1]);
+            const uint16_t* posY = (const uint16_t*)(data + offsets[2]);
+            const int16_t* velX = (const int16_t*)(data + offsets[3]);
+            const int16_t* velY = (const int16_t*)(data + offsets[4]);
+            float sizeScale = header.maxSize / 65535.0f;
+            float xScale = header.rangeX / 65535.0f;
+            float yScale = header.rangeY / 65535.0f;
+            float velScale = header.maxSpeed / 32767.0f;
+            for (size_t i = first; i < last; i++) {
+                arrays[0][i] = size[i] * sizeScale;
+                arrays[1][i] = header.minX + posX[i] * xScale;
+                arrays[2][i] = header.minY + posY[i] * yScale;
+                arrays[3][i] = velX[i] * velScale;
+                arrays[4][i] = velY[i] * velScale;
+            }
+            for (size_t m = 5; m < s_members; m++) {
+                const uint8_t* color = data + offsets[m];
+                for (size_t i = first; i < last; i++) {
+                    arrays[m][i] = color[i] * (1.0f / 255.0f);
+                }
+            }
+        }
+        balls.savePositions(first, last);
+    });
+}
+
+/** Saves a BallSystem as a scene
+ *  @param path The file to write, it is replaced if it exists
+ *  @param balls The balls to save
+ *  @param width The width of the bounds the balls are in
+ *  @param height The height of the bounds the balls are in
+ *  @param quantize Whether to quantize the balls to 13 bytes each
+ *
+ *  @note Throws a runtime error if the file can't be written
+ */
+void SceneFile::save(const std::string& path, const BallSystem& balls,
+                     float width, float height, bool quantize) {
+    size_t count = balls.count();
+    Header header;
+    std::memset(&header, 0, sizeof(header));
+    std::memcpy(header.magic, s_magic, sizeof(s_magic));
+    header.version = s_version;
+    header.count = count;
+    header.flags = quantize ? Quantized : 0;
+    header.width = width;
+    header.height = height;
+
+    const float* arrays[s_members] = {
+        balls.size(), balls.posX(), balls.posY(),  balls.velX(),
+        balls.velY(), balls.red(),  balls.green(), balls.blue()};
+    if (quantize && count > 0) {
+        auto range = [&](const float* values, float& low, float& high) {
+            auto bounds = std::minmax_element(values, values + count);
+            low = *bounds.first;
+            high = *bounds.second;
+        };
+        float low, high, lowY, highY;
+        range(balls.posX(), low, high);
+        range(balls.posY(), lowY, highY);
+        header.minX = low;
+        header.rangeX = high - low;
+        header.minY = lowY;
+        header.rangeY = highY - lowY;
+        range(balls.size(), low, high);
+        header.maxSize = std::max(high, 0.0f);
+        range(balls.velX(), low, high);
+        header.maxSpeed = std::max(-low, high);
+        range(balls.velY(), low, high);
+        header.maxSpeed = std::max(header.maxSpeed, std::max(-low, high));
+    }
+
+    std::ofstream file(path, std::ios::binary | std::ios::trunc);
+    if (!file.is_open()) {
+        throw std::runtime_error("Unable to create " + path);
+    }
+    file.write((const char*)&header, sizeof(header));
+
+    size_t offsets[s_members];
+    size_t total = arrayOffsets(count, quantize, offsets);
+    std::vector<uint8_t> packed;
+    for (size_t m = 0; m < s_members; m++) {
+        file.seekp(offsets[m]);
+        if (!quantize) {
+            file.write((const char*)arrays[m], count * sizeof(float));
+            continue;
+        }
+
+        packed.resize(count * s_quantizedBytes[m]);
+        const float* values = arrays[m];
+        float scale = 0;
+        float offset = 0;
+        if (m == 0) {
+            scale = header.maxSize > 0 ? 65535.0f / header.maxSize : 0;
+        } else if (m <= 2) {
+            float extent = m == 1 ? header.rangeX : header.rangeY;
+            offset = m == 1 ? header.minX : header.minY;
+            scale = extent > 0 ? 65535.0f / extent : 0;
+        } else if (m <= 4) {
+            scale = header.maxSpeed > 0 ? 32767.0f / header.maxSpeed : 0;
+        }
+        uint8_t* out = packed.data();
+        JobSystem::parallelFor(
+            0, count, s_grain, [&](size_t first, size_t last) {
+                for (size_t i = first; i < last; i++) {
+                    if (m <= 2) {
+                        ((uint16_t*)out)[i] =
+                            toUnsigned16(values[i] - offset, scale);
+                    } else if (m <= 4) {
+                        ((int16_t*)out)[i] = toSigned16(values[i], scale);
+                    } else {
+                        out[i] = toUnsigned8(values[i]);
+                    }
+                }
+            });
+        file.write((const char*)packed.data(), packed.size());
+    }
+    // pad the last array out to the size the loader checks for
+    if ((size_t)file.tellp() < total) {
+        file.seekp(total - 1);
+        file.put(0);
+    }
+    if (!file) {
+        throw std::runtime_error("Unable to write " + path);
+    }
+}
+
+/** Returns the size of a scene file
+ *  @param count The number of balls
+ *  @param quantize Whether the balls are quantized
+ */
+size_t SceneFile::fileSize(size_t count, bool quantize) {
+    size_t offsets[s_members];
+    return arrayOffsets(count, quantize, offsets);
+}
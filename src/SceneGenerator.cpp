@@ -0,0 +1,250 @@
+#include "SceneGenerator.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <vector>
+
+#include "CounterRNG.h"
+#include "JobSystem.h"
+
+namespace {
+
+    const char* s_names[] = {"uniform", "clustered", "powerlaw", "grid",
+                             "ring"};
+    const size_t s_distributions = sizeof(s_names) / sizeof(s_names[0]);
+    const char s_prefix[] = "gen:";  // marks a description, see describe()
+
+    const size_t s_grain = 1 << 16;       // balls per job
+    const uint64_t s_stream = 3ull << 62;  // CounterRNG streams, one a member
+    const float s_pi = 3.14159265358979f;
+    const float s_paretoShape = 1.5f;
+
+    // what each stream is drawn for
+    enum {
+        SizeStream,
+        XStream,
+        YStream,
+        AngleStream,
+        SpeedStream,
+        RedStream,
+        GreenStream,
+        BlueStream,
+        ClusterStream,
+        CenterStream
+    };
+
+    /// Radius of a ball relative to the smallest one, in [1, spread]
+    float relativeRadius(SceneGenerator::Distribution distribution,
+                         float spread, float u) {
+        switch (distribution) {
+        case SceneGenerator::Grid:
+            return 1.0f;
+        case SceneGenerator::PowerLaw: {
+            // inverse of a pareto CDF cut off at spread
+            float tail = 1.0f - std::pow(spread, -s_paretoShape);
+            return std::min(std::pow(1.0f - u * tail, -1.0f / s_paretoShape),
+                            spread);
+        }
+        default:
+            return std::pow(spread, u);
+        }
+    }
+
+}  // namespace
+
+/// Returns settings for a thousand uniformly placed balls
+SceneGenerator::Settings SceneGenerator::defaults() {
+    Settings settings;
+    settings.distribution = Uniform;
+    settings.count = 1000;
+    settings.seed = 0;
+    settings.width = 0;
+    settings.height = 0;
+    settings.coverage = 0.5f;
+    settings.spread = 8.0f;
+    settings.speed = 5.0f;
+    return settings;
+}
+
+/** Looks up a distribution by name
+ *  @param name uniform, clustered, powerlaw, grid or ring
+ *  @param distribution Receives the distribution
+ *  @return Whether the name was known
+ */
+bool SceneGenerator::parseDistribution(const std::string& name,
+                                       Distribution& distribution) {
+    for (size_t i = 0; i < s_distributions; i++) {
+        if (name == s_names[i]) {
+            distribution = (Distribution)i;
+            return true;
+        }
+    }
+    return false;
+}
+
+/// Returns the name of a distribution, as taken by parseDistribution
+const char* SceneGenerator::name(Distribution distribution) {
+    return s_names[distribution];
+}
+
+/** Replaces the contents of a BallSystem with a generated scene
+ *  @param settings What to generate, a field of 0 by 0 is taken as 300 by
+ * 300
+ *  @param balls The system to overwrite, the positions before the last
+ * tick are set to the current ones
+ */
+void SceneGenerator::generate(const Settings& settings, BallSystem& balls) {
+    size_t count = settings.count;
+    Distribution distribution = settings.distribution;
+    float width = settings.width > 0 ? settings.width : 300.0f;
+    float height = settings.height > 0 ? settings.height : 300.0f;
+    float spread = std::max(settings.spread, 1.0f);
+    balls.resize(count);
+    if (count == 0) {
+        return;
+    }
+
+    uint32_t keys[CenterStream + 1];
+    for (uint32_t i = 0; i <= CenterStream; i++) {
+        keys[i] = CounterRNG::key(settings.seed, s_stream + i);
+    }
+    auto uniform = [&](int stream, size_t index) {
+        return CounterRNG::uniform(keys[stream], (uint32_t)index);
+    };
+
+    // relative radii first, summed in fixed blocks so the total doesn't
+    // depend on how the jobs were split
+    float* size = balls.size();
+    size_t blocks = (count + s_grain - 1) / s_grain;
+    std::vector<double> areas(blocks, 0.0);
+    JobSystem::parallelFor(0, blocks, 1, [&](size_t first, size_t last) {
+        for (size_t block = first; block < last; block++) {
+            size_t end = std::min((block + 1) * s_grain, count);
+            double area = 0;
+            for (size_t i = block * s_grain; i < end; i++) {
+                size[i] = relativeRadius(distribution, spread,
+                                         uniform(SizeStream, i));
+                area += (double)size[i] * size[i];
+            }
+            areas[block] = area;
+        }
+    });
+    double area = 0;
+    for (double blockArea : areas) {
+        area += blockArea;
+    }
+    float scale = (float)std::sqrt(settings.coverage * width * height /
+                                   (s_pi * area));
+
+    // clusters are about a quarter as wide as the space each one gets
+    size_t clusters = std::max<size_t>((size_t)std::sqrt((double)count) / 4,
+                                       1);
+    float sigma = 0.25f * std::sqrt(width * height / clusters);
+    // grid cells keep the field's aspect ratio
+    size_t columns =
+        std::max<size_t>((size_t)std::ceil(std::sqrt(count * width / height)),
+                         1);
+    size_t rows = (count + columns - 1) / columns;
+    float ringRadius = 0.4f * std::min(width, height);
+
+    float* posX = balls.posX();
+    float* posY = balls.posY();
+    float* velX = balls.velX();
+    float* velY = balls.velY();
+    float* colors[3] = {balls.red(), balls.green(), balls.blue()};
+    JobSystem::parallelFor(0, count, s_grain, [&](size_t first, size_t last) {
+        for (size_t i = first; i < last; i++) {
+            size[i] *= scale;
+            float x, y;
+            switch (distribution) {
+            case Clustered: {
+                size_t cluster =
+                    CounterRNG::bits(keys[ClusterStream], (uint32_t)i) %
+                    clusters;
+                // box-muller, 1 - u keeps the log finite
+                float radius =
+                    sigma * std::sqrt(-2.0f * std::log(1.0f -
+                                                       uniform(XStream, i)));
+                float angle = 2.0f * s_pi * uniform(YStream, i);
+                x = uniform(CenterStream, 2 * cluster) * width +
+                    radius * std::cos(angle);
+                y = uniform(CenterStream, 2 * cluster + 1) * height +
+                    radius * std::sin(angle);
+                x = std::min(std::max(x, 0.0f), width);
+                y = std::min(std::max(y, 0.0f), height);
+                break;
+            }
+            case Grid:
+                x = (i % columns + 0.5f) * width / columns;
+                y = (i / columns + 0.5f) * height / rows;
+                break;
+            case Ring: {
+                float angle = 2.0f * s_pi * i / count;
+                x = 0.5f * width + ringRadius * std::cos(angle);
+                y = 0.5f * height + ringRadius * std::sin(angle);
+                break;
+            }
+            default:
+                x = uniform(XStream, i) * width;
+                y = uniform(YStream, i) * height;
+                break;
+            }
+            posX[i] = x;
+            posY[i] = y;
+
+            float angle = 2.0f * s_pi * uniform(AngleStream, i);
+            float speed = settings.speed * uniform(SpeedStream, i);
+            velX[i] = speed * std::cos(angle);
+            velY[i] = speed * std::sin(angle);
+            for (int c = 0; c < 3; c++) {
+                colors[c][i] = uniform(RedStream + c, i);
+            }
+        }
+        balls.savePositions(first, last);
+    });
+}
+
+/** Describes settings in a single string, to be read back by parse()
+ *  @note Descriptions start with "gen:", so they can share a field with
+ * scene file paths
+ */
+std::string SceneGenerator::describe(const Settings& settings) {
+    char description[256];
+    snprintf(description, sizeof(description),
+             "%s%s,%zu,%llu,%.9g,%.9g,%.9g,%.9g,%.9g", s_prefix,
+             name(settings.distribution), settings.count,
+             (unsigned long long)settings.seed, settings.width,
+             settings.height, settings.coverage, settings.spread,
+             settings.speed);
+    return description;
+}
+
+/** Reads settings back from describe()
+ *  @param description The description to read
+ *  @param settings Receives the settings
+ *  @return Whether the string was a description
+ */
+bool SceneGenerator::parse(const std::string& description,
+                           Settings& settings) {
+    size_t prefix = sizeof(s_prefix) - 1;
+    if (description.compare(0, prefix, s_prefix) != 0) {
+        return false;
+    }
+    size_t comma = description.find(',', prefix);
+    if (comma == std::string::npos ||
+        !parseDistribution(description.substr(prefix, comma - prefix),
+                           settings.distribution)) {
+        return false;
+    }
+    unsigned long long count, seed;
+    if (sscanf(description.c_str() + comma + 1, "%llu,%llu,%g,%g,%g,%g,%g",
+               &count, &seed, &settings.width, &settings.height,
+               &settings.coverage, &settings.spread, &settings.speed) != 7) {
+        return false;
+    }
+    settings.count = (size_t)count;
+    settings.seed = seed;
+    return true;
+}
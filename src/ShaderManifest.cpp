@@ -0,0 +1,212 @@
+#include "ShaderManifest.h"
+
+#include <iomanip>
+
+using namespace Shader;
+
+// golden image tolerances of shaders that don't set their own
+static const int s_defaultMaxError = 8;
+static const float s_defaultMinPSNR = 40.0f;
+static const float s_defaultMaxOutliers = 0.0f;
+
+/// Strips leading and trailing whitespace from a string
+static std::string trim(const std::string& str) {
+    size_t first = str.find_first_not_of(" \t\r\n");
+    if (first == std::string::npos) {
+        return "";
+    }
+    size_t last = str.find_last_not_of(" \t\r\n");
+    return str.substr(first, last - first + 1);
+}
+
+/// Builds the exception thrown for malformed manifest lines
+static std::runtime_error manifestError(size_t lineNumber,
+                                        const std::string& msg) {
+    return std::runtime_error(std::string("Shader manifest line ") +
+                              std::to_string(lineNumber) + ": " + msg);
+}
+
+/// Manifest default constructor
+Manifest::Manifest() : m_default(0) {}
+
+/// Manifest destructor, frees any programs that were built
+Manifest::~Manifest() { release(); }
+
+/** Loads a shader manifest
+ *  @param filename The path to the manifest file
+ *
+ *  @note Throws a runtime error if the file can't be read or is malformed
+ *  @note Only the descriptions are loaded, programs are built on demand
+ */
+void Manifest::load(const std::string& filename) {
+    std::ifstream file(filename);
+    if (!file.is_open()) {
+        throw std::runtime_error(std::string("Unable to open shader manifest ") +
+                                 filename);
+    }
+
+    release();
+    m_programs.clear();
+    m_default = 0;
+
+    std::string line;
+    size_t lineNumber = 0;
+    while (std::getline(file, line)) {
+        lineNumber++;
+        line = trim(line);
+        if (line.empty() || line[0] == '#') {
+            continue;
+        }
+
+        // start of a new program block
+        if (line.front() == '[') {
+            if (line.back() != ']') {
+                throw manifestError(lineNumber, "unterminated section header");
+            }
+            ProgramEntry entry;
+            entry.id = trim(line.substr(1, line.size() - 2));
+            entry.name = entry.id;
+            entry.fieldTree = false;
+            entry.maxError = s_defaultMaxError;
+            entry.minPSNR = s_defaultMinPSNR;
+            entry.maxOutliers = s_defaultMaxOutliers;
+            entry.program = nullptr;
+            m_programs.push_back(entry);
+            continue;
+        }
+
+        size_t eq = line.find('=');
+        if (eq == std::string::npos) {
+            throw manifestError(lineNumber, "expected <key> = <value>");
+        }
+        if (m_programs.empty()) {
+            throw manifestError(lineNumber, "key outside of a [program] block");
+        }
+        std::string key = trim(line.substr(0, eq));
+        std::string value = trim(line.substr(eq + 1));
+        ProgramEntry& entry = m_programs.back();
+
+        if (key == "name") {
+            entry.name = value;
+        } else if (key == "file") {
+            entry.file = value;
+        } else if (key == "backends") {
+            std::istringstream stream(value);
+            std::string backend;
+            while (stream >> backend) {
+                entry.backends.push_back(backend);
+            }
+        } else if (key == "default") {
+            if (value == "true" || value == "1") {
+                m_default = m_programs.size() - 1;
+            }
+        } else if (key == "fieldtree") {
+            entry.fieldTree = value == "true" || value == "1";
+        } else if (key == "tolerance") {
+            std::istringstream stream(value);
+            stream >> entry.maxError >> entry.minPSNR;
+            // the fraction of outliers is optional
+            if (!stream.fail() && !stream.eof()) {
+                stream >> entry.maxOutliers;
+            }
+            if (stream.fail() || !stream.eof()) {
+                throw manifestError(lineNumber,
+                                    std::string("malformed tolerance ") +
+                                        value);
+            }
+        } else if (key == "float") {
+            entry.params.push_back(parseParameter(FloatParam, value, lineNumber));
+        } else if (key == "bool") {
+            entry.params.push_back(parseParameter(BoolParam, value, lineNumber));
+        } else {
+            throw manifestError(lineNumber, std::string("unknown key ") + key);
+        }
+    }
+
+    for (auto& entry : m_programs) {
+        if (entry.file.empty()) {
+            throw std::runtime_error(std::string("Shader manifest entry ") +
+                                     entry.id + " has no file");
+        }
+    }
+    if (m_programs.empty()) {
+        throw std::runtime_error(std::string("Shader manifest ") + filename +
+                                 " lists no programs");
+    }
+}
+
+/** Parses the value of a float or bool key
+ *  float = <uniform> "<label>" <min> <max> <default> [reciprocal] [sameline]
+ *  bool = <uniform> "<label>" <default> [sameline]
+ */
+Parameter Manifest::parseParameter(ParameterType type, const std::string& value,
+                                   size_t lineNumber) {
+    Parameter param;
+    param.type = type;
+    param.min = 0.0f;
+    param.max = 1.0f;
+    param.value = 0.0f;
+    param.reciprocal = false;
+    param.sameLine = false;
+    param.location = -1;
+
+    std::istringstream stream(value);
+    stream >> param.uniform >> std::quoted(param.label);
+    if (type == FloatParam) {
+        stream >> param.min >> param.max >> param.value;
+    } else {
+        std::string def;
+        stream >> def;
+        param.value = (def == "true" || def == "1") ? 1.0f : 0.0f;
+    }
+    if (stream.fail()) {
+        throw manifestError(lineNumber, std::string("malformed parameter ") +
+                                            value);
+    }
+
+    std::string flag;
+    while (stream >> flag) {
+        if (flag == "reciprocal") {
+            param.reciprocal = true;
+        } else if (flag == "sameline") {
+            param.sameLine = true;
+        } else {
+            throw manifestError(lineNumber,
+                                std::string("unknown parameter flag ") + flag);
+        }
+    }
+    return param;
+}
+
+/// Returns the number of programs listed in the manifest
+size_t Manifest::size() const { return m_programs.size(); }
+
+/// Returns the index of the program marked as default
+size_t Manifest::defaultProgram() const { return m_default; }
+
+/// Returns the entry at the provided index
+ProgramEntry& Manifest::operator[](size_t index) { return m_programs[index]; }
+
+/// Returns all of the entries in the manifest
+std::vector<ProgramEntry>& Manifest::programs() { return m_programs; }
+
+/** Checks if a program lists the provided backend
+ *  @param index The index of the program
+ *  @param backend The backend name, ex. "glsl" or "spirv"
+ */
+bool Manifest::supports(size_t index, const std::string& backend) const {
+    for (auto& name : m_programs[index].backends) {
+        if (name == backend) {
+            return true;
+        }
+    }
+    return false;
+}
+
+/// Frees any built programs, they will be rebuilt when next requested
+void Manifest::release() {
+    for (auto& entry : m_programs) {
+        delete entry.program;
+        entry.program = nullptr;
+    }
+}
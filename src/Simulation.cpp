@@ -0,0 +1,442 @@
+#include "Simulation.h"
+
+#include <algorithm>
+
+#include "JobSystem.h"
+#include "PerfCounters.h"
+#include "Profiler.h"
+#include "Recorder.h"
+
+const double Simulation::s_referenceHz = 60.0;
+const double Simulation::s_maxBacklog = 0.25;
+const size_t Simulation::s_grain = 1024;
+
+static PerfCounters::Section s_stepCounters("simulation step", "ball");
+
+/** Simulation constructor
+ *  @param seed The seed for the random ball movement
+ */
+Simulation::Simulation(uint64_t seed)
+    : m_width(0),
+      m_height(0),
+      m_wiggly(false),
+      m_wiggleAngle(2.0f),
+      m_collisions(false),
+      m_gravity(false),
+      m_gravityStrength(0.01f),
+      m_theta(0.7f),
+      m_integrator(SemiImplicitEuler),
+      m_drag(0.0f),
+      m_tickRate(s_referenceHz),
+      m_substeps(1),
+      m_paused(false),
+      m_accumulator(0),
+      m_seed(seed),
+      m_frame(0),
+      m_tick(0),
+      m_applied(0),
+      m_recorder(nullptr),
+      m_running(false),
+      m_sentWidth(-1),
+      m_sentHeight(-1) {}
+
+Simulation::~Simulation() { stop(); }
+
+/// Starts advancing the simulation on its own thread
+void Simulation::start() {
+    if (m_thread.joinable()) {
+        return;
+    }
+    m_running = true;
+    m_thread = std::thread(&Simulation::run, this);
+}
+
+/// Stops and joins the simulation thread, if there is one
+void Simulation::stop() {
+    if (!m_thread.joinable()) {
+        return;
+    }
+    {
+        std::lock_guard<std::mutex> lock(m_wakeMutex);
+        m_running = false;
+    }
+    m_wake.notify_one();
+    m_thread.join();
+}
+
+/// Returns whether the simulation runs on its own thread
+bool Simulation::threaded() const { return m_thread.joinable(); }
+
+/** Advances the simulation by real time in fixed ticks
+ *  @param elapsed Seconds since the last call
+ *
+ *  @note Leftover time is carried over to the next call, the snapshot's
+ * tick time lets the renderer interpolate through it
+ */
+void Simulation::advance(double elapsed) {
+    bool changed = applyCommands();
+
+    // don't try to catch up on time lost to a stall, just slow down
+    m_accumulator = m_paused ? 0
+                             : std::min(m_accumulator + elapsed, s_maxBacklog);
+    double tick = 1.0 / m_tickRate;
+    while (m_accumulator >= tick) {
+        step();
+        m_accumulator -= tick;
+        changed = true;
+    }
+    if (changed) {
+        publish();
+    }
+}
+
+/** Advances the simulation by a whole number of ticks, ignoring real time
+ *  @param ticks The number of ticks to run
+ *
+ *  @note Meant for offline rendering, where frames are a fixed number of
+ * ticks apart however long they take
+ */
+void Simulation::advanceTicks(uint64_t ticks) {
+    applyCommands();
+    for (uint64_t i = 0; i < ticks; i++) {
+        step();
+    }
+    publish();
+}
+
+/// Returns the newest published snapshot, never blocks
+const BallSnapshot& Simulation::snapshot() {
+    m_snapshots.update();
+    return m_snapshots.readBuffer();
+}
+
+/// Returns how far between its last two ticks a snapshot should be drawn
+float Simulation::alpha(const BallSnapshot& snapshot) {
+    if (snapshot.tickLength <= 0) {
+        return 1.0f;
+    }
+    double since = std::chrono::duration<double>(
+                       std::chrono::steady_clock::now() - snapshot.tickTime)
+                       .count();
+    return (float)std::min(std::max(since / snapshot.tickLength, 0.0), 1.0);
+}
+
+/// Appends a ball
+void Simulation::pushBall(const Ball& ball) {
+    Command command{};
+    command.type = PushBall;
+    command.ball = ball;
+    send(command);
+}
+
+/// Removes the last ball
+void Simulation::popBall() {
+    Command command{};
+    command.type = PopBall;
+    send(command);
+}
+
+/// Replaces the ball at an index, ignored if the ball is gone by then
+void Simulation::setBall(size_t index, const Ball& ball) {
+    Command command{};
+    command.type = SetBall;
+    command.index = index;
+    command.ball = ball;
+    send(command);
+}
+
+/// Sets the area the balls bounce around in, ignored if unchanged
+void Simulation::setBounds(float width, float height) {
+    if (width == m_sentWidth && height == m_sentHeight) {
+        return;
+    }
+    m_sentWidth = width;
+    m_sentHeight = height;
+    Command command{};
+    command.type = SetBounds;
+    command.value = width;
+    command.value2 = height;
+    send(command);
+}
+
+/** Switches between straight and wiggly movement
+ *  @param wiggly Whether balls turn randomly every step
+ *  @param angle The widest turn in radians
+ */
+void Simulation::setWiggly(bool wiggly, float angle) {
+    Command command{};
+    command.type = SetWiggly;
+    command.value = angle;
+    command.flag = wiggly;
+    send(command);
+}
+
+/// Turns ball-ball collisions on or off
+void Simulation::setCollisions(bool collisions) {
+    Command command{};
+    command.type = SetCollisions;
+    command.flag = collisions;
+    send(command);
+}
+
+/** Turns attraction between the balls on or off
+ *  @param gravity Whether the balls pull on each other
+ *  @param strength How hard a ball of size 1 pulls, negative values repel
+ *  @param theta Barnes-Hut opening angle, smaller is slower and more exact
+ */
+void Simulation::setGravity(bool gravity, float strength, float theta) {
+    Command command{};
+    command.type = SetGravity;
+    command.value = strength;
+    command.value2 = theta;
+    command.flag = gravity;
+    send(command);
+}
+
+/** Picks how the balls are moved between ticks
+ *  @param method The integrator for straight movement, wiggly movement
+ * always takes semi-implicit Euler steps
+ *  @param drag The fraction of its velocity a ball loses per tick
+ */
+void Simulation::setIntegrator(IntegratorMethod method, float drag) {
+    Command command{};
+    command.type = SetIntegrator;
+    command.value = method;
+    command.value2 = drag;
+    send(command);
+}
+
+/** Sets how often the simulation ticks
+ *  @param hz Ticks per second, a ball moves its velocity once per 1/60th of a
+ * second regardless of the rate
+ *  @param substeps Number of smaller steps each tick is split into
+ */
+void Simulation::setTickRate(double hz, int substeps) {
+    Command command{};
+    command.type = SetTickRate;
+    command.value = hz;
+    command.value2 = substeps;
+    send(command);
+}
+
+/** Stops or restarts the ticks, edits still go through while paused
+ *  @note advanceTicks() ignores pausing, it runs the ticks it's asked for
+ */
+void Simulation::setPaused(bool paused) {
+    Command command{};
+    command.type = SetPaused;
+    command.flag = paused;
+    send(command);
+}
+
+/** Replaces every ball at once, for loading scenes too large to send as
+ *  commands
+ *  @param balls The new balls, left empty
+ *
+ *  @note Must be called before start() or from the thread that advances
+ */
+void Simulation::loadBalls(BallSystem& balls) {
+    m_balls = std::move(balls);
+    balls.clear();
+    publish();
+}
+
+/** Logs every command to a recorder as it's applied
+ *  @param recorder The recorder, or null to stop recording
+ *
+ *  @note Must not be changed while the simulation has its own thread
+ */
+void Simulation::setRecorder(Recorder* recorder) { m_recorder = recorder; }
+
+/// Queues a recorded command, to be applied before the next tick
+void Simulation::replay(const Command& command) { send(command); }
+
+/** Drops every command that hasn't been applied yet
+ *  @note Meant for starting a replay, before anything has been applied
+ */
+void Simulation::discardCommands() {
+    Command command;
+    while (m_commands.pop(command)) {
+    }
+    m_sentWidth = -1;
+    m_sentHeight = -1;
+}
+
+/// Queues a command, making room if the queue is full
+void Simulation::send(const Command& command) {
+    while (!m_commands.push(command)) {
+        if (threaded()) {
+            std::this_thread::yield();
+        } else {
+            applyCommands();
+        }
+    }
+    if (threaded()) {
+        // taking the lock orders the push before a paused thread's check
+        { std::lock_guard<std::mutex> lock(m_wakeMutex); }
+        m_wake.notify_one();
+    }
+}
+
+/// Applies every queued command, returns whether there were any
+bool Simulation::applyCommands() {
+    Command command;
+    bool applied = false;
+    while (m_commands.pop(command)) {
+        applied = true;
+        if (m_recorder) {
+            m_recorder->command(m_tick, command);
+        }
+        m_applied++;
+        switch (command.type) {
+            case PushBall:
+                m_balls.push(command.ball);
+                break;
+            case PopBall:
+                m_balls.pop();
+                break;
+            case SetBall:
+                if (command.index < m_balls.count()) {
+                    m_balls.set(command.index, command.ball);
+                }
+                break;
+            case SetBounds:
+                m_width = command.value;
+                m_height = command.value2;
+                break;
+            case SetWiggly:
+                m_wiggleAngle = command.value;
+                m_wiggly = command.flag;
+                break;
+            case SetCollisions:
+                m_collisions = command.flag;
+                break;
+            case SetGravity:
+                m_gravityStrength = command.value;
+                m_theta = std::max(command.value2, 0.0);
+                m_gravity = command.flag;
+                break;
+            case SetIntegrator:
+                m_integrator = (IntegratorMethod)command.value;
+                m_drag = std::max(command.value2, 0.0);
+                break;
+            case SetTickRate:
+                m_tickRate = command.value > 0 ? command.value : s_referenceHz;
+                m_substeps = command.value2 > 0 ? (int)command.value2 : 1;
+                break;
+            case SetPaused:
+                m_paused = command.flag;
+                break;
+        }
+    }
+    return applied;
+}
+
+/// Runs a single simulation tick
+void Simulation::step() {
+    PROFILE_SCOPE("Simulation::step");
+    PerfCounters::Scope counters(s_stepCounters, m_balls.count());
+    float dt = (float)(s_referenceHz / (m_tickRate * m_substeps));
+
+    // unless something needs every ball moved between substeps, each range
+    // of balls takes all of its substeps in one pass
+    bool coupled = m_gravity || m_collisions || m_wiggly;
+    int passes = coupled ? m_substeps : 1;
+    int substeps = coupled ? 1 : m_substeps;
+    const float* accX = nullptr;
+    const float* accY = nullptr;
+
+    for (int pass = 0; pass < passes; pass++) {
+        if (m_gravity) {
+            m_accX.resize(m_balls.count());
+            m_accY.resize(m_balls.count());
+            m_barnesHut.build(m_balls);
+            m_barnesHut.accelerations(m_balls, m_theta, m_gravityStrength,
+                                      m_accX.data(), m_accY.data());
+            accX = m_accX.data();
+            accY = m_accY.data();
+        }
+
+        // every update only touches its own range, so the balls are split
+        // across the job system
+        JobSystem::parallelFor(
+            0, m_balls.count(), s_grain, [&](size_t first, size_t last) {
+                if (pass == 0) {
+                    m_balls.savePositions(first, last);
+                }
+                if (m_wiggly) {
+                    kick(first, last, accX, accY, dt);
+                    m_balls.updateRandomPath(first, last, m_wiggleAngle,
+                                             m_width, m_height, m_seed,
+                                             m_frame, dt);
+                } else {
+                    m_balls.integrate(first, last, m_integrator, m_drag, accX,
+                                      accY, dt, substeps, m_width, m_height);
+                }
+            });
+
+        // collisions need every ball moved first
+        if (m_collisions) {
+            m_collisionGrid.resolve(m_balls, m_width, m_height);
+        }
+        m_frame += substeps;
+    }
+    m_tick++;
+}
+
+/// Semi-implicit Euler velocity update for the balls in [first, last)
+void Simulation::kick(size_t first, size_t last, const float* accX,
+                      const float* accY, float dt) {
+    float* velX = m_balls.velX();
+    float* velY = m_balls.velY();
+    float keep = std::max(1.0f - m_drag * dt, 0.0f);
+    for (size_t i = first; i < last; i++) {
+        velX[i] = velX[i] * keep + (accX ? accX[i] * dt : 0.0f);
+        velY[i] = velY[i] * keep + (accY ? accY[i] * dt : 0.0f);
+    }
+}
+
+/// Copies the balls into the free snapshot and hands it to the renderer
+void Simulation::publish() {
+    PROFILE_SCOPE("Simulation::publish");
+    BallSnapshot& snapshot = m_snapshots.writeBuffer();
+    snapshot.balls = m_balls;
+    // paused snapshots are drawn as they are, not interpolated
+    snapshot.tickLength = m_paused ? 0 : 1.0 / m_tickRate;
+    snapshot.tickTime =
+        std::chrono::steady_clock::now() -
+        std::chrono::duration_cast<std::chrono::steady_clock::duration>(
+            std::chrono::duration<double>(m_accumulator));
+    snapshot.tick = m_tick;
+    snapshot.commands = m_applied;
+    m_snapshots.publish();
+}
+
+/// Simulation thread, ticks on time and sleeps in between
+void Simulation::run() {
+    PROFILE_THREAD("simulation");
+    auto last = std::chrono::steady_clock::now();
+    while (m_running.load(std::memory_order_relaxed)) {
+        auto now = std::chrono::steady_clock::now();
+        advance(std::chrono::duration<double>(now - last).count());
+        last = now;
+
+        if (m_paused) {
+            // nothing moves until a command unpauses it or edits the balls
+            std::unique_lock<std::mutex> lock(m_wakeMutex);
+            m_wake.wait(lock, [this]() {
+                return !m_running.load(std::memory_order_relaxed) ||
+                       !m_commands.empty();
+            });
+            // the time spent paused isn't owed, or the scene would jump
+            last = std::chrono::steady_clock::now();
+            continue;
+        }
+
+        // wake up when the next tick is due, or soon enough to pick up
+        // commands if the tick rate is low
+        double wait = std::min(1.0 / m_tickRate - m_accumulator, 0.005);
+        std::this_thread::sleep_for(
+            std::chrono::duration<double>(std::max(wait, 0.0)));
+    }
+}
@@ -0,0 +1,276 @@
+#include "VideoStream.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+
+#include "JobSystem.h"
+#include "SIMD.h"
+
+namespace {
+
+    // full range BT.601, as in JPEG
+    const float s_yR = 0.299f, s_yG = 0.587f, s_yB = 0.114f;
+    const float s_uR = -0.168736f, s_uG = -0.331264f, s_uB = 0.5f;
+    const float s_vR = 0.5f, s_vG = -0.418688f, s_vB = -0.081312f;
+
+    inline uint8_t toByte(float v) {
+        v += 0.5f;
+        return v <= 0.0f ? 0 : v >= 255.0f ? 255 : (uint8_t)v;
+    }
+
+    /// Converts a row to luma
+    void lumaRow(const uint8_t* rgba, int width, uint8_t* luma) {
+        using namespace SIMD;
+        const floatv yR = set1(s_yR), yG = set1(s_yG), yB = set1(s_yB);
+        int x = 0;
+        for (; x + (int)SIMD::width <= width; x += SIMD::width) {
+            const uint8_t* p = rgba + x * 4;
+            floatv y = add(add(mul(loadChannel(p, 0), yR),
+                               mul(loadChannel(p, 1), yG)),
+                           mul(loadChannel(p, 2), yB));
+            storeBytes(luma + x, y);
+        }
+        for (; x < width; x++) {
+            const uint8_t* p = rgba + x * 4;
+            luma[x] = toByte(p[0] * s_yR + p[1] * s_yG + p[2] * s_yB);
+        }
+    }
+
+    /** Converts a pair of rows to chroma at half resolution
+     *  @param scratch Room for 2 * width floats, rounded up to SIMD::width
+     */
+    void chromaRow(const uint8_t* row0, const uint8_t* row1, int width,
+                   float* scratch, uint8_t* u, uint8_t* v) {
+        using namespace SIMD;
+        // chroma is linear, so the chroma of the summed rows is summed too
+        const floatv uR = set1(s_uR), uG = set1(s_uG), uB = set1(s_uB);
+        const floatv vR = set1(s_vR), vG = set1(s_vG), vB = set1(s_vB);
+        float* sumU = scratch;
+        float* sumV = scratch + width;
+        int x = 0;
+        for (; x + (int)SIMD::width <= width; x += SIMD::width) {
+            const uint8_t* p0 = row0 + x * 4;
+            const uint8_t* p1 = row1 + x * 4;
+            floatv r = add(loadChannel(p0, 0), loadChannel(p1, 0));
+            floatv g = add(loadChannel(p0, 1), loadChannel(p1, 1));
+            floatv b = add(loadChannel(p0, 2), loadChannel(p1, 2));
+            storeu(sumU + x, add(add(mul(r, uR), mul(g, uG)), mul(b, uB)));
+            storeu(sumV + x, add(add(mul(r, vR), mul(g, vG)), mul(b, vB)));
+        }
+        for (; x < width; x++) {
+            const uint8_t* p0 = row0 + x * 4;
+            const uint8_t* p1 = row1 + x * 4;
+            float r = p0[0] + p1[0], g = p0[1] + p1[1], b = p0[2] + p1[2];
+            sumU[x] = r * s_uR + g * s_uG + b * s_uB;
+            sumV[x] = r * s_vR + g * s_vG + b * s_vB;
+        }
+
+        // an odd last column is paired with itself
+        int chromaWidth = (width + 1) / 2;
+        for (int cx = 0; cx < chromaWidth; cx++) {
+            int x0 = cx * 2;
+            int x1 = std::min(x0 + 1, width - 1);
+            u[cx] = toByte((sumU[x0] + sumU[x1]) * 0.25f + 128.0f);
+            v[cx] = toByte((sumV[x0] + sumV[x1]) * 0.25f + 128.0f);
+        }
+    }
+
+}  // namespace
+
+/** VideoStream constructor, starts the writer thread
+ *  @param format The stream format
+ *  @param out Where the stream is written, usually stdout
+ *  @param width The width of every frame
+ *  @param height The height of every frame
+ *  @param fps The frame rate written to the Y4M header
+ *  @param drop Whether to drop frames instead of waiting for the writer
+ *  @param depth The most converted frames waiting to be written
+ */
+VideoStream::VideoStream(Format format, FILE* out, int width, int height,
+                         double fps, bool drop, size_t depth)
+    : m_format(format),
+      m_out(out),
+      m_width(width),
+      m_height(height),
+      m_fps(fps),
+      m_drop(drop),
+      m_sent(0),
+      m_dropped(0),
+      m_frames(std::max<size_t>(depth, 1)),
+      m_head(0),
+      m_tail(0),
+      m_queued(0),
+      m_stop(false),
+      m_good(true) {
+    for (std::vector<uint8_t>& frame : m_frames) {
+        frame.resize(frameSize(format, width, height));
+    }
+    m_thread = std::thread(&VideoStream::run, this);
+}
+
+/// VideoStream destructor, writes out the frames still queued
+VideoStream::~VideoStream() { finish(); }
+
+/** Converts a frame and queues it for the writer
+ *  @param rgba The frame, rows top to bottom
+ *  @return Whether the frame was queued, false if it was dropped or the
+ * stream has stopped
+ */
+bool VideoStream::push(const uint8_t* rgba) {
+    std::unique_lock<std::mutex> lock(m_mutex);
+    if (m_queued == m_frames.size() && m_drop) {
+        m_dropped++;
+        return false;
+    }
+    m_freed.wait(lock, [&] {
+        return m_queued < m_frames.size() || !m_good || m_stop;
+    });
+    if (!m_good || m_stop) {
+        return false;
+    }
+    uint8_t* frame = m_frames[m_head].data();
+    lock.unlock();
+
+    // the writer never touches frames that aren't queued
+    if (m_format == Y4M) {
+        toYUV420(rgba, m_width, m_height, frame);
+    } else {
+        std::memcpy(frame, rgba, (size_t)m_width * m_height * 4);
+    }
+
+    lock.lock();
+    m_head = (m_head + 1) % m_frames.size();
+    m_queued++;
+    m_sent++;
+    lock.unlock();
+    m_filled.notify_one();
+    return true;
+}
+
+/// Writes out the queued frames and stops the writer thread
+void VideoStream::finish() {
+    if (!m_thread.joinable()) {
+        return;
+    }
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_stop = true;
+    }
+    m_filled.notify_one();
+    m_freed.notify_all();
+    m_thread.join();
+    fflush(m_out);
+}
+
+/// Returns whether frames are still being written
+bool VideoStream::good() const { return m_good.load(); }
+
+/// Returns the number of frames queued so far
+size_t VideoStream::sent() const { return m_sent; }
+
+/// Returns the number of frames dropped because the writer was behind
+size_t VideoStream::dropped() const { return m_dropped; }
+
+/** Looks up a format by name
+ *  @param name y4m or rgba
+ *  @param format Receives the format if the name is known
+ */
+bool VideoStream::parseFormat(const std::string& name, Format& format) {
+    if (name == "y4m") {
+        format = Y4M;
+    } else if (name == "rgba") {
+        format = RGBA;
+    } else {
+        return false;
+    }
+    return true;
+}
+
+/// Returns the bytes in a frame, not counting Y4M's frame header
+size_t VideoStream::frameSize(Format format, int width, int height) {
+    if (format == RGBA) {
+        return (size_t)width * height * 4;
+    }
+    size_t chroma = (size_t)((width + 1) / 2) * ((height + 1) / 2);
+    return (size_t)width * height + chroma * 2;
+}
+
+/** Converts RGBA to planar YUV 4:2:0, the Y plane then U then V
+ *  @param rgba The frame, rows top to bottom
+ *  @param width The width of the frame
+ *  @param height The height of the frame
+ *  @param yuv Receives frameSize(Y4M, width, height) bytes
+ *
+ *  @note Chroma is the average of each 2x2 block, odd edges are repeated
+ */
+void VideoStream::toYUV420(const uint8_t* rgba, int width, int height,
+                           uint8_t* yuv) {
+    int chromaWidth = (width + 1) / 2;
+    int chromaHeight = (height + 1) / 2;
+    uint8_t* planeY = yuv;
+    uint8_t* planeU = planeY + (size_t)width * height;
+    uint8_t* planeV = planeU + (size_t)chromaWidth * chromaHeight;
+    size_t stride = (size_t)width * 4;
+
+    JobSystem::parallelFor(
+        0, chromaHeight, 8, [&](size_t first, size_t last) {
+            std::vector<float> scratch(2 * width + SIMD::width);
+            for (size_t cy = first; cy < last; cy++) {
+                int y0 = (int)cy * 2;
+                int y1 = std::min(y0 + 1, height - 1);
+                const uint8_t* row0 = rgba + stride * y0;
+                const uint8_t* row1 = rgba + stride * y1;
+                lumaRow(row0, width, planeY + (size_t)width * y0);
+                if (y1 != y0) {
+                    lumaRow(row1, width, planeY + (size_t)width * y1);
+                }
+                chromaRow(row0, row1, width, scratch.data(),
+                          planeU + (size_t)chromaWidth * cy,
+                          planeV + (size_t)chromaWidth * cy);
+            }
+        });
+}
+
+/// Writer thread, sends queued frames until finish() or a failed write
+void VideoStream::run() {
+    if (m_format == Y4M) {
+        // frame rates are written as a fraction, to three decimals
+        long rate = std::lround(m_fps * 1000.0);
+        long scale = 1000;
+        while (rate % 10 == 0 && scale > 1) {
+            rate /= 10;
+            scale /= 10;
+        }
+        if (fprintf(m_out, "YUV4MPEG2 W%d H%d F%ld:%ld Ip A1:1 C420jpeg\n",
+                    m_width, m_height, rate, scale) < 0) {
+            m_good = false;
+        }
+    }
+
+    std::unique_lock<std::mutex> lock(m_mutex);
+    while (m_good) {
+        m_filled.wait(lock, [&] { return m_queued > 0 || m_stop; });
+        if (m_queued == 0) {
+            break;
+        }
+        const std::vector<uint8_t>& frame = m_frames[m_tail];
+        lock.unlock();
+
+        bool written = true;
+        if (m_format == Y4M) {
+            written = fputs("FRAME\n", m_out) >= 0;
+        }
+        written = written && fwrite(frame.data(), 1, frame.size(), m_out) ==
+                                 frame.size();
+        written = written && fflush(m_out) == 0;
+
+        lock.lock();
+        m_tail = (m_tail + 1) % m_frames.size();
+        m_queued--;
+        if (!written) {
+            m_good = false;
+        }
+        m_freed.notify_one();
+    }
+}
@@ -0,0 +1,227 @@
+#include "Benchmark.h"
+
+#include <cmath>
+#include <cstdio>
+
+namespace {
+
+    /// Writes a string as a JSON string literal
+    void writeString(std::ostream& out, const std::string& value) {
+        out << '"';
+        for (char c : value) {
+            if (c == '"' || c == '\\') {
+                out << '\\' << c;
+            } else if ((unsigned char)c < 0x20) {
+                char escaped[8];
+                snprintf(escaped, sizeof(escaped), "\\u%04x", c);
+                out << escaped;
+            } else {
+                out << c;
+            }
+        }
+        out << '"';
+    }
+
+    /// Writes a number so it reads back exactly, JSON has no inf or nan
+    void writeNumber(std::ostream& out, double value) {
+        if (!std::isfinite(value)) {
+            out << "null";
+            return;
+        }
+        char number[32];
+        snprintf(number, sizeof(number), "%.9g", value);
+        out << number;
+    }
+
+    /// Formats seconds with a unit that keeps 3 or 4 significant digits
+    std::string formatTime(double seconds) {
+        const char* units[] = {"ns", "us", "ms", "s"};
+        double value = seconds * 1e9;
+        size_t unit = 0;
+        while (value >= 1000 && unit < 3) {
+            value /= 1000;
+            unit++;
+        }
+        char text[32];
+        snprintf(text, sizeof(text), "%.4g%s", value, units[unit]);
+        return text;
+    }
+
+    std::string formatParams(const Benchmark::Params& params) {
+        std::string text;
+        for (auto& param : params) {
+            char value[32];
+            snprintf(value, sizeof(value), "%g", param.second);
+            text += " " + param.first + "=" + value;
+        }
+        return text;
+    }
+
+}  // namespace
+
+/** Benchmark constructor
+ *  @param warmup Untimed calls before each case
+ *  @param repetitions Timed samples of each case
+ *  @param minSampleTime Seconds each sample runs for at least, fast cases
+ * are called several times a sample
+ */
+Benchmark::Benchmark(size_t warmup, size_t repetitions, double minSampleTime)
+    : m_warmup(warmup),
+      m_repetitions(std::max<size_t>(repetitions, 1)),
+      m_minSampleTime(minSampleTime) {}
+
+/// Only runs cases whose name contains filter, all of them if it's empty
+void Benchmark::setFilter(const std::string& filter) { m_filter = filter; }
+
+/// Returns whether the filter selects a case
+bool Benchmark::selected(const std::string& name) const {
+    return m_filter.empty() || name.find(m_filter) != std::string::npos;
+}
+
+/** Notes a case that couldn't be run
+ *  @param name The name of the case
+ *  @param params Numbers describing the case
+ *  @param reason Why it was skipped
+ */
+void Benchmark::skip(const std::string& name, const Params& params,
+                     const std::string& reason) {
+    if (!selected(name)) {
+        return;
+    }
+    printf("%-28s%-34s skipped, %s\n", name.c_str(),
+           formatParams(params).c_str(), reason.c_str());
+}
+
+/// Adds a line about the machine or build to the JSON output
+void Benchmark::setContext(const std::string& key, const std::string& value) {
+    m_context.push_back({key, value});
+}
+
+const std::vector<Benchmark::Result>& Benchmark::results() const {
+    return m_results;
+}
+
+/** Writes every result as a JSON document
+ *  Times are in seconds per call, throughputs in items per second.
+ */
+void Benchmark::writeJSON(std::ostream& out) const {
+    out << "{\n  \"context\": {";
+    for (size_t i = 0; i < m_context.size(); i++) {
+        out << (i ? ",\n    " : "\n    ");
+        writeString(out, m_context[i].first);
+        out << ": ";
+        writeString(out, m_context[i].second);
+    }
+    out << "\n  },\n  \"results\": [";
+    for (size_t i = 0; i < m_results.size(); i++) {
+        const Result& result = m_results[i];
+        out << (i ? ",\n    {" : "\n    {") << "\"name\": ";
+        writeString(out, result.name);
+        out << ", \"params\": {";
+        for (size_t p = 0; p < result.params.size(); p++) {
+            out << (p ? ", " : "");
+            writeString(out, result.params[p].first);
+            out << ": ";
+            writeNumber(out, result.params[p].second);
+        }
+        out << "}, \"iterations\": " << result.iterations
+            << ", \"repetitions\": " << result.samples.size()
+            << ", \"median\": ";
+        writeNumber(out, result.median);
+        out << ", \"mad\": ";
+        writeNumber(out, result.mad);
+        out << ", \"min\": ";
+        writeNumber(out, result.min);
+        out << ", \"items_per_second\": ";
+        writeNumber(out, result.items / result.median);
+        if (!result.counters.empty()) {
+            out << ", \"counters\": {";
+            for (size_t c = 0; c < result.counters.size(); c++) {
+                out << (c ? ", " : "");
+                writeString(out, result.counters[c].first);
+                out << ": ";
+                writeNumber(out, result.counters[c].second);
+            }
+            out << "}";
+        }
+        out << "}";
+    }
+    out << "\n  ]\n}\n";
+}
+
+/// Returns the median of values, the mean of the middle two if even
+double Benchmark::median(std::vector<double> values) {
+    if (values.empty()) {
+        return 0;
+    }
+    size_t middle = values.size() / 2;
+    std::nth_element(values.begin(), values.begin() + middle, values.end());
+    double upper = values[middle];
+    if (values.size() % 2 == 1) {
+        return upper;
+    }
+    double lower = *std::max_element(values.begin(), values.begin() + middle);
+    return (lower + upper) / 2;
+}
+
+/// Fills in a result's median, median absolute deviation and minimum
+void Benchmark::summarize(Result& result) {
+    result.median = median(result.samples);
+    std::vector<double> deviations;
+    for (double sample : result.samples) {
+        deviations.push_back(std::fabs(sample - result.median));
+    }
+    result.mad = median(deviations);
+    result.min = result.samples.empty()
+                     ? 0
+                     : *std::min_element(result.samples.begin(),
+                                         result.samples.end());
+}
+
+/** Fills in a result's counters from what its timed samples counted
+ *  @param delta The counts over every timed call
+ */
+void Benchmark::perItem(Result& result, const PerfCounters::Reading& delta) {
+    double calls = (double)result.iterations * result.samples.size();
+    double items = calls * std::max(result.items, 1.0);
+    uint64_t cycles = delta.counts[PerfCounters::Cycles];
+    if (cycles && PerfCounters::available(PerfCounters::Instructions)) {
+        result.counters.push_back(
+            {"ipc", (double)delta.counts[PerfCounters::Instructions] / cycles});
+    }
+    const char* names[] = {"cycles", "instructions", "l1d_misses",
+                           "llc_misses", "branch_misses"};
+    for (int counter = 0; counter < PerfCounters::Counters; counter++) {
+        if (PerfCounters::available((PerfCounters::Counter)counter)) {
+            result.counters.push_back(
+                {names[counter], delta.counts[counter] / items});
+        }
+    }
+}
+
+/// Prints a one line summary of a result
+void Benchmark::report(const Result& result) const {
+    double rate = result.items / result.median;
+    const char* prefixes[] = {"", "K", "M", "G", "T"};
+    size_t prefix = 0;
+    while (rate >= 1000 && prefix < 4) {
+        rate /= 1000;
+        prefix++;
+    }
+    printf("%-28s%-34s %10s +- %-9s %7.4g%s/s", result.name.c_str(),
+           formatParams(result.params).c_str(),
+           formatTime(result.median).c_str(), formatTime(result.mad).c_str(),
+           rate, prefixes[prefix]);
+    // the ones that say the most about a layout, the rest are in the JSON
+    for (auto& counter : result.counters) {
+        if (counter.first == "ipc") {
+            printf("  IPC %.2f", counter.second);
+        } else if (counter.first == "l1d_misses") {
+            printf("  L1d %.3g", counter.second);
+        } else if (counter.first == "llc_misses") {
+            printf("  LLC %.3g", counter.second);
+        }
+    }
+    printf("\n");
+    fflush(stdout);
+}
@@ -1,5 +1,9 @@
 #include "EventHandler.h"
 
+#include "PerfCounters.h"
+
+static PerfCounters::Section s_pollCounters("event polling", "poll");
+
 void EventHandler::clearCache()
 {
     events.clear();
@@ -24,8 +28,18 @@ void EventHandler::clearCache()
     }
 }
 
+/** Sleeps until there's an event to poll, for loops with nothing to do
+ *  @param timeout The longest to wait in milliseconds
+ *  @return Whether an event arrived before the timeout
+ */
+bool EventHandler::wait(int timeout)
+{
+    return SDL_WaitEventTimeout(nullptr, timeout) != 0;
+}
+
 void EventHandler::poll()
 {
+    PerfCounters::Scope counters(s_pollCounters, 1);
     events.clear();
     windowEvents.clear();
     mouseEvents.clear();
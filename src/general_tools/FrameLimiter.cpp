@@ -0,0 +1,56 @@
+#include "FrameLimiter.h"
+
+#include <thread>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define FRAME_LIMITER_PAUSE() _mm_pause()
+#else
+#define FRAME_LIMITER_PAUSE() std::this_thread::yield()
+#endif
+
+/** FrameLimiter constructor
+ *  @param fps The frame rate to hold, 0 doesn't wait at all
+ *  @param spin How long before each deadline to stop sleeping and spin
+ */
+FrameLimiter::FrameLimiter(double fps, clock::duration spin)
+    : m_spin(spin), m_started(false) {
+    setRate(fps);
+}
+
+/// Changes the frame rate, 0 or less to stop waiting, the grid starts over
+void FrameLimiter::setRate(double fps) {
+    m_fps = fps > 0 ? fps : 0;
+    m_period = std::chrono::duration_cast<clock::duration>(
+        std::chrono::duration<double>(m_fps > 0 ? 1.0 / m_fps : 0.0));
+    m_started = false;
+}
+
+/// Returns the frame rate held, 0 if uncapped
+double FrameLimiter::rate() const { return m_fps; }
+
+/// Blocks until the next frame should start
+void FrameLimiter::wait() {
+    clock::time_point now = clock::now();
+    if (m_fps <= 0) {
+        return;
+    }
+    if (!m_started) {
+        m_started = true;
+        m_next = now + m_period;
+        return;
+    }
+    if (now >= m_next) {
+        // late, start on the next slot of the grid rather than catching up
+        m_next += m_period * ((now - m_next) / m_period + 1);
+        return;
+    }
+
+    if (m_next - now > m_spin) {
+        std::this_thread::sleep_for(m_next - now - m_spin);
+    }
+    while (clock::now() < m_next) {
+        FRAME_LIMITER_PAUSE();
+    }
+    m_next += m_period;
+}
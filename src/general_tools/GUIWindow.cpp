@@ -14,6 +14,7 @@ bool GUIWindow::s_exists = false;
  *  @note Throws a runtime error if the window cannot be created
  *  @note This doesn't use the ImGui docking branch, so there can only be one
  * GUIWindow object
+ *  @note Headless windows skip ImGui's SDL2 backend, there's no input
  */
 GUIWindow::GUIWindow(const std::string& name, size_t height, size_t width,
                      int sdlWindowFlags)
@@ -30,13 +31,19 @@ GUIWindow::GUIWindow(const std::string& name, size_t height, size_t width,
     ImGui_ImplOpenGL3_Init("#version 430");
 
     // initialize ImGUI SDL2/OpenGL, and attatch it to the window
-    ImGui_ImplSDL2_InitForOpenGL(m_window, m_context);
+    if (m_window) {
+        ImGui_ImplSDL2_InitForOpenGL(m_window, m_context);
+    } else {
+        ImGui::GetIO().DisplaySize = ImVec2((float)getWidth(), (float)getHeight());
+    }
 }
 
 /// GUIWindow destructor
 GUIWindow::~GUIWindow() {
     ImGui_ImplOpenGL3_Shutdown();
-    ImGui_ImplSDL2_Shutdown();
+    if (m_window) {
+        ImGui_ImplSDL2_Shutdown();
+    }
     ImGui::DestroyContext();
     s_exists = false;
 }
@@ -54,14 +61,27 @@ void GUIWindow::setGUIFunc(const std::function<void(void*)>& guiFunctor) {
 void GUIWindow::setGUIParams(void* params) { m_guiParams = params; }
 
 /** Initializes a new ImGui fram
- *  @param window The window to initialize the frame for
+ *  @param window The window to initialize the frame for, null when headless
  */
 void GUIWindow::NewFrame(SDL_Window* window) {
     ImGui_ImplOpenGL3_NewFrame();
-    ImGui_ImplSDL2_NewFrame(window);
+    if (window) {
+        ImGui_ImplSDL2_NewFrame(window);
+    } else {
+        ImGui::GetIO().DeltaTime = 1.0f / 60.0f;
+    }
     ImGui::NewFrame();
 }
 
+/** Resizes the window and the area ImGui draws to
+ *  @param height The new height of the window
+ *  @param width The new width of the window
+ */
+void GUIWindow::resize(size_t height, size_t width) {
+    Window::resize(height, width);
+    ImGui::GetIO().DisplaySize = ImVec2((float)getWidth(), (float)getHeight());
+}
+
 /// Renders the current ImGui frame
 void GUIWindow::RenderFrame() {
     ImGui::Render();
@@ -0,0 +1,439 @@
+#include "JobSystem.h"
+
+#include <cstdio>
+#include <cstring>
+
+#include "Profiler.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define JOB_SYSTEM_PAUSE() _mm_pause()
+#else
+#define JOB_SYSTEM_PAUSE() std::this_thread::yield()
+#endif
+
+namespace {
+
+    typedef JobSystem::Job Job;
+
+    /** Bounded Chase-Lev deque
+     *  The owning thread pushes and pops at the bottom, other threads steal
+     *  from the top.
+     */
+    class WorkStealingQueue {
+    public:
+        WorkStealingQueue() : m_top(0), m_bottom(0) {
+            for (auto& slot : m_jobs) {
+                slot.store(nullptr, std::memory_order_relaxed);
+            }
+        }
+
+        /// Owner only, returns false if the queue is full
+        bool push(Job* job) {
+            int64_t bottom = m_bottom.load(std::memory_order_relaxed);
+            int64_t top = m_top.load(std::memory_order_acquire);
+            if (bottom - top >= (int64_t)JobSystem::PoolSize) {
+                return false;
+            }
+            m_jobs[bottom & Mask].store(job, std::memory_order_relaxed);
+            m_bottom.store(bottom + 1, std::memory_order_release);
+            return true;
+        }
+
+        /// Owner only
+        Job* pop() {
+            int64_t bottom = m_bottom.load(std::memory_order_relaxed) - 1;
+            m_bottom.store(bottom, std::memory_order_relaxed);
+            std::atomic_thread_fence(std::memory_order_seq_cst);
+            int64_t top = m_top.load(std::memory_order_relaxed);
+
+            if (top > bottom) {
+                // empty
+                m_bottom.store(bottom + 1, std::memory_order_relaxed);
+                return nullptr;
+            }
+            Job* job = m_jobs[bottom & Mask].load(std::memory_order_relaxed);
+            if (top != bottom) {
+                return job;
+            }
+            // last job, race the thieves for it
+            if (!m_top.compare_exchange_strong(top, top + 1,
+                                               std::memory_order_seq_cst,
+                                               std::memory_order_relaxed)) {
+                job = nullptr;
+            }
+            m_bottom.store(bottom + 1, std::memory_order_relaxed);
+            return job;
+        }
+
+        /// Any thread, may be out of date by the time it returns
+        bool empty() const {
+            return m_top.load(std::memory_order_acquire) >=
+                   m_bottom.load(std::memory_order_acquire);
+        }
+
+        /// Any thread
+        Job* steal() {
+            int64_t top = m_top.load(std::memory_order_acquire);
+            std::atomic_thread_fence(std::memory_order_seq_cst);
+            int64_t bottom = m_bottom.load(std::memory_order_acquire);
+            if (top >= bottom) {
+                return nullptr;
+            }
+            Job* job = m_jobs[top & Mask].load(std::memory_order_relaxed);
+            if (!m_top.compare_exchange_strong(top, top + 1,
+                                               std::memory_order_seq_cst,
+                                               std::memory_order_relaxed)) {
+                return nullptr;
+            }
+            return job;
+        }
+
+    private:
+        static constexpr int64_t Mask = JobSystem::PoolSize - 1;
+        alignas(64) std::atomic<int64_t> m_top;
+        alignas(64) std::atomic<int64_t> m_bottom;
+        alignas(64) std::atomic<Job*> m_jobs[JobSystem::PoolSize];
+    };
+
+    /// Everything a thread owns
+    struct alignas(64) ThreadState {
+        WorkStealingQueue queue;
+        Job* pool;
+        size_t poolIndex;
+        uint32_t random;  ///< xorshift state for picking a victim
+        std::atomic<bool> claimed;  ///< a thread owns this slot
+    };
+
+    /// Shared state, only exists between init() and shutdown()
+    struct System {
+        std::vector<ThreadState*> states;
+        std::vector<std::thread> workers;
+        size_t numThreads;                   ///< workers + the main thread
+        std::atomic<bool> warnedFull;        ///< every extra slot was taken
+        std::atomic<bool> running;
+        std::atomic<int> sleeping;
+        std::mutex sleepMutex;
+        std::condition_variable wake;
+    };
+
+    System* s_system = nullptr;
+    thread_local int t_slot = -1;
+    thread_local System* t_system = nullptr;
+
+    /// Gives an extra slot back when the thread that claimed it exits
+    struct SlotRelease {
+        System* system = nullptr;  ///< set once the thread claims a slot
+
+        ~SlotRelease() {
+            if (system && system == s_system && t_slot >= 0) {
+                system->states[t_slot]->claimed.store(
+                    false, std::memory_order_release);
+            }
+        }
+    };
+    thread_local SlotRelease t_release;
+
+    /// Returns the calling thread's slot, claiming a free one if needed
+    int threadSlot() {
+        if (t_system != s_system) {
+            t_slot = -1;
+            t_system = s_system;
+        }
+        if (t_slot >= 0 || !s_system) {
+            return t_slot;
+        }
+        for (size_t slot = s_system->numThreads;
+             slot < s_system->states.size(); slot++) {
+            bool expected = false;
+            if (s_system->states[slot]->claimed.compare_exchange_strong(
+                    expected, true, std::memory_order_acquire)) {
+                t_slot = (int)slot;
+                t_release.system = s_system;
+                return t_slot;
+            }
+        }
+        if (!s_system->warnedFull.exchange(true)) {
+            std::fprintf(stderr,
+                         "JobSystem: more than %zu threads besides the "
+                         "workers are scheduling jobs, the rest run theirs "
+                         "serially\n",
+                         JobSystem::ExtraThreads);
+        }
+        return -1;
+    }
+
+    void execute(Job* job);
+
+    /// Looks for work in the calling thread's deque, then steals
+    Job* findJob(int slot) {
+        ThreadState* self = s_system->states[slot];
+        Job* job = self->queue.pop();
+        if (job) {
+            return job;
+        }
+
+        size_t numStates = s_system->states.size();
+        self->random ^= self->random << 13;
+        self->random ^= self->random >> 17;
+        self->random ^= self->random << 5;
+        size_t start = self->random % numStates;
+        for (size_t i = 0; i < numStates; i++) {
+            size_t victim = (start + i) % numStates;
+            if (victim == (size_t)slot) {
+                continue;
+            }
+            job = s_system->states[victim]->queue.steal();
+            if (job) {
+                return job;
+            }
+        }
+        return nullptr;
+    }
+
+    /// Schedules a job whose dependencies are all met
+    void push(Job* job) {
+        int slot = threadSlot();
+        if (slot < 0 || !s_system->states[slot]->queue.push(job)) {
+            // nowhere to put it, so do it now
+            execute(job);
+            return;
+        }
+        // pairs with the fence in workerLoop, either the worker sees the
+        // job or this sees the worker sleeping
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        if (s_system->sleeping.load(std::memory_order_relaxed) > 0) {
+            // under the lock, so the notify can't slip in between a
+            // worker's last look at the queues and its wait
+            { std::lock_guard<std::mutex> lock(s_system->sleepMutex); }
+            s_system->wake.notify_one();
+        }
+    }
+
+    /// Marks a job (or one of its children) as done
+    void finish(Job* job) {
+        // read everything out first, once unfinished reaches 0 the owner can
+        // hand the job out again, and these are all set before run()
+        Job* parent = job->parent;
+        int32_t numContinuations = job->numContinuations;
+        Job* continuations[JobSystem::MaxContinuations];
+        std::memcpy(continuations, job->continuations,
+                    sizeof(Job*) * numContinuations);
+        if (job->unfinished.fetch_sub(1, std::memory_order_acq_rel) != 1) {
+            return;
+        }
+
+        for (int32_t i = 0; i < numContinuations; i++) {
+            if (continuations[i]->pending.fetch_sub(
+                    1, std::memory_order_acq_rel) == 1) {
+                push(continuations[i]);
+            }
+        }
+        if (parent) {
+            finish(parent);
+        }
+    }
+
+    /// Returns whether any thread has a job queued
+    bool hasWork() {
+        for (ThreadState* state : s_system->states) {
+            if (!state->queue.empty()) {
+                return true;
+            }
+        }
+        return false;
+    }
+
+    void execute(Job* job) {
+        job->function(job, job->data);
+        finish(job);
+    }
+
+    void workerLoop(int slot) {
+        PROFILE_THREAD("worker");
+        t_slot = slot;
+        t_system = s_system;
+        int idle = 0;
+        while (s_system->running.load(std::memory_order_relaxed)) {
+            Job* job = findJob(slot);
+            if (job) {
+                execute(job);
+                idle = 0;
+            } else if (++idle < 256) {
+                JOB_SYSTEM_PAUSE();
+            } else {
+                // nothing to do for a while, sleep until work is pushed
+                std::unique_lock<std::mutex> lock(s_system->sleepMutex);
+                s_system->sleeping++;
+                std::atomic_thread_fence(std::memory_order_seq_cst);
+                if (s_system->running.load(std::memory_order_relaxed) &&
+                    !hasWork()) {
+                    s_system->wake.wait(lock);
+                }
+                s_system->sleeping--;
+                idle = 0;
+            }
+        }
+    }
+
+}  // namespace
+
+/** Starts the worker threads
+ *  @param numThreads Total number of threads to use including the calling
+ * thread, 0 uses every hardware thread
+ *
+ *  @note Must be called from the main thread, later calls are ignored
+ */
+void JobSystem::init(size_t numThreads) {
+    if (s_system) {
+        return;
+    }
+    if (numThreads == 0) {
+        numThreads = std::max(1u, std::thread::hardware_concurrency());
+    }
+
+    s_system = new System;
+    s_system->numThreads = numThreads;
+    s_system->running = true;
+    s_system->sleeping = 0;
+    s_system->states.resize(numThreads + ExtraThreads);
+    for (size_t i = 0; i < s_system->states.size(); i++) {
+        ThreadState* state = new ThreadState;
+        state->pool = new Job[PoolSize];
+        for (size_t j = 0; j < PoolSize; j++) {
+            // finished, so create() can hand it out
+            state->pool[j].unfinished.store(0, std::memory_order_relaxed);
+        }
+        state->poolIndex = 0;
+        state->random = 0x9e3779b9u * (uint32_t)(i + 1);
+        state->claimed = i < numThreads;
+        s_system->states[i] = state;
+    }
+
+    // the calling thread is slot 0, workers are 1..numThreads-1, anything
+    // else that schedules jobs claims one of the extra slots until it exits
+    t_slot = 0;
+    t_system = s_system;
+    s_system->warnedFull = false;
+    for (size_t i = 1; i < numThreads; i++) {
+        s_system->workers.emplace_back(workerLoop, (int)i);
+    }
+}
+
+/// Stops and joins the worker threads
+void JobSystem::shutdown() {
+    if (!s_system) {
+        return;
+    }
+    {
+        std::lock_guard<std::mutex> lock(s_system->sleepMutex);
+        s_system->running = false;
+    }
+    s_system->wake.notify_all();
+    for (auto& worker : s_system->workers) {
+        worker.join();
+    }
+    for (auto state : s_system->states) {
+        delete[] state->pool;
+        delete state;
+    }
+    delete s_system;
+    s_system = nullptr;
+}
+
+/// Returns whether init() has been called
+bool JobSystem::initialized() { return s_system != nullptr; }
+
+/// Returns the number of threads running jobs, including the main thread
+size_t JobSystem::threadCount() {
+    return s_system ? s_system->numThreads : 1;
+}
+
+/// Returns whether the calling thread can hand jobs to other threads
+bool JobSystem::canSchedule() {
+    return s_system && s_system->numThreads > 1 && threadSlot() >= 0;
+}
+
+/** Creates a job that isn't scheduled until run() is called
+ *  @param function The function to run, it's passed the job and its data
+ *  @param parent Optional job that won't finish until this one does
+ *  @param data Optional bytes copied into the job's data
+ *  @param dataSize The number of bytes in data, at most JobDataSize
+ *
+ *  @note Throws a runtime error if the calling thread can't schedule jobs,
+ * or already has PoolSize jobs in flight
+ */
+JobSystem::Job* JobSystem::create(JobFunction function, Job* parent,
+                                  const void* data, size_t dataSize) {
+    int slot = threadSlot();
+    if (slot < 0) {
+        throw std::runtime_error("JobSystem has no slot for this thread");
+    }
+    if (dataSize > JobDataSize) {
+        throw std::runtime_error("JobSystem job data is too large");
+    }
+    ThreadState* state = s_system->states[slot];
+    // the ring's next slot is normally long finished, but nested jobs can
+    // outlive a lap of it, so skip past any that are still in flight
+    Job* job = nullptr;
+    for (size_t i = 0; i < PoolSize && !job; i++) {
+        Job* slotJob = &state->pool[state->poolIndex++ & (PoolSize - 1)];
+        if (slotJob->unfinished.load(std::memory_order_acquire) == 0) {
+            job = slotJob;
+        }
+    }
+    if (!job) {
+        throw std::runtime_error("JobSystem has too many jobs in flight");
+    }
+    job->function = function;
+    job->parent = parent;
+    job->unfinished.store(1, std::memory_order_relaxed);
+    job->pending.store(1, std::memory_order_relaxed);
+    job->numContinuations = 0;
+    if (parent) {
+        parent->unfinished.fetch_add(1, std::memory_order_relaxed);
+    }
+    if (data) {
+        std::memcpy(job->data, data, dataSize);
+    }
+    return job;
+}
+
+/** Makes a job wait for another one to finish before it is scheduled
+ *  @param job The job that depends on the prerequisite
+ *  @param prerequisite The job that must finish first
+ *
+ *  @note Must be called before either job is run
+ */
+void JobSystem::addDependency(Job* job, Job* prerequisite) {
+    if (prerequisite->numContinuations >= (int32_t)MaxContinuations) {
+        throw std::runtime_error("JobSystem job has too many continuations");
+    }
+    job->pending.fetch_add(1, std::memory_order_relaxed);
+    prerequisite->continuations[prerequisite->numContinuations++] = job;
+}
+
+/// Schedules a job once all of its dependencies have finished
+void JobSystem::run(Job* job) {
+    if (job->pending.fetch_sub(1, std::memory_order_acq_rel) == 1) {
+        push(job);
+    }
+}
+
+/// Runs other jobs on the calling thread until the job has finished
+void JobSystem::wait(Job* job) {
+    int slot = threadSlot();
+    while (!isFinished(job)) {
+        Job* next = slot >= 0 ? findJob(slot) : nullptr;
+        if (next) {
+            execute(next);
+        } else {
+            JOB_SYSTEM_PAUSE();
+        }
+    }
+}
+
+/// Returns whether a job and all of its children have finished
+bool JobSystem::isFinished(const Job* job) {
+    return job->unfinished.load(std::memory_order_acquire) == 0;
+}
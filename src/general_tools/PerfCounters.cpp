@@ -0,0 +1,230 @@
+#include "PerfCounters.h"
+
+#include <cerrno>
+#include <cstring>
+
+#ifdef __linux__
+#include <linux/perf_event.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+namespace {
+
+    const char* s_names[] = {"cycles", "instructions", "L1d misses",
+                             "LLC misses", "branch misses"};
+
+#ifdef __linux__
+    /// Fills in the perf event a counter is opened as
+    void describe(PerfCounters::Counter counter, perf_event_attr& attr) {
+        // cache events are cache | operation << 8 | result << 16
+        const uint64_t readMisses = PERF_COUNT_HW_CACHE_OP_READ << 8 |
+                                    PERF_COUNT_HW_CACHE_RESULT_MISS << 16;
+        switch (counter) {
+            case PerfCounters::Cycles:
+                attr.type = PERF_TYPE_HARDWARE;
+                attr.config = PERF_COUNT_HW_CPU_CYCLES;
+                break;
+            case PerfCounters::Instructions:
+                attr.type = PERF_TYPE_HARDWARE;
+                attr.config = PERF_COUNT_HW_INSTRUCTIONS;
+                break;
+            case PerfCounters::L1Misses:
+                attr.type = PERF_TYPE_HW_CACHE;
+                attr.config = PERF_COUNT_HW_CACHE_L1D | readMisses;
+                break;
+            case PerfCounters::LLCMisses:
+                attr.type = PERF_TYPE_HW_CACHE;
+                attr.config = PERF_COUNT_HW_CACHE_LL | readMisses;
+                break;
+            default:
+                attr.type = PERF_TYPE_HARDWARE;
+                attr.config = PERF_COUNT_HW_BRANCH_MISSES;
+                break;
+        }
+    }
+#endif
+
+}  // namespace
+
+std::atomic<bool> PerfCounters::s_enabled(false);
+int PerfCounters::s_files[Counters] = {-1, -1, -1, -1, -1};
+std::string PerfCounters::s_status = "not started";
+
+/** Section constructor, sections register themselves for the stats panel
+ *  @param name Name of the instrumented work
+ *  @param item What the work processes, used to label the per item counts
+ */
+PerfCounters::Section::Section(const char* name, const char* item)
+    : m_name(name), m_item(item) {
+    reset();
+    registry().push_back(this);
+}
+
+/// Adds the counts of one run of the work, which processed items
+void PerfCounters::Section::add(const Reading& delta, uint64_t items) {
+    m_calls.fetch_add(1, std::memory_order_relaxed);
+    m_items.fetch_add(items, std::memory_order_relaxed);
+    for (int counter = 0; counter < Counters; counter++) {
+        m_counts[counter].fetch_add(delta.counts[counter],
+                                    std::memory_order_relaxed);
+    }
+}
+
+/// Starts the totals over
+void PerfCounters::Section::reset() {
+    m_calls.store(0, std::memory_order_relaxed);
+    m_items.store(0, std::memory_order_relaxed);
+    for (auto& count : m_counts) {
+        count.store(0, std::memory_order_relaxed);
+    }
+}
+
+const char* PerfCounters::Section::name() const { return m_name; }
+
+const char* PerfCounters::Section::item() const { return m_item; }
+
+uint64_t PerfCounters::Section::calls() const {
+    return m_calls.load(std::memory_order_relaxed);
+}
+
+uint64_t PerfCounters::Section::items() const {
+    return m_items.load(std::memory_order_relaxed);
+}
+
+/// Returns every count added since the last reset()
+PerfCounters::Reading PerfCounters::Section::totals() const {
+    Reading totals;
+    for (int counter = 0; counter < Counters; counter++) {
+        totals.counts[counter] =
+            m_counts[counter].load(std::memory_order_relaxed);
+    }
+    return totals;
+}
+
+/** Starts counting, if the counters are on
+ *  @param section Where the counts are added once the scope closes
+ *  @param items How many balls or pixels the scope processes
+ */
+PerfCounters::Scope::Scope(Section& section, uint64_t items)
+    : m_section(nullptr), m_items(items) {
+    if (s_enabled.load(std::memory_order_relaxed)) {
+        m_section = &section;
+        m_start = read();
+    }
+}
+
+PerfCounters::Scope::~Scope() {
+    if (m_section) {
+        m_section->add(difference(read(), m_start), m_items);
+    }
+}
+
+/** Opens the counters for this process and every thread it starts later
+ *  @return Whether any counter could be opened, status() says which
+ * couldn't and why
+ */
+bool PerfCounters::start() {
+    if (s_enabled.load(std::memory_order_relaxed)) {
+        return true;
+    }
+#ifdef __linux__
+    std::string missing;
+    int opened = 0;
+    for (int counter = 0; counter < Counters; counter++) {
+        perf_event_attr attr;
+        std::memset(&attr, 0, sizeof(attr));
+        attr.size = sizeof(attr);
+        describe((Counter)counter, attr);
+        attr.inherit = 1;
+        attr.exclude_kernel = 1;
+        attr.exclude_hv = 1;
+        attr.read_format =
+            PERF_FORMAT_TOTAL_TIME_ENABLED | PERF_FORMAT_TOTAL_TIME_RUNNING;
+        s_files[counter] = (int)syscall(SYS_perf_event_open, &attr, 0, -1,
+                                        -1, PERF_FLAG_FD_CLOEXEC);
+        if (s_files[counter] < 0) {
+            missing += missing.empty() ? "" : ", ";
+            missing += std::string(s_names[counter]) + " (" +
+                       std::strerror(errno) + ")";
+        } else {
+            opened++;
+        }
+    }
+    if (opened == 0) {
+        s_status = "no counters: " + missing +
+                   ", the CPU may not expose them to this machine or "
+                   "/proc/sys/kernel/perf_event_paranoid may forbid them";
+        return false;
+    }
+    s_status = missing.empty() ? "counting" : "counting, without " + missing;
+    s_enabled.store(true, std::memory_order_relaxed);
+    return true;
+#else
+    s_status = "hardware counters are only read on Linux";
+    return false;
+#endif
+}
+
+/// Returns whether scopes are being counted
+bool PerfCounters::enabled() {
+    return s_enabled.load(std::memory_order_relaxed);
+}
+
+/// Returns whether a counter opened
+bool PerfCounters::available(Counter counter) {
+    return s_files[counter] >= 0;
+}
+
+/// Describes which counters are being counted, or why none are
+const std::string& PerfCounters::status() { return s_status; }
+
+const char* PerfCounters::name(Counter counter) { return s_names[counter]; }
+
+/** Reads every counter, scaled up for any time the kernel had it switched
+ *  out to share the hardware with other counters
+ */
+PerfCounters::Reading PerfCounters::read() {
+    Reading reading;
+    std::memset(&reading, 0, sizeof(reading));
+#ifdef __linux__
+    for (int counter = 0; counter < Counters; counter++) {
+        uint64_t values[3];  // count, time enabled, time running
+        if (s_files[counter] < 0 ||
+            ::read(s_files[counter], values, sizeof(values)) !=
+                (ssize_t)sizeof(values)) {
+            continue;
+        }
+        if (values[2] != 0 && values[2] < values[1]) {
+            values[0] = (uint64_t)((double)values[0] * values[1] / values[2]);
+        }
+        reading.counts[counter] = values[0];
+    }
+#endif
+    return reading;
+}
+
+/// Returns the counts between two readings
+PerfCounters::Reading PerfCounters::difference(const Reading& end,
+                                               const Reading& start) {
+    Reading delta;
+    for (int counter = 0; counter < Counters; counter++) {
+        // scaling can make a multiplexed counter step backwards
+        delta.counts[counter] = end.counts[counter] > start.counts[counter]
+                                    ? end.counts[counter] -
+                                          start.counts[counter]
+                                    : 0;
+    }
+    return delta;
+}
+
+/// Returns every section, in the order they were constructed
+const std::vector<PerfCounters::Section*>& PerfCounters::sections() {
+    return registry();
+}
+
+std::vector<PerfCounters::Section*>& PerfCounters::registry() {
+    // constructed on first use, sections are statics in other files
+    static std::vector<Section*> sections;
+    return sections;
+}
@@ -0,0 +1,158 @@
+#include "Profiler.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <fstream>
+#include <memory>
+#include <mutex>
+#include <stdexcept>
+
+namespace {
+
+    /// One thread's events, kept for the life of the program
+    struct ThreadBuffer {
+        std::vector<Profiler::Event> events;
+        std::atomic<size_t> count;  ///< events ever written
+        int tid;
+        std::string name;
+    };
+
+    std::mutex s_registryMutex;
+    std::vector<std::unique_ptr<ThreadBuffer>> s_buffers;
+
+    thread_local ThreadBuffer* t_buffer = nullptr;
+    thread_local uint32_t t_depth = 0;
+
+    /// Returns the calling thread's buffer, registering it the first time
+    ThreadBuffer* threadBuffer(size_t capacity) {
+        if (!t_buffer) {
+            std::lock_guard<std::mutex> lock(s_registryMutex);
+            s_buffers.emplace_back(new ThreadBuffer);
+            t_buffer = s_buffers.back().get();
+            t_buffer->events.resize(std::max<size_t>(capacity, 1));
+            t_buffer->count.store(0, std::memory_order_relaxed);
+            t_buffer->tid = (int)s_buffers.size();
+            t_buffer->name = "thread " + std::to_string(t_buffer->tid);
+        }
+        return t_buffer;
+    }
+
+    void writeString(std::ostream& out, const char* value) {
+        out << '"';
+        for (; *value; value++) {
+            if (*value == '"' || *value == '\\') {
+                out << '\\';
+            }
+            out << *value;
+        }
+        out << '"';
+    }
+
+}  // namespace
+
+std::atomic<bool> Profiler::s_enabled(false);
+size_t Profiler::s_capacity = 1 << 16;
+std::chrono::steady_clock::time_point Profiler::s_epoch =
+    std::chrono::steady_clock::now();
+
+void Profiler::Scope::begin(const char* name, uint32_t id) {
+    m_name = name;
+    m_id = id;
+    t_depth++;
+    m_start = now();
+}
+
+void Profiler::Scope::end() {
+    int64_t end = now();
+    t_depth--;
+    ThreadBuffer* buffer = threadBuffer(s_capacity);
+    size_t count = buffer->count.load(std::memory_order_relaxed);
+    Event& event = buffer->events[count % buffer->events.size()];
+    event.name = m_name;
+    event.id = m_id;
+    event.depth = t_depth;
+    event.start = m_start;
+    event.end = end;
+    buffer->count.store(count + 1, std::memory_order_release);
+}
+
+/** Starts recording scopes
+ *  @param eventsPerThread The size of each thread's ring, only used for
+ * threads that haven't recorded anything yet
+ */
+void Profiler::start(size_t eventsPerThread) {
+    s_capacity = eventsPerThread;
+    s_enabled.store(true, std::memory_order_relaxed);
+}
+
+/// Stops recording scopes, the events recorded so far are kept
+void Profiler::stop() { s_enabled.store(false, std::memory_order_relaxed); }
+
+/// Returns whether scopes are being recorded
+bool Profiler::enabled() { return s_enabled.load(std::memory_order_relaxed); }
+
+/// Names the calling thread in the trace
+void Profiler::setThreadName(const char* name) {
+    ThreadBuffer* buffer = threadBuffer(s_capacity);
+    std::lock_guard<std::mutex> lock(s_registryMutex);
+    buffer->name = name;
+}
+
+/// Returns nanoseconds since the profiler's epoch, when the program started
+int64_t Profiler::now() {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+               std::chrono::steady_clock::now() - s_epoch)
+        .count();
+}
+
+/// Returns the number of events held across every thread
+size_t Profiler::eventCount() {
+    std::lock_guard<std::mutex> lock(s_registryMutex);
+    size_t total = 0;
+    for (auto& buffer : s_buffers) {
+        total += std::min(buffer->count.load(std::memory_order_acquire),
+                          buffer->events.size());
+    }
+    return total;
+}
+
+/** Writes every thread's events as a Chrome trace_event JSON file
+ *  Scopes are complete ("X") events with times in microseconds, each
+ *  thread is named with a metadata ("M") event.
+ *
+ *  @note Throws a runtime error if the file can't be written
+ */
+void Profiler::writeChromeTrace(const std::string& path) {
+    std::ofstream file(path);
+    file << "{\"displayTimeUnit\": \"ms\", \"traceEvents\": [";
+    bool first = true;
+    char numbers[96];
+    std::lock_guard<std::mutex> lock(s_registryMutex);
+    for (auto& buffer : s_buffers) {
+        file << (first ? "\n" : ",\n")
+             << "{\"ph\": \"M\", \"name\": \"thread_name\", \"pid\": 1, "
+             << "\"tid\": " << buffer->tid << ", \"args\": {\"name\": ";
+        writeString(file, buffer->name.c_str());
+        file << "}}";
+        first = false;
+
+        size_t count = buffer->count.load(std::memory_order_acquire);
+        size_t capacity = buffer->events.size();
+        size_t kept = std::min(count, capacity);
+        for (size_t i = count - kept; i < count; i++) {
+            const Event& event = buffer->events[i % capacity];
+            file << ",\n{\"ph\": \"X\", \"name\": ";
+            writeString(file, event.name);
+            snprintf(numbers, sizeof(numbers),
+                     ", \"pid\": 1, \"tid\": %d, \"ts\": %.3f, \"dur\": %.3f",
+                     buffer->tid, event.start / 1000.0,
+                     (event.end - event.start) / 1000.0);
+            file << numbers << ", \"args\": {\"depth\": " << event.depth
+                 << "}}";
+        }
+    }
+    file << "\n]}\n";
+    if (!file) {
+        throw std::runtime_error("Unable to write " + path);
+    }
+}
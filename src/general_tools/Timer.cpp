@@ -3,6 +3,11 @@
 #include <chrono>
 #include <thread>
 
+std::vector<Timers::timerScope> Timers::named_timers;
+std::mutex Timers::named_timers_mutex;
+std::string Timers::out_file = "";
+bool Timers::toScreen = false;
+
 /** Logs all named scope timers
  *  If a log file isn't set, then the timers are logged to the screen,
  *  otherwise the will be logged to the provided file. If Timers::toScreen
@@ -10,9 +15,10 @@
  *  provided file.
  */
 void Timers::logNamedTimers() {
+    std::lock_guard<std::mutex> lock(named_timers_mutex);
     if (out_file == "") {
         for (auto i = named_timers.begin(); i < named_timers.end(); i++) {
-            std::cout << i->m_scopeName << ": " << *(i->m_executionTime) << "us"
+            std::cout << i->m_scopeName << ": " << i->m_executionTime << "us"
                       << std::endl;
         }
     } else {
@@ -26,14 +32,14 @@ void Timers::logNamedTimers() {
         out << "====================================" << std::endl;
         if (Timers::toScreen) {
             for (auto i = named_timers.begin(); i < named_timers.end(); i++) {
-                std::cout << i->m_scopeName << ": " << *(i->m_executionTime)
+                std::cout << i->m_scopeName << ": " << i->m_executionTime
                           << "us" << std::endl;
-                out << i->m_scopeName << ": " << *(i->m_executionTime) << "us"
+                out << i->m_scopeName << ": " << i->m_executionTime << "us"
                     << std::endl;
             }
         } else {
             for (auto i = named_timers.begin(); i < named_timers.end(); i++) {
-                out << i->m_scopeName << ": " << *(i->m_executionTime) << "us"
+                out << i->m_scopeName << ": " << i->m_executionTime << "us"
                     << std::endl;
             }
         }
@@ -60,11 +66,11 @@ Timer::Timer(long long& out) {
 /** Timer constructor
  *  @param scopeName The name used to identify the timers scope
  *
- *  @note This timer can be logged with Timers::logNamedTimers()
+ *  @note This timer can be logged with Timers::logNamedTimers() once it's
+ * destroyed
  */
-Timer::Timer(std::string scopeName) {
-    m_out = new long long;
-    Timers::named_timers.push_back({scopeName, m_out});
+Timer::Timer(std::string scopeName) : m_scopeName(scopeName) {
+    m_out = nullptr;
     m_initialTime = hresClock::now();
 }
 
@@ -74,6 +80,11 @@ Timer::~Timer() {
         *m_out = std::chrono::duration_cast<std::chrono::microseconds>(
                      hresClock::now() - m_initialTime)
                      .count();
+    if (!m_scopeName.empty()) {
+        long long elapsed = getMicrosecondsElapsed();
+        std::lock_guard<std::mutex> lock(Timers::named_timers_mutex);
+        Timers::named_timers.push_back({m_scopeName, elapsed});
+    }
 }
 
 /// Sets a new internal start time for the timer
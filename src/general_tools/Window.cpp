@@ -1,7 +1,25 @@
 #include <Window.h>
 
+#ifdef METABALLS_HEADLESS_EGL
+#include <EGL/egl.h>
+#include <EGL/eglext.h>
+#endif
+
+#include <sstream>
+
+#include "Profiler.h"
+
 int Window::s_windowCount = 0;
 bool Window::s_glewInitialized = false;
+bool Window::s_headless = false;
+
+/** Switches between on screen windows and headless offscreen contexts
+ *  @param headless Whether windows created from now on have no display
+ */
+void Window::setHeadless(bool headless) { s_headless = headless; }
+
+/// Returns whether windows are created without a display
+bool Window::isHeadless() { return s_headless; }
 
 /** Window constructor
  *  @param name The title for the window being created
@@ -12,10 +30,36 @@ bool Window::s_glewInitialized = false;
  *
  *  @note Initializes SDL2 for OpenGL as well as GLEW
  *  @note Throws a runtime error if the window cannot be created
+ *  @note Headless windows only initialize SDL's event loop, see setHeadless
  */
 Window::Window(const std::string& name, size_t height, size_t width,
                int sdlWindowFlags)
-    : m_window(nullptr), m_drawParams(nullptr) {
+    : m_window(nullptr),
+      m_context(nullptr),
+      m_swapInterval(0),
+      m_drawParams(nullptr),
+      m_eglDisplay(nullptr),
+      m_eglContext(nullptr),
+      m_framebuffer(0),
+      m_colorbuffer(0) {
+    m_name = name;
+    if (s_headless) {
+        if (s_windowCount == 0 && SDL_Init(SDL_INIT_EVENTS) < 0) {
+            std::string msg =
+                std::string("SDL failed to initialize: ") + SDL_GetError();
+            throw(std::runtime_error(msg));
+        }
+        m_shown = true;
+        m_hidden = false;
+        m_minimized = false;
+        m_focused = true;
+        m_height = height ? height : 720;
+        m_width = width ? width : 1280;
+        createHeadlessContext();
+        createFramebuffer();
+        return;
+    }
+
     if (s_windowCount == 0) {
         // initialize SDL
         if (SDL_Init(SDL_INIT_VIDEO) < 0) {
@@ -38,6 +82,7 @@ Window::Window(const std::string& name, size_t height, size_t width,
     m_shown = sdlWindowFlags & SDL_WINDOW_SHOWN;
     m_hidden = sdlWindowFlags & SDL_WINDOW_HIDDEN;
     m_minimized = sdlWindowFlags & SDL_WINDOW_MINIMIZED;
+    m_focused = true;  // until told otherwise, SDL focuses new windows
 
     // time to make a friggen window!
     // but are we full screen?
@@ -45,7 +90,6 @@ Window::Window(const std::string& name, size_t height, size_t width,
     SDL_GetDesktopDisplayMode(0, &display);
     m_height = height ? height : display.h;
     m_width = width ? width : display.w;
-    m_name = name;
 
     m_window = SDL_CreateWindow(name.c_str(), SDL_WINDOWPOS_UNDEFINED,
                                 SDL_WINDOWPOS_UNDEFINED, m_width, m_height,
@@ -64,11 +108,8 @@ Window::Window(const std::string& name, size_t height, size_t width,
         throw(std::runtime_error(msg));
     }
 
-    // use vsync
-    if (SDL_GL_SetSwapInterval(1) < 0) {
-        std::string msg = std::string("Unable to use VSync: ") + SDL_GetError();
-        throw(std::runtime_error(msg));
-    }
+    // use vsync where the driver allows it
+    setSwapInterval(1);
 
     if (!s_glewInitialized) {
         s_glewInitialized = true;
@@ -82,8 +123,120 @@ Window::Window(const std::string& name, size_t height, size_t width,
     }
 }
 
+/** Creates an OpenGL 4.3 core context with no window or display
+ *  Mesa's surfaceless platform is tried first, so no X server or GPU is
+ *  needed (llvmpipe works), then the default EGL display.
+ *
+ *  @note Throws a runtime error if any step fails, or if the build didn't
+ * find EGL
+ */
+void Window::createHeadlessContext() {
+#ifdef METABALLS_HEADLESS_EGL
+    auto fail = [](const std::string& step) {
+        std::ostringstream msg;
+        msg << "Headless context: " << step << " failed (EGL error 0x"
+            << std::hex << eglGetError() << ")";
+        return std::runtime_error(msg.str());
+    };
+
+    EGLDisplay display = EGL_NO_DISPLAY;
+    auto getPlatformDisplay = (PFNEGLGETPLATFORMDISPLAYEXTPROC)eglGetProcAddress(
+        "eglGetPlatformDisplayEXT");
+    if (getPlatformDisplay) {
+        display = getPlatformDisplay(EGL_PLATFORM_SURFACELESS_MESA,
+                                     EGL_DEFAULT_DISPLAY, nullptr);
+    }
+    if (display == EGL_NO_DISPLAY) {
+        display = eglGetDisplay(EGL_DEFAULT_DISPLAY);
+    }
+    EGLint major, minor;
+    if (display == EGL_NO_DISPLAY || !eglInitialize(display, &major, &minor)) {
+        throw fail("eglInitialize");
+    }
+    m_eglDisplay = display;
+    if (!eglBindAPI(EGL_OPENGL_API)) {
+        throw fail("eglBindAPI");
+    }
+
+    // nothing is ever drawn to an EGL surface, so any OpenGL config will do
+    const EGLint configAttribs[] = {EGL_SURFACE_TYPE, EGL_PBUFFER_BIT,
+                                    EGL_RENDERABLE_TYPE, EGL_OPENGL_BIT,
+                                    EGL_NONE};
+    EGLConfig config = EGL_NO_CONFIG_KHR;
+    EGLint numConfigs = 0;
+    if (!eglChooseConfig(display, configAttribs, &config, 1, &numConfigs) ||
+        numConfigs == 0) {
+        config = EGL_NO_CONFIG_KHR;
+    }
+
+    const EGLint contextAttribs[] = {
+        EGL_CONTEXT_MAJOR_VERSION_KHR, 4,
+        EGL_CONTEXT_MINOR_VERSION_KHR, 3,
+        EGL_CONTEXT_OPENGL_PROFILE_MASK_KHR,
+        EGL_CONTEXT_OPENGL_CORE_PROFILE_BIT_KHR,
+        EGL_NONE};
+    EGLContext context =
+        eglCreateContext(display, config, EGL_NO_CONTEXT, contextAttribs);
+    if (context == EGL_NO_CONTEXT) {
+        throw fail("eglCreateContext");
+    }
+    m_eglContext = context;
+    if (!eglMakeCurrent(display, EGL_NO_SURFACE, EGL_NO_SURFACE, context)) {
+        throw fail("eglMakeCurrent");
+    }
+
+    // the GLX specific part of glewInit fails without an X display
+    if (!s_glewInitialized) {
+        s_glewInitialized = true;
+        glewExperimental = GL_TRUE;
+        GLenum err = glewContextInit();
+        if (err != GLEW_OK) {
+            std::string msg = std::string("GLEW Error: ") +
+                              std::string((char*)glewGetErrorString(err));
+            throw(std::runtime_error(msg));
+        }
+    }
+#else
+    throw std::runtime_error(
+        "Headless rendering needs EGL, which wasn't found at build time");
+#endif
+}
+
+/** Creates the framebuffer object a headless window draws into and binds it
+ *  in place of the default framebuffer
+ *
+ *  @note Throws a runtime error if the framebuffer is incomplete
+ */
+void Window::createFramebuffer() {
+    glGenFramebuffers(1, &m_framebuffer);
+    glGenRenderbuffers(1, &m_colorbuffer);
+    glBindRenderbuffer(GL_RENDERBUFFER, m_colorbuffer);
+    glRenderbufferStorage(GL_RENDERBUFFER, GL_RGBA8, m_width, m_height);
+    glBindFramebuffer(GL_FRAMEBUFFER, m_framebuffer);
+    glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0,
+                              GL_RENDERBUFFER, m_colorbuffer);
+    if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE) {
+        throw std::runtime_error("Headless framebuffer is incomplete");
+    }
+    glViewport(0, 0, m_width, m_height);
+}
+
 /// Window destructor
 Window::~Window() {
+    if (m_framebuffer) {
+        glDeleteFramebuffers(1, &m_framebuffer);
+        glDeleteRenderbuffers(1, &m_colorbuffer);
+    }
+#ifdef METABALLS_HEADLESS_EGL
+    if (m_eglDisplay) {
+        eglMakeCurrent(m_eglDisplay, EGL_NO_SURFACE, EGL_NO_SURFACE,
+                       EGL_NO_CONTEXT);
+        if (m_eglContext) {
+            eglDestroyContext(m_eglDisplay, m_eglContext);
+        }
+        eglTerminate(m_eglDisplay);
+    }
+#endif
     SDL_DestroyWindow(m_window);
     SDL_GL_DeleteContext(m_context);
     s_windowCount--;
@@ -100,8 +253,42 @@ void Window::focus() {
     SDL_RaiseWindow(m_window);
 }
 
-/// Swaps the OpenGL framebuffer for the calling window
-void Window::swap() { SDL_GL_SwapWindow(m_window); }
+/** Swaps the OpenGL framebuffer for the calling window
+ *  @note Headless windows have nothing to swap, they wait for the frame to
+ * finish so frame times stay honest
+ */
+void Window::swap() {
+    PROFILE_SCOPE("Window::swap");
+    if (m_framebuffer) {
+        glFinish();
+        return;
+    }
+    SDL_GL_SwapWindow(m_window);
+}
+
+/** Sets how many vertical blanks a swap waits for
+ *  @param interval 0 for none, 1 for vsync or -1 for adaptive vsync, which
+ * swaps late frames straight away rather than waiting for the next blank
+ *  @return The interval in effect: drivers may refuse adaptive vsync, which
+ * falls back to vsync, or vsync, which falls back to none
+ *
+ *  @note Headless windows have nothing to wait for, their interval is 0
+ */
+int Window::setSwapInterval(int interval) {
+    if (m_framebuffer) {
+        return m_swapInterval = 0;
+    }
+    while (interval != 0 && SDL_GL_SetSwapInterval(interval) < 0) {
+        interval = interval < 0 ? 1 : 0;
+    }
+    if (interval == 0) {
+        SDL_GL_SetSwapInterval(0);
+    }
+    return m_swapInterval = interval;
+}
+
+/// Returns the swap interval in effect, see setSwapInterval
+int Window::getSwapInterval() const { return m_swapInterval; }
 
 /// Hides the calling window
 void Window::hide() {
@@ -152,6 +339,23 @@ void Window::handleEvent(SDL_WindowEvent& event) {
                 hide();
                 break;
 
+            case SDL_WINDOWEVENT_MINIMIZED:
+                m_minimized = true;
+                break;
+
+            case SDL_WINDOWEVENT_RESTORED:
+            case SDL_WINDOWEVENT_MAXIMIZED:
+                m_minimized = false;
+                break;
+
+            case SDL_WINDOWEVENT_FOCUS_GAINED:
+                m_focused = true;
+                break;
+
+            case SDL_WINDOWEVENT_FOCUS_LOST:
+                m_focused = false;
+                break;
+
             // all those other events that should be handeled explicitly :P
             default:
                 break;
@@ -162,17 +366,25 @@ void Window::handleEvent(SDL_WindowEvent& event) {
 /// Returns a pointer to the SDL_Window object
 SDL_Window* Window::getWindow() { return m_window; }
 
-/// Returns a pointer to the SDL_GLContext object
+/// Returns a pointer to the SDL_GLContext object, null when headless
 SDL_GLContext& Window::getContext() { return m_context; }
 
+/// Returns the framebuffer a headless window draws into, 0 otherwise
+GLuint Window::getFramebuffer() const { return m_framebuffer; }
+
 /** Resizes the calling Window
  *  @param height The new height for the window
  *  @param width The new width for the window
  */
 void Window::resize(size_t height, size_t width) {
-    SDL_SetWindowSize(m_window, height, width);
     m_height = height;
     m_width = width;
+    if (m_framebuffer) {
+        glBindRenderbuffer(GL_RENDERBUFFER, m_colorbuffer);
+        glRenderbufferStorage(GL_RENDERBUFFER, GL_RGBA8, m_width, m_height);
+        return;
+    }
+    SDL_SetWindowSize(m_window, width, height);
 }
 
 /// Returns the Window's height
@@ -190,6 +402,9 @@ bool Window::isHidden() const { return m_hidden; }
 /// Returns whether or not the Window is minimized
 bool Window::isMinimized() const { return m_minimized; }
 
+/// Returns whether the calling window has keyboard focus
+bool Window::hasFocus() const { return m_focused; }
+
 /// Casts the window to an SDL_Window pointer for SDL functions
 Window::operator SDL_Window*() { return m_window; }
 
@@ -0,0 +1,728 @@
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <ctime>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <vector>
+
+#include "BallSystem.h"
+#include "BarnesHut.h"
+#include "Benchmark.h"
+#include "CMDParser.h"
+#include "CPURenderer.h"
+#include "CollisionGrid.h"
+#include "GoldenImage.h"
+#include "Graphics.h"
+#include "JobSystem.h"
+#include "MetaballsCommit.h"  // generated at build time, see CMakeLists.txt
+#include "PerfCounters.h"
+#include "PixelReadback.h"
+#include "SceneGenerator.h"
+#include "ShaderManifest.h"
+
+// struct to hold benchmark parameters
+typedef struct {
+    int warmup;
+    int repetitions;
+    double sample_time;  // seconds each sample runs for at least
+    std::string filter;
+    std::string json;
+    double budget;  // most ball-pixel pairs a field kernel may shade
+    int max_balls;
+    int threads;
+    int gpu;
+    int headless;
+    int seed;
+    SceneGenerator::Distribution distribution;
+    std::string golden;  // compare against the references in here instead
+    int bless;           // write the references rather than compare
+    std::string diffs;   // where failed comparisons are written
+    double capacity;     // frame budget in ms to search ball counts for
+    double percentile;   // of frame times that must be within the budget
+    int frames;          // timed for each ball count
+    int counters;        // read hardware counters around each case
+} benchParams;
+
+/// The most balls a shader renders within the frame budget
+typedef struct {
+    std::string shader;
+    const char* backend;
+    int width;
+    int height;
+    size_t balls;      // 0 if even a single ball is over budget
+    double frameTime;  // ms at the percentile, with that many balls
+    bool capped;       // still within budget at -maxballs
+} Capacity;
+
+static const size_t s_ballCounts[] = {10, 100, 1000, 10000, 100000, 1000000};
+// height x width, 256^2 up to 4K
+static const int s_resolutions[][2] = {
+    {256, 256}, {512, 512}, {1024, 1024}, {1080, 1920}, {2160, 3840}};
+static const size_t s_grain = 1024;  // balls per update job, as Simulation
+
+// fixed scenes for the golden images, whatever -seed and -gen say
+static const struct {
+    SceneGenerator::Distribution distribution;
+    size_t count;
+} s_goldenScenes[] = {{SceneGenerator::Uniform, 100},
+                      {SceneGenerator::Clustered, 1000},
+                      {SceneGenerator::PowerLaw, 300}};
+static const int s_goldenSize = 256;
+static const uint64_t s_goldenSeed = 1;
+static const int s_goldenSkipped = 77;  // ctest's SKIP_RETURN_CODE for golden
+static const size_t s_capacityStart = 16;  // balls the search starts from
+
+static bool parseCMD(int argc, char* argv[], benchParams& params);
+
+/// Generates the balls every case with this count and field size uses
+static SceneGenerator::Settings scene(const benchParams& params, size_t count,
+                                      int width, int height) {
+    SceneGenerator::Settings settings = SceneGenerator::defaults();
+    settings.distribution = params.distribution;
+    settings.count = count;
+    settings.seed = (uint64_t)params.seed;
+    settings.width = (float)width;
+    settings.height = (float)height;
+    return settings;
+}
+
+/** Returns the work a field kernel does for a frame, in ball-pixel pairs
+ *  Field tree kernels only visit about log(balls) nodes a pixel.
+ */
+static double fieldCost(const Shader::ProgramEntry& entry, size_t balls,
+                        int width, int height) {
+    double perPixel = entry.fieldTree ? std::log2((double)balls + 1) + 1
+                                      : (double)balls;
+    return perPixel * width * height;
+}
+
+/// Times the simulation's updates, at 1080p
+static void benchUpdates(Benchmark& bench, const benchParams& params) {
+    const int width = 1920, height = 1080;
+    for (size_t count : s_ballCounts) {
+        if (count > (size_t)params.max_balls) {
+            continue;
+        }
+        BallSystem balls;
+        SceneGenerator::generate(scene(params, count, width, height), balls);
+        Benchmark::Params caseParams = {{"balls", (double)count}};
+        auto parallel = [&](auto update) {
+            JobSystem::parallelFor(0, balls.count(), s_grain, update);
+        };
+
+        bench.run("update/straight", caseParams, count, [&]() {
+            parallel([&](size_t first, size_t last) {
+                balls.updateStraightPath(first, last, width, height);
+            });
+        });
+        uint64_t frame = 0;
+        bench.run("update/random", caseParams, count, [&]() {
+            parallel([&](size_t first, size_t last) {
+                balls.updateRandomPath(first, last, 2.0f, width, height,
+                                       params.seed, frame);
+            });
+            frame++;
+        });
+        const char* methods[] = {"explicit_euler", "semi_implicit_euler",
+                                 "verlet", "rk4"};
+        IntegratorMethod methodIds[] = {ExplicitEuler, SemiImplicitEuler,
+                                        VelocityVerlet, RungeKutta4};
+        for (int m = 0; m < 4; m++) {
+            bench.run(std::string("update/integrate/") + methods[m],
+                      caseParams, count, [&]() {
+                          parallel([&](size_t first, size_t last) {
+                              balls.integrate(first, last, methodIds[m], 0.0f,
+                                              nullptr, nullptr, 1.0f, 1,
+                                              width, height);
+                          });
+                      });
+        }
+
+        BarnesHut barnesHut;
+        AlignedVector<float> accX(count), accY(count);
+        bench.run("update/gravity", caseParams, count, [&]() {
+            barnesHut.build(balls);
+            barnesHut.accelerations(balls, 0.7f, 0.01f, accX.data(),
+                                    accY.data());
+        });
+        CollisionGrid grid;
+        bench.run("update/collisions", caseParams, count,
+                  [&]() { grid.resolve(balls, width, height); });
+    }
+}
+
+/// Times every CPU kernel at every size, without a GL context
+static void benchCPUKernels(Benchmark& bench, const benchParams& params,
+                            Shader::Manifest& shaders) {
+    CPURenderer renderer;
+    for (auto& resolution : s_resolutions) {
+        int height = resolution[0], width = resolution[1];
+        renderer.resize(width, height);
+        for (size_t count : s_ballCounts) {
+            if (count > (size_t)params.max_balls) {
+                continue;
+            }
+            BallSystem balls;
+            SceneGenerator::generate(scene(params, count, width, height),
+                                     balls);
+            Benchmark::Params caseParams = {{"balls", (double)count},
+                                            {"width", (double)width},
+                                            {"height", (double)height}};
+            for (size_t i = 0; i < shaders.size(); i++) {
+                const Shader::ProgramEntry& entry = shaders[i];
+                std::string name = "field/cpu/" + entry.id;
+                if (!shaders.supports(i, "cpu")) {
+                    continue;
+                }
+                if (fieldCost(entry, count, width, height) > params.budget) {
+                    bench.skip(name, caseParams, "over -budget");
+                    continue;
+                }
+                bench.run(name, caseParams, (double)width * height,
+                          [&]() { renderer.render(entry, balls); });
+            }
+        }
+    }
+}
+
+/// Times the compute shaders, the SSBO uploads and the readback paths
+static void benchGPU(Benchmark& bench, const benchParams& params) {
+    Window::setHeadless(params.headless != 0);
+    Graphics graphics(s_resolutions[0][0], s_resolutions[0][1],
+                      (uint64_t)params.seed);
+    graphics.setMenuVisible(false);
+    bench.setContext("gl_renderer",
+                     (const char*)glGetString(GL_RENDERER));
+    bench.setContext("gl_version", (const char*)glGetString(GL_VERSION));
+    auto resize = [&](int height, int width) {
+        graphics.Window()->resize(height, width);
+        graphics.updateDimensions();
+    };
+
+    for (auto& resolution : s_resolutions) {
+        int height = resolution[0], width = resolution[1];
+        resize(height, width);
+        for (size_t count : s_ballCounts) {
+            if (count > (size_t)params.max_balls) {
+                continue;
+            }
+            graphics.generateScene(scene(params, count, width, height));
+            Benchmark::Params caseParams = {{"balls", (double)count},
+                                            {"width", (double)width},
+                                            {"height", (double)height}};
+            for (size_t i = 0; i < graphics.shaderCount(); i++) {
+                const Shader::ProgramEntry& entry = graphics.shaderEntry(i);
+                std::string name = "field/gpu/" + entry.id;
+                if (!bench.selected(name) || !graphics.useShader(i, false)) {
+                    continue;
+                }
+                if (fieldCost(entry, count, width, height) > params.budget) {
+                    bench.skip(name, caseParams, "over -budget");
+                    continue;
+                }
+                bench.run(name, caseParams, (double)width * height,
+                          [&]() { graphics.render(); });
+            }
+        }
+    }
+
+    // uploads, mapped for each frame or kept mapped
+    bool persistent = graphics.setPersistentSSBO(true);
+    for (size_t count : s_ballCounts) {
+        if (count > (size_t)params.max_balls) {
+            continue;
+        }
+        graphics.generateScene(scene(params, count, 1920, 1080));
+        Benchmark::Params caseParams = {{"balls", (double)count}};
+        for (int mapped = 0; mapped < 2; mapped++) {
+            std::string name = mapped ? "upload/persistent" : "upload/map";
+            if (!graphics.setPersistentSSBO(mapped != 0)) {
+                bench.skip(name, caseParams, "no buffer storage");
+                continue;
+            }
+            // the snapshot is published once, only the copy is timed
+            graphics.step(0);
+            bench.run(name, caseParams, count, [&]() {
+                graphics.uploadBalls();
+                glFinish();
+            });
+        }
+    }
+    graphics.setPersistentSSBO(persistent);
+
+    // readbacks of the cheapest frame there is
+    for (size_t i = 0; i < graphics.shaderCount(); i++) {
+        if (graphics.shaderEntry(i).id == "circles") {
+            graphics.useShader(i, false);
+        }
+    }
+    for (auto& resolution : s_resolutions) {
+        int height = resolution[0], width = resolution[1];
+        resize(height, width);
+        graphics.generateScene(scene(params, 10, width, height));
+        Benchmark::Params caseParams = {{"width", (double)width},
+                                        {"height", (double)height}};
+        double pixels = (double)width * height;
+        bench.run("readback/none", caseParams, pixels,
+                  [&]() { graphics.render(); });
+        std::vector<uint8_t> image((size_t)width * height * 4);
+        bench.run("readback/sync", caseParams, pixels,
+                  [&]() { graphics.renderImage(image.data()); });
+        // frames in flight while the next ones render, as -render does
+        PixelReadback readback;
+        bench.run("readback/pbo", caseParams, pixels, [&]() {
+            if (readback.full()) {
+                readback.map();
+                readback.release();
+            }
+            graphics.renderImage(readback);
+        });
+        while (!readback.empty()) {
+            readback.map();
+            readback.release();
+        }
+    }
+}
+
+/** Checks that this machine can make an OpenGL context at all, so golden
+ *  runs without a GPU or EGL are reported as skipped rather than failed
+ *
+ *  @return Whether a context was made
+ */
+static bool haveContext(const benchParams& params) {
+    Window::setHeadless(params.headless != 0);
+    try {
+        Window probe("Metaballs", s_goldenSize, s_goldenSize,
+                     SDL_WINDOW_HIDDEN);
+    } catch (std::exception& e) {
+        std::cout << "SKIP  no OpenGL context: " << e.what() << std::endl;
+        return false;
+    }
+    return true;
+}
+
+/** Renders every shader on every backend and compares each frame to the
+ *  golden image of its shader and scene, timing the renders as it goes
+ *
+ *  Backends share a golden image, so they are held to each other as well
+ *  as to the reference. Blessing writes each image from the first backend
+ *  to render it, the GPU, and still compares the rest against it.
+ *
+ *  @return The number of frames that failed
+ */
+static int runGolden(Benchmark& bench, const benchParams& params) {
+    Window::setHeadless(params.headless != 0);
+    Graphics graphics(s_goldenSize, s_goldenSize, s_goldenSeed);
+    graphics.setMenuVisible(false);
+    bench.setContext("gl_renderer", (const char*)glGetString(GL_RENDERER));
+    bench.setContext("gl_version", (const char*)glGetString(GL_VERSION));
+    std::error_code error;
+    std::filesystem::create_directories(params.golden, error);
+
+    int width = graphics.imageWidth(), height = graphics.imageHeight();
+    std::vector<uint8_t> frame((size_t)width * height * 4), reference,
+        difference;
+    int failures = 0;
+    auto fail = [&](const std::string& image, const char* reason) {
+        std::cout << "FAIL  " << image << ": " << reason << std::endl;
+        failures++;
+    };
+    for (auto& goldenScene : s_goldenScenes) {
+        SceneGenerator::Settings settings = SceneGenerator::defaults();
+        settings.distribution = goldenScene.distribution;
+        settings.count = goldenScene.count;
+        settings.seed = s_goldenSeed;
+        graphics.generateScene(settings);
+        std::string sceneName = SceneGenerator::name(settings.distribution);
+        Benchmark::Params caseParams = {{"balls", (double)settings.count},
+                                        {"width", (double)width},
+                                        {"height", (double)height}};
+
+        for (size_t i = 0; i < graphics.shaderCount(); i++) {
+            const Shader::ProgramEntry& entry = graphics.shaderEntry(i);
+            std::string golden = sceneName + "_" + entry.id;
+            std::string path = params.golden + "/" + golden + ".ppm";
+            bool blessed = false;
+            for (int cpu = 0; cpu < 2; cpu++) {
+                const char* backend = cpu ? "cpu" : GRAPHICS_BACKEND;
+                std::string name = std::string("golden/") + backend + "/" +
+                                   sceneName + "/" + entry.id;
+                std::string image = golden + "_" + backend;
+                if (!bench.selected(name) || !graphics.useShader(i, cpu)) {
+                    continue;
+                }
+                bench.run(name, caseParams, (double)width * height,
+                          [&]() { graphics.renderImage(frame.data()); });
+
+                if (params.bless && !blessed) {
+                    GoldenImage::writePPM(path, frame.data(), width, height);
+                    std::cout << "BLESS " << image << std::endl;
+                    blessed = true;
+                    continue;
+                }
+                int goldenWidth, goldenHeight;
+                try {
+                    if (!GoldenImage::readPPM(path, reference, goldenWidth,
+                                              goldenHeight)) {
+                        fail(image, "no golden image, run with -bless 1");
+                        continue;
+                    }
+                } catch (std::exception& e) {
+                    fail(image, e.what());
+                    continue;
+                }
+                if (goldenWidth != width || goldenHeight != height) {
+                    fail(image, "golden image is a different size");
+                    continue;
+                }
+
+                GoldenImage::Comparison comparison =
+                    GoldenImage::compare(frame.data(), reference.data(),
+                                         width, height, entry.maxError);
+                size_t maxOutliers =
+                    (size_t)(entry.maxOutliers * width * height);
+                bool passed = comparison.outliers <= maxOutliers &&
+                              comparison.psnr >= entry.minPSNR;
+                char line[192];
+                snprintf(line, sizeof(line),
+                         "%-6s%-32s max error %3d  %zu/%zu pixels past %d  "
+                         "PSNR %6.1f/%.0f dB  %zu pixels differ",
+                         passed ? "ok" : "FAIL", image.c_str(),
+                         comparison.maxError, comparison.outliers,
+                         maxOutliers, entry.maxError, comparison.psnr,
+                         entry.minPSNR, comparison.differing);
+                std::cout << line << std::endl;
+                if (passed) {
+                    continue;
+                }
+                failures++;
+                std::filesystem::create_directories(params.diffs, error);
+                std::string prefix = params.diffs + "/" + image;
+                GoldenImage::diff(frame.data(), reference.data(), width,
+                                  height, difference);
+                GoldenImage::writePPM(prefix + "_diff.ppm", difference.data(),
+                                      width, height);
+                GoldenImage::writePPM(prefix + "_actual.ppm", frame.data(),
+                                      width, height);
+            }
+        }
+    }
+    return failures;
+}
+
+/** Times frames of the current scene, each a simulation tick, the upload
+ *  and the render
+ *  @return The frame time at the -percentile, in milliseconds
+ */
+static double frameTime(Graphics& graphics, const benchParams& params) {
+    typedef std::chrono::steady_clock clock;
+    std::vector<double> times(std::max(params.frames, 1));
+    graphics.step(1);
+    graphics.render();
+    for (double& time : times) {
+        clock::time_point start = clock::now();
+        graphics.step(1);
+        graphics.render();
+        time = std::chrono::duration<double, std::milli>(clock::now() - start)
+                   .count();
+    }
+    std::sort(times.begin(), times.end());
+    size_t rank = (size_t)std::ceil(params.percentile / 100 * times.size());
+    return times[std::min(std::max<size_t>(rank, 1), times.size()) - 1];
+}
+
+/** Searches for the most balls a shader renders within the frame budget
+ *  The count doubles until a frame goes over budget, then a binary search
+ *  narrows it down to within 2%.
+ */
+static Capacity findCapacity(Graphics& graphics, const benchParams& params,
+                             int width, int height) {
+    size_t maxBalls = (size_t)std::max(params.max_balls, 1);
+    auto measure = [&](size_t count) {
+        graphics.generateScene(scene(params, count, width, height));
+        return frameTime(graphics, params);
+    };
+    Capacity capacity;
+    capacity.width = width;
+    capacity.height = height;
+    capacity.balls = 0;
+    capacity.frameTime = 0;
+    size_t over = 0;  // fewest balls seen over budget, 0 if none yet
+    for (size_t count = std::min(s_capacityStart, maxBalls);;
+         count = std::min(count * 2, maxBalls)) {
+        double time = measure(count);
+        if (time > params.capacity) {
+            over = count;
+            break;
+        }
+        capacity.balls = count;
+        capacity.frameTime = time;
+        if (count == maxBalls) {
+            break;
+        }
+    }
+    capacity.capped = over == 0;
+    // down to 2% of the count, or a single ball
+    while (over && over - capacity.balls > capacity.balls / 50 + 1) {
+        size_t count = capacity.balls + (over - capacity.balls) / 2;
+        double time = measure(count);
+        if (time > params.capacity) {
+            over = count;
+        } else {
+            capacity.balls = count;
+            capacity.frameTime = time;
+        }
+    }
+    return capacity;
+}
+
+/// Writes the capacities found as JSON, with what they were measured on
+static void writeCapacities(std::ostream& out, const benchParams& params,
+                            const std::vector<Capacity>& capacities,
+                            const std::string& renderer) {
+    char date[32];
+    time_t now = time(nullptr);
+    strftime(date, sizeof(date), "%Y-%m-%dT%H:%M:%SZ", gmtime(&now));
+    out << "{\n  \"context\": {\"commit\": \"" << METABALLS_COMMIT
+        << "\", \"date\": \"" << date << "\", \"gl_renderer\": \""
+        << renderer << "\", \"threads\": " << JobSystem::threadCount()
+        << ", \"scene\": \"" << SceneGenerator::name(params.distribution)
+        << "\"},\n  \"budget_ms\": " << params.capacity
+        << ",\n  \"percentile\": " << params.percentile
+        << ",\n  \"frames\": " << params.frames << ",\n  \"results\": [";
+    char line[256];
+    for (size_t i = 0; i < capacities.size(); i++) {
+        const Capacity& capacity = capacities[i];
+        snprintf(line, sizeof(line),
+                 "%s\n    {\"shader\": \"%s\", \"backend\": \"%s\", "
+                 "\"width\": %d, \"height\": %d, \"balls\": %zu, "
+                 "\"frame_ms\": %.4f, \"capped\": %s}",
+                 i ? "," : "", capacity.shader.c_str(), capacity.backend,
+                 capacity.width, capacity.height, capacity.balls,
+                 capacity.frameTime, capacity.capped ? "true" : "false");
+        out << line;
+    }
+    out << "\n  ]\n}\n";
+}
+
+/** Finds the most balls every shader renders on every backend and
+ *  resolution while the -percentile frame time stays within -capacity ms
+ *  @return False if the results couldn't be written
+ */
+static bool runCapacity(const benchParams& params) {
+    Window::setHeadless(params.headless != 0);
+    Graphics graphics(s_resolutions[0][0], s_resolutions[0][1],
+                      (uint64_t)params.seed);
+    graphics.setMenuVisible(false);
+    std::string renderer = (const char*)glGetString(GL_RENDERER);
+    std::vector<Capacity> capacities;
+    char line[160];
+    snprintf(line, sizeof(line), "%-28s%-8s%-12s%12s%12s", "shader",
+             "backend", "resolution", "balls",
+             ("p" + std::to_string((int)params.percentile) + " ms").c_str());
+    std::cout << line << std::endl;
+
+    for (auto& resolution : s_resolutions) {
+        int height = resolution[0], width = resolution[1];
+        graphics.Window()->resize(height, width);
+        graphics.updateDimensions();
+        for (size_t i = 0; i < graphics.shaderCount(); i++) {
+            const Shader::ProgramEntry& entry = graphics.shaderEntry(i);
+            for (int cpu = 0; cpu < 2; cpu++) {
+                const char* backend = cpu ? "cpu" : GRAPHICS_BACKEND;
+                std::string name =
+                    std::string("capacity/") + backend + "/" + entry.id;
+                if ((params.filter.size() != 0 &&
+                     name.find(params.filter) == std::string::npos) ||
+                    !graphics.useShader(i, cpu)) {
+                    continue;
+                }
+                Capacity capacity = findCapacity(graphics, params, width,
+                                                 height);
+                capacity.shader = entry.id;
+                capacity.backend = backend;
+                capacities.push_back(capacity);
+                std::string size =
+                    std::to_string(width) + "x" + std::to_string(height);
+                snprintf(line, sizeof(line), "%-28s%-8s%-12s%11zu%s%12.2f",
+                         entry.id.c_str(), backend, size.c_str(),
+                         capacity.balls, capacity.capped ? "+" : " ",
+                         capacity.frameTime);
+                std::cout << line << std::endl;
+            }
+        }
+    }
+
+    std::ofstream json(params.json);
+    writeCapacities(json, params, capacities, renderer);
+    if (!json) {
+        std::cout << "Unable to write " << params.json << std::endl;
+        return false;
+    }
+    std::cout << capacities.size() << " capacities written to " << params.json
+              << ", + marks counts capped by -maxballs" << std::endl;
+    return true;
+}
+
+/// Runs every benchmark, returns false if the shaders couldn't be loaded
+static bool runBenchmarks(Benchmark& bench, const benchParams& params) {
+    benchUpdates(bench, params);
+    {
+        Shader::Manifest shaders;
+        try {
+            shaders.load("shaders/shaders.manifest");
+        } catch (std::exception& e) {
+            std::cout << e.what() << std::endl;
+            return false;
+        }
+        benchCPUKernels(bench, params, shaders);
+    }
+    if (params.gpu) {
+        benchGPU(bench, params);
+    }
+    return true;
+}
+
+int main(int argc, char* argv[]) {
+    benchParams params;
+    params.warmup = 2;
+    params.repetitions = 10;
+    params.sample_time = 0.005;
+    params.json = "metaballs_bench.json";
+    params.budget = 1e9;
+    params.max_balls = 1000000;
+    params.threads = 0;
+    params.gpu = 1;
+    params.headless = 1;
+    params.seed = 0;
+    params.distribution = SceneGenerator::Uniform;
+    params.bless = 0;
+    params.diffs = "golden_diffs";
+    params.capacity = 0;
+    params.percentile = 95;
+    params.frames = 30;
+    params.counters = 1;
+    if (!parseCMD(argc, argv, params)) {
+        return -1;
+    }
+    // before the workers start, so they inherit the counters
+    if (params.counters) {
+        PerfCounters::start();
+        std::cout << "CPU counters: " << PerfCounters::status() << std::endl;
+    }
+    JobSystem::init(params.threads > 0 ? params.threads : 0);
+    if (params.capacity > 0) {
+        bool written = runCapacity(params);
+        JobSystem::shutdown();
+        return written ? 0 : -1;
+    }
+
+    Benchmark bench(params.warmup, params.repetitions, params.sample_time);
+    bench.setFilter(params.filter);
+    char date[32];
+    time_t now = time(nullptr);
+    strftime(date, sizeof(date), "%Y-%m-%dT%H:%M:%SZ", gmtime(&now));
+    bench.setContext("commit", METABALLS_COMMIT);
+    bench.setContext("date", date);
+    bench.setContext("threads", std::to_string(JobSystem::threadCount()));
+    bench.setContext("simd_width", std::to_string(SIMD::width));
+    bench.setContext("scene", params.golden.size() != 0
+                                  ? "golden"
+                                  : SceneGenerator::name(params.distribution));
+
+    int failures = 0;
+    if (params.golden.size() != 0) {
+        if (!haveContext(params)) {
+            JobSystem::shutdown();
+            return s_goldenSkipped;
+        }
+        try {
+            failures = runGolden(bench, params);
+        } catch (std::exception& e) {
+            std::cout << e.what() << std::endl;
+            return -1;
+        }
+        if (failures) {
+            std::cout << failures << " frames differ from their golden "
+                      << "images, see " << params.diffs << std::endl;
+        }
+    } else if (!runBenchmarks(bench, params)) {
+        return -1;
+    }
+
+    std::ofstream json(params.json);
+    bench.writeJSON(json);
+    if (!json) {
+        std::cout << "Unable to write " << params.json << std::endl;
+        return -1;
+    }
+    std::cout << bench.results().size() << " results written to "
+              << params.json << std::endl;
+    JobSystem::shutdown();
+    return failures ? 1 : 0;
+}
+
+static bool parseCMD(int argc, char* argv[], benchParams& params) {
+    std::string distribution;
+    CMDParser parser;
+    parser.bindVar<int>("-warmup", params.warmup, 1,
+                        "Untimed calls before each case");
+    parser.bindVar<int>("-reps", params.repetitions, 1,
+                        "Timed samples of each case");
+    parser.bindVar<double>("-sample", params.sample_time, 1,
+                           "Seconds each sample runs for at least");
+    parser.bindVar<std::string>("-filter", params.filter, 1,
+                                "Only run cases whose name contains this");
+    parser.bindVar<std::string>("-json", params.json, 1,
+                                "File the results are written to");
+    parser.bindVar<double>("-budget", params.budget, 1,
+                           "Skip field kernels shading more ball-pixel "
+                           "pairs than this a frame");
+    parser.bindVar<int>("-maxballs", params.max_balls, 1,
+                        "Largest ball count to run");
+    parser.bindVar<int>("-threads", params.threads, 1,
+                        "Number of worker threads, 0 uses every core");
+    parser.bindVar<int>("-gpu", params.gpu, 1,
+                        "0 to skip the cases that need OpenGL");
+    parser.bindVar<int>("-headless", params.headless, 1,
+                        "0 to open a window for the OpenGL cases");
+    parser.bindVar<int>("-seed", params.seed, 1, "Seed for the scenes");
+    parser.bindVar<std::string>(
+        "-gen", distribution, 1,
+        "Scene to run on: uniform, clustered, powerlaw, grid or ring");
+    parser.bindVar<std::string>("-golden", params.golden, 1,
+                                "Compare every shader and backend against "
+                                "the golden images in this directory");
+    parser.bindVar<int>("-bless", params.bless, 1,
+                        "1 to write the golden images instead");
+    parser.bindVar<std::string>("-diffs", params.diffs, 1,
+                                "Where -golden writes the frames that fail");
+    parser.bindVar<int>("-counters", params.counters, 1,
+                        "0 to skip reading the CPU's hardware counters");
+    parser.bindVar<double>("-capacity", params.capacity, 1,
+                           "Find the most balls each shader renders within "
+                           "this many ms a frame instead");
+    parser.bindVar<double>("-percentile", params.percentile, 1,
+                           "Frame time percentile -capacity holds to");
+    parser.bindVar<int>("-frames", params.frames, 1,
+                        "Frames -capacity times for each ball count");
+    if (!parser.parse(argc, argv)) {
+        return false;
+    }
+    if (distribution.size() != 0 &&
+        !SceneGenerator::parseDistribution(distribution,
+                                           params.distribution)) {
+        std::cout << "Unknown scene generator " << distribution << std::endl;
+        parser.printHelp();
+        return false;
+    }
+    if (params.golden.size() != 0 && params.capacity > 0) {
+        std::cout << "-golden and -capacity can't be run together"
+                  << std::endl;
+        return false;
+    }
+    return true;
+}